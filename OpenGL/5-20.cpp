@@ -1,6 +1,8 @@
 #include "OpenGL.h"
+#include "scene.h"
 
-#ifdef EX5_20
+namespace
+{
 
 GLuint program;
 GLuint buffer;
@@ -105,4 +107,11 @@ void onShutdown()
 	glDeleteBuffers(1, &buffer);
 }
 
-#endif
+const Scene ex5_20_scene =
+{
+	"EX5_20", "Atomic counter area count (OpenGL SuperBible listing 5.20)",
+	getWindowWidth(), getWindowHeight(), onAwake, onUpdate, onShutdown, NULL, NULL, NULL
+};
+const bool ex5_20_registered = registerScene(ex5_20_scene);
+
+} // namespace
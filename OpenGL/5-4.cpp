@@ -1,15 +1,135 @@
 #include "OpenGL.h"
 
-#ifdef EX5_4
-
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
 #include <vmath.h>
 
+#include "camera.h"
+#include "frame_arena.h"
+#include "gl_state.h"
+#include "jobs.h"
+#include "render_thread.h"
+#include "scene.h"
+#include "uniform_ring.h"
+
+namespace
+{
+
 GLuint program;
 GLuint vao;
 GLuint position_buffer;
 GLuint index_buffer;
 GLint mv_location;
-GLint proj_location;
+bool many_cubes;	// cube_count cubes, one draw call each, instead of one
+int cube_count;
+bool instanced;		// All cubes in one draw, their matrices in a buffer texture
+bool streamed;		// A draw per cube, their matrices in a persistently mapped uniform ring
+bool attributed;	// All cubes in one draw, their offsets a per-instance vertex attribute
+
+// MANY_CUBES_1M's
+GLuint instanced_program;
+GLuint matrix_buffer;
+GLuint matrix_texture;
+
+// The MANY_CUBES_RING scenes'. The ring holds the frame's matrices in
+// blocks of OBJECTS_PER_BLOCK, bound one block at a time as the Objects
+// uniform block; a per-instance attribute counting 0, 1, 2... picks the
+// cube's matrix in its block through the draw's base instance.
+const int OBJECTS_PER_BLOCK = 256;		// The shader's array: 16 KiB, the least GL_MAX_UNIFORM_BLOCK_SIZE there is
+const GLuint OBJECTS_BINDING = 1;		// The shader's, next to the camera's
+GLuint ring_program;
+GLuint object_index_buffer;
+UniformRing matrix_ring;
+
+// MANY_CUBES_INSTANCED's. The cubes share their rotation, so all a cube
+// needs of its own is where it is: 12 bytes an instance instead of a matrix.
+GLuint attributed_program;
+GLint spin_location;
+GLuint offset_buffer;
+
+// Cubes per job of the simulation and matrix passes.
+const size_t CUBES_PER_JOB = 2048;
+
+// Time spent in the passes, for the scaling report at shutdown.
+double step_seconds;
+double matrix_seconds;
+unsigned int timed_steps;
+unsigned int timed_frames;
+
+// What a simulation step produces. The two latest are kept, and each frame
+// draws in between them.
+struct State
+{
+	float spin_y;		// Degrees
+	float spin_x;
+	std::vector<vmath::vec3> offsets;
+};
+
+State states[2];
+int current;
+int previous;
+double simulated_time;
+
+vmath::vec3 blend(const vmath::vec3 &from, const vmath::vec3 &to, float alpha)
+{
+	return from + (to - from) * alpha;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Job: offsets of the cubes [begin, end) at the simulated time.
+void stepCubes(void *data, size_t begin, size_t end)
+{
+	const float t = (float)simulated_time;
+	State &state = *(State *)data;
+	for (size_t i = begin; i < end; i++)
+	{
+		float f = (float)i + t * 0.3f;
+		state.offsets[i] = vmath::vec3(sinf(2.1f * f) * 2.0f,
+			cosf(1.7f * f) * 2.0f,
+			sinf(1.3f * f) * cosf(1.5f * f) * 2.0f);
+	}
+}
+
+struct MatrixPass
+{
+	vmath::mat4 spin;		// Shared by all cubes: camera distance and rotation
+	const State *from;
+	const State *to;
+	float alpha;
+	vmath::mat4 *out;
+};
+
+// Job: model-view matrices of the cubes [begin, end).
+void computeMatrices(void *data, size_t begin, size_t end)
+{
+	const MatrixPass &pass = *(const MatrixPass *)data;
+	for (size_t i = begin; i < end; i++)
+		pass.out[i] = pass.spin * vmath::translate(blend(pass.from->offsets[i], pass.to->offsets[i], pass.alpha));
+}
+
+struct OffsetPass
+{
+	const State *from;
+	const State *to;
+	float alpha;
+	vmath::vec3 *out;
+};
+
+// Job: offsets of the cubes [begin, end) at the frame's point between steps.
+void blendOffsets(void *data, size_t begin, size_t end)
+{
+	const OffsetPass &pass = *(const OffsetPass *)data;
+	for (size_t i = begin; i < end; i++)
+		pass.out[i] = blend(pass.from->offsets[i], pass.to->offsets[i], pass.alpha);
+}
+
+void onStep(double step);
 
 int getWindowWidth()
 {
@@ -23,9 +143,25 @@ int getWindowHeight()
 
 void onAwake()
 {
+	many_cubes = false;
+	instanced = false;
+	streamed = false;
+	attributed = false;
+	cube_count = 1;
+	step_seconds = 0.0;
+	matrix_seconds = 0.0;
+	timed_steps = 0;
+	timed_frames = 0;
+	states[0].offsets.resize(1);
+	states[1].offsets.resize(1);
+	simulated_time = 0.0;
+	current = 0;
+	previous = 0;
+
 	static const char * vs_source[] =
 	{
-		"#version 420 core                                                  \n"
+		"#version 420 core                                                  \n",
+		CAMERA_GLSL,
 		"                                                                   \n"
 		"in vec4 position;                                                  \n"
 		"                                                                   \n"
@@ -35,7 +171,6 @@ void onAwake()
 		"} vs_out;                                                          \n"
 		"                                                                   \n"
 		"uniform mat4 mv_matrix;                                            \n"
-		"uniform mat4 proj_matrix;                                          \n"
 		"                                                                   \n"
 		"void main(void)                                                    \n"
 		"{                                                                  \n"
@@ -67,7 +202,7 @@ void onAwake()
 	glCompileShader(fs);
 
 	GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vs, 1, vs_source, NULL);
+	glShaderSource(vs, 3, vs_source, NULL);
 	glCompileShader(vs);
 
 	glAttachShader(program, vs);
@@ -76,7 +211,6 @@ void onAwake()
 	glLinkProgram(program);
 
 	mv_location = glGetUniformLocation(program, "mv_matrix");
-	proj_location = glGetUniformLocation(program, "proj_matrix");
 
 	glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
@@ -130,56 +264,657 @@ void onAwake()
 
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
+
+	// Both states at time 0, so the first frame has something to blend.
+	onStep(0.0);
+	onStep(0.0);
+}
+
+// Advances the cube transforms by one fixed simulation step; onRender only
+// blends the last two results.
+void onStep(double step)
+{
+	simulated_time += step;
+	previous = current;
+	current = 1 - current;
+
+	const float t = (float)simulated_time;
+	State &state = states[current];
+	if (many_cubes)
+	{
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		state.spin_y = t * 45.0f;
+		state.spin_x = t * 21.0f;
+		parallelFor(0, cube_count, CUBES_PER_JOB, stepCubes, &state);
+		step_seconds += secondsSince(start);
+		timed_steps++;
+	}
+	else
+	{
+		float f = t * 0.3f;
+		state.spin_y = t * 45.0f;
+		state.spin_x = t * 81.0f;
+		state.offsets[0] = vmath::vec3(sinf(2.1f * f) * 0.5f,
+			cosf(1.7f * f) * 0.5f,
+			sinf(1.3f * f) * cosf(1.5f * f) * 2.0f);
+	}
 }
 
-void onUpdate(double current_time)
+void onRecord(double alpha, CommandRecorder &commands)
 {
 	int i;
 	static const GLfloat green[] = { 0.0f, 0.25f, 0.0f, 1.0f };
 	static const GLfloat one = 1.0f;
 
-	glViewport(0, 0, getWindowWidth(), getWindowHeight());
+	commands.clearColor(green);
+	commands.clearDepth(one);
+
+	commands.useProgram(program);
+	commands.bindVertexArray(vao);
+
+	const State &from = states[previous];
+	const State &to = states[current];
+	const float a = (float)alpha;
+	const float spin_y = from.spin_y + (to.spin_y - from.spin_y) * a;
+	const float spin_x = from.spin_x + (to.spin_x - from.spin_x) * a;
+
+	if (many_cubes)
+	{
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		MatrixPass pass;
+		pass.spin = vmath::translate(0.0f, 0.0f, -20.0f) *
+			vmath::rotate(spin_y, 0.0f, 1.0f, 0.0f) *
+			vmath::rotate(spin_x, 1.0f, 0.0f, 0.0f);
+		pass.from = &from;
+		pass.to = &to;
+		pass.alpha = a;
+		// Only read while recording, so the frame's arena outlives them.
+		vmath::mat4 *matrices = frameArena().allocateArray<vmath::mat4>(cube_count);
+		pass.out = matrices;
+		parallelFor(0, cube_count, CUBES_PER_JOB, computeMatrices, &pass);
+		matrix_seconds += secondsSince(start);
+		timed_frames++;
+
+		for (i = 0; i < cube_count; i++)
+		{
+			commands.uniformMatrix4(mv_location, matrices[i]);
+			commands.drawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0);
+		}
+	}
+	else
+	{
+		vmath::mat4 mv_matrix = vmath::translate(0.0f, 0.0f, -4.0f) *
+			vmath::translate(blend(from.offsets[0], to.offsets[0], a)) *
+			vmath::rotate(spin_y, 0.0f, 1.0f, 0.0f) *
+			vmath::rotate(spin_x, 1.0f, 0.0f, 0.0f);
+		commands.uniformMatrix4(mv_location, mv_matrix);
+		commands.drawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0);
+	}
+}
+
+void onRender(double alpha)
+{
+	CommandRecorder commands;
+	onRecord(alpha, commands);
+}
+
+// Computes the matrices straight into the buffer texture the instanced
+// vertex shader reads them from, then draws every cube in one call.
+void onRenderInstanced(double alpha)
+{
+	static const GLfloat green[] = { 0.0f, 0.25f, 0.0f, 1.0f };
+	static const GLfloat one = 1.0f;
+
 	glClearBufferfv(GL_COLOR, 0, green);
 	glClearBufferfv(GL_DEPTH, 0, &one);
 
-	glUseProgram(program);
-
-	vmath::mat4 proj_matrix = vmath::perspective(50.0f,
-		(float)getWindowWidth() / (float)getWindowHeight(),
-		0.1f,
-		1000.0f);
-	glUniformMatrix4fv(proj_location, 1, GL_FALSE, proj_matrix);
-
-#ifdef MANY_CUBES
-	for (i = 0; i < 24; i++)
-	{
-		float f = (float)i + (float)current_time * 0.3f;
-		vmath::mat4 mv_matrix = vmath::translate(0.0f, 0.0f, -20.0f) *
-			vmath::rotate((float)current_time * 45.0f, 0.0f, 1.0f, 0.0f) *
-			vmath::rotate((float)current_time * 21.0f, 1.0f, 0.0f, 0.0f) *
-			vmath::translate(sinf(2.1f * f) * 2.0f,
-				cosf(1.7f * f) * 2.0f,
-				sinf(1.3f * f) * cosf(1.5f * f) * 2.0f);
-		glUniformMatrix4fv(mv_location, 1, GL_FALSE, mv_matrix);
-		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0);
+	cachedUseProgram(instanced_program);
+	cachedBindVertexArray(vao);
+
+	const State &from = states[previous];
+	const State &to = states[current];
+	const float a = (float)alpha;
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	MatrixPass pass;
+	pass.spin = vmath::translate(0.0f, 0.0f, -20.0f) *
+		vmath::rotate(from.spin_y + (to.spin_y - from.spin_y) * a, 0.0f, 1.0f, 0.0f) *
+		vmath::rotate(from.spin_x + (to.spin_x - from.spin_x) * a, 1.0f, 0.0f, 0.0f);
+	pass.from = &from;
+	pass.to = &to;
+	pass.alpha = a;
+
+	// Invalidated, so the driver hands out fresh memory instead of waiting
+	// for the previous frame's draw to finish reading.
+	cachedBindBuffer(GL_TEXTURE_BUFFER, matrix_buffer);
+	pass.out = (vmath::mat4 *)glMapBufferRange(GL_TEXTURE_BUFFER, 0, cube_count * sizeof(vmath::mat4),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (pass.out)
+	{
+		parallelFor(0, cube_count, CUBES_PER_JOB, computeMatrices, &pass);
+		glUnmapBuffer(GL_TEXTURE_BUFFER);
 	}
-#else
-	float f = (float)current_time * 0.3f;
-	vmath::mat4 mv_matrix = vmath::translate(0.0f, 0.0f, -4.0f) *
-		vmath::translate(sinf(2.1f * f) * 0.5f,
-			cosf(1.7f * f) * 0.5f,
-			sinf(1.3f * f) * cosf(1.5f * f) * 2.0f) *
-		vmath::rotate((float)current_time * 45.0f, 0.0f, 1.0f, 0.0f) *
-		vmath::rotate((float)current_time * 81.0f, 1.0f, 0.0f, 0.0f);
-	glUniformMatrix4fv(mv_location, 1, GL_FALSE, mv_matrix);
-	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0);
-#endif
+	matrix_seconds += secondsSince(start);
+	timed_frames++;
+
+	cachedBindTexture(0, GL_TEXTURE_BUFFER, matrix_texture);
+	glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0, cube_count);
+}
+
+// Computes the matrices straight into the frame's region of the ring, then
+// draws a cube per call as onRender does, with no uniform set in between:
+// one range bind per block of cubes selects their matrices.
+void onRenderStreamed(double alpha)
+{
+	static const GLfloat green[] = { 0.0f, 0.25f, 0.0f, 1.0f };
+	static const GLfloat one = 1.0f;
+
+	if (!matrix_ring.active())
+	{
+		onRender(alpha);
+		return;
+	}
+
+	glClearBufferfv(GL_COLOR, 0, green);
+	glClearBufferfv(GL_DEPTH, 0, &one);
+
+	cachedUseProgram(ring_program);
+	cachedBindVertexArray(vao);
+
+	const State &from = states[previous];
+	const State &to = states[current];
+	const float a = (float)alpha;
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	MatrixPass pass;
+	pass.spin = vmath::translate(0.0f, 0.0f, -20.0f) *
+		vmath::rotate(from.spin_y + (to.spin_y - from.spin_y) * a, 0.0f, 1.0f, 0.0f) *
+		vmath::rotate(from.spin_x + (to.spin_x - from.spin_x) * a, 1.0f, 0.0f, 0.0f);
+	pass.from = &from;
+	pass.to = &to;
+	pass.alpha = a;
+	pass.out = (vmath::mat4 *)matrix_ring.beginFrame();
+	parallelFor(0, cube_count, CUBES_PER_JOB, computeMatrices, &pass);
+	matrix_seconds += secondsSince(start);
+	timed_frames++;
+
+	const size_t block_bytes = OBJECTS_PER_BLOCK * sizeof(vmath::mat4);
+	for (int first = 0; first < cube_count; first += OBJECTS_PER_BLOCK)
+	{
+		glBindBufferRange(GL_UNIFORM_BUFFER, OBJECTS_BINDING, matrix_ring.buffer(),
+			matrix_ring.frameOffset() + first * sizeof(vmath::mat4), block_bytes);
+		const int last = std::min(first + OBJECTS_PER_BLOCK, cube_count);
+		for (int i = first; i < last; i++)
+			glDrawElementsInstancedBaseInstance(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0, 1, i - first);
+	}
+	matrix_ring.endFrame();
+}
+
+// Writes the cubes' offsets into the instance buffer and draws them all in
+// one call; the rotation they share is a single uniform.
+void onRenderAttributed(double alpha)
+{
+	static const GLfloat green[] = { 0.0f, 0.25f, 0.0f, 1.0f };
+	static const GLfloat one = 1.0f;
+
+	glClearBufferfv(GL_COLOR, 0, green);
+	glClearBufferfv(GL_DEPTH, 0, &one);
+
+	cachedUseProgram(attributed_program);
+	cachedBindVertexArray(vao);
+
+	const State &from = states[previous];
+	const State &to = states[current];
+	const float a = (float)alpha;
+	const vmath::mat4 spin = vmath::translate(0.0f, 0.0f, -20.0f) *
+		vmath::rotate(from.spin_y + (to.spin_y - from.spin_y) * a, 0.0f, 1.0f, 0.0f) *
+		vmath::rotate(from.spin_x + (to.spin_x - from.spin_x) * a, 1.0f, 0.0f, 0.0f);
+	cachedUniformMatrix4(spin_location, spin);
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	OffsetPass pass;
+	pass.from = &from;
+	pass.to = &to;
+	pass.alpha = a;
+	// Invalidated, as the buffer texture of MANY_CUBES_1M is.
+	cachedBindBuffer(GL_ARRAY_BUFFER, offset_buffer);
+	pass.out = (vmath::vec3 *)glMapBufferRange(GL_ARRAY_BUFFER, 0, cube_count * sizeof(vmath::vec3),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (pass.out)
+	{
+		parallelFor(0, cube_count, CUBES_PER_JOB, blendOffsets, &pass);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+	matrix_seconds += secondsSince(start);
+	timed_frames++;
+
+	glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0, cube_count);
+}
+
+void awakeCubes(int count, bool draw_instanced)
+{
+	onAwake();
+	many_cubes = true;
+	instanced = draw_instanced;
+	cube_count = count;
+	states[0].offsets.resize(count);
+	states[1].offsets.resize(count);
+	// The states onAwake stepped are those of the single cube.
+	onStep(0.0);
+	onStep(0.0);
+}
+
+void onAwakeManyCubes()
+{
+	awakeCubes(sceneCount(24), false);
+}
+
+// CPU bound: the simulation and the draw calls dominate, the GPU has next
+// to nothing to do.
+void onAwakeManyCubes4K()
+{
+	awakeCubes(4096, false);
+}
+
+// The counts the uniform ring is measured at, against the same counts
+// drawn with a glUniformMatrix4fv per cube.
+void onAwakeManyCubes1K()
+{
+	awakeCubes(1000, false);
+}
+
+void onAwakeManyCubes10K()
+{
+	awakeCubes(10000, false);
+}
+
+void onAwakeManyCubes100K()
+{
+	awakeCubes(100000, false);
+}
+
+void awakeStreamedCubes(int count)
+{
+	static const char * vs_source[] =
+	{
+		"#version 420 core                                                  \n",
+		CAMERA_GLSL,
+		"                                                                   \n"
+		"layout (location = 0) in vec4 position;                            \n"
+		"layout (location = 1) in float object;                             \n"
+		"                                                                   \n"
+		"out VS_OUT                                                         \n"
+		"{                                                                  \n"
+		"    vec4 color;                                                    \n"
+		"} vs_out;                                                          \n"
+		"                                                                   \n"
+		"layout (std140, binding = 1) uniform Objects                       \n"
+		"{                                                                  \n"
+		"    mat4 mv_matrices[256];                                         \n"
+		"};                                                                 \n"
+		"                                                                   \n"
+		"void main(void)                                                    \n"
+		"{                                                                  \n"
+		"    mat4 mv_matrix = mv_matrices[int(object)];                     \n"
+		"    gl_Position = proj_matrix * mv_matrix * position;              \n"
+		"    vs_out.color = position * 2.0 + vec4(0.5, 0.5, 0.5, 0.0);      \n"
+		"}                                                                  \n"
+	};
+
+	static const char * fs_source[] =
+	{
+		"#version 420 core                                                  \n"
+		"                                                                   \n"
+		"out vec4 color;                                                    \n"
+		"                                                                   \n"
+		"in VS_OUT                                                          \n"
+		"{                                                                  \n"
+		"    vec4 color;                                                    \n"
+		"} fs_in;                                                           \n"
+		"                                                                   \n"
+		"void main(void)                                                    \n"
+		"{                                                                  \n"
+		"    color = fs_in.color;                                           \n"
+		"}                                                                  \n"
+	};
+
+	awakeCubes(count, false);
+	streamed = true;
+
+	ring_program = glCreateProgram();
+	GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fs, 1, fs_source, NULL);
+	glCompileShader(fs);
+	CheckShaderCompileError(fs);
+
+	GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vs, 3, vs_source, NULL);
+	glCompileShader(vs);
+	CheckShaderCompileError(vs);
+
+	glAttachShader(ring_program, vs);
+	glAttachShader(ring_program, fs);
+	glLinkProgram(ring_program);
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+
+	// Attribute 1 steps once per instance, so base instance n reads n.
+	GLfloat object_indices[OBJECTS_PER_BLOCK];
+	for (int i = 0; i < OBJECTS_PER_BLOCK; i++)
+		object_indices[i] = (GLfloat)i;
+	glGenBuffers(1, &object_index_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, object_index_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(object_indices), object_indices, GL_STATIC_DRAW);
+	glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 0, NULL);
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(1);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Whole blocks, so the last one's range stays inside the frame's region.
+	const int blocks = (count + OBJECTS_PER_BLOCK - 1) / OBJECTS_PER_BLOCK;
+	if (!matrix_ring.create(blocks * OBJECTS_PER_BLOCK * sizeof(vmath::mat4)))
+		printf("No persistently mapped buffers, drawing with a uniform per cube instead\n");
+}
+
+void onAwakeManyCubesRing1K()
+{
+	awakeStreamedCubes(1000);
+}
+
+void onAwakeManyCubesRing10K()
+{
+	awakeStreamedCubes(10000);
+}
+
+void onAwakeManyCubesRing100K()
+{
+	awakeStreamedCubes(100000);
+}
+
+// A million cubes are past what one draw call each can do, so they are
+// drawn instanced; what is left on the CPU is the simulation and the
+// matrices, both spread over the job system.
+void onAwakeManyCubes1M()
+{
+	static const char * vs_source[] =
+	{
+		"#version 420 core                                                  \n",
+		CAMERA_GLSL,
+		"                                                                   \n"
+		"in vec4 position;                                                  \n"
+		"                                                                   \n"
+		"out VS_OUT                                                         \n"
+		"{                                                                  \n"
+		"    vec4 color;                                                    \n"
+		"} vs_out;                                                          \n"
+		"                                                                   \n"
+		"uniform samplerBuffer mv_matrices;                                 \n"
+		"                                                                   \n"
+		"void main(void)                                                    \n"
+		"{                                                                  \n"
+		"    int column = gl_InstanceID * 4;                                \n"
+		"    mat4 mv_matrix = mat4(texelFetch(mv_matrices, column),         \n"
+		"                          texelFetch(mv_matrices, column + 1),     \n"
+		"                          texelFetch(mv_matrices, column + 2),     \n"
+		"                          texelFetch(mv_matrices, column + 3));    \n"
+		"    gl_Position = proj_matrix * mv_matrix * position;              \n"
+		"    vs_out.color = position * 2.0 + vec4(0.5, 0.5, 0.5, 0.0);      \n"
+		"}                                                                  \n"
+	};
+
+	static const char * fs_source[] =
+	{
+		"#version 420 core                                                  \n"
+		"                                                                   \n"
+		"out vec4 color;                                                    \n"
+		"                                                                   \n"
+		"in VS_OUT                                                          \n"
+		"{                                                                  \n"
+		"    vec4 color;                                                    \n"
+		"} fs_in;                                                           \n"
+		"                                                                   \n"
+		"void main(void)                                                    \n"
+		"{                                                                  \n"
+		"    color = fs_in.color;                                           \n"
+		"}                                                                  \n"
+	};
+
+	int count = 1 << 20;
+	GLint max_texels = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+	if (count > max_texels / 4)
+	{
+		printf("Buffer textures hold %d texels, drawing %d cubes instead of %d\n", max_texels, max_texels / 4, count);
+		count = max_texels / 4;
+	}
+	awakeCubes(count, true);
+
+	instanced_program = glCreateProgram();
+	GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fs, 1, fs_source, NULL);
+	glCompileShader(fs);
+	CheckShaderCompileError(fs);
+
+	GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vs, 3, vs_source, NULL);
+	glCompileShader(vs);
+	CheckShaderCompileError(vs);
+
+	glAttachShader(instanced_program, vs);
+	glAttachShader(instanced_program, fs);
+	glLinkProgram(instanced_program);
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+
+	glUseProgram(instanced_program);
+	glUniform1i(glGetUniformLocation(instanced_program, "mv_matrices"), 0);
+
+	glGenBuffers(1, &matrix_buffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, matrix_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, count * sizeof(vmath::mat4), NULL, GL_STREAM_DRAW);
+	glGenTextures(1, &matrix_texture);
+	glBindTexture(GL_TEXTURE_BUFFER, matrix_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, matrix_buffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// MANY_CUBES, instanced: --count cubes, up to millions, in one draw call.
+void onAwakeManyCubesInstanced()
+{
+	static const char * vs_source[] =
+	{
+		"#version 420 core                                                  \n",
+		CAMERA_GLSL,
+		"                                                                   \n"
+		"layout (location = 0) in vec4 position;                            \n"
+		"layout (location = 1) in vec3 offset;                              \n"
+		"                                                                   \n"
+		"out VS_OUT                                                         \n"
+		"{                                                                  \n"
+		"    vec4 color;                                                    \n"
+		"} vs_out;                                                          \n"
+		"                                                                   \n"
+		"uniform mat4 spin_matrix;                                          \n"
+		"                                                                   \n"
+		"void main(void)                                                    \n"
+		"{                                                                  \n"
+		"    vec4 moved = vec4(position.xyz + offset, 1.0);                 \n"
+		"    gl_Position = proj_matrix * spin_matrix * moved;               \n"
+		"    vs_out.color = position * 2.0 + vec4(0.5, 0.5, 0.5, 0.0);      \n"
+		"}                                                                  \n"
+	};
+
+	static const char * fs_source[] =
+	{
+		"#version 420 core                                                  \n"
+		"                                                                   \n"
+		"out vec4 color;                                                    \n"
+		"                                                                   \n"
+		"in VS_OUT                                                          \n"
+		"{                                                                  \n"
+		"    vec4 color;                                                    \n"
+		"} fs_in;                                                           \n"
+		"                                                                   \n"
+		"void main(void)                                                    \n"
+		"{                                                                  \n"
+		"    color = fs_in.color;                                           \n"
+		"}                                                                  \n"
+	};
+
+	const int count = sceneCount(24);
+	awakeCubes(count, false);
+	attributed = true;
+
+	attributed_program = glCreateProgram();
+	GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fs, 1, fs_source, NULL);
+	glCompileShader(fs);
+	CheckShaderCompileError(fs);
+
+	GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vs, 3, vs_source, NULL);
+	glCompileShader(vs);
+	CheckShaderCompileError(vs);
+
+	glAttachShader(attributed_program, vs);
+	glAttachShader(attributed_program, fs);
+	glLinkProgram(attributed_program);
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+
+	spin_location = glGetUniformLocation(attributed_program, "spin_matrix");
+
+	// Attribute 1 steps once per instance: instance n reads offset n.
+	glGenBuffers(1, &offset_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, offset_buffer);
+	glBufferData(GL_ARRAY_BUFFER, count * sizeof(vmath::vec3), NULL, GL_STREAM_DRAW);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vmath::vec3), NULL);
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(1);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void onShutdown()
 {
+	if (timed_frames)
+	{
+		printf("%d cubes on %u job threads: %.3f ms per simulation step, %.3f ms per frame computing matrices\n",
+			cube_count, jobThreadCount(), step_seconds * 1000.0 / (timed_steps ? timed_steps : 1),
+			matrix_seconds * 1000.0 / timed_frames);
+	}
+
 	glDeleteVertexArrays(1, &vao);
 	glDeleteProgram(program);
 	glDeleteBuffers(1, &position_buffer);
+	glDeleteBuffers(1, &index_buffer);
+	if (instanced)
+	{
+		glDeleteProgram(instanced_program);
+		glDeleteBuffers(1, &matrix_buffer);
+		glDeleteTextures(1, &matrix_texture);
+	}
+	if (streamed)
+	{
+		if (matrix_ring.active())
+		{
+			const UniformRingStats ring_stats = matrix_ring.stats();
+			printf("Uniform ring: %u KiB per frame, %llu of %llu frames waited for the GPU (%.3f ms)\n",
+				(unsigned int)(matrix_ring.frameBytes() / 1024), ring_stats.waits, ring_stats.frames,
+				ring_stats.wait_seconds * 1000.0);
+		}
+		matrix_ring.destroy();
+		glDeleteProgram(ring_program);
+		glDeleteBuffers(1, &object_index_buffer);
+	}
+	if (attributed)
+	{
+		glDeleteProgram(attributed_program);
+		glDeleteBuffers(1, &offset_buffer);
+	}
+
+	// The states of a million cubes are worth giving back.
+	std::vector<vmath::vec3>().swap(states[0].offsets);
+	std::vector<vmath::vec3>().swap(states[1].offsets);
 }
-#endif
+
+const Scene ex5_4_scene =
+{
+	"EX5_4", "Spinning indexed cube (OpenGL SuperBible listing 5.4)",
+	getWindowWidth(), getWindowHeight(), onAwake, NULL, onShutdown, onStep, onRender, onRecord
+};
+const bool ex5_4_registered = registerScene(ex5_4_scene);
+
+const Scene many_cubes_scene =
+{
+	"MANY_CUBES", "Listing 5.4 drawing --count cubes (default 24), one draw call each",
+	getWindowWidth(), getWindowHeight(), onAwakeManyCubes, NULL, onShutdown, onStep, onRender, onRecord
+};
+const bool many_cubes_registered = registerScene(many_cubes_scene);
+
+const Scene many_cubes_4k_scene =
+{
+	"MANY_CUBES_4K", "MANY_CUBES with 4096 cubes, CPU bound",
+	getWindowWidth(), getWindowHeight(), onAwakeManyCubes4K, NULL, onShutdown, onStep, onRender, onRecord
+};
+const bool many_cubes_4k_registered = registerScene(many_cubes_4k_scene);
+
+const Scene many_cubes_1m_scene =
+{
+	"MANY_CUBES_1M", "MANY_CUBES with 2^20 cubes drawn instanced, matrices on the job system",
+	getWindowWidth(), getWindowHeight(), onAwakeManyCubes1M, NULL, onShutdown, onStep, onRenderInstanced, NULL
+};
+const bool many_cubes_1m_registered = registerScene(many_cubes_1m_scene);
+
+// Sweep with --benchmark N --scene MANY_CUBES,MANY_CUBES_INSTANCED --count 24,1000,...
+const Scene many_cubes_instanced_scene =
+{
+	"MANY_CUBES_INSTANCED", "MANY_CUBES in one instanced draw, per-cube offsets in a vertex attribute",
+	getWindowWidth(), getWindowHeight(), onAwakeManyCubesInstanced, NULL, onShutdown, onStep, onRenderAttributed, NULL
+};
+const bool many_cubes_instanced_registered = registerScene(many_cubes_instanced_scene);
+
+const Scene many_cubes_1k_scene =
+{
+	"MANY_CUBES_1K", "MANY_CUBES with 1000 cubes, a uniform update per draw",
+	getWindowWidth(), getWindowHeight(), onAwakeManyCubes1K, NULL, onShutdown, onStep, onRender, onRecord
+};
+const bool many_cubes_1k_registered = registerScene(many_cubes_1k_scene);
+
+const Scene many_cubes_10k_scene =
+{
+	"MANY_CUBES_10K", "MANY_CUBES with 10000 cubes, a uniform update per draw",
+	getWindowWidth(), getWindowHeight(), onAwakeManyCubes10K, NULL, onShutdown, onStep, onRender, onRecord
+};
+const bool many_cubes_10k_registered = registerScene(many_cubes_10k_scene);
+
+const Scene many_cubes_100k_scene =
+{
+	"MANY_CUBES_100K", "MANY_CUBES with 100000 cubes, a uniform update per draw",
+	getWindowWidth(), getWindowHeight(), onAwakeManyCubes100K, NULL, onShutdown, onStep, onRender, onRecord
+};
+const bool many_cubes_100k_registered = registerScene(many_cubes_100k_scene);
+
+// Compare with the scenes above: --benchmark N --scene MANY_CUBES_1K,MANY_CUBES_RING_1K,...
+const Scene many_cubes_ring_1k_scene =
+{
+	"MANY_CUBES_RING_1K", "MANY_CUBES_1K with the matrices in a persistently mapped uniform ring",
+	getWindowWidth(), getWindowHeight(), onAwakeManyCubesRing1K, NULL, onShutdown, onStep, onRenderStreamed, NULL
+};
+const bool many_cubes_ring_1k_registered = registerScene(many_cubes_ring_1k_scene);
+
+const Scene many_cubes_ring_10k_scene =
+{
+	"MANY_CUBES_RING_10K", "MANY_CUBES_10K with the matrices in a persistently mapped uniform ring",
+	getWindowWidth(), getWindowHeight(), onAwakeManyCubesRing10K, NULL, onShutdown, onStep, onRenderStreamed, NULL
+};
+const bool many_cubes_ring_10k_registered = registerScene(many_cubes_ring_10k_scene);
+
+const Scene many_cubes_ring_100k_scene =
+{
+	"MANY_CUBES_RING_100K", "MANY_CUBES_100K with the matrices in a persistently mapped uniform ring",
+	getWindowWidth(), getWindowHeight(), onAwakeManyCubesRing100K, NULL, onShutdown, onStep, onRenderStreamed, NULL
+};
+const bool many_cubes_ring_100k_registered = registerScene(many_cubes_ring_100k_scene);
+
+} // namespace
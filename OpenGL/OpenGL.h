@@ -1,8 +1,10 @@
 #pragma once
 
-#define TUT7
+// The examples register themselves (scene.h) and are picked at run time with
+// --scene. Define BENCH_LOADER, TEXENC or GL_REPLAY to build one of the
+// command line tools instead.
 
-#include <GL/glew.h>
+#include "gl_trace.h"
 #include <iostream>
 
 #define NULL 0
@@ -53,3 +55,46 @@ static void CheckGLError()
 		std::cout << "GL Error: " << GetGLErrorStr(err) << std::endl;
 	}
 }
+
+// Returns a mask with bit N set for every vertex input the linked program
+// actually reads at layout(location = N).
+static GLuint GetProgramInputMask(GLuint program)
+{
+	GLuint mask = 0;
+
+	if (GLEW_VERSION_4_3 || GLEW_ARB_program_interface_query)
+	{
+		GLint count = 0;
+		glGetProgramInterfaceiv(program, GL_PROGRAM_INPUT, GL_ACTIVE_RESOURCES, &count);
+
+		const GLenum property = GL_LOCATION;
+		for (GLint i = 0; i < count; i++)
+		{
+			GLint location = -1;
+			glGetProgramResourceiv(program, GL_PROGRAM_INPUT, i, 1, &property, 1, NULL, &location);
+			if (location >= 0 && location < 32)
+				mask |= 1u << location;
+		}
+	}
+	else
+	{
+		GLint count = 0;
+		GLint max_length = 0;
+		glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+		glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_length);
+
+		GLchar *name = new GLchar[max_length + 1];
+		for (GLint i = 0; i < count; i++)
+		{
+			GLint size;
+			GLenum type;
+			glGetActiveAttrib(program, i, max_length + 1, NULL, &size, &type, name);
+			const GLint location = glGetAttribLocation(program, name);
+			if (location >= 0 && location < 32)
+				mask |= 1u << location;
+		}
+		delete[] name;
+	}
+
+	return mask;
+}
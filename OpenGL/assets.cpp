@@ -0,0 +1,683 @@
+#include "assets.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fileio.h"
+#include "gl_state.h"
+
+namespace
+{
+
+struct Completion
+{
+    MeshAsset *mesh;
+    TextureAsset *texture;
+};
+
+std::vector<std::thread> workers;
+std::deque<std::function<void()> > jobs;
+std::mutex jobs_mutex;
+std::condition_variable jobs_ready;
+bool stopping = false;
+
+std::deque<Completion> completions;
+std::mutex completions_mutex;
+
+// Everything below belongs to the thread that has the GL context, the
+// main thread or the render thread (see setAssetLoaderThread).
+std::atomic<std::thread::id> owner;
+
+std::vector<MeshAsset *> live_meshes;
+std::vector<TextureAsset *> live_textures;
+std::vector<void *> in_flight;
+
+// GL objects shared by every asset whose file has the same contents.
+struct SharedMesh
+{
+    GLuint vao;
+    GLuint buffers[2];
+    GLsizei index_count;
+    unsigned int users;
+};
+
+struct SharedTexture
+{
+    GLuint texture;
+    unsigned int users;
+};
+
+// The owner's too. Assets by canonical path, GL objects by content hash.
+std::map<std::string, MeshAsset *> meshes_by_path;
+std::map<std::string, TextureAsset *> textures_by_path;
+std::map<unsigned long long, SharedMesh> meshes_by_content;
+std::map<unsigned long long, SharedTexture> textures_by_content;
+AssetCacheStats cache_stats;
+
+// The keys of meshes_by_content, for workers to skip parsing files whose
+// contents are already uploaded. The owner keeps it in step with the map.
+std::set<unsigned long long> uploaded_meshes;
+std::mutex uploaded_meshes_mutex;
+
+GLuint placeholder_texture = 0;
+GLuint placeholder_vao = 0;
+GLuint placeholder_buffers[2] = { 0, 0 };
+GLsizei placeholder_index_count = 0;
+
+void workerMain()
+{
+    for (;;)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(jobs_mutex);
+            jobs_ready.wait(lock, []() { return stopping || !jobs.empty(); });
+            if (stopping)
+                return;
+            job.swap(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void complete(MeshAsset *mesh, TextureAsset *texture)
+{
+    Completion completion = { mesh, texture };
+    std::lock_guard<std::mutex> lock(completions_mutex);
+    completions.push_back(completion);
+}
+
+// Reports a call from a thread that does not own the loader; its state
+// is not locked, so such a call races with the owner.
+void checkOwner(const char *function)
+{
+    if (std::this_thread::get_id() != owner.load(std::memory_order_relaxed))
+        printf("%s called from a thread without the GL context, see assets.h\n", function);
+}
+
+bool isInFlight(void *asset)
+{
+    return std::find(in_flight.begin(), in_flight.end(), asset) != in_flight.end();
+}
+
+template <typename T>
+void eraseValue(std::vector<T> &values, T value)
+{
+    values.erase(std::remove(values.begin(), values.end(), value), values.end());
+}
+
+void uploadStream(GLuint location, GLint size, const void *data, size_t bytes, size_t &offset)
+{
+    if (bytes == 0)
+        return;
+    glBufferSubData(GL_ARRAY_BUFFER, offset, bytes, data);
+    glEnableVertexAttribArray(location);
+    glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE, 0, (void*)offset);
+    offset += bytes;
+}
+
+// One VAO per mesh. The streams share a single buffer, one after the other,
+// at the attribute locations given by their MeshAttrib bits.
+void createMeshObjects(const Mesh &mesh, GLuint &vao, GLuint buffers[2])
+{
+    const size_t vertex_count = mesh.positions.size();
+    const size_t size = vertex_count * sizeof(vmath::vec3) +
+        mesh.uvs.size() * sizeof(vmath::vec2) +
+        mesh.normals.size() * sizeof(vmath::vec3) +
+        mesh.tangents.size() * sizeof(vmath::vec4);
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(2, buffers);
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STATIC_DRAW);
+
+    size_t offset = 0;
+    if (vertex_count)
+    {
+        uploadStream(0, 3, &mesh.positions[0], vertex_count * sizeof(vmath::vec3), offset);
+        if (!mesh.uvs.empty())
+            uploadStream(1, 2, &mesh.uvs[0], mesh.uvs.size() * sizeof(vmath::vec2), offset);
+        if (!mesh.normals.empty())
+            uploadStream(2, 3, &mesh.normals[0], mesh.normals.size() * sizeof(vmath::vec3), offset);
+        if (!mesh.tangents.empty())
+            uploadStream(3, 4, &mesh.tangents[0], mesh.tangents.size() * sizeof(vmath::vec4), offset);
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int),
+                 mesh.indices.empty() ? NULL : &mesh.indices[0], GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+}
+
+// A 2 x 2 unit cube with uvs and normals, drawn while a mesh is loading.
+void createPlaceholderMesh()
+{
+    static const float faces[6][3][3] =
+    {
+        // normal, u axis, v axis
+        { {  1, 0, 0 }, { 0, 0, -1 }, { 0, 1, 0 } },
+        { { -1, 0, 0 }, { 0, 0,  1 }, { 0, 1, 0 } },
+        { { 0,  1, 0 }, { 1, 0, 0 }, { 0, 0, -1 } },
+        { { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0,  1 } },
+        { { 0, 0,  1 }, { 1, 0, 0 }, { 0, 1, 0 } },
+        { { 0, 0, -1 }, { -1, 0, 0 }, { 0, 1, 0 } }
+    };
+    static const float corners[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+
+    Mesh cube;
+    for (int f = 0; f < 6; f++)
+    {
+        const vmath::vec3 n(faces[f][0][0], faces[f][0][1], faces[f][0][2]);
+        const vmath::vec3 u(faces[f][1][0], faces[f][1][1], faces[f][1][2]);
+        const vmath::vec3 v(faces[f][2][0], faces[f][2][1], faces[f][2][2]);
+        const unsigned int base = (unsigned int)cube.positions.size();
+        for (int c = 0; c < 4; c++)
+        {
+            cube.positions.push_back(n + u * (corners[c][0] * 2.0f - 1.0f) + v * (corners[c][1] * 2.0f - 1.0f));
+            cube.uvs.push_back(vmath::vec2(corners[c][0], corners[c][1]));
+            cube.normals.push_back(n);
+        }
+        const unsigned int quad[6] = { 0, 1, 2, 0, 2, 3 };
+        for (int i = 0; i < 6; i++)
+            cube.indices.push_back(base + quad[i]);
+    }
+    generateTangents(cube);
+
+    createMeshObjects(cube, placeholder_vao, placeholder_buffers);
+    placeholder_index_count = (GLsizei)cube.indices.size();
+}
+
+// Grey and white checkers.
+void createPlaceholderTexture()
+{
+    static const unsigned char pixels[] =
+    {
+        160, 160, 160, 255,   255, 255, 255, 255,
+        255, 255, 255, 255,   160, 160, 160, 255
+    };
+
+    glGenTextures(1, &placeholder_texture);
+    glBindTexture(GL_TEXTURE_2D, placeholder_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+}
+
+void destroyMesh(MeshAsset *asset)
+{
+    if (asset->buffers[0])
+    {
+        std::map<unsigned long long, SharedMesh>::iterator shared = meshes_by_content.find(asset->content_hash);
+        if (shared == meshes_by_content.end())
+        {
+            glDeleteVertexArrays(1, &asset->vao);
+            glDeleteBuffers(2, asset->buffers);
+        }
+        else if (--shared->second.users == 0)
+        {
+            glDeleteVertexArrays(1, &shared->second.vao);
+            glDeleteBuffers(2, shared->second.buffers);
+            meshes_by_content.erase(shared);
+            std::lock_guard<std::mutex> lock(uploaded_meshes_mutex);
+            uploaded_meshes.erase(asset->content_hash);
+        }
+    }
+    eraseValue(live_meshes, asset);
+    delete asset;
+}
+
+void destroyTexture(TextureAsset *asset)
+{
+    if (asset->texture != placeholder_texture)
+    {
+        std::map<unsigned long long, SharedTexture>::iterator shared = textures_by_content.find(asset->content_hash);
+        if (shared == textures_by_content.end())
+            glDeleteTextures(1, &asset->texture);
+        else if (--shared->second.users == 0)
+        {
+            glDeleteTextures(1, &shared->second.texture);
+            textures_by_content.erase(shared);
+        }
+    }
+    delete asset->file;
+    eraseValue(live_textures, asset);
+    delete asset;
+}
+
+void queueMeshLoad(MeshAsset *asset)
+{
+    queueAssetJob([asset]() {
+        // Hash the mapping first and parse that same mapping only if no
+        // other file with these contents is uploaded already.
+        MappedFile file;
+        if (!file.open(asset->path.c_str()))
+        {
+            printf("Impossible to open the file !\n");
+            asset->state = ASSET_FAILED;
+            complete(asset, NULL);
+            return;
+        }
+
+        // The same file loaded with other attributes is a different mesh.
+        const unsigned long long hash =
+            hashBytes(file.data(), file.size()) ^ hashBytes(&asset->attribs, sizeof(asset->attribs));
+        asset->content_hash = hash;
+        {
+            std::lock_guard<std::mutex> lock(uploaded_meshes_mutex);
+            asset->reused = uploaded_meshes.count(hash) != 0;
+        }
+
+        if (asset->reused)
+            asset->state = ASSET_DECODED;
+        else
+        {
+            MeshLoadOptions options;
+            options.attribs = asset->attribs;
+            asset->state = parseOBJ(file.data(), file.size(), asset->mesh, options) ? ASSET_DECODED : ASSET_FAILED;
+        }
+        complete(asset, NULL);
+    });
+}
+
+// Both return the bytes handed to the GL, for the upload budget.
+size_t finishMesh(MeshAsset *asset)
+{
+    if (asset->released)
+    {
+        destroyMesh(asset);
+        return 0;
+    }
+
+    size_t bytes = 0;
+    // Assets whose file could not be hashed (content_hash 0) share nothing.
+    std::map<unsigned long long, SharedMesh>::iterator shared = meshes_by_content.find(asset->content_hash);
+    if (asset->state == ASSET_DECODED && asset->content_hash && shared != meshes_by_content.end())
+    {
+        asset->vao = shared->second.vao;
+        asset->buffers[0] = shared->second.buffers[0];
+        asset->buffers[1] = shared->second.buffers[1];
+        asset->index_count = shared->second.index_count;
+        asset->state = ASSET_READY;
+        shared->second.users++;
+        cache_stats.content_hits++;
+    }
+    else if (asset->reused)
+    {
+        // The last user of the contents released them after the worker
+        // looked; parse the file after all. The worker owns the asset again.
+        asset->reused = false;
+        asset->state = ASSET_LOADING;
+        in_flight.push_back(asset);
+        queueMeshLoad(asset);
+        return 0;
+    }
+    else if (asset->state == ASSET_DECODED)
+    {
+        const Mesh &mesh = asset->mesh;
+        bytes = mesh.positions.size() * sizeof(vmath::vec3) + mesh.uvs.size() * sizeof(vmath::vec2) +
+                mesh.normals.size() * sizeof(vmath::vec3) + mesh.tangents.size() * sizeof(vmath::vec4) +
+                mesh.indices.size() * sizeof(unsigned int);
+        createMeshObjects(mesh, asset->vao, asset->buffers);
+        asset->index_count = (GLsizei)mesh.indices.size();
+        asset->state = ASSET_READY;
+
+        if (asset->content_hash)
+        {
+            SharedMesh &entry = meshes_by_content[asset->content_hash];
+            entry.vao = asset->vao;
+            entry.buffers[0] = asset->buffers[0];
+            entry.buffers[1] = asset->buffers[1];
+            entry.index_count = asset->index_count;
+            entry.users = 1;
+            std::lock_guard<std::mutex> lock(uploaded_meshes_mutex);
+            uploaded_meshes.insert(asset->content_hash);
+        }
+        cache_stats.misses++;
+    }
+    asset->mesh = Mesh();
+    return bytes;
+}
+
+size_t finishTexture(TextureAsset *asset)
+{
+    if (asset->released)
+    {
+        if (asset->staged)
+            retireUpload(asset->span);
+        destroyTexture(asset);
+        return 0;
+    }
+
+    size_t bytes = 0;
+    std::map<unsigned long long, SharedTexture>::iterator shared = textures_by_content.find(asset->content_hash);
+    if (asset->state == ASSET_DECODED && asset->content_hash && shared != textures_by_content.end())
+    {
+        // Same contents as a texture already uploaded under another path.
+        if (asset->staged)
+            retireUpload(asset->span);
+        asset->texture = shared->second.texture;
+        asset->state = ASSET_READY;
+        shared->second.users++;
+        cache_stats.content_hits++;
+    }
+    else if (asset->state == ASSET_DECODED)
+    {
+        GLuint texture;
+        if (asset->file)
+        {
+            for (size_t i = 0; i < asset->file->levels.size(); i++)
+                bytes += asset->file->levels[i].size;
+            texture = createTextureFromFile(*asset->file);
+        }
+        else if (asset->staged)
+        {
+            bytes = asset->span.size;
+            texture = createStagedTexture(asset->image, asset->span);
+        }
+        else
+        {
+            bytes = asset->image.pixels.size();
+            for (size_t i = 0; i < asset->image.mips.size(); i++)
+                bytes += asset->image.mips[i].pixels.size();
+            texture = createTexture(asset->image);
+        }
+
+        if (texture)
+        {
+            asset->texture = texture;
+            asset->state = ASSET_READY;
+
+            if (asset->content_hash)
+            {
+                SharedTexture &entry = textures_by_content[asset->content_hash];
+                entry.texture = texture;
+                entry.users = 1;
+            }
+            cache_stats.misses++;
+        }
+        else
+            asset->state = ASSET_FAILED;
+    }
+    else if (asset->staged)
+        retireUpload(asset->span);
+
+    asset->image = Image();
+    asset->staged = false;
+    delete asset->file;
+    asset->file = NULL;
+    return bytes;
+}
+
+} // namespace
+
+void initAssetLoader(unsigned int worker_count, size_t upload_ring_bytes)
+{
+    if (worker_count == 0)
+    {
+        worker_count = std::thread::hardware_concurrency();
+        worker_count = worker_count > 1 ? worker_count - 1 : 1;
+    }
+
+    setAssetLoaderThread();
+    stopping = false;
+    cache_stats = AssetCacheStats();
+    for (unsigned int i = 0; i < worker_count; i++)
+        workers.push_back(std::thread(workerMain));
+
+    createPlaceholderMesh();
+    createPlaceholderTexture();
+    if (upload_ring_bytes)
+        initUploadRing(upload_ring_bytes);
+}
+
+void setAssetLoaderThread()
+{
+    owner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+}
+
+void shutdownAssetLoader()
+{
+    checkOwner("shutdownAssetLoader");
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    jobs_ready.notify_all();
+    // Workers waiting for ring space give up and finish their job.
+    closeUploadRing();
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+    workers.clear();
+
+    completions.clear();
+    in_flight.clear();
+    while (!live_meshes.empty())
+        destroyMesh(live_meshes.back());
+    while (!live_textures.empty())
+        destroyTexture(live_textures.back());
+    meshes_by_path.clear();
+    textures_by_path.clear();
+    meshes_by_content.clear();
+    textures_by_content.clear();
+    uploaded_meshes.clear();
+
+    glDeleteVertexArrays(1, &placeholder_vao);
+    glDeleteBuffers(2, placeholder_buffers);
+    glDeleteTextures(1, &placeholder_texture);
+    placeholder_vao = 0;
+    placeholder_texture = 0;
+
+    shutdownUploadRing();
+}
+
+void pumpAssetUploads(double budget_seconds, size_t budget_bytes)
+{
+    checkOwner("pumpAssetUploads");
+    recycleUploads();
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool saved = false;
+    GLint vertex_array = 0;
+    GLint texture = 0;
+    size_t bytes = 0;
+
+    for (;;)
+    {
+        Completion completion;
+        {
+            std::lock_guard<std::mutex> lock(completions_mutex);
+            if (completions.empty())
+                break;
+            if (budget_bytes && bytes >= budget_bytes)
+            {
+                countDeferredUploadFrame();
+                break;
+            }
+            completion = completions.front();
+            completions.pop_front();
+        }
+
+        // Uploads bind objects; leave the scene's bindings as they were.
+        if (!saved)
+        {
+            glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vertex_array);
+            glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
+            saved = true;
+        }
+
+        if (completion.mesh)
+        {
+            eraseValue(in_flight, (void *)completion.mesh);
+            bytes += finishMesh(completion.mesh);
+        }
+        else
+        {
+            eraseValue(in_flight, (void *)completion.texture);
+            bytes += finishTexture(completion.texture);
+        }
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed >= budget_seconds)
+            break;
+    }
+
+    if (saved)
+    {
+        glBindVertexArray(vertex_array);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        // The array buffer binding is not put back.
+        invalidateGLState();
+    }
+}
+
+void queueAssetJob(const std::function<void()> &job)
+{
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        jobs.push_back(job);
+    }
+    jobs_ready.notify_one();
+}
+
+unsigned int pendingAssetCount()
+{
+    checkOwner("pendingAssetCount");
+    return (unsigned int)in_flight.size();
+}
+
+MeshAsset *loadMeshAsync(const char *path, unsigned int attribs)
+{
+    checkOwner("loadMeshAsync");
+    char attrib_suffix[16];
+    snprintf(attrib_suffix, sizeof(attrib_suffix), "|%x", attribs);
+    const std::string key = canonicalPath(path) + attrib_suffix;
+    std::map<std::string, MeshAsset *>::iterator cached = meshes_by_path.find(key);
+    if (cached != meshes_by_path.end())
+    {
+        cached->second->refs++;
+        cache_stats.path_hits++;
+        return cached->second;
+    }
+
+    MeshAsset *asset = new MeshAsset;
+    asset->vao = placeholder_vao;
+    asset->index_count = placeholder_index_count;
+    asset->state = ASSET_LOADING;
+    asset->buffers[0] = asset->buffers[1] = 0;
+    asset->released = false;
+    asset->attribs = attribs;
+    asset->refs = 1;
+    asset->key = key;
+    asset->path = path;
+    asset->content_hash = 0;
+    asset->reused = false;
+
+    meshes_by_path[key] = asset;
+    live_meshes.push_back(asset);
+    in_flight.push_back(asset);
+
+    queueMeshLoad(asset);
+    return asset;
+}
+
+TextureAsset *loadTextureAsync(const char *imagepath)
+{
+    checkOwner("loadTextureAsync");
+    const std::string key = canonicalPath(imagepath);
+    std::map<std::string, TextureAsset *>::iterator cached = textures_by_path.find(key);
+    if (cached != textures_by_path.end())
+    {
+        cached->second->refs++;
+        cache_stats.path_hits++;
+        return cached->second;
+    }
+
+    TextureAsset *asset = new TextureAsset;
+    asset->texture = placeholder_texture;
+    asset->state = ASSET_LOADING;
+    asset->file = NULL;
+    asset->staged = false;
+    asset->released = false;
+    asset->refs = 1;
+    asset->key = key;
+    asset->content_hash = 0;
+
+    textures_by_path[key] = asset;
+    live_textures.push_back(asset);
+    in_flight.push_back(asset);
+
+    const std::string file(imagepath);
+    queueAssetJob([asset, file]() {
+        // Containers only have their header parsed here and upload straight
+        // from the mapping. Other images are decoded, get their mip chain
+        // built and are copied into the upload ring here, so the main thread
+        // only issues the uploads.
+        unsigned long long hash;
+        if (hashFile(file.c_str(), hash))
+            asset->content_hash = hash;
+        asset->file = openTextureContainer(file.c_str());
+        if (asset->file)
+            asset->state = ASSET_DECODED;
+        else if (isTextureContainerPath(file.c_str()))
+            asset->state = ASSET_FAILED;
+        else if (decodeBMP(file.c_str(), asset->image))
+        {
+            generateMipmaps(asset->image);
+            asset->staged = stageImage(asset->image, asset->span);
+            asset->state = ASSET_DECODED;
+        }
+        else
+            asset->state = ASSET_FAILED;
+        complete(NULL, asset);
+    });
+    return asset;
+}
+
+void releaseMesh(MeshAsset *mesh)
+{
+    checkOwner("releaseMesh");
+    if (!mesh || --mesh->refs > 0)
+        return;
+    meshes_by_path.erase(mesh->key);
+    if (isInFlight(mesh))
+        mesh->released = true;
+    else
+        destroyMesh(mesh);
+}
+
+void releaseTexture(TextureAsset *texture)
+{
+    checkOwner("releaseTexture");
+    if (!texture || --texture->refs > 0)
+        return;
+    textures_by_path.erase(texture->key);
+    if (isInFlight(texture))
+        texture->released = true;
+    else
+        destroyTexture(texture);
+}
+
+AssetCacheStats assetCacheStats()
+{
+    AssetCacheStats stats = cache_stats;
+    stats.meshes = (unsigned int)meshes_by_content.size();
+    stats.textures = (unsigned int)textures_by_content.size();
+    return stats;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "gl_trace.h"
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string>
+
+#include "mesh.h"
+#include "texture.h"
+#include "upload.h"
+
+// Asynchronous asset loading. Files are read and decoded on a pool of worker
+// threads; the GL objects are created on the main thread by
+// pumpAssetUploads, which the host loop calls once per frame. Until then
+// every asset hands out a shared placeholder, so scenes can draw from the
+// first frame on without checking anything.
+//
+// Decoded images are copied by the workers into the persistently mapped
+// upload ring (upload.h) when the GL supports it, so the main thread only
+// issues glTexSubImage2D from buffer offsets.
+//
+// The loader's bookkeeping belongs to the thread that has the GL context:
+// the main thread, or the render thread (render_thread.h) while one runs.
+// Loads, releases, pumpAssetUploads and pendingAssetCount are called from
+// that thread only, which is why scenes load in onAwake and release in
+// onShutdown, outside the render thread's lifetime. Calls from another
+// thread are reported.
+//
+// Loads are cached twice over. Loading a file that is already loaded (or
+// loading) returns the same asset, whatever the path's spelling, with one
+// more reference. A different file whose contents hash the same as a loaded
+// one gets its own asset but shares the GL objects. Either way the GL objects
+// are freed when the last user releases them.
+
+enum AssetState
+{
+    ASSET_LOADING,      // Queued or decoding on a worker
+    ASSET_DECODED,      // Waiting for its GL upload
+    ASSET_READY,
+    ASSET_FAILED        // Keeps using the placeholder
+};
+
+struct MeshAsset
+{
+    // Attribute N of the VAO is MeshAttrib bit N; indices are GL_UNSIGNED_INT.
+    GLuint vao;
+    GLsizei index_count;
+    std::atomic<int> state;
+
+    // Owned by the loader.
+    Mesh mesh;
+    GLuint buffers[2];
+    bool released;
+    unsigned int attribs;
+    unsigned int refs;              // Loads of this path not yet released
+    std::string key;                // Canonical path and attribs
+    std::string path;               // As loaded, for parsing again
+    unsigned long long content_hash;    // Set by the worker, 0 if the file could not be read
+    bool reused;                    // Not parsed, content_hash was already uploaded
+};
+
+struct TextureAsset
+{
+    GLuint texture;     // GL_TEXTURE_2D
+    std::atomic<int> state;
+
+    // Owned by the loader.
+    Image image;
+    TextureFile *file;              // Used instead of image for .ktx2 / .dds files and caches
+    UploadSpan span;                // Holds the image's pixels when staged
+    bool staged;
+    bool released;
+    unsigned int refs;
+    std::string key;
+    unsigned long long content_hash;
+};
+
+struct AssetCacheStats
+{
+    unsigned long long path_hits;       // Loads answered with an asset already loaded or loading
+    unsigned long long content_hits;    // Uploads skipped because another file had the same contents
+    unsigned long long misses;          // Uploads that created GL objects
+    unsigned int meshes;                // Distinct GL meshes and textures alive
+    unsigned int textures;
+
+    AssetCacheStats() : path_hits(0), content_hits(0), misses(0), meshes(0), textures(0) {}
+};
+
+// Starts the worker threads (0 = one per hardware thread, minus the main
+// thread), creates the placeholders and an upload ring of upload_ring_bytes
+// (0 = upload from client memory). Needs the GL context.
+void initAssetLoader(unsigned int worker_count = 0, size_t upload_ring_bytes = 64 << 20);
+
+// Makes the calling thread the loader's owner. initAssetLoader's caller owns
+// it to begin with; the render thread takes it over while it runs.
+void setAssetLoaderThread();
+
+// Joins the workers and frees every asset still alive.
+void shutdownAssetLoader();
+
+// Frees upload ring space the GPU is done with, then creates GL objects for
+// decoded assets until budget_seconds have been spent or budget_bytes
+// uploaded (0 = no byte limit). At least one upload runs per call so loading
+// always makes progress.
+void pumpAssetUploads(double budget_seconds, size_t budget_bytes = 0);
+
+// Runs job on one of the loader's worker threads. Jobs still queued at
+// shutdown are dropped.
+void queueAssetJob(const std::function<void()> &job);
+
+// Number of assets still loading or waiting for upload.
+unsigned int pendingAssetCount();
+
+MeshAsset *loadMeshAsync(const char *path, unsigned int attribs = MESH_ALL);
+// .ktx2 and .dds files are memory-mapped and uploaded straight from the
+// mapping. For other images the block-compressed cache written by texenc
+// (<imagepath>.bc7.dds, then .bc3.dds, then .bc1.dds) is used instead when it
+// is current and the GL supports its format.
+TextureAsset *loadTextureAsync(const char *imagepath);
+
+// Drops one reference. The asset is freed once the last one is gone and it is
+// no longer in flight, and its GL objects with it unless another asset with
+// the same contents still uses them.
+void releaseMesh(MeshAsset *mesh);
+void releaseTexture(TextureAsset *texture);
+
+AssetCacheStats assetCacheStats();
@@ -0,0 +1,302 @@
+#include "atlas.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+
+// Top edge of the packed area over [x, x + width) of a page.
+struct SkylineSegment
+{
+    unsigned int x;
+    unsigned int y;
+    unsigned int width;
+};
+
+struct Page
+{
+    std::vector<SkylineSegment> skyline;
+};
+
+// Lowest y at which a cell of the given width can start at segment index,
+// or false if it runs off the right edge.
+bool fitSegment(const std::vector<SkylineSegment> &skyline, size_t index, unsigned int width, unsigned int page_size, unsigned int &out_y)
+{
+    const unsigned int x = skyline[index].x;
+    if (x + width > page_size)
+        return false;
+
+    unsigned int y = 0;
+    unsigned int covered = 0;
+    for (size_t i = index; covered < width; i++)
+    {
+        if (i == skyline.size())
+            return false;
+        y = std::max(y, skyline[i].y);
+        covered += skyline[i].width;
+    }
+    out_y = y;
+    return true;
+}
+
+// Bottom-left rule: the position that leaves the lowest top edge, then the
+// leftmost one.
+bool findPosition(const Page &page, unsigned int width, unsigned int height, unsigned int page_size,
+                  unsigned int &out_x, unsigned int &out_y)
+{
+    bool found = false;
+    unsigned int best_top = 0;
+    for (size_t i = 0; i < page.skyline.size(); i++)
+    {
+        unsigned int y;
+        if (!fitSegment(page.skyline, i, width, page_size, y) || y + height > page_size)
+            continue;
+        if (!found || y + height < best_top)
+        {
+            found = true;
+            best_top = y + height;
+            out_x = page.skyline[i].x;
+            out_y = y;
+        }
+    }
+    return found;
+}
+
+void addToSkyline(Page &page, unsigned int x, unsigned int y, unsigned int width, unsigned int height)
+{
+    std::vector<SkylineSegment> &skyline = page.skyline;
+    std::vector<SkylineSegment> updated;
+    updated.reserve(skyline.size() + 2);
+
+    const unsigned int right = x + width;
+    bool inserted = false;
+    for (size_t i = 0; i < skyline.size(); i++)
+    {
+        const SkylineSegment &segment = skyline[i];
+        const unsigned int segment_right = segment.x + segment.width;
+
+        // Parts of the segment left and right of the new cell survive.
+        if (segment.x < x)
+        {
+            SkylineSegment left = { segment.x, segment.y, std::min(segment_right, x) - segment.x };
+            updated.push_back(left);
+        }
+        if (!inserted && segment_right > x)
+        {
+            SkylineSegment cell = { x, y + height, width };
+            updated.push_back(cell);
+            inserted = true;
+        }
+        if (segment_right > right)
+        {
+            const unsigned int start = std::max(segment.x, right);
+            SkylineSegment rest = { start, segment.y, segment_right - start };
+            updated.push_back(rest);
+        }
+    }
+
+    // Merge neighbours of equal height so later fits scan fewer segments.
+    skyline.clear();
+    for (size_t i = 0; i < updated.size(); i++)
+    {
+        if (!skyline.empty() && skyline.back().y == updated[i].y)
+            skyline.back().width += updated[i].width;
+        else
+            skyline.push_back(updated[i]);
+    }
+}
+
+unsigned int roundUp(unsigned int value, unsigned int multiple)
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+unsigned int log2Floor(unsigned int value)
+{
+    unsigned int log = 0;
+    while (value > 1)
+    {
+        value >>= 1;
+        log++;
+    }
+    return log;
+}
+
+bool isPowerOfTwo(unsigned int value)
+{
+    return value && !(value & (value - 1));
+}
+
+// Byte offsets of R, G, B and A in a source pixel, -1 for an opaque alpha.
+bool channelOrder(GLenum format, int order[4])
+{
+    const bool bgr = format == GL_BGR || format == GL_BGRA;
+    if (format != GL_RGB && format != GL_RGBA && !bgr)
+        return false;
+    order[0] = bgr ? 2 : 0;
+    order[1] = 1;
+    order[2] = bgr ? 0 : 2;
+    order[3] = imageChannels(format) == 4 ? 3 : -1;
+    return true;
+}
+
+// Copies the image into its cell and repeats its edge texels over the rest
+// of the cell.
+void blitPadded(const Image &image, Image &page, unsigned int cell_x, unsigned int cell_y,
+                unsigned int cell_width, unsigned int cell_height, unsigned int padding)
+{
+    int order[4];
+    channelOrder(image.format, order);
+    const unsigned int channels = imageChannels(image.format);
+    const size_t src_stride = imageRowBytes(image.width, channels);
+    const size_t dst_stride = (size_t)page.width * 4;
+
+    for (unsigned int y = 0; y < cell_height; y++)
+    {
+        const unsigned int src_y = (unsigned int)std::min(std::max((int)y - (int)padding, 0), (int)image.height - 1);
+        const unsigned char *src_row = &image.pixels[src_y * src_stride];
+        unsigned char *dst = &page.pixels[(cell_y + y) * dst_stride + (size_t)cell_x * 4];
+        for (unsigned int x = 0; x < cell_width; x++, dst += 4)
+        {
+            const unsigned int src_x = (unsigned int)std::min(std::max((int)x - (int)padding, 0), (int)image.width - 1);
+            const unsigned char *src = src_row + (size_t)src_x * channels;
+            dst[0] = src[order[0]];
+            dst[1] = src[order[1]];
+            dst[2] = src[order[2]];
+            dst[3] = order[3] < 0 ? 255 : src[order[3]];
+        }
+    }
+}
+
+struct ImageOrder
+{
+    const std::vector<const Image *> *images;
+
+    bool operator()(size_t a, size_t b) const
+    {
+        const Image &image_a = *(*images)[a];
+        const Image &image_b = *(*images)[b];
+        if (image_a.height != image_b.height)
+            return image_a.height > image_b.height;
+        return image_a.width > image_b.width;
+    }
+};
+
+} // namespace
+
+bool packAtlas(const std::vector<const Image *> &images, TextureAtlas &out_atlas, const AtlasOptions &options)
+{
+    out_atlas = TextureAtlas();
+    if (!isPowerOfTwo(options.page_size) || !isPowerOfTwo(options.alignment))
+    {
+        printf("Atlas page size and alignment must be powers of two\n");
+        return false;
+    }
+
+    const unsigned int page_size = options.page_size;
+    const unsigned int padding = options.padding;
+    out_atlas.page_size = page_size;
+
+    // Level N texels average 2^N x 2^N aligned blocks, so they stay inside a
+    // cell while 2^N <= alignment, and bilinear taps at level N reach 2^N
+    // texels past the image, which the padding has to cover.
+    const unsigned int safe_levels = std::min(log2Floor(options.alignment), padding ? log2Floor(padding) : 0) + 1;
+    out_atlas.levels = std::min(safe_levels, mipLevelCount(page_size, page_size));
+
+    std::vector<size_t> order(images.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const Image &image = *images[i];
+        int channel_order[4];
+        if (image.pixels.empty() || !channelOrder(image.format, channel_order))
+        {
+            printf("Atlas image %u is empty or not 8-bit RGB(A)\n", (unsigned int)i);
+            return false;
+        }
+        if (roundUp(image.width + 2 * padding, options.alignment) > page_size ||
+            roundUp(image.height + 2 * padding, options.alignment) > page_size)
+        {
+            printf("Atlas image %u (%u x %u) does not fit a %u page\n", (unsigned int)i, image.width, image.height, page_size);
+            return false;
+        }
+        order[i] = i;
+    }
+    ImageOrder taller_first = { &images };
+    std::stable_sort(order.begin(), order.end(), taller_first);
+
+    std::vector<Page> pages;
+    out_atlas.regions.resize(images.size());
+    for (size_t n = 0; n < order.size(); n++)
+    {
+        const Image &image = *images[order[n]];
+        const unsigned int cell_width = roundUp(image.width + 2 * padding, options.alignment);
+        const unsigned int cell_height = roundUp(image.height + 2 * padding, options.alignment);
+
+        // First page with room, else a new one.
+        unsigned int x = 0, y = 0;
+        size_t layer = 0;
+        while (layer < pages.size() && !findPosition(pages[layer], cell_width, cell_height, page_size, x, y))
+            layer++;
+        if (layer == pages.size())
+        {
+            Page page;
+            SkylineSegment ground = { 0, 0, page_size };
+            page.skyline.push_back(ground);
+            pages.push_back(page);
+
+            Image pixels;
+            pixels.width = page_size;
+            pixels.height = page_size;
+            pixels.pixels.resize((size_t)page_size * page_size * 4);
+            out_atlas.pages.push_back(pixels);
+
+            x = 0;
+            y = 0;
+        }
+        addToSkyline(pages[layer], x, y, cell_width, cell_height);
+        blitPadded(image, out_atlas.pages[layer], x, y, cell_width, cell_height, padding);
+
+        AtlasRegion &region = out_atlas.regions[order[n]];
+        region.layer = (unsigned int)layer;
+        region.x = x + padding;
+        region.y = y + padding;
+        region.width = image.width;
+        region.height = image.height;
+        region.uv_scale = vmath::vec2((float)image.width / page_size, (float)image.height / page_size);
+        region.uv_offset = vmath::vec2((float)region.x / page_size, (float)region.y / page_size);
+    }
+
+    for (size_t i = 0; i < out_atlas.pages.size(); i++)
+    {
+        Image &page = out_atlas.pages[i];
+        if (out_atlas.levels > 1)
+        {
+            generateMipmaps(page, MIP_FILTER_BOX);
+            page.mips.resize(out_atlas.levels - 1);
+        }
+    }
+    return true;
+}
+
+void remapAtlasUVs(Mesh &mesh, const AtlasRegion &region)
+{
+    for (size_t i = 0; i < mesh.uvs.size(); i++)
+    {
+        vmath::vec2 &uv = mesh.uvs[i];
+        uv = vmath::vec2(uv[0] * region.uv_scale[0] + region.uv_offset[0],
+                         uv[1] * region.uv_scale[1] + region.uv_offset[1]);
+    }
+}
+
+double atlasOccupancy(const TextureAtlas &atlas)
+{
+    if (atlas.pages.empty())
+        return 0.0;
+
+    double used = 0.0;
+    for (size_t i = 0; i < atlas.regions.size(); i++)
+        used += (double)atlas.regions[i].width * atlas.regions[i].height;
+    return used / ((double)atlas.page_size * atlas.page_size * atlas.pages.size());
+}
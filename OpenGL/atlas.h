@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <vmath.h>
+
+#include "image.h"
+#include "mesh.h"
+
+// Packs many small images into a few large pages, uploaded as the layers of
+// one GL_TEXTURE_2D_ARRAY (createAtlasTexture in texture.h), so objects with
+// different textures can share a single binding and be drawn together. Every
+// image keeps its own [0, 1] uv space through a scale and offset; either bake
+// that into the mesh with remapAtlasUVs or pass it per instance together
+// with the layer. Nothing here needs a GL context.
+//
+// Images are packed with a skyline bottom-left packer on cells aligned to
+// options.alignment and padded by repeating their edge texels, so bilinear
+// filtering and the first few mip levels never pick up a neighbour. The mip
+// chain is cut off where that would stop holding (see TextureAtlas::levels).
+// Atlas uvs cannot wrap: GL_REPEAT tiling needs the image alone in a layer,
+// which is what a page_size equal to the image size gives.
+
+struct AtlasOptions
+{
+    unsigned int page_size;     // Width and height of every page, a power of two
+    unsigned int padding;       // Edge texels repeated around each image
+    unsigned int alignment;     // Cells start and end on multiples of this, a power of two
+
+    AtlasOptions()
+        : page_size(2048),
+          padding(8),
+          alignment(16)
+    {
+    }
+};
+
+// Where one source image ended up.
+struct AtlasRegion
+{
+    unsigned int layer;             // Page, i.e. array layer
+    unsigned int x, y;              // Bottom-left texel of the image in its page, padding excluded
+    unsigned int width, height;
+    vmath::vec2 uv_scale;           // Atlas uv = source uv * uv_scale + uv_offset
+    vmath::vec2 uv_offset;
+};
+
+struct TextureAtlas
+{
+    unsigned int page_size;
+    unsigned int levels;            // Mip levels that stay free of bleeding, 1 = none
+    std::vector<Image> pages;       // GL_RGBA8 with mips, one per array layer
+    std::vector<AtlasRegion> regions;   // One per packed image, in input order
+
+    TextureAtlas() : page_size(0), levels(1) {}
+};
+
+// Packs the images into as few pages as the packer manages, taller images
+// first. Accepts 8-bit RGB(A) / BGR(A) images. Fails if an image plus its
+// padding does not fit into a page.
+bool packAtlas(const std::vector<const Image *> &images, TextureAtlas &out_atlas, const AtlasOptions &options = AtlasOptions());
+
+// Moves the mesh's uvs into the region. The layer still has to reach the
+// shader, as a uniform or per-instance attribute.
+void remapAtlasUVs(Mesh &mesh, const AtlasRegion &region);
+
+// Fraction of page texels covered by images, padding excluded.
+double atlasOccupancy(const TextureAtlas &atlas);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "gl_trace.h"
+
+// Where the host loop in OpenGL.cpp gets its GL context from: a GLFW window,
+// or a surfaceless EGL context rendering into an offscreen framebuffer for
+// machines without a display (headless render servers, CI). Scenes run the
+// same either way; they draw to whatever framebuffer is bound when onUpdate
+// is called and must not bind framebuffer 0 themselves.
+
+struct HeadlessOptions
+{
+    const char *capture_path;   // Binary PPM of the last frame, NULL = none
+
+    HeadlessOptions()
+        : capture_path(NULL)
+    {
+    }
+};
+
+class Backend
+{
+public:
+    virtual ~Backend() {}
+
+    // Creates a GL 3.3+ core context of the given size, makes it current
+    // and loads the GL entry points with GLEW. Prints why on failure.
+    virtual bool create(int width, int height, const char *title) = 0;
+
+    // False once the window was closed. Headless runs until the host stops.
+    virtual bool running() = 0;
+
+    // Whether presenting waits for vertical blank. On by default.
+    virtual void setVsync(bool enabled) = 0;
+
+    // Resizes the window or the offscreen framebuffer, for the next scene.
+    virtual void resize(int width, int height) = 0;
+
+    // Seconds since create, passed to onUpdate.
+    virtual double time() = 0;
+
+    // Presents the frame. May run on another thread than the rest, with the
+    // context current there (see makeCurrent).
+    virtual void present() = 0;
+
+    // Handles window events. The thread that called create.
+    virtual void pollEvents() = 0;
+
+    void endFrame()
+    {
+        present();
+        pollEvents();
+    }
+
+    // Makes the context current on the calling thread, or releases it from
+    // there, so a render thread can take it over. A context is current on
+    // one thread at a time.
+    virtual bool makeCurrent(bool current) = 0;
+
+    // Frees the context (and the window). The GL must not be used after.
+    virtual void destroy() = 0;
+};
+
+Backend *createWindowBackend();
+
+// Surfaceless EGL (Mesa's llvmpipe on machines without a GPU). Needs a
+// build with HAVE_EGL, linked against libEGL; otherwise returns NULL.
+Backend *createHeadlessBackend(const HeadlessOptions &options);
@@ -0,0 +1,297 @@
+#include "backend.h"
+
+#include <cstdio>
+
+#ifdef HAVE_EGL
+
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "camera.h"
+#include "fileio.h"
+
+namespace
+{
+
+bool hasClientExtension(const char *name)
+{
+    const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    return extensions && strstr(extensions, name) != NULL;
+}
+
+// Mesa's surfaceless platform first: it needs neither a display server nor
+// a GPU and falls back to llvmpipe. Then the first EGL device, then
+// whatever the default display is.
+EGLDisplay openDisplay()
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+    if (getPlatformDisplay && hasClientExtension("EGL_MESA_platform_surfaceless"))
+    {
+        EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display != EGL_NO_DISPLAY)
+            return display;
+    }
+
+    PFNEGLQUERYDEVICESEXTPROC queryDevices = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+    if (getPlatformDisplay && queryDevices && hasClientExtension("EGL_EXT_platform_device"))
+    {
+        EGLDeviceEXT device;
+        EGLint count = 0;
+        if (queryDevices(1, &device, &count) && count > 0)
+        {
+            EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, device, NULL);
+            if (display != EGL_NO_DISPLAY)
+                return display;
+        }
+    }
+
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+class HeadlessBackend : public Backend
+{
+public:
+    explicit HeadlessBackend(const HeadlessOptions &options)
+        : options_(options),
+          display_(EGL_NO_DISPLAY),
+          context_(EGL_NO_CONTEXT),
+          framebuffer_(0),
+          width_(0),
+          height_(0),
+          frame_(0)
+    {
+        renderbuffers_[0] = renderbuffers_[1] = 0;
+    }
+
+    bool create(int width, int height, const char *title)
+    {
+        (void)title;
+        width_ = width;
+        height_ = height;
+
+        display_ = openDisplay();
+        EGLint major, minor;
+        if (display_ == EGL_NO_DISPLAY || !eglInitialize(display_, &major, &minor))
+        {
+            printf("EGL display could not be initialized (0x%x)\n", eglGetError());
+            return false;
+        }
+
+        const char *extensions = eglQueryString(display_, EGL_EXTENSIONS);
+        if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context") ||
+            !strstr(extensions, "EGL_KHR_create_context"))
+        {
+            printf("EGL %d.%d lacks surfaceless contexts\n", major, minor);
+            destroy();
+            return false;
+        }
+
+        const EGLint config_attribs[] =
+        {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_NONE
+        };
+        EGLConfig config = NULL;
+        EGLint config_count = 0;
+        if (!eglBindAPI(EGL_OPENGL_API) ||
+            !eglChooseConfig(display_, config_attribs, &config, 1, &config_count) || config_count == 0)
+        {
+            printf("EGL has no desktop GL config (0x%x)\n", eglGetError());
+            destroy();
+            return false;
+        }
+
+        // Same request as the window: 3.3 core. Mesa hands out the highest
+        // core version it has.
+        const EGLint context_attribs[] =
+        {
+            EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+            EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+            EGL_CONTEXT_FLAGS_KHR, EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE_BIT_KHR,
+            EGL_NONE
+        };
+        context_ = eglCreateContext(display_, config, EGL_NO_CONTEXT, context_attribs);
+        if (context_ == EGL_NO_CONTEXT || !eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, context_))
+        {
+            printf("EGL context could not be created (0x%x)\n", eglGetError());
+            destroy();
+            return false;
+        }
+
+        // A GLEW built for GLX loads every entry point and then gives up on
+        // the missing X display; the GL itself is usable.
+        glewExperimental = GL_TRUE;
+        const GLenum err = glewInit();
+        if (err != GLEW_OK && err != GLEW_ERROR_NO_GLX_DISPLAY)
+        {
+            printf("GLEW initialize failure %s\n", (const char *)glewGetErrorString(err));
+            destroy();
+            return false;
+        }
+
+        // Stands in for the window's default framebuffer.
+        glGenRenderbuffers(2, renderbuffers_);
+        allocateRenderbuffers();
+
+        glGenFramebuffers(1, &framebuffer_);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers_[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers_[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            printf("Offscreen framebuffer of %d x %d is incomplete\n", width, height);
+            destroy();
+            return false;
+        }
+
+        printf("Headless: %s, %s\n", (const char *)glGetString(GL_RENDERER), (const char *)glGetString(GL_VERSION));
+        start_ = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    bool running()
+    {
+        return true;
+    }
+
+    // Nothing is presented, so there is nothing to wait for.
+    void setVsync(bool enabled)
+    {
+        (void)enabled;
+    }
+
+    void resize(int width, int height)
+    {
+        width_ = width;
+        height_ = height;
+        allocateRenderbuffers();
+    }
+
+    double time()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+    void present()
+    {
+        frame_++;
+        glFlush();
+    }
+
+    void pollEvents()
+    {
+    }
+
+    bool makeCurrent(bool current)
+    {
+        if (!eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, current ? context_ : EGL_NO_CONTEXT))
+        {
+            printf("EGL context could not be made current (0x%x)\n", eglGetError());
+            return false;
+        }
+        return true;
+    }
+
+    void destroy()
+    {
+        if (frame_)
+        {
+            if (options_.capture_path)
+                capture(options_.capture_path);
+            glFinish();
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+            printf("Headless: %u frames in %.2f s (%.2f ms per frame)\n", frame_, seconds, seconds * 1000.0 / frame_);
+        }
+
+        if (framebuffer_)
+        {
+            glDeleteFramebuffers(1, &framebuffer_);
+            glDeleteRenderbuffers(2, renderbuffers_);
+            framebuffer_ = 0;
+        }
+        if (context_ != EGL_NO_CONTEXT)
+        {
+            eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(display_, context_);
+            context_ = EGL_NO_CONTEXT;
+        }
+        if (display_ != EGL_NO_DISPLAY)
+        {
+            eglTerminate(display_);
+            display_ = EGL_NO_DISPLAY;
+        }
+    }
+
+private:
+    // Attachments keep their names, so the framebuffer stays complete.
+    void allocateRenderbuffers()
+    {
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers_[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width_, height_);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers_[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width_, height_);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        setFramebufferSize(width_, height_);
+    }
+
+    // Writes the offscreen color buffer as a binary PPM, top row first.
+    void capture(const char *path)
+    {
+        const size_t row = (size_t)width_ * 3;
+        std::vector<unsigned char> pixels(row * height_);
+
+        GLint read_framebuffer = 0;
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_framebuffer);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer_);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width_, height_, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer);
+
+        FILE *file = openFile(path, "wb");
+        if (!file)
+        {
+            printf("%s could not be written\n", path);
+            return;
+        }
+        fprintf(file, "P6\n%d %d\n255\n", width_, height_);
+        for (int y = height_ - 1; y >= 0; y--)
+            fwrite(&pixels[y * row], 1, row, file);
+        fclose(file);
+    }
+
+    HeadlessOptions options_;
+    EGLDisplay display_;
+    EGLContext context_;
+    GLuint framebuffer_;
+    GLuint renderbuffers_[2];   // Color, depth-stencil
+    int width_;
+    int height_;
+    unsigned int frame_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace
+
+Backend *createHeadlessBackend(const HeadlessOptions &options)
+{
+    return new HeadlessBackend(options);
+}
+
+#else
+
+Backend *createHeadlessBackend(const HeadlessOptions &options)
+{
+    (void)options;
+    printf("--headless needs a build with HAVE_EGL\n");
+    return NULL;
+}
+
+#endif
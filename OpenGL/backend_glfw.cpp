@@ -0,0 +1,137 @@
+#include "backend.h"
+
+#include <GLFW/glfw3.h>
+#include <iostream>
+
+#include "camera.h"
+#include "frame_timer.h"
+
+namespace
+{
+
+void showGlfwError(int error, const char *description)
+{
+    std::cerr << "Error: " << description << '\n';
+}
+
+// In pixels, which on high-DPI displays is not the window size. The next
+// frame picks the new size up (updateCamera); drawing here would race the
+// render thread and show a blank frame.
+void framebufferResized(GLFWwindow *window, int width, int height)
+{
+    (void)window;
+    std::cout << "Framebuffer resized: " << width << " x " << height << '\n';
+    setFramebufferSize(width, height);
+}
+
+void keyPressed(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+    // Leaves the loop, so the scene and the loader shut down properly.
+    if (key == 'Q' && action == GLFW_PRESS)
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
+    if (key == 'T' && action == GLFW_PRESS)
+        requestFrameTimingReport();
+}
+
+class WindowBackend : public Backend
+{
+public:
+    WindowBackend() : window_(NULL) {}
+
+    bool create(int width, int height, const char *title)
+    {
+        glfwSetErrorCallback(showGlfwError);
+
+        if (!glfwInit())
+        {
+            std::cerr << "GLFW initialize failure" << '\n';
+            return false;
+        }
+
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+
+        window_ = glfwCreateWindow(width, height, title, NULL, NULL);
+        if (!window_)
+        {
+            std::cerr << "Window create failure" << '\n';
+            glfwTerminate();
+            return false;
+        }
+
+        glfwMakeContextCurrent(window_);
+        int framebuffer_width = 0;
+        int framebuffer_height = 0;
+        glfwGetFramebufferSize(window_, &framebuffer_width, &framebuffer_height);
+        setFramebufferSize(framebuffer_width, framebuffer_height);
+        glfwSetFramebufferSizeCallback(window_, framebufferResized);
+        glfwSetKeyCallback(window_, keyPressed);
+        glfwSwapInterval(1);
+        glewExperimental = GL_TRUE;
+
+        const GLenum err = glewInit();
+        if (err != GLEW_OK)
+        {
+            std::cerr << "GLEW initialize failure " << glewGetErrorString(err) << '\n';
+            destroy();
+            return false;
+        }
+        return true;
+    }
+
+    bool running()
+    {
+        return !glfwWindowShouldClose(window_);
+    }
+
+    void setVsync(bool enabled)
+    {
+        glfwSwapInterval(enabled ? 1 : 0);
+    }
+
+    void resize(int width, int height)
+    {
+        glfwSetWindowSize(window_, width, height);
+    }
+
+    double time()
+    {
+        return glfwGetTime();
+    }
+
+    void present()
+    {
+        glfwSwapBuffers(window_);
+    }
+
+    void pollEvents()
+    {
+        glfwPollEvents();
+    }
+
+    bool makeCurrent(bool current)
+    {
+        glfwMakeContextCurrent(current ? window_ : NULL);
+        return true;
+    }
+
+    void destroy()
+    {
+        if (window_)
+            glfwDestroyWindow(window_);
+        window_ = NULL;
+        glfwTerminate();
+    }
+
+private:
+    GLFWwindow *window_;
+};
+
+} // namespace
+
+Backend *createWindowBackend()
+{
+    return new WindowBackend;
+}
@@ -0,0 +1,331 @@
+// Texture binding benchmark. A grid of cubes, each showing one of many small
+// generated textures, is drawn two ways: one glBindTexture + glDraw call per
+// cube, and with every texture packed into an array texture atlas (atlas.h)
+// and the whole grid in one instanced draw, the layer and uv transform
+// coming from a per-instance attribute. Prints the average CPU submit time
+// and GPU time (GL_TIME_ELAPSED) per frame of both.
+
+#include "OpenGL.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+#include <vmath.h>
+
+#include "atlas.h"
+#include "bench_modes.h"
+#include "mesh.h"
+#include "camera.h"
+#include "gl_state.h"
+#include "scene.h"
+#include "texture.h"
+
+namespace
+{
+
+const char *const mode_names[] = { "bind_per_object", "atlas_instanced" };
+const int MODE_COUNT = 2;
+const int GRID_SIZE = 64;       // Cubes per side
+const int CUBE_COUNT = GRID_SIZE * GRID_SIZE;
+const int TEXTURE_COUNT = 256;
+const float SPACING = 3.0f;
+
+// Per-instance attributes. The per-object mode reads the same buffer through
+// the base instance and ignores the atlas fields.
+struct CubeInstance
+{
+    GLfloat offset[3];
+    GLfloat layer;
+    GLfloat uv_scale[2];
+    GLfloat uv_offset[2];
+};
+
+GLuint programs[MODE_COUNT];
+GLint mv_locations[MODE_COUNT];
+GLuint vao;
+GLuint buffers[4];              // positions, uvs, indices, instances
+GLsizei index_count;
+GLuint textures[TEXTURE_COUNT];
+GLuint atlas_texture;
+bool ready;                     // False if the cube or the atlas could not be made
+BenchmarkModes modes(MODE_COUNT);
+
+int getWindowWidth()
+{
+    return 1280;
+}
+
+int getWindowHeight()
+{
+    return 720;
+}
+
+// Two-colour checkerboard whose size and colours depend on the index.
+void makeTexture(int index, Image &out_image)
+{
+    static const unsigned int sizes[] = { 16, 24, 32, 48, 64, 96, 128 };
+    out_image.width = sizes[index % 7];
+    out_image.height = sizes[(index / 7) % 7];
+    out_image.pixels.resize((size_t)out_image.width * out_image.height * 4);
+
+    const unsigned char a[3] = { (unsigned char)(index * 37), (unsigned char)(index * 91), (unsigned char)(255 - index) };
+    const unsigned int checker = 4 + index % 5;
+    unsigned char *pixel = &out_image.pixels[0];
+    for (unsigned int y = 0; y < out_image.height; y++)
+    {
+        for (unsigned int x = 0; x < out_image.width; x++, pixel += 4)
+        {
+            const bool dark = ((x / checker) ^ (y / checker)) & 1;
+            pixel[0] = dark ? a[0] / 4 : a[0];
+            pixel[1] = dark ? a[1] / 4 : a[1];
+            pixel[2] = dark ? a[2] / 4 : a[2];
+            pixel[3] = 255;
+        }
+    }
+}
+
+GLuint createProgram(const char *fs_body)
+{
+    static const char *vs_source[] =
+    {
+        "#version 420 core                                                  \n",
+        CAMERA_GLSL,
+        "                                                                   \n"
+        "layout(location = 0) in vec3 position;                             \n"
+        "layout(location = 1) in vec2 uv;                                   \n"
+        "layout(location = 2) in vec4 instance_offset;  // xyz, layer       \n"
+        "layout(location = 3) in vec4 instance_uv;      // scale, offset    \n"
+        "                                                                   \n"
+        "out vec2 fragmentUV;                                               \n"
+        "out vec3 atlasUV;                                                  \n"
+        "                                                                   \n"
+        "uniform mat4 mv_matrix;                                            \n"
+        "                                                                   \n"
+        "void main(void)                                                    \n"
+        "{                                                                  \n"
+        "    gl_Position = proj_matrix * mv_matrix * vec4(position + instance_offset.xyz, 1); \n"
+        "    fragmentUV = uv;                                               \n"
+        "    atlasUV = vec3(uv * instance_uv.xy + instance_uv.zw, instance_offset.w); \n"
+        "}                                                                  \n"
+    };
+
+    const char *fs_source[] =
+    {
+        "#version 420 core                                                  \n"
+        "                                                                   \n"
+        "out vec3 color;                                                    \n"
+        "                                                                   \n"
+        "in vec2 fragmentUV;                                                \n"
+        "in vec3 atlasUV;                                                   \n"
+        "                                                                   \n",
+        fs_body
+    };
+
+    GLuint program = glCreateProgram();
+    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fs, 2, fs_source, NULL);
+    glCompileShader(fs);
+    CheckShaderCompileError(fs);
+
+    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vs, 3, vs_source, NULL);
+    glCompileShader(vs);
+    CheckShaderCompileError(vs);
+
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+
+    glLinkProgram(program);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    return program;
+}
+
+void onAwake()
+{
+    CameraLens lens;
+    lens.fov = 60.0f;
+    lens.near_plane = 1.0f;
+    setCameraLens(lens);
+
+    // What is not made stays 0 for onShutdown, if loading fails part way.
+    ready = false;
+    vao = 0;
+    atlas_texture = 0;
+    for (int i = 0; i < 4; i++)
+        buffers[i] = 0;
+    for (int i = 0; i < TEXTURE_COUNT; i++)
+        textures[i] = 0;
+
+    programs[0] = createProgram(
+        "uniform sampler2D texSampler;                                      \n"
+        "                                                                   \n"
+        "void main(void)                                                    \n"
+        "{                                                                  \n"
+        "    color = texture(texSampler, fragmentUV).rgb;                   \n"
+        "}                                                                  \n");
+    programs[1] = createProgram(
+        "uniform sampler2DArray texSampler;                                 \n"
+        "                                                                   \n"
+        "void main(void)                                                    \n"
+        "{                                                                  \n"
+        "    color = texture(texSampler, atlasUV).rgb;                      \n"
+        "}                                                                  \n");
+    for (int i = 0; i < MODE_COUNT; i++)
+    {
+        glUseProgram(programs[i]);
+        mv_locations[i] = glGetUniformLocation(programs[i], "mv_matrix");
+        glUniform1i(glGetUniformLocation(programs[i], "texSampler"), 0);
+    }
+
+    Mesh cube;
+    MeshLoadOptions mesh_options;
+    mesh_options.attribs = MESH_POSITION | MESH_UV;
+    if (!loadOBJ("cube.obj", cube, mesh_options))
+    {
+        printf("BENCH_ATLAS: cube.obj could not be loaded, nothing will be drawn\n");
+        return;
+    }
+    index_count = (GLsizei)cube.indices.size();
+
+    // The same images as separate textures and as one atlas.
+    std::vector<Image> images(TEXTURE_COUNT);
+    std::vector<const Image *> image_pointers(TEXTURE_COUNT);
+    for (int i = 0; i < TEXTURE_COUNT; i++)
+    {
+        makeTexture(i, images[i]);
+        image_pointers[i] = &images[i];
+        textures[i] = createTexture(images[i]);
+    }
+
+    TextureAtlas atlas;
+    if (!packAtlas(image_pointers, atlas))
+    {
+        printf("BENCH_ATLAS: the textures could not be packed, nothing will be drawn\n");
+        return;
+    }
+    atlas_texture = createAtlasTexture(atlas);
+    printf("atlas: %u images in %u layers of %u x %u, %u levels, %.0f%% occupied\n",
+           TEXTURE_COUNT, (unsigned int)atlas.pages.size(), atlas.page_size, atlas.page_size,
+           atlas.levels, atlasOccupancy(atlas) * 100.0);
+
+    std::vector<CubeInstance> instances(CUBE_COUNT);
+    for (int i = 0; i < CUBE_COUNT; i++)
+    {
+        CubeInstance &instance = instances[i];
+        instance.offset[0] = ((i % GRID_SIZE) - GRID_SIZE * 0.5f) * SPACING;
+        instance.offset[1] = 0.0f;
+        instance.offset[2] = ((i / GRID_SIZE) - GRID_SIZE * 0.5f) * SPACING;
+
+        const AtlasRegion &region = atlas.regions[i % TEXTURE_COUNT];
+        instance.layer = (GLfloat)region.layer;
+        instance.uv_scale[0] = region.uv_scale[0];
+        instance.uv_scale[1] = region.uv_scale[1];
+        instance.uv_offset[0] = region.uv_offset[0];
+        instance.uv_offset[1] = region.uv_offset[1];
+    }
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(4, buffers);
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, cube.positions.size() * sizeof(vmath::vec3), &cube.positions[0], GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+    glBufferData(GL_ARRAY_BUFFER, cube.uvs.size() * sizeof(vmath::vec2), &cube.uvs[0], GL_STATIC_DRAW);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(1);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, cube.indices.size() * sizeof(unsigned int), &cube.indices[0], GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[3]);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(CubeInstance), &instances[0], GL_STATIC_DRAW);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), (const void *)offsetof(CubeInstance, offset));
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(CubeInstance), (const void *)offsetof(CubeInstance, uv_scale));
+    glEnableVertexAttribArray(2);
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(2, 1);
+    glVertexAttribDivisor(3, 1);
+
+    glActiveTexture(GL_TEXTURE0);
+    modes.create();
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    ready = true;
+}
+
+void onUpdate(double current_time)
+{
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (!ready)
+        return;
+
+    modes.beginFrame();
+    if (modes.reportDue())
+    {
+        printf("%-20s %10s %10s %10s\n", "mode", "cpu_ms", "gpu_ms", "draws");
+        for (int i = 0; i < MODE_COUNT; i++)
+        {
+            printf("%-20s %10.3f %10.3f %10d\n", mode_names[i],
+                   modes.cpuMilliseconds(i), modes.gpuMilliseconds(i), i == 0 ? CUBE_COUNT : 1);
+        }
+        if (modes.droppedQueries())
+            printf("%u query results did not come back in time\n", modes.droppedQueries());
+    }
+    const int mode = modes.mode();
+
+    // Looking down on the grid at an angle, slowly turning.
+    const vmath::mat4 mv_matrix = vmath::translate(0.0f, 0.0f, -150.0f) *
+        vmath::rotate(50.0f, 1.0f, 0.0f, 0.0f) *
+        vmath::rotate((float)current_time * 5.0f, 0.0f, 1.0f, 0.0f);
+
+    modes.beginGPU();
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    cachedUseProgram(programs[mode]);
+    cachedUniformMatrix4(mv_locations[mode], mv_matrix);
+    cachedBindVertexArray(vao);
+    if (mode == 0)
+    {
+        for (int i = 0; i < CUBE_COUNT; i++)
+        {
+            cachedBindTexture(0, GL_TEXTURE_2D, textures[i % TEXTURE_COUNT]);
+            glDrawElementsInstancedBaseInstance(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0, 1, i);
+        }
+    }
+    else
+    {
+        cachedBindTexture(0, GL_TEXTURE_2D_ARRAY, atlas_texture);
+        glDrawElementsInstanced(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0, CUBE_COUNT);
+    }
+
+    modes.addCPUSeconds(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    modes.endGPU();
+
+    modes.endFrame();
+}
+
+void onShutdown()
+{
+    modes.destroy();
+    glDeleteTextures(TEXTURE_COUNT, textures);
+    glDeleteTextures(1, &atlas_texture);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(4, buffers);
+    glDeleteProgram(programs[0]);
+    glDeleteProgram(programs[1]);
+}
+
+const Scene bench_atlas_scene =
+{
+    "BENCH_ATLAS", "Per-object binds against an instanced texture atlas",
+    getWindowWidth(), getWindowHeight(), onAwake, onUpdate, onShutdown, NULL, NULL, NULL
+};
+const bool bench_atlas_registered = registerScene(bench_atlas_scene);
+
+} // namespace
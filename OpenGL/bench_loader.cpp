@@ -0,0 +1,472 @@
+// Mesh loader throughput benchmark. Select it with #define BENCH_LOADER in
+// OpenGL.h, or build it on its own; it needs no window or GL context:
+//
+//   g++ -O2 -std=c++14 -DBENCH_LOADER -Iinclude bench_loader.cpp mesh.cpp fileio.cpp jobs.cpp -pthread -o bench_loader
+//
+// Writes deterministic synthetic OBJ files into a temp directory, times every
+// loader mode on each of them and prints the results as JSON on stdout.
+//
+//   bench_loader [--max-triangles N] [--repeat N] [--dir PATH] [--keep]
+
+#include "OpenGL.h"
+
+#ifdef BENCH_LOADER
+
+#include "mesh.h"
+#include "fileio.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+
+enum FaceFormat
+{
+    FACE_V,
+    FACE_V_VT,
+    FACE_V_VN,
+    FACE_V_VT_VN,
+    FACE_QUAD_V_VT_VN
+};
+
+const char *face_format_names[] = { "v", "v/vt", "v//vn", "v/vt/vn", "quad v/vt/vn" };
+
+const unsigned long long corpus_sizes[] = { 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 50000000ull };
+
+const MeshLoadMode modes[] = { MESH_LOAD_STDIO, MESH_LOAD_MMAP, MESH_LOAD_PARALLEL, MESH_LOAD_CACHE };
+const char *mode_names[] = { "stdio", "mmap", "parallel", "cache" };
+
+// Small buffered writer; fprintf is far too slow for the larger files.
+class ObjWriter
+{
+public:
+    explicit ObjWriter(FILE *file) : file_(file), used_(0), buffer_(1 << 20) {}
+    ~ObjWriter() { flush(); }
+
+    void text(const char *s)
+    {
+        while (*s)
+            put(*s++);
+    }
+
+    void integer(unsigned long long value)
+    {
+        char digits[24];
+        int n = 0;
+        do
+        {
+            digits[n++] = (char)('0' + value % 10);
+            value /= 10;
+        } while (value);
+        while (n)
+            put(digits[--n]);
+    }
+
+    // Fixed point with six decimals, like %f.
+    void real(float value)
+    {
+        if (value < 0.0f)
+        {
+            put('-');
+            value = -value;
+        }
+        const unsigned long long scaled = (unsigned long long)(value * 1000000.0 + 0.5);
+        integer(scaled / 1000000);
+        put('.');
+        const unsigned long long fraction = scaled % 1000000;
+        for (unsigned long long d = 100000; d; d /= 10)
+            put((char)('0' + fraction / d % 10));
+    }
+
+    void put(char c)
+    {
+        if (used_ == buffer_.size())
+            flush();
+        buffer_[used_++] = c;
+    }
+
+    void flush()
+    {
+        fwrite(&buffer_[0], 1, used_, file_);
+        used_ = 0;
+    }
+
+private:
+    FILE *file_;
+    size_t used_;
+    std::vector<char> buffer_;
+};
+
+// Deterministic height field noise.
+float noise(unsigned int i, unsigned int j)
+{
+    unsigned int h = i * 374761393u + j * 668265263u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return (float)((h ^ (h >> 16)) & 0xffff) / 65535.0f * 0.05f;
+}
+
+void writeCorner(ObjWriter &out, FaceFormat format, unsigned long long index)
+{
+    out.put(' ');
+    out.integer(index);
+    if (format == FACE_V)
+        return;
+    out.put('/');
+    if (format != FACE_V_VN)
+        out.integer(index);
+    if (format == FACE_V_VT)
+        return;
+    out.put('/');
+    out.integer(index);
+}
+
+// A (side + 1)^2 vertex grid with 2 * side^2 triangles.
+bool writeSyntheticOBJ(const char *path, unsigned long long triangles, FaceFormat format)
+{
+    FILE *file = openFile(path, "wb");
+    if (!file)
+        return false;
+
+    unsigned int side = 1;
+    while (2ull * side * side < triangles)
+        side++;
+    const unsigned int stride = side + 1;
+
+    {
+        ObjWriter out(file);
+        out.text("# bench_loader synthetic grid\n");
+        for (unsigned int j = 0; j <= side; j++)
+        {
+            for (unsigned int i = 0; i <= side; i++)
+            {
+                out.text("v ");
+                out.real((float)i / side);
+                out.put(' ');
+                out.real(noise(i, j));
+                out.put(' ');
+                out.real((float)j / side);
+                out.put('\n');
+            }
+        }
+        if (format != FACE_V && format != FACE_V_VN)
+        {
+            for (unsigned int j = 0; j <= side; j++)
+            {
+                for (unsigned int i = 0; i <= side; i++)
+                {
+                    out.text("vt ");
+                    out.real((float)i / side);
+                    out.put(' ');
+                    out.real((float)j / side);
+                    out.put('\n');
+                }
+            }
+        }
+        if (format != FACE_V && format != FACE_V_VT)
+        {
+            for (unsigned int j = 0; j <= side; j++)
+            {
+                for (unsigned int i = 0; i <= side; i++)
+                {
+                    out.text("vn ");
+                    out.real(noise(j, i));
+                    out.text(" 1.000000 ");
+                    out.real(noise(i + 7, j));
+                    out.put('\n');
+                }
+            }
+        }
+
+        const FaceFormat corner_format = format == FACE_QUAD_V_VT_VN ? FACE_V_VT_VN : format;
+        for (unsigned int j = 0; j < side; j++)
+        {
+            for (unsigned int i = 0; i < side; i++)
+            {
+                const unsigned long long a = (unsigned long long)j * stride + i + 1;
+                const unsigned long long b = a + 1;
+                const unsigned long long c = a + stride + 1;
+                const unsigned long long d = a + stride;
+                if (format == FACE_QUAD_V_VT_VN)
+                {
+                    out.put('f');
+                    writeCorner(out, corner_format, a);
+                    writeCorner(out, corner_format, d);
+                    writeCorner(out, corner_format, c);
+                    writeCorner(out, corner_format, b);
+                    out.put('\n');
+                }
+                else
+                {
+                    out.put('f');
+                    writeCorner(out, corner_format, a);
+                    writeCorner(out, corner_format, d);
+                    writeCorner(out, corner_format, b);
+                    out.text("\nf");
+                    writeCorner(out, corner_format, b);
+                    writeCorner(out, corner_format, d);
+                    writeCorner(out, corner_format, c);
+                    out.put('\n');
+                }
+            }
+        }
+    }
+
+    const bool ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
+
+std::string tempDirectory()
+{
+#ifdef _WIN32
+    char path[MAX_PATH + 1];
+    const DWORD length = GetTempPathA(sizeof(path), path);
+    if (length > 0 && length < sizeof(path))
+        return std::string(path, length);
+    return ".\\";
+#else
+    const char *dir = getenv("TMPDIR");
+    std::string result = dir && *dir ? dir : "/tmp";
+    if (result[result.size() - 1] != '/')
+        result += '/';
+    return result;
+#endif
+}
+
+bool isDirectory(const std::string &path)
+{
+#ifdef _WIN32
+    const DWORD attributes = GetFileAttributesA(path.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+// Linux lets us reset the high-water mark so every run reports its own peak;
+// elsewhere the number is the peak of the whole process so far.
+void resetPeakRss()
+{
+#ifdef __linux__
+    FILE *file = fopen("/proc/self/clear_refs", "w");
+    if (file)
+    {
+        fputs("5", file);
+        fclose(file);
+    }
+#endif
+}
+
+unsigned long long peakRssKb()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize / 1024;
+    return 0;
+#else
+#ifdef __linux__
+    FILE *file = fopen("/proc/self/status", "r");
+    if (file)
+    {
+        char line[256];
+        unsigned long long kb = 0;
+        while (fgets(line, sizeof(line), file))
+        {
+            if (strncmp(line, "VmHWM:", 6) == 0)
+            {
+                kb = strtoull(line + 6, NULL, 10);
+                break;
+            }
+        }
+        fclose(file);
+        if (kb)
+            return kb;
+    }
+#endif
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (unsigned long long)usage.ru_maxrss;
+#endif
+}
+
+// Pulls the file into the page cache so every mode starts equally warm.
+void warmPageCache(const char *path)
+{
+    MappedFile file;
+    if (!file.open(path))
+        return;
+    volatile char sink = 0;
+    for (size_t i = 0; i < file.size(); i += 4096)
+        sink ^= file.data()[i];
+    (void)sink;
+}
+
+struct RunResult
+{
+    double seconds;
+    unsigned long long peak_rss_kb;
+    size_t triangles;
+    bool ok;
+};
+
+RunResult timeLoad(const char *path, MeshLoadMode mode, int repeat)
+{
+    RunResult result;
+    result.seconds = 1e30;
+    result.peak_rss_kb = 0;
+    result.triangles = 0;
+    result.ok = true;
+
+    MeshLoadOptions options;
+    options.attribs = MESH_POSITION | MESH_UV | MESH_NORMAL;
+    options.mode = mode;
+
+    for (int r = 0; r < repeat; r++)
+    {
+        resetPeakRss();
+        Mesh mesh;
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        result.ok = loadOBJ(path, mesh, options) && result.ok;
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        result.seconds = std::min(result.seconds, seconds);
+        result.peak_rss_kb = std::max(result.peak_rss_kb, peakRssKb());
+        result.triangles = mesh.indices.size() / 3;
+    }
+    return result;
+}
+
+void printRun(const char *mode, const RunResult &run, unsigned long long bytes, bool last)
+{
+    printf("        { \"mode\": \"%s\", \"ok\": %s, \"seconds\": %.6f, \"mb_per_s\": %.2f, "
+           "\"triangles_per_s\": %.0f, \"peak_rss_kb\": %llu }%s\n",
+           mode, run.ok ? "true" : "false", run.seconds,
+           bytes / (1024.0 * 1024.0) / run.seconds,
+           run.triangles / run.seconds,
+           run.peak_rss_kb, last ? "" : ",");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    unsigned long long max_triangles = 1000000;
+    int repeat = 3;
+    bool keep = false;
+    std::string dir = tempDirectory();
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--max-triangles") == 0 && i + 1 < argc)
+            max_triangles = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+            repeat = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc)
+        {
+            dir = argv[++i];
+            if (!dir.empty() && dir[dir.size() - 1] != '/' && dir[dir.size() - 1] != '\\')
+                dir += '/';
+        }
+        else if (strcmp(argv[i], "--keep") == 0)
+            keep = true;
+        else
+        {
+            fprintf(stderr, "usage: %s [--max-triangles N] [--repeat N] [--dir PATH] [--keep]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // Checked before anything is timed; the corpus files are written there.
+    if (!isDirectory(dir.empty() ? "." : dir))
+    {
+        fprintf(stderr, "directory %s does not exist\n", dir.c_str());
+        return 1;
+    }
+
+    // The parallel modes run on the job system, one thread per core.
+    initJobSystem();
+
+    bool first = true;
+    printf("{\n  \"repeat\": %d,\n  \"results\": [\n", repeat);
+
+    for (size_t s = 0; s < sizeof(corpus_sizes) / sizeof(corpus_sizes[0]); s++)
+    {
+        const unsigned long long triangles = corpus_sizes[s];
+        if (triangles > max_triangles)
+            break;
+
+        for (int f = FACE_V; f <= FACE_QUAD_V_VT_VN; f++)
+        {
+            char name[64];
+            snprintf(name, sizeof(name), "bench_loader_%llu_%d.obj", triangles, f);
+            const std::string path = dir + name;
+            const std::string cache_path = path + ".meshcache";
+
+            fprintf(stderr, "%llu triangles, %s ...\n", triangles, face_format_names[f]);
+            if (!writeSyntheticOBJ(path.c_str(), triangles, (FaceFormat)f))
+            {
+                fprintf(stderr, "could not write %s\n", path.c_str());
+                shutdownJobSystem();
+                return 1;
+            }
+
+            unsigned long long bytes = 0;
+            long long mtime = 0;
+            getFileStamp(path.c_str(), bytes, mtime);
+            warmPageCache(path.c_str());
+
+            printf("%s    {\n      \"triangles\": %llu,\n      \"format\": \"%s\",\n      \"bytes\": %llu,\n      \"runs\": [\n",
+                   first ? "" : ",\n", triangles, face_format_names[f], bytes);
+            first = false;
+
+            for (int m = 0; m < 4; m++)
+            {
+                if (modes[m] == MESH_LOAD_CACHE)
+                {
+                    // Cold: parse and write the cache. Warm: read it back.
+                    remove(cache_path.c_str());
+                    printRun("cache_cold", timeLoad(path.c_str(), MESH_LOAD_CACHE, 1), bytes, false);
+                    printRun("cache_warm", timeLoad(path.c_str(), MESH_LOAD_CACHE, repeat), bytes, true);
+                }
+                else
+                {
+                    printRun(mode_names[m], timeLoad(path.c_str(), modes[m], repeat), bytes, false);
+                }
+            }
+            printf("      ]\n    }");
+            fflush(stdout);
+
+            if (!keep)
+            {
+                remove(path.c_str());
+                remove(cache_path.c_str());
+            }
+        }
+    }
+
+    printf("\n  ]\n}\n");
+    shutdownJobSystem();
+    return 0;
+}
+
+#endif
@@ -0,0 +1,233 @@
+// Minified texture sampling benchmark. A ground plane tiled with
+// uvtemplate.bmp is seen at a grazing angle, so most pixels sample far below
+// level 0. The scene cycles through the sampling modes and prints the
+// average GPU time per frame of each (GL_TIME_ELAPSED), which tracks the
+// texture fetch bandwidth: without mips every fetch touches scattered
+// level 0 texels and misses the texture cache.
+
+#include "OpenGL.h"
+
+#include <cstdio>
+#include <vmath.h>
+
+#include "bench_modes.h"
+#include "camera.h"
+#include "gl_state.h"
+#include "scene.h"
+#include "texture.h"
+
+namespace
+{
+
+struct SamplingMode
+{
+    const char *name;
+    bool mipmaps;
+    float anisotropy;
+};
+
+const SamplingMode sampling_modes[] =
+{
+    { "level0_linear", false, 1.0f },
+    { "trilinear", true, 1.0f },
+    { "trilinear_aniso4", true, 4.0f },
+    { "trilinear_aniso16", true, 16.0f }
+};
+const int MODE_COUNT = sizeof(sampling_modes) / sizeof(sampling_modes[0]);
+const int LAYERS = 8;           // Full-screen draws per frame, so texture fetches dominate
+const float PLANE_SIZE = 1000.0f;
+const float TILES = 500.0f;
+
+GLuint program;
+GLuint vao;
+GLuint position_buffer;
+GLuint uv_buffer;
+GLint mv_location;
+GLint tex_location;
+GLuint textures[MODE_COUNT];
+BenchmarkModes modes(MODE_COUNT);
+
+int getWindowWidth()
+{
+    return 1280;
+}
+
+int getWindowHeight()
+{
+    return 720;
+}
+
+void onAwake()
+{
+    // Out to the horizon of the plane.
+    CameraLens lens;
+    lens.fov = 60.0f;
+    lens.far_plane = 2000.0f;
+    setCameraLens(lens);
+
+    static const char *vs_source[] =
+    {
+        "#version 420 core                                                  \n",
+        CAMERA_GLSL,
+        "                                                                   \n"
+        "layout(location = 0) in vec3 position;                             \n"
+        "layout(location = 1) in vec2 uv;                                   \n"
+        "                                                                   \n"
+        "out vec2 fragmentUV;                                               \n"
+        "                                                                   \n"
+        "uniform mat4 mv_matrix;                                            \n"
+        "                                                                   \n"
+        "void main(void)                                                    \n"
+        "{                                                                  \n"
+        "    gl_Position = proj_matrix * mv_matrix * vec4(position, 1);     \n"
+        "    fragmentUV = uv;                                               \n"
+        "}                                                                  \n"
+    };
+
+    static const char *fs_source[] =
+    {
+        "#version 420 core                                                  \n"
+        "                                                                   \n"
+        "out vec3 color;                                                    \n"
+        "                                                                   \n"
+        "in vec2 fragmentUV;                                                \n"
+        "                                                                   \n"
+        "uniform sampler2D texSampler;                                      \n"
+        "                                                                   \n"
+        "void main(void)                                                    \n"
+        "{                                                                  \n"
+        "    color = texture(texSampler, fragmentUV).rgb;                   \n"
+        "}                                                                  \n"
+    };
+
+    program = glCreateProgram();
+    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fs, 1, fs_source, NULL);
+    glCompileShader(fs);
+    CheckShaderCompileError(fs);
+
+    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vs, 3, vs_source, NULL);
+    glCompileShader(vs);
+    CheckShaderCompileError(vs);
+
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+
+    glLinkProgram(program);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    glUseProgram(program);
+
+    mv_location = glGetUniformLocation(program, "mv_matrix");
+    tex_location = glGetUniformLocation(program, "texSampler");
+
+    static const GLfloat plane_positions[] =
+    {
+        -PLANE_SIZE, 0.0f, -PLANE_SIZE,
+         PLANE_SIZE, 0.0f, -PLANE_SIZE,
+         PLANE_SIZE, 0.0f,  PLANE_SIZE,
+        -PLANE_SIZE, 0.0f, -PLANE_SIZE,
+         PLANE_SIZE, 0.0f,  PLANE_SIZE,
+        -PLANE_SIZE, 0.0f,  PLANE_SIZE
+    };
+
+    static const GLfloat plane_uvs[] =
+    {
+        0.0f, 0.0f,
+        TILES, 0.0f,
+        TILES, TILES,
+        0.0f, 0.0f,
+        TILES, TILES,
+        0.0f, TILES
+    };
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    glGenBuffers(1, &position_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, position_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(plane_positions), plane_positions, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(0);
+
+    glGenBuffers(1, &uv_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, uv_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(plane_uvs), plane_uvs, GL_STATIC_DRAW);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(1);
+
+    // One decode and CPU mip chain, shared by every mode.
+    Image image;
+    if (decodeBMP("./uvtemplate.bmp", image))
+        generateMipmaps(image);
+
+    for (int i = 0; i < MODE_COUNT; i++)
+    {
+        TextureOptions options;
+        options.mipmaps = sampling_modes[i].mipmaps;
+        options.anisotropy = sampling_modes[i].anisotropy;
+        textures[i] = image.pixels.empty() ? 0 : createTexture(image, options);
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(tex_location, 0);
+
+    modes.create();
+    glDisable(GL_DEPTH_TEST);
+}
+
+void onUpdate(double current_time)
+{
+    modes.beginFrame();
+    if (modes.reportDue())
+    {
+        printf("%-20s %10s %10s\n", "mode", "gpu_ms", "speedup");
+        const double base = modes.gpuMilliseconds(0);
+        for (int i = 0; i < MODE_COUNT; i++)
+        {
+            const double average = modes.gpuMilliseconds(i);
+            printf("%-20s %10.3f %10.2f\n", sampling_modes[i].name, average, average > 0.0 ? base / average : 0.0);
+        }
+        if (modes.droppedQueries())
+            printf("%u query results did not come back in time\n", modes.droppedQueries());
+    }
+    const int mode = modes.mode();
+
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    // Eye just above the plane, looking at the horizon and slowly turning.
+    const vmath::mat4 mv_matrix = vmath::rotate(8.0f, 1.0f, 0.0f, 0.0f) *
+        vmath::rotate((float)current_time * 5.0f, 0.0f, 1.0f, 0.0f) *
+        vmath::translate(0.0f, -1.5f, 0.0f);
+    cachedUseProgram(program);
+    cachedUniformMatrix4(mv_location, mv_matrix);
+    cachedBindTexture(0, GL_TEXTURE_2D, textures[mode]);
+    cachedBindVertexArray(vao);
+
+    modes.beginGPU();
+    for (int i = 0; i < LAYERS; i++)
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    modes.endGPU();
+
+    modes.endFrame();
+}
+
+void onShutdown()
+{
+    modes.destroy();
+    glDeleteTextures(MODE_COUNT, textures);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &position_buffer);
+    glDeleteBuffers(1, &uv_buffer);
+    glDeleteProgram(program);
+}
+
+const Scene bench_mip_scene =
+{
+    "BENCH_MIP", "Minified sampling benchmark",
+    getWindowWidth(), getWindowHeight(), onAwake, onUpdate, onShutdown, NULL, NULL, NULL
+};
+const bool bench_mip_registered = registerScene(bench_mip_scene);
+
+} // namespace
@@ -0,0 +1,138 @@
+#include "bench_modes.h"
+
+#include <algorithm>
+
+BenchmarkModes::BenchmarkModes(int mode_count, int frames_per_mode, int warmup_frames)
+    : mode_count_(std::min(mode_count, (int)MAX_MODES)),
+      frames_per_mode_(frames_per_mode),
+      warmup_frames_(std::min(warmup_frames, frames_per_mode)),
+      frame_(0),
+      reported_(false),
+      dropped_(0)
+{
+    for (int i = 0; i < QUERIES; i++)
+    {
+        slots_[i].query = 0;
+        slots_[i].mode = 0;
+        slots_[i].pending = false;
+    }
+}
+
+void BenchmarkModes::create()
+{
+    destroy();
+    for (int i = 0; i < QUERIES; i++)
+        glGenQueries(1, &slots_[i].query);
+
+    frame_ = 0;
+    reported_ = false;
+    dropped_ = 0;
+    for (int i = 0; i < MAX_MODES; i++)
+    {
+        gpu_seconds_[i] = cpu_seconds_[i] = 0.0;
+        gpu_samples_[i] = cpu_samples_[i] = 0;
+    }
+}
+
+void BenchmarkModes::destroy()
+{
+    for (int i = 0; i < QUERIES; i++)
+    {
+        if (slots_[i].query)
+            glDeleteQueries(1, &slots_[i].query);
+        slots_[i].query = 0;
+        slots_[i].pending = false;
+    }
+}
+
+bool BenchmarkModes::collect(Slot &slot)
+{
+    GLint available = 0;
+    glGetQueryObjectiv(slot.query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return false;
+
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(slot.query, GL_QUERY_RESULT, &elapsed);
+    gpu_seconds_[slot.mode] += elapsed * 1e-9;
+    gpu_samples_[slot.mode]++;
+    slot.pending = false;
+    return true;
+}
+
+void BenchmarkModes::beginFrame()
+{
+    for (int i = 0; i < QUERIES; i++)
+        if (slots_[i].pending)
+            collect(slots_[i]);
+}
+
+void BenchmarkModes::endFrame()
+{
+    frame_++;
+}
+
+int BenchmarkModes::mode() const
+{
+    return (frame_ / frames_per_mode_) % mode_count_;
+}
+
+bool BenchmarkModes::measured() const
+{
+    return frame_ % frames_per_mode_ >= warmup_frames_ && frame_ < frames_per_mode_ * mode_count_;
+}
+
+void BenchmarkModes::beginGPU()
+{
+    if (!measured())
+        return;
+
+    Slot &slot = slots_[frame_ % QUERIES];
+    if (slot.pending)
+    {
+        // Still not back after QUERIES frames.
+        slot.pending = false;
+        dropped_++;
+    }
+    slot.mode = mode();
+    glBeginQuery(GL_TIME_ELAPSED, slot.query);
+}
+
+void BenchmarkModes::endGPU()
+{
+    if (!measured())
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    slots_[frame_ % QUERIES].pending = true;
+}
+
+void BenchmarkModes::addCPUSeconds(double seconds)
+{
+    if (!measured())
+        return;
+
+    cpu_seconds_[mode()] += seconds;
+    cpu_samples_[mode()]++;
+}
+
+bool BenchmarkModes::reportDue()
+{
+    if (reported_ || frame_ < frames_per_mode_ * mode_count_)
+        return false;
+    for (int i = 0; i < QUERIES; i++)
+        if (slots_[i].pending)
+            return false;
+    reported_ = true;
+    return true;
+}
+
+double BenchmarkModes::gpuMilliseconds(int mode) const
+{
+    return gpu_samples_[mode] > 0 ? gpu_seconds_[mode] * 1000.0 / gpu_samples_[mode] : 0.0;
+}
+
+double BenchmarkModes::cpuMilliseconds(int mode) const
+{
+    return cpu_samples_[mode] > 0 ? cpu_seconds_[mode] * 1000.0 / cpu_samples_[mode] : 0.0;
+}
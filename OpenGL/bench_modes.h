@@ -0,0 +1,83 @@
+#pragma once
+
+#include "gl_trace.h"
+
+// Frame loop of the benchmark scenes that compare several ways of drawing
+// the same thing. Each mode runs for frames_per_mode frames, the first
+// warmup_frames of them not measured, then the next mode takes over. The
+// measured frames' draws are timed with GL_TIME_ELAPSED queries from a small
+// ring, read once GL_QUERY_RESULT_AVAILABLE says so, so the benchmark never
+// waits for the GPU it is measuring; a query still not back when its slot
+// comes round again is dropped and counted.
+//
+//     modes.beginFrame();
+//     modes.beginGPU();           // around the draws of modes.mode()
+//     ...draws...
+//     modes.endGPU();
+//     modes.endFrame();
+//     if (modes.reportDue())
+//         ...print modes.gpuMilliseconds(m) of every mode...
+//
+// Needs the GL context.
+
+class BenchmarkModes
+{
+public:
+    static const int QUERIES = 4;       // Frames in flight before a result is dropped
+
+    BenchmarkModes(int mode_count, int frames_per_mode = 300, int warmup_frames = 30);
+
+    // Creates the queries and starts over from the first mode.
+    void create();
+    void destroy();
+
+    // Collects the results that have come back.
+    void beginFrame();
+    void endFrame();
+
+    int mode() const;
+    bool measured() const;
+
+    // Around the measured draws; nothing on other frames.
+    void beginGPU();
+    void endGPU();
+
+    // CPU time spent submitting the frame, counted on measured frames only.
+    void addCPUSeconds(double seconds);
+
+    // True once, when every mode has been measured and its results are in.
+    bool reportDue();
+
+    // Averages per measured frame, 0 without samples.
+    double gpuMilliseconds(int mode) const;
+    double cpuMilliseconds(int mode) const;
+    unsigned int droppedQueries() const { return dropped_; }
+
+private:
+    BenchmarkModes(const BenchmarkModes &);
+    BenchmarkModes &operator=(const BenchmarkModes &);
+
+    static const int MAX_MODES = 8;
+
+    struct Slot
+    {
+        GLuint query;
+        int mode;
+        bool pending;
+    };
+
+    // Reads the slot's result if it is available. False if still pending.
+    bool collect(Slot &slot);
+
+    int mode_count_;
+    int frames_per_mode_;
+    int warmup_frames_;
+    int frame_;
+    bool reported_;
+    unsigned int dropped_;
+    Slot slots_[QUERIES];
+    double gpu_seconds_[MAX_MODES];
+    double cpu_seconds_[MAX_MODES];
+    int gpu_samples_[MAX_MODES];
+    int cpu_samples_[MAX_MODES];
+};
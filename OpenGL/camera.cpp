@@ -0,0 +1,120 @@
+#include "camera.h"
+
+#include <atomic>
+#include <cstring>
+#include <vmath.h>
+
+// Must match CAMERA_BINDING.
+const char *const CAMERA_GLSL =
+    "layout(std140, binding = 0) uniform Camera                         \n"
+    "{                                                                  \n"
+    "    mat4 proj_matrix;                                              \n"
+    "    vec2 viewport_size;                                            \n"
+    "};                                                                 \n";
+
+namespace
+{
+
+// std140 layout of the block.
+struct CameraBlock
+{
+    GLfloat proj_matrix[16];
+    GLfloat viewport_size[2];
+    GLfloat padding[2];
+};
+
+// Written by the event thread, read by the one with the context. The
+// generation is bumped after the size, so a reader that sees it change
+// reads the new size or a newer one, whose bump it catches next frame.
+std::atomic<int> framebuffer_width(0);
+std::atomic<int> framebuffer_height(0);
+std::atomic<unsigned int> framebuffer_generation(0);
+
+std::atomic<bool> lens_changed(true);
+CameraLens lens;
+
+GLuint camera_buffer;
+unsigned int applied_generation;
+CameraStats stats;
+
+} // namespace
+
+void setFramebufferSize(int width, int height)
+{
+    if (width == framebuffer_width.load(std::memory_order_relaxed) &&
+        height == framebuffer_height.load(std::memory_order_relaxed))
+        return;
+    framebuffer_width.store(width, std::memory_order_relaxed);
+    framebuffer_height.store(height, std::memory_order_relaxed);
+    framebuffer_generation.fetch_add(1, std::memory_order_release);
+}
+
+int framebufferWidth()
+{
+    return framebuffer_width.load(std::memory_order_relaxed);
+}
+
+int framebufferHeight()
+{
+    return framebuffer_height.load(std::memory_order_relaxed);
+}
+
+void initCamera()
+{
+    glGenBuffers(1, &camera_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, camera_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BINDING, camera_buffer);
+    lens_changed = true;
+    stats = CameraStats();
+}
+
+void shutdownCamera()
+{
+    glDeleteBuffers(1, &camera_buffer);
+    camera_buffer = 0;
+}
+
+void setCameraLens(const CameraLens &new_lens)
+{
+    lens = new_lens;
+    lens_changed.store(true, std::memory_order_release);
+}
+
+void updateCamera()
+{
+    stats.frames++;
+    const unsigned int generation = framebuffer_generation.load(std::memory_order_acquire);
+    const bool new_lens = lens_changed.exchange(false, std::memory_order_acquire);
+    if (generation == applied_generation && !new_lens)
+        return;
+
+    const int width = framebufferWidth();
+    const int height = framebufferHeight();
+    if (width <= 0 || height <= 0)
+    {
+        if (new_lens)
+            lens_changed = true;
+        return;
+    }
+    applied_generation = generation;
+
+    CameraBlock block = CameraBlock();
+    const vmath::mat4 proj_matrix = vmath::perspective(lens.fov, (float)width / (float)height,
+                                                       lens.near_plane, lens.far_plane);
+    memcpy(block.proj_matrix, (const GLfloat *)proj_matrix, sizeof(block.proj_matrix));
+    block.viewport_size[0] = (GLfloat)width;
+    block.viewport_size[1] = (GLfloat)height;
+
+    glViewport(0, 0, width, height);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BINDING, camera_buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    stats.updates++;
+}
+
+CameraStats cameraStats()
+{
+    return stats;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "gl_trace.h"
+
+// The viewport and projection every scene draws with. Backends report the
+// framebuffer size when it changes (a GLFW framebuffer-size event, or a
+// resize of the headless framebuffer); the scene sets its lens once in
+// onAwake. The host calls updateCamera before each frame, which only sets
+// the viewport and uploads the Camera uniform block when one of the two
+// changed since, so a frame that nothing resized costs nothing.
+
+// Uniform block binding point of the camera.
+const GLuint CAMERA_BINDING = 0;
+
+// Declares the Camera block: proj_matrix and viewport_size (in pixels).
+// Needs GLSL 4.20 for the binding; paste after the #version line.
+extern const char *const CAMERA_GLSL;
+
+struct CameraLens
+{
+    float fov;                  // Vertical, degrees
+    float near_plane;
+    float far_plane;
+
+    CameraLens() : fov(50.0f), near_plane(0.1f), far_plane(1000.0f) {}
+};
+
+struct CameraStats
+{
+    unsigned long long frames;
+    unsigned long long updates;     // Frames that changed the viewport and uploaded the block
+
+    CameraStats() : frames(0), updates(0) {}
+};
+
+// Backends, on the thread that handles window events. Sizes in pixels.
+void setFramebufferSize(int width, int height);
+int framebufferWidth();
+int framebufferHeight();
+
+// Creates the uniform buffer. Needs the GL context.
+void initCamera();
+void shutdownCamera();
+
+// Main thread, before the frames it applies to. The host puts the default
+// lens back before each scene's onAwake.
+void setCameraLens(const CameraLens &lens);
+
+// On the thread that has the context, before the scene draws. Skips frames
+// with a zero-sized (minimised) framebuffer.
+void updateCamera();
+
+CameraStats cameraStats();
@@ -0,0 +1,58 @@
+#pragma once
+
+// DirectDraw Surface file layout, shared by the BCn cache writer and the
+// texture file reader. All fields are little-endian.
+
+#define DDS_FOURCC(a, b, c, d) ((unsigned int)(a) | ((unsigned int)(b) << 8) | ((unsigned int)(c) << 16) | ((unsigned int)(d) << 24))
+
+struct DDSPixelFormat
+{
+    unsigned int size;
+    unsigned int flags;
+    unsigned int fourcc;
+    unsigned int rgb_bit_count;
+    unsigned int masks[4];
+};
+
+struct DDSHeader
+{
+    unsigned int size;
+    unsigned int flags;
+    unsigned int height;
+    unsigned int width;
+    unsigned int linear_size;
+    unsigned int depth;
+    unsigned int mip_count;
+    unsigned int reserved1[11];
+    DDSPixelFormat format;
+    unsigned int caps[4];
+    unsigned int reserved2;
+};
+
+struct DDSHeaderDX10
+{
+    unsigned int dxgi_format;
+    unsigned int dimension;
+    unsigned int misc_flags;
+    unsigned int array_size;
+    unsigned int misc_flags2;
+};
+
+const unsigned int DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000;
+const unsigned int DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+const unsigned int DDPF_FOURCC = 0x4;
+const unsigned int DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+const unsigned int DXGI_FORMAT_BC7_UNORM = 98;
+const unsigned int D3D10_RESOURCE_DIMENSION_TEXTURE2D = 3;
+
+// Legacy pixel format flags and the DXGI formats we can map to GL.
+const unsigned int DDPF_ALPHAPIXELS = 0x1, DDPF_RGB = 0x40, DDPF_LUMINANCE = 0x20000;
+const unsigned int DXGI_FORMAT_R8G8B8A8_UNORM = 28, DXGI_FORMAT_R8G8B8A8_UNORM_SRGB = 29;
+const unsigned int DXGI_FORMAT_BC1_UNORM = 71, DXGI_FORMAT_BC1_UNORM_SRGB = 72;
+const unsigned int DXGI_FORMAT_BC2_UNORM = 74, DXGI_FORMAT_BC2_UNORM_SRGB = 75;
+const unsigned int DXGI_FORMAT_BC3_UNORM = 77, DXGI_FORMAT_BC3_UNORM_SRGB = 78;
+const unsigned int DXGI_FORMAT_BC4_UNORM = 80, DXGI_FORMAT_BC5_UNORM = 83;
+const unsigned int DXGI_FORMAT_B8G8R8A8_UNORM = 87, DXGI_FORMAT_B8G8R8A8_UNORM_SRGB = 91;
+const unsigned int DXGI_FORMAT_BC7_UNORM_SRGB = 99;
+
+static_assert(sizeof(DDSHeader) == 124, "DDS header must be 124 bytes");
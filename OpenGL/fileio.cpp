@@ -0,0 +1,203 @@
+#include "fileio.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+FILE *openFile(const char *path, const char *mode)
+{
+#ifdef _MSC_VER
+    FILE *file = NULL;
+    if (fopen_s(&file, path, mode))
+        return NULL;
+    return file;
+#else
+    return fopen(path, mode);
+#endif
+}
+
+bool getFileStamp(const char *path, unsigned long long &size, long long &mtime)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path, &st) != 0)
+        return false;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return false;
+#endif
+    size = (unsigned long long)st.st_size;
+    mtime = (long long)st.st_mtime;
+    return true;
+}
+
+std::string canonicalPath(const char *path)
+{
+#ifdef _WIN32
+    char full[_MAX_PATH];
+    if (!_fullpath(full, path, _MAX_PATH))
+        return path;
+    // NTFS names are case-insensitive.
+    std::string canonical(full);
+    for (size_t i = 0; i < canonical.size(); i++)
+        canonical[i] = canonical[i] == '/' ? '\\' : (char)tolower((unsigned char)canonical[i]);
+    return canonical;
+#else
+    char full[PATH_MAX];
+    if (!realpath(path, full))
+        return path;
+    return full;
+#endif
+}
+
+unsigned long long hashBytes(const void *data, size_t size)
+{
+    // Eight bytes per step with a multiply-rotate mix, then a final
+    // avalanche so that nearby inputs spread over all 64 bits.
+    const unsigned long long k1 = 0x9E3779B97F4A7C15ull;
+    const unsigned long long k2 = 0xC2B2AE3D27D4EB4Full;
+    const unsigned char *bytes = (const unsigned char *)data;
+    unsigned long long hash = size * k1;
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        unsigned long long word;
+        memcpy(&word, bytes + i, 8);
+        hash ^= word * k2;
+        hash = ((hash << 31) | (hash >> 33)) * k1;
+    }
+    unsigned long long rest = 0;
+    for (size_t shift = 0; i < size; i++, shift += 8)
+        rest |= (unsigned long long)bytes[i] << shift;
+    hash ^= rest * k2;
+
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+bool hashFile(const char *path, unsigned long long &out_hash)
+{
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    out_hash = hashBytes(file.data(), file.size());
+    return true;
+}
+
+MappedFile::MappedFile()
+    : data_(NULL),
+      size_(0)
+#ifdef _WIN32
+      , file_(INVALID_HANDLE_VALUE),
+      mapping_(NULL)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const char *path)
+{
+    close();
+
+#ifdef _WIN32
+    file_ = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file_ == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_, &size))
+    {
+        close();
+        return false;
+    }
+    size_ = (size_t)size.QuadPart;
+    if (size_ == 0)
+        return true;
+
+    mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping_)
+    {
+        close();
+        return false;
+    }
+    data_ = (const char *)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+#else
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    size_ = (size_t)st.st_size;
+    if (size_ == 0)
+    {
+        ::close(fd);
+        return true;
+    }
+
+    void *data = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        size_ = 0;
+        return false;
+    }
+    madvise(data, size_, MADV_SEQUENTIAL);
+    data_ = (const char *)data;
+#endif
+
+    if (!data_)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (data_)
+        UnmapViewOfFile(data_);
+    if (mapping_)
+        CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE)
+        CloseHandle(file_);
+    mapping_ = NULL;
+    file_ = INVALID_HANDLE_VALUE;
+#else
+    if (data_)
+        munmap((void *)data_, size_);
+#endif
+    data_ = NULL;
+    size_ = 0;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdio>
+#include <cstddef>
+#include <string>
+
+// fopen that goes through fopen_s on MSVC. Returns NULL on failure.
+FILE *openFile(const char *path, const char *mode);
+
+// Size and modification time of a file, used to validate derived caches.
+bool getFileStamp(const char *path, unsigned long long &size, long long &mtime);
+
+// Absolute path with "." and ".." resolved (and, on Windows, lower-cased with
+// backslashes), so different spellings of one file compare equal. Returns the
+// path unchanged if it cannot be resolved.
+std::string canonicalPath(const char *path);
+
+// 64-bit hash of a byte range, for telling contents apart. Not cryptographic.
+unsigned long long hashBytes(const void *data, size_t size);
+
+// hashBytes over a whole file, read through a mapping.
+bool hashFile(const char *path, unsigned long long &out_hash);
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const char *path);
+    void close();
+
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    const char *data_;
+    size_t size_;
+#ifdef _WIN32
+    void *file_;
+    void *mapping_;
+#endif
+};
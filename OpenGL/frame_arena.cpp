@@ -0,0 +1,161 @@
+#include "frame_arena.h"
+
+#include <algorithm>
+
+namespace
+{
+
+// Enough for the matrices of MANY_CUBES_4K; bigger frames grow it once.
+const size_t FRAME_ARENA_BYTES = 512 << 10;
+const size_t SCRATCH_ARENA_BYTES = 64 << 10;
+
+struct FrameArena : LinearArena
+{
+    FrameArena() : LinearArena(FRAME_ARENA_BYTES) {}
+};
+
+FrameArena frame_arenas[FRAME_ARENAS];
+int frame_arena = 0;
+
+size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+} // namespace
+
+LinearArena::LinearArena(size_t initial_bytes)
+    : initial_bytes_(initial_bytes),
+      block_(0),
+      used_(0),
+      high_water_(0),
+      overflows_(0)
+{
+}
+
+LinearArena::~LinearArena()
+{
+    for (size_t i = 0; i < blocks_.size(); i++)
+        delete[] blocks_[i].memory;
+}
+
+void *LinearArena::allocate(size_t bytes, size_t alignment)
+{
+    if (blocks_.empty())
+        addBlock(std::max(initial_bytes_, bytes + alignment));
+
+    for (;;)
+    {
+        const Block &block = blocks_[block_];
+        const size_t address = (size_t)block.memory + used_;
+        const size_t start = alignUp(address, alignment) - (size_t)block.memory;
+        if (start + bytes <= block.size)
+        {
+            used_ = start + bytes;
+            high_water_ = std::max(high_water_, block.base + used_);
+            return block.memory + start;
+        }
+
+        // Blocks past the current one are left over from a frame that
+        // overflowed before; reuse them before chaining a new one.
+        if (block_ + 1 == blocks_.size())
+        {
+            addBlock(std::max(block.size * 2, bytes + alignment));
+            overflows_++;
+        }
+        block_++;
+        used_ = 0;
+    }
+}
+
+void LinearArena::release(void *memory, size_t bytes)
+{
+    if (blocks_.empty())
+        return;
+    const Block &block = blocks_[block_];
+    if ((unsigned char *)memory + bytes == block.memory + used_)
+        used_ = (unsigned char *)memory - block.memory;
+}
+
+LinearArena::Marker LinearArena::mark() const
+{
+    Marker marker;
+    marker.block = block_;
+    marker.used = used_;
+    return marker;
+}
+
+void LinearArena::rewind(const Marker &marker)
+{
+    block_ = marker.block;
+    used_ = marker.used;
+
+    // Back at the start, merge the blocks an overflow left so the next pass
+    // fits in one.
+    if (block_ == 0 && used_ == 0 && blocks_.size() > 1)
+    {
+        const size_t total = blocks_.back().base + blocks_.back().size;
+        for (size_t i = 0; i < blocks_.size(); i++)
+            delete[] blocks_[i].memory;
+        blocks_.clear();
+        addBlock(total);
+    }
+}
+
+void LinearArena::reset()
+{
+    rewind(Marker());
+}
+
+size_t LinearArena::capacity() const
+{
+    return blocks_.empty() ? 0 : blocks_.back().base + blocks_.back().size;
+}
+
+size_t LinearArena::highWater() const
+{
+    return high_water_;
+}
+
+unsigned long long LinearArena::overflows() const
+{
+    return overflows_;
+}
+
+void LinearArena::addBlock(size_t bytes)
+{
+    Block block;
+    block.memory = new unsigned char[bytes];
+    block.size = bytes;
+    block.base = blocks_.empty() ? 0 : blocks_.back().base + blocks_.back().size;
+    blocks_.push_back(block);
+}
+
+void beginFrameArena()
+{
+    frame_arena = (frame_arena + 1) % FRAME_ARENAS;
+    frame_arenas[frame_arena].reset();
+}
+
+LinearArena &frameArena()
+{
+    return frame_arenas[frame_arena];
+}
+
+LinearArena &scratchArena()
+{
+    static thread_local LinearArena arena(SCRATCH_ARENA_BYTES);
+    return arena;
+}
+
+FrameArenaStats frameArenaStats()
+{
+    FrameArenaStats stats;
+    for (int i = 0; i < FRAME_ARENAS; i++)
+    {
+        stats.capacity += frame_arenas[i].capacity();
+        stats.high_water = std::max(stats.high_water, frame_arenas[i].highWater());
+        stats.overflows += frame_arenas[i].overflows();
+    }
+    return stats;
+}
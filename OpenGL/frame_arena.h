@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Bump allocators for data that lives no longer than a frame: matrices,
+// visibility lists, draw packets. An allocation is a pointer increment;
+// nothing is freed on its own, the whole arena is rewound at once.
+//
+// The main thread records into one of FRAME_ARENAS arenas, switched by
+// beginFrameArena at the top of every frame. The render thread may still be
+// submitting the frame before, so its arena is left alone until the frame
+// after that. Any other use, on any thread, takes the thread's own scratch
+// arena for the length of a scope:
+//
+//     ArenaScope scope(scratchArena());
+//     ArenaVector<Draw> visible((ArenaAllocator<Draw>(scratchArena())));
+//
+// An arena that runs out chains another block, twice as big, and merges
+// them into one on the next rewind to its start, so after the first few
+// frames it stops touching the heap.
+
+class LinearArena
+{
+public:
+    struct Marker
+    {
+        size_t block;
+        size_t used;
+
+        Marker() : block(0), used(0) {}
+    };
+
+    explicit LinearArena(size_t initial_bytes);
+    ~LinearArena();
+
+    // Never fails; a NULL return only comes with the heap's own failure.
+    void *allocate(size_t bytes, size_t alignment);
+
+    template <typename T>
+    T *allocateArray(size_t count)
+    {
+        return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    // Hands back the most recent allocation, as a vector's growth does;
+    // anything else stays until the rewind.
+    void release(void *memory, size_t bytes);
+
+    Marker mark() const;
+    // Frees everything allocated since marker.
+    void rewind(const Marker &marker);
+    void reset();
+
+    size_t capacity() const;
+    size_t highWater() const;
+    unsigned long long overflows() const;
+
+private:
+    struct Block
+    {
+        unsigned char *memory;
+        size_t size;
+        size_t base;            // Bytes in the blocks before
+    };
+
+    LinearArena(const LinearArena &);
+    LinearArena &operator=(const LinearArena &);
+
+    void addBlock(size_t bytes);
+
+    std::vector<Block> blocks_;
+    size_t initial_bytes_;
+    size_t block_;              // Allocating from blocks_[block_]
+    size_t used_;               // In that block
+    size_t high_water_;
+    unsigned long long overflows_;
+};
+
+// Restores the arena to where it was on construction.
+class ArenaScope
+{
+public:
+    explicit ArenaScope(LinearArena &arena) : arena_(arena), marker_(arena.mark()) {}
+    ~ArenaScope() { arena_.rewind(marker_); }
+
+private:
+    ArenaScope(const ArenaScope &);
+    ArenaScope &operator=(const ArenaScope &);
+
+    LinearArena &arena_;
+    LinearArena::Marker marker_;
+};
+
+// Standard allocator over an arena. deallocate only gives memory back when
+// it was the arena's last allocation; the container must not outlive the
+// arena's next rewind.
+template <typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(LinearArena &arena) : arena_(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena()) {}
+
+    T *allocate(size_t count)
+    {
+        return arena_->allocateArray<T>(count);
+    }
+
+    void deallocate(T *memory, size_t count)
+    {
+        arena_->release(memory, count * sizeof(T));
+    }
+
+    LinearArena *arena() const
+    {
+        return arena_;
+    }
+
+private:
+    LinearArena *arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+{
+    return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+{
+    return a.arena() != b.arena();
+}
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+// Frames the main thread may be ahead of the thread reading its data: the
+// render thread submits frame N while frame N + 1 is recorded.
+const int FRAME_ARENAS = 2;
+
+struct FrameArenaStats
+{
+    size_t capacity;                // Bytes held by all frame arenas
+    size_t high_water;              // Most any frame used
+    unsigned long long overflows;   // Blocks chained because a frame outgrew its arena
+
+    FrameArenaStats() : capacity(0), high_water(0), overflows(0) {}
+};
+
+// Main thread, before anything of the frame is allocated. Rewinds the
+// arena of frame N - FRAME_ARENAS and makes it current.
+void beginFrameArena();
+
+// The current frame's arena. Main thread only.
+LinearArena &frameArena();
+
+// The calling thread's scratch arena. Only use it under an ArenaScope.
+LinearArena &scratchArena();
+
+FrameArenaStats frameArenaStats();
@@ -0,0 +1,327 @@
+#include "frame_timer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "fileio.h"
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+struct FrameSample
+{
+    double phase_ms[FRAME_PHASE_COUNT];
+    double gpu_ms;              // Negative until the queries came back
+};
+
+// One begin / end timestamp pair per frame in flight.
+struct QuerySlot
+{
+    GLuint queries[2];
+    unsigned long long frame;
+    bool pending;
+};
+
+FrameTimingOptions settings;
+std::vector<FrameSample> samples;   // samples[frame % window]
+std::vector<QuerySlot> slots;       // slots[frame % (gpu_latency + 1)]
+unsigned long long frame = 0;       // Frames begun
+unsigned long long first_frame = 0; // Set by resetFrameTiming
+unsigned long long gpu_missed = 0;
+bool gpu_timing = false;
+bool frame_open = false;
+bool swapping = false;
+Clock::time_point last_mark;
+std::atomic<bool> report_requested(false);
+
+FrameSample &sampleFor(unsigned long long index)
+{
+    return samples[(size_t)(index % samples.size())];
+}
+
+bool inWindow(unsigned long long index)
+{
+    return index >= first_frame && index < frame && frame - index <= samples.size();
+}
+
+double millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Stores the slot's GPU time if its frame is still in the window.
+void readSlot(QuerySlot &slot)
+{
+    GLuint64 begin = 0, end = 0;
+    glGetQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(slot.queries[1], GL_QUERY_RESULT, &end);
+    if (inWindow(slot.frame))
+        sampleFor(slot.frame).gpu_ms = (end - begin) / 1000000.0;
+    slot.pending = false;
+}
+
+FrameTimingPercentiles percentiles(std::vector<double> &values)
+{
+    FrameTimingPercentiles result;
+    if (values.empty())
+        return result;
+
+    // Nearest rank; the epsilon keeps 0.95 * 100 from rounding up to 96.
+    std::sort(values.begin(), values.end());
+    const size_t n = values.size();
+    const double ranks[3] = { 0.50, 0.95, 0.99 };
+    double *outputs[3] = { &result.p50, &result.p95, &result.p99 };
+    for (int i = 0; i < 3; i++)
+    {
+        const size_t rank = (size_t)std::ceil(ranks[i] * n - 1e-9);
+        *outputs[i] = values[std::max<size_t>(rank, 1) - 1];
+    }
+    result.max = values.back();
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++)
+        sum += values[i];
+    result.mean = sum / n;
+    result.samples = (unsigned int)n;
+    return result;
+}
+
+// Finished frames in the window, oldest first. The frame still open is left
+// out; its swap has not been timed yet.
+void finishedFrames(unsigned long long &first, unsigned long long &last)
+{
+    last = frame_open ? frame - 1 : frame;
+    // The open frame already holds one slot of the window.
+    const unsigned long long kept = frame_open ? samples.size() - 1 : samples.size();
+    first = last > kept ? last - kept : 0;
+    first = std::min(std::max(first, first_frame), last);
+}
+
+void writeReport()
+{
+    const std::string base = settings.report_path ? settings.report_path : "frame_timing";
+    if (writeFrameTimingCSV((base + ".csv").c_str()) && writeFrameTimingJSON((base + ".json").c_str()))
+        printf("Frame timing written to %s.csv and %s.json\n", base.c_str(), base.c_str());
+}
+
+void writePercentiles(FILE *file, const char *name, const FrameTimingPercentiles &p, bool last)
+{
+    fprintf(file, "    \"%s\": { \"samples\": %u, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"mean\": %.4f }%s\n",
+            name, p.samples, p.p50, p.p95, p.p99, p.max, p.mean, last ? "" : ",");
+}
+
+} // namespace
+
+void initFrameTiming(const FrameTimingOptions &options)
+{
+    settings = options;
+    settings.window = std::max(settings.window, 1u);
+    samples.assign(settings.window, FrameSample());
+    frame = 0;
+    first_frame = 0;
+    gpu_missed = 0;
+    frame_open = false;
+    swapping = false;
+
+    slots.clear();
+    gpu_timing = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    if (gpu_timing)
+    {
+        slots.resize(settings.gpu_latency + 1);
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            glGenQueries(2, slots[i].queries);
+            slots[i].frame = 0;
+            slots[i].pending = false;
+        }
+    }
+}
+
+void shutdownFrameTiming()
+{
+    // The loop is over, so waiting for the last results costs nothing.
+    if (swapping)
+    {
+        sampleFor(frame - 1).phase_ms[FRAME_SWAP] = millisecondsSince(last_mark);
+        frame_open = false;
+        swapping = false;
+    }
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        if (slots[i].pending)
+            readSlot(slots[i]);
+    }
+
+    if (settings.report_path || report_requested.exchange(false))
+        writeReport();
+
+    for (size_t i = 0; i < slots.size(); i++)
+        glDeleteQueries(2, slots[i].queries);
+    slots.clear();
+}
+
+void resetFrameTiming()
+{
+    first_frame = frame;
+    gpu_missed = 0;
+}
+
+void beginFrameTiming()
+{
+    // The previous frame ends once its swap returns.
+    const Clock::time_point now = Clock::now();
+    if (swapping)
+    {
+        sampleFor(frame - 1).phase_ms[FRAME_SWAP] = std::chrono::duration<double, std::milli>(now - last_mark).count();
+        swapping = false;
+    }
+    frame_open = true;
+    last_mark = now;
+
+    if (report_requested.exchange(false))
+        writeReport();
+
+    FrameSample &sample = sampleFor(frame);
+    for (int i = 0; i < FRAME_PHASE_COUNT; i++)
+        sample.phase_ms[i] = 0.0;
+    sample.gpu_ms = -1.0;
+
+    if (!slots.empty())
+    {
+        // This slot was issued gpu_latency + 1 frames ago, so gpu_latency
+        // whole frames have been issued since its queries ended. Read it only
+        // if it is done; otherwise the sample is dropped rather than waited
+        // for.
+        QuerySlot &slot = slots[(size_t)(frame % slots.size())];
+        if (slot.pending)
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(slot.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+                readSlot(slot);
+            else
+            {
+                slot.pending = false;
+                gpu_missed++;
+            }
+        }
+        glQueryCounter(slot.queries[0], GL_TIMESTAMP);
+        slot.frame = frame;
+    }
+    frame++;
+}
+
+void markFramePhase(FramePhase phase)
+{
+    const Clock::time_point now = Clock::now();
+    sampleFor(frame - 1).phase_ms[phase] += std::chrono::duration<double, std::milli>(now - last_mark).count();
+    last_mark = now;
+}
+
+void endFrameTiming()
+{
+    if (!slots.empty())
+    {
+        QuerySlot &slot = slots[(size_t)((frame - 1) % slots.size())];
+        glQueryCounter(slot.queries[1], GL_TIMESTAMP);
+        slot.pending = true;
+    }
+    last_mark = Clock::now();
+    swapping = true;
+}
+
+FrameTimingSummary frameTimingSummary()
+{
+    FrameTimingSummary summary;
+    summary.gpu_missed = gpu_missed;
+    summary.gpu_timing = gpu_timing;
+
+    unsigned long long first, last;
+    finishedFrames(first, last);
+    summary.frames = last > first_frame ? last - first_frame : 0;
+
+    std::vector<double> values[FRAME_PHASE_COUNT + 2];
+    for (unsigned long long i = first; i < last; i++)
+    {
+        const FrameSample &sample = sampleFor(i);
+        double cpu = 0.0;
+        for (int p = 0; p < FRAME_PHASE_COUNT; p++)
+        {
+            values[p].push_back(sample.phase_ms[p]);
+            cpu += sample.phase_ms[p];
+        }
+        values[FRAME_PHASE_COUNT].push_back(cpu);
+        if (sample.gpu_ms >= 0.0)
+            values[FRAME_PHASE_COUNT + 1].push_back(sample.gpu_ms);
+    }
+
+    for (int p = 0; p < FRAME_PHASE_COUNT; p++)
+        summary.phases[p] = percentiles(values[p]);
+    summary.cpu = percentiles(values[FRAME_PHASE_COUNT]);
+    summary.gpu = percentiles(values[FRAME_PHASE_COUNT + 1]);
+    return summary;
+}
+
+bool writeFrameTimingCSV(const char *path)
+{
+    FILE *file = openFile(path, "w");
+    if (!file)
+    {
+        printf("%s could not be written\n", path);
+        return false;
+    }
+
+    fprintf(file, "frame,update_ms,submit_ms,swap_ms,cpu_ms,gpu_ms\n");
+    unsigned long long first, last;
+    finishedFrames(first, last);
+    for (unsigned long long i = first; i < last; i++)
+    {
+        const FrameSample &sample = sampleFor(i);
+        const double cpu = sample.phase_ms[FRAME_UPDATE] + sample.phase_ms[FRAME_SUBMIT] + sample.phase_ms[FRAME_SWAP];
+        fprintf(file, "%llu,%.4f,%.4f,%.4f,%.4f,", i, sample.phase_ms[FRAME_UPDATE], sample.phase_ms[FRAME_SUBMIT],
+                sample.phase_ms[FRAME_SWAP], cpu);
+        if (sample.gpu_ms >= 0.0)
+            fprintf(file, "%.4f", sample.gpu_ms);
+        fprintf(file, "\n");
+    }
+    fclose(file);
+    return true;
+}
+
+bool writeFrameTimingJSON(const char *path)
+{
+    FILE *file = openFile(path, "w");
+    if (!file)
+    {
+        printf("%s could not be written\n", path);
+        return false;
+    }
+
+    const FrameTimingSummary summary = frameTimingSummary();
+    fprintf(file, "{\n");
+    fprintf(file, "  \"frames\": %llu,\n", summary.frames);
+    fprintf(file, "  \"window\": %u,\n", settings.window);
+    fprintf(file, "  \"gpu_timing\": %s,\n", summary.gpu_timing ? "true" : "false");
+    fprintf(file, "  \"gpu_missed\": %llu,\n", summary.gpu_missed);
+    fprintf(file, "  \"milliseconds\": {\n");
+    writePercentiles(file, "update", summary.phases[FRAME_UPDATE], false);
+    writePercentiles(file, "submit", summary.phases[FRAME_SUBMIT], false);
+    writePercentiles(file, "swap", summary.phases[FRAME_SWAP], false);
+    writePercentiles(file, "cpu", summary.cpu, false);
+    writePercentiles(file, "gpu", summary.gpu, true);
+    fprintf(file, "  }\n");
+    fprintf(file, "}\n");
+    fclose(file);
+    return true;
+}
+
+void requestFrameTimingReport()
+{
+    report_requested = true;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "gl_trace.h"
+
+// Per-frame timing for the host loop. CPU time is split into phases by
+// markFramePhase; GPU time comes from a pair of GL_TIMESTAMP queries around
+// the frame's commands that is read back gpu_latency frames later, and only
+// once its result is available, so timing never stalls the pipeline.
+// Timestamps rather than GL_TIME_ELAPSED because the benchmarks run their
+// own elapsed-time queries, and those cannot nest.
+//
+// The last window frames are kept for the percentiles and the CSV report.
+//
+//     beginFrameTiming();
+//     ...host work...         markFramePhase(FRAME_UPDATE);
+//     onUpdate(time);         markFramePhase(FRAME_SUBMIT);
+//     endFrameTiming();       // GPU end timestamp; the swap is timed from here
+//     swap buffers            // to the next beginFrameTiming
+
+enum FramePhase
+{
+    FRAME_UPDATE,       // Host work around the scene: asset uploads, texture streaming
+    FRAME_SUBMIT,       // The scene's onUpdate, which issues its GL commands
+    FRAME_SWAP,         // Present and window events
+    FRAME_PHASE_COUNT
+};
+
+struct FrameTimingOptions
+{
+    unsigned int window;        // Frames kept for the percentiles
+    unsigned int gpu_latency;   // Frames between issuing a query pair and reading it back
+    const char *report_path;    // Written as <path>.csv and <path>.json at shutdown, NULL = none
+
+    FrameTimingOptions()
+        : window(1000),
+          gpu_latency(3),
+          report_path(NULL)
+    {
+    }
+};
+
+// Milliseconds over the frames in the window.
+struct FrameTimingPercentiles
+{
+    double p50, p95, p99, max, mean;
+    unsigned int samples;
+
+    FrameTimingPercentiles() : p50(0.0), p95(0.0), p99(0.0), max(0.0), mean(0.0), samples(0) {}
+};
+
+struct FrameTimingSummary
+{
+    unsigned long long frames;
+    unsigned long long gpu_missed;      // Query pairs still not ready after gpu_latency frames
+    bool gpu_timing;                    // False without GL 3.3 or ARB_timer_query
+    FrameTimingPercentiles phases[FRAME_PHASE_COUNT];
+    FrameTimingPercentiles cpu;         // All phases
+    FrameTimingPercentiles gpu;
+
+    FrameTimingSummary() : frames(0), gpu_missed(0), gpu_timing(false) {}
+};
+
+// Needs the GL context.
+void initFrameTiming(const FrameTimingOptions &options = FrameTimingOptions());
+
+// Reads the queries still in flight, writes the report if a path was given
+// and deletes the queries. Needs the GL context.
+void shutdownFrameTiming();
+
+// Forgets the frames so far, e.g. after a warm-up. GPU results of earlier
+// frames that come back later are dropped.
+void resetFrameTiming();
+
+void beginFrameTiming();
+void markFramePhase(FramePhase phase);
+void endFrameTiming();
+
+FrameTimingSummary frameTimingSummary();
+
+// One row per frame in the window; the GPU column is empty where no result
+// came back.
+bool writeFrameTimingCSV(const char *path);
+
+// The summary: frame counts and the percentiles of every phase, the CPU
+// total and the GPU.
+bool writeFrameTimingJSON(const char *path);
+
+// Safe from window callbacks: writes the report (to the report path, or
+// "frame_timing") at the start of the next frame.
+void requestFrameTimingReport();
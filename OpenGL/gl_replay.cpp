@@ -0,0 +1,1113 @@
+// GL trace replay. Select it with #define GL_REPLAY in OpenGL.h, or build it
+// on its own:
+//
+//   g++ -O2 -std=c++14 -DGL_REPLAY -DHAVE_EGL -Iinclude gl_replay.cpp gl_trace.cpp backend_egl.cpp backend_glfw.cpp
+//       camera.cpp fileio.cpp -lGLEW -lglfw -lEGL -lGL -o gl_replay
+//
+// Plays back a trace written with --trace (gl_trace.h) as fast as it goes,
+// without the scenes, their simulation or their asset loading, and prints
+// how long the GL took over each kind of call. Runs headless unless
+// --window; --repeat plays the whole trace several times in a row.
+//
+//   gl_replay TRACE [--window] [--repeat N] [--capture FILE.ppm]
+
+#include "OpenGL.h"
+
+#ifdef GL_REPLAY
+
+#include "backend.h"
+#include "fileio.h"
+#include "gl_trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+// Header: magic, version, width, height.
+const size_t HEADER_BYTES = sizeof(GL_TRACE_MAGIC) + 3 * 4;
+
+// Larger recorded names are not the GL's and are used as they are.
+const GLuint MAX_MAPPED_NAME = 1 << 24;
+
+class TraceReader
+{
+public:
+    TraceReader(const char *data, size_t size) : start_(data), next_(data), end_(data + size), ok_(true) {}
+
+    const void *bytes(size_t size)
+    {
+        if (!ok_ || (size_t)(end_ - next_) < size)
+        {
+            ok_ = false;
+            return NULL;
+        }
+        const void *bytes = next_;
+        next_ += size;
+        return bytes;
+    }
+
+    unsigned char u8()
+    {
+        const void *value = bytes(1);
+        return value ? *(const unsigned char *)value : 0;
+    }
+
+    GLuint u32()
+    {
+        GLuint value = 0;
+        if (const void *data = bytes(4))
+            memcpy(&value, data, 4);
+        return value;
+    }
+
+    GLint i32()
+    {
+        return (GLint)u32();
+    }
+
+    unsigned long long u64()
+    {
+        unsigned long long value = 0;
+        if (const void *data = bytes(8))
+            memcpy(&value, data, 8);
+        return value;
+    }
+
+    GLfloat f32()
+    {
+        GLfloat value = 0.0f;
+        if (const void *data = bytes(4))
+            memcpy(&value, data, 4);
+        return value;
+    }
+
+    // Copied out, since the trace keeps no alignment.
+    const GLfloat *floats(size_t count, std::vector<GLfloat> &out)
+    {
+        out.resize(std::max<size_t>(count, 1));
+        if (const void *data = bytes(count * sizeof(GLfloat)))
+            memcpy(&out[0], data, count * sizeof(GLfloat));
+        return &out[0];
+    }
+
+    // An 8-byte count and the bytes; NULL for none.
+    const void *data(size_t &size)
+    {
+        size = (size_t)u64();
+        return size ? bytes(size) : NULL;
+    }
+
+    const void *pixels()
+    {
+        size_t size;
+        switch (u8())
+        {
+        case TRACE_PIXELS_DATA:
+            return data(size);
+        case TRACE_PIXELS_OFFSET:
+            return (const void *)(size_t)u64();
+        default:
+            return NULL;
+        }
+    }
+
+    bool ok() const { return ok_; }
+    size_t offset() const { return next_ - start_; }
+
+private:
+    const char *start_;
+    const char *next_;
+    const char *end_;
+    bool ok_;
+};
+
+// Recorded names to the ones the replay got. Names made before the trace
+// started are used as they are.
+class NameMap
+{
+public:
+    GLuint operator()(GLuint recorded) const
+    {
+        return recorded < names_.size() && names_[recorded] ? names_[recorded] : recorded;
+    }
+
+    void set(GLuint recorded, GLuint name)
+    {
+        if (recorded == 0 || recorded >= MAX_MAPPED_NAME)
+            return;
+        if (recorded >= names_.size())
+            names_.resize(recorded + 1);
+        names_[recorded] = name;
+    }
+
+private:
+    std::vector<GLuint> names_;
+};
+
+struct Mapping
+{
+    unsigned char *data;
+    GLintptr offset;
+};
+
+struct CallTime
+{
+    unsigned long long count;
+    double seconds;
+
+    CallTime() : count(0), seconds(0.0) {}
+};
+
+struct PassResult
+{
+    unsigned int frames;
+    unsigned long long calls;
+    double seconds;
+
+    PassResult() : frames(0), calls(0), seconds(0.0) {}
+};
+
+// One pass over the trace. Names, locations and mappings are its own, so a
+// pass starts from scratch like the recorded run did.
+class Replay
+{
+public:
+    Replay(Backend *backend, CallTime *times) : backend_(backend), times_(times), program_(0) {}
+
+    bool run(const MappedFile &trace, int &width, int &height, PassResult &result);
+
+private:
+    bool record(TraceReader &in, GLTraceCall call, int &width, int &height, PassResult &result);
+
+    void account(GLTraceCall call, Clock::time_point start)
+    {
+        times_[call].count++;
+        times_[call].seconds += std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    const GLuint *readNames(TraceReader &in, GLsizei &n, const NameMap &map)
+    {
+        n = in.i32();
+        names_.resize(std::max(n, 1));
+        for (GLsizei i = 0; i < n; i++)
+            names_[i] = map(in.u32());
+        return &names_[0];
+    }
+
+    void mapNames(const std::vector<GLuint> &recorded, GLsizei n, NameMap &map)
+    {
+        for (GLsizei i = 0; i < n && i < (GLsizei)recorded.size(); i++)
+            map.set(recorded[i], names_[i]);
+    }
+
+    GLint location(GLint recorded) const
+    {
+        if (program_ < locations_.size() && recorded >= 0 && (size_t)recorded < locations_[program_].size())
+            return locations_[program_][recorded];
+        return recorded;
+    }
+
+    Backend *backend_;
+    CallTime *times_;
+    NameMap buffers_;
+    NameMap textures_;
+    NameMap vertex_arrays_;
+    NameMap programs_;                              // And shaders, which share the names
+    std::map<unsigned long long, GLsync> syncs_;
+    std::map<GLuint, Mapping> mappings_;            // By recorded buffer
+    std::vector<std::vector<GLint> > locations_;    // By recorded program and location
+    GLuint program_;                                // Recorded, bound
+    std::vector<GLuint> names_;
+    std::vector<GLfloat> floats_;
+    std::vector<unsigned char> readback_;
+};
+
+bool Replay::run(const MappedFile &trace, int &width, int &height, PassResult &result)
+{
+    TraceReader in(trace.data() + HEADER_BYTES, trace.size() - HEADER_BYTES);
+    const Clock::time_point start = Clock::now();
+    for (;;)
+    {
+        const size_t offset = in.offset() + HEADER_BYTES;
+        const unsigned char call = in.u8();
+        if (!in.ok() || call >= TRACE_CALLS)
+        {
+            printf("The trace is %s at byte %zu\n", in.ok() ? "corrupt" : "cut short", offset);
+            return false;
+        }
+        if (call == TRACE_END)
+        {
+            if (result.frames)
+            {
+                const Clock::time_point present = Clock::now();
+                backend_->endFrame();
+                account(TRACE_FRAME, present);
+            }
+            const Clock::time_point finish = Clock::now();
+            glFinish();
+            account(TRACE_END, finish);
+            result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            return true;
+        }
+        if (!record(in, (GLTraceCall)call, width, height, result) || !in.ok())
+        {
+            printf("The trace is %s at byte %zu (%s)\n", in.ok() ? "corrupt" : "cut short", offset,
+                   glTraceCallName((GLTraceCall)call));
+            return false;
+        }
+        if (call > TRACE_MAPPED_WRITE)
+            result.calls++;
+    }
+}
+
+// Decodes one record and issues it. Only the GL call itself is timed.
+bool Replay::record(TraceReader &in, GLTraceCall call, int &width, int &height, PassResult &result)
+{
+    Clock::time_point start;
+    size_t size = 0;
+    switch (call)
+    {
+    case TRACE_FRAME:
+    {
+        const int frame_width = in.i32();
+        const int frame_height = in.i32();
+        if (result.frames)
+        {
+            start = Clock::now();
+            backend_->endFrame();
+            account(call, start);
+        }
+        if (frame_width != width || frame_height != height)
+        {
+            width = frame_width;
+            height = frame_height;
+            backend_->resize(width, height);
+        }
+        result.frames++;
+        return true;
+    }
+    case TRACE_MAPPED_WRITE:
+    {
+        const GLuint buffer = in.u32();
+        const GLintptr offset = (GLintptr)in.u64();
+        const void *data = in.data(size);
+        std::map<GLuint, Mapping>::const_iterator mapping = mappings_.find(buffer);
+        if (mapping == mappings_.end() || offset < mapping->second.offset)
+            return false;
+        start = Clock::now();
+        memcpy(mapping->second.data + (offset - mapping->second.offset), data, size);
+        account(call, start);
+        return true;
+    }
+
+    case TRACE_BindTexture:
+    {
+        const GLenum target = in.u32();
+        const GLuint texture = textures_(in.u32());
+        start = Clock::now();
+        glBindTexture(target, texture);
+        break;
+    }
+    case TRACE_Clear:
+    {
+        const GLbitfield mask = in.u32();
+        start = Clock::now();
+        glClear(mask);
+        break;
+    }
+    case TRACE_ClearColor:
+    {
+        const GLfloat *color = in.floats(4, floats_);
+        start = Clock::now();
+        glClearColor(color[0], color[1], color[2], color[3]);
+        break;
+    }
+    case TRACE_DeleteTextures:
+    {
+        GLsizei n;
+        const GLuint *textures = readNames(in, n, textures_);
+        start = Clock::now();
+        glDeleteTextures(n, textures);
+        break;
+    }
+    case TRACE_DepthFunc:
+    {
+        const GLenum func = in.u32();
+        start = Clock::now();
+        glDepthFunc(func);
+        break;
+    }
+    case TRACE_Disable:
+    {
+        const GLenum cap = in.u32();
+        start = Clock::now();
+        glDisable(cap);
+        break;
+    }
+    case TRACE_DrawArrays:
+    {
+        const GLenum mode = in.u32();
+        const GLint first = in.i32();
+        const GLsizei count = in.i32();
+        start = Clock::now();
+        glDrawArrays(mode, first, count);
+        break;
+    }
+    case TRACE_DrawElements:
+    {
+        const GLenum mode = in.u32();
+        const GLsizei count = in.i32();
+        const GLenum type = in.u32();
+        const void *indices = (const void *)(size_t)in.u64();
+        start = Clock::now();
+        glDrawElements(mode, count, type, indices);
+        break;
+    }
+    case TRACE_Enable:
+    {
+        const GLenum cap = in.u32();
+        start = Clock::now();
+        glEnable(cap);
+        break;
+    }
+    case TRACE_FrontFace:
+    {
+        const GLenum mode = in.u32();
+        start = Clock::now();
+        glFrontFace(mode);
+        break;
+    }
+    case TRACE_GenTextures:
+    {
+        GLsizei n;
+        std::vector<GLuint> recorded;
+        readNames(in, n, NameMap());
+        recorded.assign(names_.begin(), names_.begin() + n);
+        start = Clock::now();
+        glGenTextures(n, &names_[0]);
+        account(call, start);
+        mapNames(recorded, n, textures_);
+        return true;
+    }
+    case TRACE_PixelStorei:
+    {
+        const GLenum pname = in.u32();
+        const GLint param = in.i32();
+        start = Clock::now();
+        glPixelStorei(pname, param);
+        break;
+    }
+    case TRACE_TexImage2D:
+    {
+        const GLenum target = in.u32();
+        const GLint level = in.i32();
+        const GLint internalformat = in.i32();
+        const GLsizei width = in.i32();
+        const GLsizei height = in.i32();
+        const GLint border = in.i32();
+        const GLenum format = in.u32();
+        const GLenum type = in.u32();
+        const void *pixels = in.pixels();
+        start = Clock::now();
+        glTexImage2D(target, level, internalformat, width, height, border, format, type, pixels);
+        break;
+    }
+    case TRACE_TexParameterf:
+    {
+        const GLenum target = in.u32();
+        const GLenum pname = in.u32();
+        const GLfloat param = in.f32();
+        start = Clock::now();
+        glTexParameterf(target, pname, param);
+        break;
+    }
+    case TRACE_TexParameteri:
+    {
+        const GLenum target = in.u32();
+        const GLenum pname = in.u32();
+        const GLint param = in.i32();
+        start = Clock::now();
+        glTexParameteri(target, pname, param);
+        break;
+    }
+    case TRACE_TexSubImage2D:
+    {
+        const GLenum target = in.u32();
+        const GLint level = in.i32();
+        const GLint xoffset = in.i32();
+        const GLint yoffset = in.i32();
+        const GLsizei width = in.i32();
+        const GLsizei height = in.i32();
+        const GLenum format = in.u32();
+        const GLenum type = in.u32();
+        const void *pixels = in.pixels();
+        start = Clock::now();
+        glTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels);
+        break;
+    }
+    case TRACE_Viewport:
+    {
+        const GLint x = in.i32();
+        const GLint y = in.i32();
+        const GLsizei viewport_width = in.i32();
+        const GLsizei viewport_height = in.i32();
+        start = Clock::now();
+        glViewport(x, y, viewport_width, viewport_height);
+        break;
+    }
+
+    case TRACE_ActiveTexture:
+    {
+        const GLenum texture = in.u32();
+        start = Clock::now();
+        glActiveTexture(texture);
+        break;
+    }
+    case TRACE_AttachShader:
+    {
+        const GLuint program = programs_(in.u32());
+        const GLuint shader = programs_(in.u32());
+        start = Clock::now();
+        glAttachShader(program, shader);
+        break;
+    }
+    case TRACE_BindBuffer:
+    {
+        const GLenum target = in.u32();
+        const GLuint buffer = buffers_(in.u32());
+        start = Clock::now();
+        glBindBuffer(target, buffer);
+        break;
+    }
+    case TRACE_BindBufferBase:
+    {
+        const GLenum target = in.u32();
+        const GLuint index = in.u32();
+        const GLuint buffer = buffers_(in.u32());
+        start = Clock::now();
+        glBindBufferBase(target, index, buffer);
+        break;
+    }
+    case TRACE_BindBufferRange:
+    {
+        const GLenum target = in.u32();
+        const GLuint index = in.u32();
+        const GLuint buffer = buffers_(in.u32());
+        const GLintptr offset = (GLintptr)in.u64();
+        const GLsizeiptr range = (GLsizeiptr)in.u64();
+        start = Clock::now();
+        glBindBufferRange(target, index, buffer, offset, range);
+        break;
+    }
+    case TRACE_BindSampler:
+    {
+        const GLuint unit = in.u32();
+        const GLuint sampler = in.u32();
+        start = Clock::now();
+        glBindSampler(unit, sampler);
+        break;
+    }
+    case TRACE_BindVertexArray:
+    {
+        const GLuint array = vertex_arrays_(in.u32());
+        start = Clock::now();
+        glBindVertexArray(array);
+        break;
+    }
+    case TRACE_BufferData:
+    {
+        const GLenum target = in.u32();
+        const GLsizeiptr buffer_size = (GLsizeiptr)in.u64();
+        const void *data = in.data(size);
+        const GLenum usage = in.u32();
+        start = Clock::now();
+        glBufferData(target, buffer_size, data, usage);
+        break;
+    }
+    case TRACE_BufferStorage:
+    {
+        const GLenum target = in.u32();
+        const GLsizeiptr buffer_size = (GLsizeiptr)in.u64();
+        const void *data = in.data(size);
+        const GLbitfield flags = in.u32();
+        start = Clock::now();
+        glBufferStorage(target, buffer_size, data, flags);
+        break;
+    }
+    case TRACE_BufferSubData:
+    {
+        const GLenum target = in.u32();
+        const GLintptr offset = (GLintptr)in.u64();
+        const void *data = in.data(size);
+        start = Clock::now();
+        glBufferSubData(target, offset, size, data);
+        break;
+    }
+    case TRACE_ClearBufferData:
+    {
+        const GLenum target = in.u32();
+        const GLenum internalformat = in.u32();
+        const GLenum format = in.u32();
+        const GLenum type = in.u32();
+        const void *data = in.data(size);
+        start = Clock::now();
+        glClearBufferData(target, internalformat, format, type, data);
+        break;
+    }
+    case TRACE_ClearBufferSubData:
+    {
+        const GLenum target = in.u32();
+        const GLenum internalformat = in.u32();
+        const GLintptr offset = (GLintptr)in.u64();
+        const GLsizeiptr clear_size = (GLsizeiptr)in.u64();
+        const GLenum format = in.u32();
+        const GLenum type = in.u32();
+        const void *data = in.data(size);
+        start = Clock::now();
+        glClearBufferSubData(target, internalformat, offset, clear_size, format, type, data);
+        break;
+    }
+    case TRACE_ClearBufferfv:
+    {
+        const GLenum buffer = in.u32();
+        const GLint drawbuffer = in.i32();
+        const GLfloat *value = in.floats(buffer == GL_COLOR ? 4 : 1, floats_);
+        start = Clock::now();
+        glClearBufferfv(buffer, drawbuffer, value);
+        break;
+    }
+    case TRACE_ClientWaitSync:
+    {
+        const GLsync sync = syncs_[in.u64()];
+        const GLbitfield flags = in.u32();
+        const GLuint64 timeout = in.u64();
+        start = Clock::now();
+        glClientWaitSync(sync, flags, timeout);
+        break;
+    }
+    case TRACE_CompileShader:
+    {
+        const GLuint shader = programs_(in.u32());
+        start = Clock::now();
+        glCompileShader(shader);
+        break;
+    }
+    case TRACE_CompressedTexImage2D:
+    {
+        const GLenum target = in.u32();
+        const GLint level = in.i32();
+        const GLenum internalformat = in.u32();
+        const GLsizei width = in.i32();
+        const GLsizei height = in.i32();
+        const GLint border = in.i32();
+        const GLsizei image_size = in.i32();
+        const void *data = in.pixels();
+        start = Clock::now();
+        glCompressedTexImage2D(target, level, internalformat, width, height, border, image_size, data);
+        break;
+    }
+    case TRACE_CompressedTexSubImage2D:
+    {
+        const GLenum target = in.u32();
+        const GLint level = in.i32();
+        const GLint xoffset = in.i32();
+        const GLint yoffset = in.i32();
+        const GLsizei width = in.i32();
+        const GLsizei height = in.i32();
+        const GLenum format = in.u32();
+        const GLsizei image_size = in.i32();
+        const void *data = in.pixels();
+        start = Clock::now();
+        glCompressedTexSubImage2D(target, level, xoffset, yoffset, width, height, format, image_size, data);
+        break;
+    }
+    case TRACE_CreateProgram:
+    {
+        const GLuint recorded = in.u32();
+        start = Clock::now();
+        const GLuint program = glCreateProgram();
+        account(call, start);
+        programs_.set(recorded, program);
+        return true;
+    }
+    case TRACE_CreateShader:
+    {
+        const GLenum type = in.u32();
+        const GLuint recorded = in.u32();
+        start = Clock::now();
+        const GLuint shader = glCreateShader(type);
+        account(call, start);
+        programs_.set(recorded, shader);
+        return true;
+    }
+    case TRACE_DeleteBuffers:
+    {
+        GLsizei n;
+        std::vector<GLuint> recorded;
+        readNames(in, n, NameMap());
+        recorded.assign(names_.begin(), names_.begin() + n);
+        for (GLsizei i = 0; i < n; i++)
+        {
+            names_[i] = buffers_(recorded[i]);
+            mappings_.erase(recorded[i]);
+        }
+        start = Clock::now();
+        glDeleteBuffers(n, &names_[0]);
+        break;
+    }
+    case TRACE_DeleteProgram:
+    {
+        const GLuint program = programs_(in.u32());
+        start = Clock::now();
+        glDeleteProgram(program);
+        break;
+    }
+    case TRACE_DeleteShader:
+    {
+        const GLuint shader = programs_(in.u32());
+        start = Clock::now();
+        glDeleteShader(shader);
+        break;
+    }
+    case TRACE_DeleteSync:
+    {
+        const unsigned long long recorded = in.u64();
+        const GLsync sync = syncs_[recorded];
+        syncs_.erase(recorded);
+        start = Clock::now();
+        glDeleteSync(sync);
+        break;
+    }
+    case TRACE_DeleteVertexArrays:
+    {
+        GLsizei n;
+        const GLuint *arrays = readNames(in, n, vertex_arrays_);
+        start = Clock::now();
+        glDeleteVertexArrays(n, arrays);
+        break;
+    }
+    case TRACE_DisableVertexAttribArray:
+    {
+        const GLuint index = in.u32();
+        start = Clock::now();
+        glDisableVertexAttribArray(index);
+        break;
+    }
+    case TRACE_DrawElementsInstanced:
+    {
+        const GLenum mode = in.u32();
+        const GLsizei count = in.i32();
+        const GLenum type = in.u32();
+        const void *indices = (const void *)(size_t)in.u64();
+        const GLsizei instances = in.i32();
+        start = Clock::now();
+        glDrawElementsInstanced(mode, count, type, indices, instances);
+        break;
+    }
+    case TRACE_DrawElementsInstancedBaseInstance:
+    {
+        const GLenum mode = in.u32();
+        const GLsizei count = in.i32();
+        const GLenum type = in.u32();
+        const void *indices = (const void *)(size_t)in.u64();
+        const GLsizei instances = in.i32();
+        const GLuint base_instance = in.u32();
+        start = Clock::now();
+        glDrawElementsInstancedBaseInstance(mode, count, type, indices, instances, base_instance);
+        break;
+    }
+    case TRACE_EnableVertexAttribArray:
+    {
+        const GLuint index = in.u32();
+        start = Clock::now();
+        glEnableVertexAttribArray(index);
+        break;
+    }
+    case TRACE_FenceSync:
+    {
+        const GLenum condition = in.u32();
+        const GLbitfield flags = in.u32();
+        const unsigned long long recorded = in.u64();
+        start = Clock::now();
+        const GLsync sync = glFenceSync(condition, flags);
+        account(call, start);
+        syncs_[recorded] = sync;
+        return true;
+    }
+    case TRACE_GenBuffers:
+    {
+        GLsizei n;
+        std::vector<GLuint> recorded;
+        readNames(in, n, NameMap());
+        recorded.assign(names_.begin(), names_.begin() + n);
+        start = Clock::now();
+        glGenBuffers(n, &names_[0]);
+        account(call, start);
+        mapNames(recorded, n, buffers_);
+        return true;
+    }
+    case TRACE_GenVertexArrays:
+    {
+        GLsizei n;
+        std::vector<GLuint> recorded;
+        readNames(in, n, NameMap());
+        recorded.assign(names_.begin(), names_.begin() + n);
+        start = Clock::now();
+        glGenVertexArrays(n, &names_[0]);
+        account(call, start);
+        mapNames(recorded, n, vertex_arrays_);
+        return true;
+    }
+    case TRACE_GenerateMipmap:
+    {
+        const GLenum target = in.u32();
+        start = Clock::now();
+        glGenerateMipmap(target);
+        break;
+    }
+    case TRACE_GetBufferSubData:
+    {
+        const GLenum target = in.u32();
+        const GLintptr offset = (GLintptr)in.u64();
+        const GLsizeiptr read_size = (GLsizeiptr)in.u64();
+        readback_.resize(std::max<size_t>(read_size, 1));
+        start = Clock::now();
+        glGetBufferSubData(target, offset, read_size, &readback_[0]);
+        break;
+    }
+    case TRACE_GetUniformLocation:
+    {
+        const GLuint recorded_program = in.u32();
+        const void *name_data = in.data(size);
+        const std::string name(name_data ? (const char *)name_data : "", size);
+        const GLint recorded = in.i32();
+        const GLuint program = programs_(recorded_program);
+        start = Clock::now();
+        const GLint location = glGetUniformLocation(program, name.c_str());
+        account(call, start);
+        if (recorded >= 0 && recorded_program < MAX_MAPPED_NAME && recorded < (GLint)MAX_MAPPED_NAME)
+        {
+            if (recorded_program >= locations_.size())
+                locations_.resize(recorded_program + 1);
+            std::vector<GLint> &locations = locations_[recorded_program];
+            while (locations.size() <= (size_t)recorded)
+                locations.push_back((GLint)locations.size());
+            locations[recorded] = location;
+        }
+        return true;
+    }
+    case TRACE_LinkProgram:
+    {
+        const GLuint program = programs_(in.u32());
+        start = Clock::now();
+        glLinkProgram(program);
+        break;
+    }
+    case TRACE_MapBufferRange:
+    {
+        const GLenum target = in.u32();
+        const GLintptr offset = (GLintptr)in.u64();
+        const GLsizeiptr length = (GLsizeiptr)in.u64();
+        const GLbitfield access = in.u32();
+        const GLuint recorded = in.u32();
+        start = Clock::now();
+        void *data = glMapBufferRange(target, offset, length, access);
+        account(call, start);
+        if (data)
+        {
+            Mapping mapping = { (unsigned char *)data, offset };
+            mappings_[recorded] = mapping;
+        }
+        return true;
+    }
+    case TRACE_ShaderSource:
+    {
+        const GLuint shader = programs_(in.u32());
+        const GLsizei count = in.i32();
+        std::vector<const GLchar *> strings(std::max(count, 1));
+        std::vector<GLint> lengths(std::max(count, 1));
+        for (GLsizei i = 0; i < count; i++)
+        {
+            strings[i] = (const GLchar *)in.data(size);
+            lengths[i] = (GLint)size;
+        }
+        start = Clock::now();
+        glShaderSource(shader, count, &strings[0], &lengths[0]);
+        break;
+    }
+    case TRACE_TexBuffer:
+    {
+        const GLenum target = in.u32();
+        const GLenum internalformat = in.u32();
+        const GLuint buffer = buffers_(in.u32());
+        start = Clock::now();
+        glTexBuffer(target, internalformat, buffer);
+        break;
+    }
+    case TRACE_TexImage3D:
+    {
+        const GLenum target = in.u32();
+        const GLint level = in.i32();
+        const GLint internalformat = in.i32();
+        const GLsizei width = in.i32();
+        const GLsizei height = in.i32();
+        const GLsizei depth = in.i32();
+        const GLint border = in.i32();
+        const GLenum format = in.u32();
+        const GLenum type = in.u32();
+        const void *pixels = in.pixels();
+        start = Clock::now();
+        glTexImage3D(target, level, internalformat, width, height, depth, border, format, type, pixels);
+        break;
+    }
+    case TRACE_TexStorage2D:
+    {
+        const GLenum target = in.u32();
+        const GLsizei levels = in.i32();
+        const GLenum internalformat = in.u32();
+        const GLsizei width = in.i32();
+        const GLsizei height = in.i32();
+        start = Clock::now();
+        glTexStorage2D(target, levels, internalformat, width, height);
+        break;
+    }
+    case TRACE_TexStorage3D:
+    {
+        const GLenum target = in.u32();
+        const GLsizei levels = in.i32();
+        const GLenum internalformat = in.u32();
+        const GLsizei width = in.i32();
+        const GLsizei height = in.i32();
+        const GLsizei depth = in.i32();
+        start = Clock::now();
+        glTexStorage3D(target, levels, internalformat, width, height, depth);
+        break;
+    }
+    case TRACE_TexSubImage3D:
+    {
+        const GLenum target = in.u32();
+        const GLint level = in.i32();
+        const GLint xoffset = in.i32();
+        const GLint yoffset = in.i32();
+        const GLint zoffset = in.i32();
+        const GLsizei width = in.i32();
+        const GLsizei height = in.i32();
+        const GLsizei depth = in.i32();
+        const GLenum format = in.u32();
+        const GLenum type = in.u32();
+        const void *pixels = in.pixels();
+        start = Clock::now();
+        glTexSubImage3D(target, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels);
+        break;
+    }
+    case TRACE_Uniform1i:
+    {
+        const GLint uniform = location(in.i32());
+        const GLint value = in.i32();
+        start = Clock::now();
+        glUniform1i(uniform, value);
+        break;
+    }
+    case TRACE_Uniform3fv:
+    {
+        const GLint uniform = location(in.i32());
+        const GLsizei count = in.i32();
+        const GLfloat *value = in.floats(count * 3, floats_);
+        start = Clock::now();
+        glUniform3fv(uniform, count, value);
+        break;
+    }
+    case TRACE_UniformMatrix4fv:
+    {
+        const GLint uniform = location(in.i32());
+        const GLsizei count = in.i32();
+        const GLboolean transpose = (GLboolean)in.u32();
+        const GLfloat *value = in.floats(count * 16, floats_);
+        start = Clock::now();
+        glUniformMatrix4fv(uniform, count, transpose, value);
+        break;
+    }
+    case TRACE_UnmapBuffer:
+    {
+        const GLenum target = in.u32();
+        start = Clock::now();
+        glUnmapBuffer(target);
+        break;
+    }
+    case TRACE_UseProgram:
+    {
+        program_ = in.u32();
+        const GLuint program = programs_(program_);
+        start = Clock::now();
+        glUseProgram(program);
+        break;
+    }
+    case TRACE_VertexAttribDivisor:
+    {
+        const GLuint index = in.u32();
+        const GLuint divisor = in.u32();
+        start = Clock::now();
+        glVertexAttribDivisor(index, divisor);
+        break;
+    }
+    case TRACE_VertexAttribPointer:
+    {
+        const GLuint index = in.u32();
+        const GLint components = in.i32();
+        const GLenum type = in.u32();
+        const GLboolean normalized = (GLboolean)in.u32();
+        const GLsizei stride = in.i32();
+        const void *pointer = (const void *)(size_t)in.u64();
+        start = Clock::now();
+        glVertexAttribPointer(index, components, type, normalized, stride, pointer);
+        break;
+    }
+    default:
+        return false;
+    }
+    account(call, start);
+    return true;
+}
+
+// What the replay does for the records that are not calls.
+const char *rowName(GLTraceCall call)
+{
+    switch (call)
+    {
+    case TRACE_END:
+        return "glFinish at the end";
+    case TRACE_FRAME:
+        return "present";
+    case TRACE_MAPPED_WRITE:
+        return "writes to mapped buffers";
+    default:
+        return glTraceCallName(call);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    bool window = false;
+    int repeat = 1;
+    HeadlessOptions headless_options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--window") == 0)
+            window = true;
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+            repeat = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+            headless_options.capture_path = argv[++i];
+        else if (argv[i][0] != '-' && !path)
+            path = argv[i];
+        else
+        {
+            path = NULL;
+            break;
+        }
+    }
+    if (!path)
+    {
+        fprintf(stderr, "usage: %s TRACE [--window] [--repeat N] [--capture FILE.ppm]\n", argv[0]);
+        return 1;
+    }
+
+    MappedFile trace;
+    if (!trace.open(path))
+    {
+        fprintf(stderr, "%s could not be read\n", path);
+        return 1;
+    }
+    TraceReader header(trace.data(), trace.size());
+    const void *magic = header.bytes(sizeof(GL_TRACE_MAGIC));
+    const unsigned int version = header.u32();
+    int width = header.i32();
+    int height = header.i32();
+    if (!header.ok() || memcmp(magic, GL_TRACE_MAGIC, sizeof(GL_TRACE_MAGIC)) != 0)
+    {
+        fprintf(stderr, "%s is not a GL trace\n", path);
+        return 1;
+    }
+    if (version != GL_TRACE_VERSION)
+    {
+        fprintf(stderr, "%s is a version %u GL trace, this replays version %u\n", path, version, GL_TRACE_VERSION);
+        return 1;
+    }
+
+    Backend *backend = window ? createWindowBackend() : createHeadlessBackend(headless_options);
+    if (!backend || !backend->create(width, height, "GL replay"))
+    {
+        delete backend;
+        return 1;
+    }
+    backend->setVsync(false);
+
+    // Summed over the passes.
+    std::vector<CallTime> times(TRACE_CALLS);
+    PassResult total;
+    const int first_width = width;
+    const int first_height = height;
+    for (int pass = 0; pass < repeat; pass++)
+    {
+        if (width != first_width || height != first_height)
+        {
+            width = first_width;
+            height = first_height;
+            backend->resize(width, height);
+        }
+        Replay replay(backend, &times[0]);
+        PassResult result;
+        if (!replay.run(trace, width, height, result))
+            break;
+        printf("Replay of %s: %u frames, %llu calls in %.3f s, %.1f fps, %.3f ms per frame\n", path, result.frames,
+               result.calls, result.seconds, result.frames / result.seconds, result.seconds * 1000.0 / result.frames);
+        total.frames += result.frames;
+        total.calls += result.calls;
+        total.seconds += result.seconds;
+    }
+
+    if (total.frames)
+    {
+        std::vector<int> rows;
+        double gl_seconds = 0.0;
+        for (int call = 0; call < TRACE_CALLS; call++)
+        {
+            if (!times[call].count)
+                continue;
+            rows.push_back(call);
+            gl_seconds += times[call].seconds;
+        }
+        std::sort(rows.begin(), rows.end(), [&times](int a, int b) { return times[a].seconds > times[b].seconds; });
+
+        printf("%-38s %12s %12s %10s %7s\n", "Call", "per frame", "ms per frame", "us each", "share");
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            const CallTime &time = times[rows[i]];
+            printf("%-38s %12.2f %12.4f %10.3f %6.1f%%\n", rowName((GLTraceCall)rows[i]),
+                   (double)time.count / total.frames, time.seconds * 1000.0 / total.frames,
+                   time.seconds * 1e6 / time.count, time.seconds * 100.0 / total.seconds);
+        }
+        printf("GL %.3f ms per frame, replay %.3f ms per frame (decoding the trace, mapping names)\n",
+               gl_seconds * 1000.0 / total.frames, (total.seconds - gl_seconds) * 1000.0 / total.frames);
+    }
+
+    backend->destroy();
+    delete backend;
+    return total.frames ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,245 @@
+#include "gl_state.h"
+
+#include <cstring>
+#include <vector>
+
+namespace
+{
+
+const GLuint UNKNOWN = 0xFFFFFFFFu;
+const GLuint TEXTURE_UNITS = 16;
+
+enum TextureTarget
+{
+    TEXTURE_TARGET_2D,
+    TEXTURE_TARGET_2D_ARRAY,
+    TEXTURE_TARGET_BUFFER,
+    TEXTURE_TARGETS
+};
+
+// Capabilities the scenes switch; others are passed on unshadowed.
+const GLenum CAPABILITIES[] = { GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_SCISSOR_TEST, GL_STENCIL_TEST };
+const int CAPABILITY_COUNT = sizeof(CAPABILITIES) / sizeof(CAPABILITIES[0]);
+
+enum UniformType
+{
+    UNIFORM_UNKNOWN,
+    UNIFORM_INT,
+    UNIFORM_VEC3,
+    UNIFORM_MAT4
+};
+
+struct UniformShadow
+{
+    UniformType type;
+    GLfloat values[16];         // An int is kept in the first element's bits
+
+    UniformShadow() : type(UNIFORM_UNKNOWN) {}
+};
+
+GLuint program = UNKNOWN;
+GLuint vertex_array = UNKNOWN;
+GLuint array_buffer = UNKNOWN;
+GLuint texture_buffer = UNKNOWN;
+GLuint active_unit = UNKNOWN;
+GLuint textures[TEXTURE_UNITS][TEXTURE_TARGETS];
+GLuint samplers[TEXTURE_UNITS];
+signed char capabilities[CAPABILITY_COUNT];     // -1 unknown
+
+// By program name, then location. Names are small and handed out in
+// order, so plain vectors do.
+std::vector<std::vector<UniformShadow> > uniforms;
+
+GLStateStats stats;
+
+bool skip(GLStateKind kind, bool unchanged)
+{
+    stats.calls[kind]++;
+    if (unchanged)
+        stats.skipped[kind]++;
+    return unchanged;
+}
+
+int textureTarget(GLenum target)
+{
+    switch (target)
+    {
+    case GL_TEXTURE_2D:
+        return TEXTURE_TARGET_2D;
+    case GL_TEXTURE_2D_ARRAY:
+        return TEXTURE_TARGET_2D_ARRAY;
+    case GL_TEXTURE_BUFFER:
+        return TEXTURE_TARGET_BUFFER;
+    default:
+        return -1;
+    }
+}
+
+// The shadow of location in the bound program, NULL if either is unknown.
+UniformShadow *uniformShadow(GLint location)
+{
+    if (program == UNKNOWN || location < 0)
+        return NULL;
+    if (program >= uniforms.size())
+        uniforms.resize(program + 1);
+    std::vector<UniformShadow> &shadows = uniforms[program];
+    if ((size_t)location >= shadows.size())
+        shadows.resize(location + 1);
+    return &shadows[location];
+}
+
+// Whether value is what the shadow holds; if not, it does from now on.
+bool updateUniform(GLint location, UniformType type, const GLfloat *value, size_t count)
+{
+    UniformShadow *shadow = uniformShadow(location);
+    if (!shadow)
+        return skip(GL_STATE_UNIFORM, false);
+    const bool unchanged = shadow->type == type && !memcmp(shadow->values, value, count * sizeof(GLfloat));
+    shadow->type = type;
+    memcpy(shadow->values, value, count * sizeof(GLfloat));
+    return skip(GL_STATE_UNIFORM, unchanged);
+}
+
+} // namespace
+
+const char *glStateKindName(GLStateKind kind)
+{
+    static const char *const names[GL_STATE_KINDS] =
+    {
+        "program", "vertex array", "buffer", "texture", "sampler", "enable", "uniform"
+    };
+    return names[kind];
+}
+
+void cachedUseProgram(GLuint new_program)
+{
+    if (skip(GL_STATE_PROGRAM, program == new_program))
+        return;
+    glUseProgram(new_program);
+    program = new_program;
+}
+
+void cachedBindVertexArray(GLuint vao)
+{
+    if (skip(GL_STATE_VERTEX_ARRAY, vertex_array == vao))
+        return;
+    glBindVertexArray(vao);
+    vertex_array = vao;
+}
+
+void cachedBindBuffer(GLenum target, GLuint buffer)
+{
+    GLuint *shadow = target == GL_ARRAY_BUFFER ? &array_buffer
+        : target == GL_TEXTURE_BUFFER ? &texture_buffer
+        : NULL;
+    if (skip(GL_STATE_BUFFER, shadow && *shadow == buffer))
+        return;
+    glBindBuffer(target, buffer);
+    if (shadow)
+        *shadow = buffer;
+}
+
+void cachedBindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+    const int slot = textureTarget(target);
+    if (skip(GL_STATE_TEXTURE, slot >= 0 && unit < TEXTURE_UNITS && textures[unit][slot] == texture))
+        return;
+    if (active_unit != unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        active_unit = unit;
+    }
+    glBindTexture(target, texture);
+    if (slot >= 0 && unit < TEXTURE_UNITS)
+        textures[unit][slot] = texture;
+}
+
+void cachedBindSampler(GLuint unit, GLuint sampler)
+{
+    if (skip(GL_STATE_SAMPLER, unit < TEXTURE_UNITS && samplers[unit] == sampler))
+        return;
+    glBindSampler(unit, sampler);
+    if (unit < TEXTURE_UNITS)
+        samplers[unit] = sampler;
+}
+
+void cachedEnable(GLenum capability, bool enabled)
+{
+    int index = 0;
+    while (index < CAPABILITY_COUNT && CAPABILITIES[index] != capability)
+        index++;
+    const bool known = index < CAPABILITY_COUNT;
+    if (skip(GL_STATE_ENABLE, known && capabilities[index] == (enabled ? 1 : 0)))
+        return;
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+    if (known)
+        capabilities[index] = enabled ? 1 : 0;
+}
+
+void cachedUniform1i(GLint location, GLint value)
+{
+    GLfloat bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if (!updateUniform(location, UNIFORM_INT, &bits, 1))
+        glUniform1i(location, value);
+}
+
+void cachedUniform3fv(GLint location, const GLfloat *value)
+{
+    if (!updateUniform(location, UNIFORM_VEC3, value, 3))
+        glUniform3fv(location, 1, value);
+}
+
+void cachedUniformMatrix4(GLint location, const GLfloat *matrix)
+{
+    if (!updateUniform(location, UNIFORM_MAT4, matrix, 16))
+        glUniformMatrix4fv(location, 1, GL_FALSE, matrix);
+}
+
+void invalidateGLState()
+{
+    program = vertex_array = array_buffer = texture_buffer = active_unit = UNKNOWN;
+    for (GLuint unit = 0; unit < TEXTURE_UNITS; unit++)
+    {
+        for (int target = 0; target < TEXTURE_TARGETS; target++)
+            textures[unit][target] = UNKNOWN;
+        samplers[unit] = UNKNOWN;
+    }
+    for (int i = 0; i < CAPABILITY_COUNT; i++)
+        capabilities[i] = -1;
+}
+
+void resetGLState()
+{
+    invalidateGLState();
+    for (size_t i = 0; i < uniforms.size(); i++)
+        uniforms[i].clear();
+    stats = GLStateStats();
+}
+
+void restoreDefaultGLState()
+{
+    glUseProgram(0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    for (int unit = 7; unit >= 0; unit--)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+    glDisable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_BLEND);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    invalidateGLState();
+}
+
+GLStateStats glStateStats()
+{
+    return stats;
+}
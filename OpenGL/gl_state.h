@@ -0,0 +1,82 @@
+#pragma once
+
+#include "gl_trace.h"
+
+// Shadow of the GL bindings the frame loop keeps setting to what they
+// already are: the program, the vertex array, array and texture buffers,
+// textures and samplers per unit, enables, and the uniforms of each
+// program. A cached* call compares against the shadow and only reaches the
+// driver when something changes; each is counted either way, so
+// glStateStats shows how much was skipped.
+//
+// The shadow is only right while every change goes through it. Code that
+// binds behind its back (texture loaders, the asset pump) must call
+// invalidateGLState after, and so must code that deletes objects that may
+// still be bound, since that unbinds them. The host does so after each
+// scene's onAwake and when it resets the state between scenes. Use from the
+// thread that has the context only.
+
+enum GLStateKind
+{
+    GL_STATE_PROGRAM,
+    GL_STATE_VERTEX_ARRAY,
+    GL_STATE_BUFFER,
+    GL_STATE_TEXTURE,           // Including the glActiveTexture calls it takes
+    GL_STATE_SAMPLER,
+    GL_STATE_ENABLE,
+    GL_STATE_UNIFORM,
+    GL_STATE_KINDS
+};
+
+struct GLStateStats
+{
+    unsigned long long calls[GL_STATE_KINDS];      // Made through the cache
+    unsigned long long skipped[GL_STATE_KINDS];    // Of those, not passed on
+
+    GLStateStats()
+    {
+        for (int i = 0; i < GL_STATE_KINDS; i++)
+            calls[i] = skipped[i] = 0;
+    }
+};
+
+const char *glStateKindName(GLStateKind kind);
+
+void cachedUseProgram(GLuint program);
+void cachedBindVertexArray(GLuint vao);
+
+// GL_ARRAY_BUFFER and GL_TEXTURE_BUFFER are shadowed; other targets go
+// straight to glBindBuffer.
+void cachedBindBuffer(GLenum target, GLuint buffer);
+
+// Binds texture to target on unit, switching the active unit only when
+// needed. GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY and GL_TEXTURE_BUFFER on units
+// below 16 are shadowed.
+void cachedBindTexture(GLuint unit, GLenum target, GLuint texture);
+void cachedBindSampler(GLuint unit, GLuint sampler);
+
+void cachedEnable(GLenum capability, bool enabled);
+
+// Uniforms of the program bound through cachedUseProgram. Shadowed per
+// program and location, so a value a program already holds is not sent
+// again in later frames either.
+void cachedUniform1i(GLint location, GLint value);
+void cachedUniform3fv(GLint location, const GLfloat *value);
+void cachedUniformMatrix4(GLint location, const GLfloat *matrix);
+
+// Forgets the bindings and enables. Uniform values stay: they belong to
+// the programs and only change through glUniform*.
+void invalidateGLState();
+
+// Forgets everything, the uniform values too, and zeroes the statistics.
+// For scene changes, where programs are deleted and their names reused.
+void resetGLState();
+
+// Sets the state scenes commonly change back to the defaults of a fresh
+// context (no program, vertex array or textures bound, depth test, culling
+// and blending off, black clear colour), then forgets the shadow. Leaves the
+// framebuffer binding alone: headless rendering goes to the backend's
+// offscreen one. The host calls it after each scene's onShutdown.
+void restoreDefaultGLState();
+
+GLStateStats glStateStats();
@@ -0,0 +1,1025 @@
+#define GL_TRACE_NO_REDIRECT
+#include "gl_trace.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "camera.h"
+#include "fileio.h"
+
+// What the redirected GL 1.1 calls go through; the GL's own while no trace
+// runs.
+#define GL_TRACE_DEFINE(name) decltype(&gl##name) __glTrace##name = gl##name;
+GL_TRACE_CORE_CALLS(GL_TRACE_DEFINE)
+#undef GL_TRACE_DEFINE
+
+namespace
+{
+
+// Records are gathered and written in blocks of this size.
+const size_t BUFFER_BYTES = 1 << 20;
+
+struct BufferBinding
+{
+    GLenum target;
+    GLuint buffer;
+};
+
+struct Mapping
+{
+    GLuint buffer;
+    unsigned char *data;
+    GLintptr offset;
+    GLsizeiptr length;
+    GLbitfield access;
+};
+
+FILE *file = NULL;
+std::vector<unsigned char> records;
+GLTraceStats stats;
+
+// What the recording needs to know to tell how many bytes a call reads.
+std::vector<BufferBinding> bindings;
+std::vector<Mapping> mappings;
+GLint unpack_alignment = 4;
+GLint unpack_row_length = 0;
+GLint unpack_image_height = 0;
+
+// The entry points the recording ones call on to.
+#define GL_TRACE_REAL_CORE(name) decltype(__glTrace##name) real##name;
+#define GL_TRACE_REAL_GLEW(name) decltype(__glew##name) real##name;
+GL_TRACE_CORE_CALLS(GL_TRACE_REAL_CORE)
+GL_TRACE_GLEW_CALLS(GL_TRACE_REAL_GLEW)
+#undef GL_TRACE_REAL_CORE
+#undef GL_TRACE_REAL_GLEW
+
+void flush()
+{
+    if (records.empty())
+        return;
+    fwrite(&records[0], 1, records.size(), file);
+    stats.bytes += records.size();
+    records.clear();
+}
+
+void putBytes(const void *data, size_t size)
+{
+    if (records.size() + size > BUFFER_BYTES)
+        flush();
+    if (size > BUFFER_BYTES)
+    {
+        fwrite(data, 1, size, file);
+        stats.bytes += size;
+        return;
+    }
+    const unsigned char *bytes = (const unsigned char *)data;
+    records.insert(records.end(), bytes, bytes + size);
+}
+
+void put8(unsigned char value)
+{
+    putBytes(&value, 1);
+}
+
+void put32(unsigned int value)
+{
+    putBytes(&value, 4);
+}
+
+void put64(unsigned long long value)
+{
+    putBytes(&value, 8);
+}
+
+void putFloats(const GLfloat *values, size_t count)
+{
+    putBytes(values, count * sizeof(GLfloat));
+}
+
+void putData(const void *data, size_t size)
+{
+    put64(size);
+    putBytes(data, size);
+}
+
+void begin(GLTraceCall call)
+{
+    put8((unsigned char)call);
+    stats.calls++;
+}
+
+GLuint boundBuffer(GLenum target)
+{
+    for (size_t i = 0; i < bindings.size(); i++)
+    {
+        if (bindings[i].target == target)
+            return bindings[i].buffer;
+    }
+    return 0;
+}
+
+void bindBuffer(GLenum target, GLuint buffer)
+{
+    for (size_t i = 0; i < bindings.size(); i++)
+    {
+        if (bindings[i].target == target)
+        {
+            bindings[i].buffer = buffer;
+            return;
+        }
+    }
+    BufferBinding binding = { target, buffer };
+    bindings.push_back(binding);
+}
+
+Mapping *findMapping(GLuint buffer)
+{
+    for (size_t i = 0; i < mappings.size(); i++)
+    {
+        if (mappings[i].buffer == buffer)
+            return &mappings[i];
+    }
+    return NULL;
+}
+
+// Records size bytes the GL is about to read at offset of a mapped buffer.
+void putMappedWrite(const Mapping &mapping, GLintptr offset, size_t size)
+{
+    if (offset < mapping.offset || offset + (GLintptr)size > mapping.offset + mapping.length)
+        return;
+    put8(TRACE_MAPPED_WRITE);
+    put32(mapping.buffer);
+    put64(offset);
+    putData(mapping.data + (offset - mapping.offset), size);
+}
+
+size_t componentCount(GLenum format)
+{
+    switch (format)
+    {
+    case GL_RG:
+    case GL_RG_INTEGER:
+    case GL_DEPTH_STENCIL:
+        return 2;
+    case GL_RGB:
+    case GL_BGR:
+    case GL_RGB_INTEGER:
+    case GL_BGR_INTEGER:
+        return 3;
+    case GL_RGBA:
+    case GL_BGRA:
+    case GL_RGBA_INTEGER:
+    case GL_BGRA_INTEGER:
+        return 4;
+    default:
+        return 1;
+    }
+}
+
+size_t pixelBytes(GLenum format, GLenum type)
+{
+    switch (type)
+    {
+    case GL_UNSIGNED_BYTE:
+    case GL_BYTE:
+        return componentCount(format);
+    case GL_UNSIGNED_SHORT:
+    case GL_SHORT:
+    case GL_HALF_FLOAT:
+        return componentCount(format) * 2;
+    case GL_UNSIGNED_BYTE_3_3_2:
+    case GL_UNSIGNED_BYTE_2_3_3_REV:
+        return 1;
+    case GL_UNSIGNED_SHORT_5_6_5:
+    case GL_UNSIGNED_SHORT_5_6_5_REV:
+    case GL_UNSIGNED_SHORT_4_4_4_4:
+    case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+    case GL_UNSIGNED_SHORT_5_5_5_1:
+    case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+        return 2;
+    case GL_UNSIGNED_INT_8_8_8_8:
+    case GL_UNSIGNED_INT_8_8_8_8_REV:
+    case GL_UNSIGNED_INT_10_10_10_2:
+    case GL_UNSIGNED_INT_2_10_10_10_REV:
+    case GL_UNSIGNED_INT_24_8:
+    case GL_UNSIGNED_INT_10F_11F_11F_REV:
+    case GL_UNSIGNED_INT_5_9_9_9_REV:
+        return 4;
+    case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+        return 8;
+    default:                    // GL_UNSIGNED_INT, GL_INT, GL_FLOAT
+        return componentCount(format) * 4;
+    }
+}
+
+// Bytes a client-memory upload reads under the current unpack state.
+size_t imageBytes(GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type)
+{
+    if (width <= 0 || height <= 0 || depth <= 0)
+        return 0;
+    const size_t pixel = pixelBytes(format, type);
+    const size_t row_pixels = unpack_row_length > 0 ? unpack_row_length : width;
+    const size_t alignment = unpack_alignment > 0 ? unpack_alignment : 1;
+    const size_t row = (row_pixels * pixel + alignment - 1) / alignment * alignment;
+    const size_t image = row * (unpack_image_height > 0 ? unpack_image_height : height);
+    return image * (depth - 1) + row * (height - 1) + width * pixel;
+}
+
+// Before the call's record: what a persistently mapped unpack buffer holds
+// there is recorded, since nothing else says when it was written.
+void putUnpackSource(const void *pixels, size_t size)
+{
+    const GLuint unpack = boundBuffer(GL_PIXEL_UNPACK_BUFFER);
+    const Mapping *mapping = unpack ? findMapping(unpack) : NULL;
+    if (mapping && (mapping->access & GL_MAP_PERSISTENT_BIT))
+        putMappedWrite(*mapping, (GLintptr)pixels, size);
+}
+
+void putPixels(const void *pixels, size_t size)
+{
+    if (boundBuffer(GL_PIXEL_UNPACK_BUFFER))
+    {
+        put8(TRACE_PIXELS_OFFSET);
+        put64((size_t)pixels);
+    }
+    else if (pixels)
+    {
+        put8(TRACE_PIXELS_DATA);
+        putData(pixels, size);
+    }
+    else
+        put8(TRACE_PIXELS_NONE);
+}
+
+void putNames(GLsizei n, const GLuint *names)
+{
+    put32(n);
+    for (GLsizei i = 0; i < n; i++)
+        put32(names[i]);
+}
+
+// GL 1.1
+
+void GLAPIENTRY traceBindTexture(GLenum target, GLuint texture)
+{
+    realBindTexture(target, texture);
+    begin(TRACE_BindTexture);
+    put32(target);
+    put32(texture);
+}
+
+void GLAPIENTRY traceClear(GLbitfield mask)
+{
+    realClear(mask);
+    begin(TRACE_Clear);
+    put32(mask);
+}
+
+void GLAPIENTRY traceClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha)
+{
+    realClearColor(red, green, blue, alpha);
+    const GLfloat color[4] = { red, green, blue, alpha };
+    begin(TRACE_ClearColor);
+    putFloats(color, 4);
+}
+
+void GLAPIENTRY traceDeleteTextures(GLsizei n, const GLuint *textures)
+{
+    realDeleteTextures(n, textures);
+    begin(TRACE_DeleteTextures);
+    putNames(n, textures);
+}
+
+void GLAPIENTRY traceDepthFunc(GLenum func)
+{
+    realDepthFunc(func);
+    begin(TRACE_DepthFunc);
+    put32(func);
+}
+
+void GLAPIENTRY traceDisable(GLenum cap)
+{
+    realDisable(cap);
+    begin(TRACE_Disable);
+    put32(cap);
+}
+
+void GLAPIENTRY traceDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    realDrawArrays(mode, first, count);
+    begin(TRACE_DrawArrays);
+    put32(mode);
+    put32(first);
+    put32(count);
+}
+
+void GLAPIENTRY traceDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices)
+{
+    realDrawElements(mode, count, type, indices);
+    begin(TRACE_DrawElements);
+    put32(mode);
+    put32(count);
+    put32(type);
+    put64((size_t)indices);
+}
+
+void GLAPIENTRY traceEnable(GLenum cap)
+{
+    realEnable(cap);
+    begin(TRACE_Enable);
+    put32(cap);
+}
+
+void GLAPIENTRY traceFrontFace(GLenum mode)
+{
+    realFrontFace(mode);
+    begin(TRACE_FrontFace);
+    put32(mode);
+}
+
+void GLAPIENTRY traceGenTextures(GLsizei n, GLuint *textures)
+{
+    realGenTextures(n, textures);
+    begin(TRACE_GenTextures);
+    putNames(n, textures);
+}
+
+void GLAPIENTRY tracePixelStorei(GLenum pname, GLint param)
+{
+    realPixelStorei(pname, param);
+    if (pname == GL_UNPACK_ALIGNMENT)
+        unpack_alignment = param;
+    else if (pname == GL_UNPACK_ROW_LENGTH)
+        unpack_row_length = param;
+    else if (pname == GL_UNPACK_IMAGE_HEIGHT)
+        unpack_image_height = param;
+    begin(TRACE_PixelStorei);
+    put32(pname);
+    put32(param);
+}
+
+void GLAPIENTRY traceTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height,
+                                GLint border, GLenum format, GLenum type, const void *pixels)
+{
+    realTexImage2D(target, level, internalformat, width, height, border, format, type, pixels);
+    const size_t size = imageBytes(width, height, 1, format, type);
+    putUnpackSource(pixels, size);
+    begin(TRACE_TexImage2D);
+    put32(target);
+    put32(level);
+    put32(internalformat);
+    put32(width);
+    put32(height);
+    put32(border);
+    put32(format);
+    put32(type);
+    putPixels(pixels, size);
+}
+
+void GLAPIENTRY traceTexParameterf(GLenum target, GLenum pname, GLfloat param)
+{
+    realTexParameterf(target, pname, param);
+    begin(TRACE_TexParameterf);
+    put32(target);
+    put32(pname);
+    putFloats(&param, 1);
+}
+
+void GLAPIENTRY traceTexParameteri(GLenum target, GLenum pname, GLint param)
+{
+    realTexParameteri(target, pname, param);
+    begin(TRACE_TexParameteri);
+    put32(target);
+    put32(pname);
+    put32(param);
+}
+
+void GLAPIENTRY traceTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height,
+                                   GLenum format, GLenum type, const void *pixels)
+{
+    realTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels);
+    const size_t size = imageBytes(width, height, 1, format, type);
+    putUnpackSource(pixels, size);
+    begin(TRACE_TexSubImage2D);
+    put32(target);
+    put32(level);
+    put32(xoffset);
+    put32(yoffset);
+    put32(width);
+    put32(height);
+    put32(format);
+    put32(type);
+    putPixels(pixels, size);
+}
+
+void GLAPIENTRY traceViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    realViewport(x, y, width, height);
+    begin(TRACE_Viewport);
+    put32(x);
+    put32(y);
+    put32(width);
+    put32(height);
+}
+
+// Loaded by GLEW
+
+void GLAPIENTRY traceActiveTexture(GLenum texture)
+{
+    realActiveTexture(texture);
+    begin(TRACE_ActiveTexture);
+    put32(texture);
+}
+
+void GLAPIENTRY traceAttachShader(GLuint program, GLuint shader)
+{
+    realAttachShader(program, shader);
+    begin(TRACE_AttachShader);
+    put32(program);
+    put32(shader);
+}
+
+void GLAPIENTRY traceBindBuffer(GLenum target, GLuint buffer)
+{
+    realBindBuffer(target, buffer);
+    bindBuffer(target, buffer);
+    begin(TRACE_BindBuffer);
+    put32(target);
+    put32(buffer);
+}
+
+void GLAPIENTRY traceBindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    realBindBufferBase(target, index, buffer);
+    bindBuffer(target, buffer);
+    begin(TRACE_BindBufferBase);
+    put32(target);
+    put32(index);
+    put32(buffer);
+}
+
+void GLAPIENTRY traceBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    realBindBufferRange(target, index, buffer, offset, size);
+    bindBuffer(target, buffer);
+    // Shaders read the range from now on; like an unpack source, nothing
+    // else says when a persistent mapping of it was written.
+    const Mapping *mapping = buffer ? findMapping(buffer) : NULL;
+    if (mapping && (mapping->access & GL_MAP_PERSISTENT_BIT))
+        putMappedWrite(*mapping, offset, size);
+    begin(TRACE_BindBufferRange);
+    put32(target);
+    put32(index);
+    put32(buffer);
+    put64(offset);
+    put64(size);
+}
+
+void GLAPIENTRY traceBindSampler(GLuint unit, GLuint sampler)
+{
+    realBindSampler(unit, sampler);
+    begin(TRACE_BindSampler);
+    put32(unit);
+    put32(sampler);
+}
+
+void GLAPIENTRY traceBindVertexArray(GLuint array)
+{
+    realBindVertexArray(array);
+    begin(TRACE_BindVertexArray);
+    put32(array);
+}
+
+void GLAPIENTRY traceBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage)
+{
+    realBufferData(target, size, data, usage);
+    begin(TRACE_BufferData);
+    put32(target);
+    put64(size);
+    putData(data, data ? size : 0);
+    put32(usage);
+}
+
+void GLAPIENTRY traceBufferStorage(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags)
+{
+    realBufferStorage(target, size, data, flags);
+    begin(TRACE_BufferStorage);
+    put32(target);
+    put64(size);
+    putData(data, data ? size : 0);
+    put32(flags);
+}
+
+void GLAPIENTRY traceBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data)
+{
+    realBufferSubData(target, offset, size, data);
+    begin(TRACE_BufferSubData);
+    put32(target);
+    put64(offset);
+    putData(data, size);
+}
+
+void GLAPIENTRY traceClearBufferData(GLenum target, GLenum internalformat, GLenum format, GLenum type, const void *data)
+{
+    realClearBufferData(target, internalformat, format, type, data);
+    begin(TRACE_ClearBufferData);
+    put32(target);
+    put32(internalformat);
+    put32(format);
+    put32(type);
+    putData(data, data ? pixelBytes(format, type) : 0);
+}
+
+void GLAPIENTRY traceClearBufferSubData(GLenum target, GLenum internalformat, GLintptr offset, GLsizeiptr size,
+                                        GLenum format, GLenum type, const void *data)
+{
+    realClearBufferSubData(target, internalformat, offset, size, format, type, data);
+    begin(TRACE_ClearBufferSubData);
+    put32(target);
+    put32(internalformat);
+    put64(offset);
+    put64(size);
+    put32(format);
+    put32(type);
+    putData(data, data ? pixelBytes(format, type) : 0);
+}
+
+void GLAPIENTRY traceClearBufferfv(GLenum buffer, GLint drawbuffer, const GLfloat *value)
+{
+    realClearBufferfv(buffer, drawbuffer, value);
+    begin(TRACE_ClearBufferfv);
+    put32(buffer);
+    put32(drawbuffer);
+    putFloats(value, buffer == GL_COLOR ? 4 : 1);
+}
+
+GLenum GLAPIENTRY traceClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+    const GLenum result = realClientWaitSync(sync, flags, timeout);
+    begin(TRACE_ClientWaitSync);
+    put64((size_t)sync);
+    put32(flags);
+    put64(timeout);
+    return result;
+}
+
+void GLAPIENTRY traceCompileShader(GLuint shader)
+{
+    realCompileShader(shader);
+    begin(TRACE_CompileShader);
+    put32(shader);
+}
+
+void GLAPIENTRY traceCompressedTexImage2D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height,
+                                          GLint border, GLsizei imageSize, const void *data)
+{
+    realCompressedTexImage2D(target, level, internalformat, width, height, border, imageSize, data);
+    putUnpackSource(data, imageSize);
+    begin(TRACE_CompressedTexImage2D);
+    put32(target);
+    put32(level);
+    put32(internalformat);
+    put32(width);
+    put32(height);
+    put32(border);
+    put32(imageSize);
+    putPixels(data, imageSize);
+}
+
+void GLAPIENTRY traceCompressedTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width,
+                                             GLsizei height, GLenum format, GLsizei imageSize, const void *data)
+{
+    realCompressedTexSubImage2D(target, level, xoffset, yoffset, width, height, format, imageSize, data);
+    putUnpackSource(data, imageSize);
+    begin(TRACE_CompressedTexSubImage2D);
+    put32(target);
+    put32(level);
+    put32(xoffset);
+    put32(yoffset);
+    put32(width);
+    put32(height);
+    put32(format);
+    put32(imageSize);
+    putPixels(data, imageSize);
+}
+
+GLuint GLAPIENTRY traceCreateProgram()
+{
+    const GLuint program = realCreateProgram();
+    begin(TRACE_CreateProgram);
+    put32(program);
+    return program;
+}
+
+GLuint GLAPIENTRY traceCreateShader(GLenum type)
+{
+    const GLuint shader = realCreateShader(type);
+    begin(TRACE_CreateShader);
+    put32(type);
+    put32(shader);
+    return shader;
+}
+
+void GLAPIENTRY traceDeleteBuffers(GLsizei n, const GLuint *buffers)
+{
+    realDeleteBuffers(n, buffers);
+    begin(TRACE_DeleteBuffers);
+    putNames(n, buffers);
+
+    // Deleting unbinds and unmaps.
+    for (GLsizei i = 0; i < n; i++)
+    {
+        for (size_t b = 0; b < bindings.size(); b++)
+        {
+            if (bindings[b].buffer == buffers[i])
+                bindings[b].buffer = 0;
+        }
+        for (size_t m = mappings.size(); m-- > 0;)
+        {
+            if (mappings[m].buffer == buffers[i])
+                mappings.erase(mappings.begin() + m);
+        }
+    }
+}
+
+void GLAPIENTRY traceDeleteProgram(GLuint program)
+{
+    realDeleteProgram(program);
+    begin(TRACE_DeleteProgram);
+    put32(program);
+}
+
+void GLAPIENTRY traceDeleteShader(GLuint shader)
+{
+    realDeleteShader(shader);
+    begin(TRACE_DeleteShader);
+    put32(shader);
+}
+
+void GLAPIENTRY traceDeleteSync(GLsync sync)
+{
+    realDeleteSync(sync);
+    begin(TRACE_DeleteSync);
+    put64((size_t)sync);
+}
+
+void GLAPIENTRY traceDeleteVertexArrays(GLsizei n, const GLuint *arrays)
+{
+    realDeleteVertexArrays(n, arrays);
+    begin(TRACE_DeleteVertexArrays);
+    putNames(n, arrays);
+}
+
+void GLAPIENTRY traceDisableVertexAttribArray(GLuint index)
+{
+    realDisableVertexAttribArray(index);
+    begin(TRACE_DisableVertexAttribArray);
+    put32(index);
+}
+
+void GLAPIENTRY traceDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei primcount)
+{
+    realDrawElementsInstanced(mode, count, type, indices, primcount);
+    begin(TRACE_DrawElementsInstanced);
+    put32(mode);
+    put32(count);
+    put32(type);
+    put64((size_t)indices);
+    put32(primcount);
+}
+
+void GLAPIENTRY traceDrawElementsInstancedBaseInstance(GLenum mode, GLsizei count, GLenum type, const void *indices,
+                                                       GLsizei primcount, GLuint baseinstance)
+{
+    realDrawElementsInstancedBaseInstance(mode, count, type, indices, primcount, baseinstance);
+    begin(TRACE_DrawElementsInstancedBaseInstance);
+    put32(mode);
+    put32(count);
+    put32(type);
+    put64((size_t)indices);
+    put32(primcount);
+    put32(baseinstance);
+}
+
+void GLAPIENTRY traceEnableVertexAttribArray(GLuint index)
+{
+    realEnableVertexAttribArray(index);
+    begin(TRACE_EnableVertexAttribArray);
+    put32(index);
+}
+
+GLsync GLAPIENTRY traceFenceSync(GLenum condition, GLbitfield flags)
+{
+    const GLsync sync = realFenceSync(condition, flags);
+    begin(TRACE_FenceSync);
+    put32(condition);
+    put32(flags);
+    put64((size_t)sync);
+    return sync;
+}
+
+void GLAPIENTRY traceGenBuffers(GLsizei n, GLuint *buffers)
+{
+    realGenBuffers(n, buffers);
+    begin(TRACE_GenBuffers);
+    putNames(n, buffers);
+}
+
+void GLAPIENTRY traceGenVertexArrays(GLsizei n, GLuint *arrays)
+{
+    realGenVertexArrays(n, arrays);
+    begin(TRACE_GenVertexArrays);
+    putNames(n, arrays);
+}
+
+void GLAPIENTRY traceGenerateMipmap(GLenum target)
+{
+    realGenerateMipmap(target);
+    begin(TRACE_GenerateMipmap);
+    put32(target);
+}
+
+void GLAPIENTRY traceGetBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, void *data)
+{
+    realGetBufferSubData(target, offset, size, data);
+    begin(TRACE_GetBufferSubData);
+    put32(target);
+    put64(offset);
+    put64(size);
+}
+
+GLint GLAPIENTRY traceGetUniformLocation(GLuint program, const GLchar *name)
+{
+    const GLint location = realGetUniformLocation(program, name);
+    begin(TRACE_GetUniformLocation);
+    put32(program);
+    putData(name, strlen(name));
+    put32(location);
+    return location;
+}
+
+void GLAPIENTRY traceLinkProgram(GLuint program)
+{
+    realLinkProgram(program);
+    begin(TRACE_LinkProgram);
+    put32(program);
+}
+
+void *GLAPIENTRY traceMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+    void *data = realMapBufferRange(target, offset, length, access);
+    const GLuint buffer = boundBuffer(target);
+    begin(TRACE_MapBufferRange);
+    put32(target);
+    put64(offset);
+    put64(length);
+    put32(access);
+    put32(buffer);
+    if (data && buffer)
+    {
+        Mapping mapping = { buffer, (unsigned char *)data, offset, length, access };
+        mappings.push_back(mapping);
+    }
+    return data;
+}
+
+void GLAPIENTRY traceShaderSource(GLuint shader, GLsizei count, const GLchar *const *string, const GLint *length)
+{
+    realShaderSource(shader, count, string, length);
+    begin(TRACE_ShaderSource);
+    put32(shader);
+    put32(count);
+    for (GLsizei i = 0; i < count; i++)
+        putData(string[i], length && length[i] >= 0 ? length[i] : strlen(string[i]));
+}
+
+void GLAPIENTRY traceTexBuffer(GLenum target, GLenum internalformat, GLuint buffer)
+{
+    realTexBuffer(target, internalformat, buffer);
+    begin(TRACE_TexBuffer);
+    put32(target);
+    put32(internalformat);
+    put32(buffer);
+}
+
+void GLAPIENTRY traceTexImage3D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height,
+                                GLsizei depth, GLint border, GLenum format, GLenum type, const void *pixels)
+{
+    realTexImage3D(target, level, internalformat, width, height, depth, border, format, type, pixels);
+    const size_t size = imageBytes(width, height, depth, format, type);
+    putUnpackSource(pixels, size);
+    begin(TRACE_TexImage3D);
+    put32(target);
+    put32(level);
+    put32(internalformat);
+    put32(width);
+    put32(height);
+    put32(depth);
+    put32(border);
+    put32(format);
+    put32(type);
+    putPixels(pixels, size);
+}
+
+void GLAPIENTRY traceTexStorage2D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height)
+{
+    realTexStorage2D(target, levels, internalformat, width, height);
+    begin(TRACE_TexStorage2D);
+    put32(target);
+    put32(levels);
+    put32(internalformat);
+    put32(width);
+    put32(height);
+}
+
+void GLAPIENTRY traceTexStorage3D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height,
+                                  GLsizei depth)
+{
+    realTexStorage3D(target, levels, internalformat, width, height, depth);
+    begin(TRACE_TexStorage3D);
+    put32(target);
+    put32(levels);
+    put32(internalformat);
+    put32(width);
+    put32(height);
+    put32(depth);
+}
+
+void GLAPIENTRY traceTexSubImage3D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width,
+                                   GLsizei height, GLsizei depth, GLenum format, GLenum type, const void *pixels)
+{
+    realTexSubImage3D(target, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels);
+    const size_t size = imageBytes(width, height, depth, format, type);
+    putUnpackSource(pixels, size);
+    begin(TRACE_TexSubImage3D);
+    put32(target);
+    put32(level);
+    put32(xoffset);
+    put32(yoffset);
+    put32(zoffset);
+    put32(width);
+    put32(height);
+    put32(depth);
+    put32(format);
+    put32(type);
+    putPixels(pixels, size);
+}
+
+void GLAPIENTRY traceUniform1i(GLint location, GLint v0)
+{
+    realUniform1i(location, v0);
+    begin(TRACE_Uniform1i);
+    put32(location);
+    put32(v0);
+}
+
+void GLAPIENTRY traceUniform3fv(GLint location, GLsizei count, const GLfloat *value)
+{
+    realUniform3fv(location, count, value);
+    begin(TRACE_Uniform3fv);
+    put32(location);
+    put32(count);
+    putFloats(value, count * 3);
+}
+
+void GLAPIENTRY traceUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+{
+    realUniformMatrix4fv(location, count, transpose, value);
+    begin(TRACE_UniformMatrix4fv);
+    put32(location);
+    put32(count);
+    put32(transpose);
+    putFloats(value, count * 16);
+}
+
+GLboolean GLAPIENTRY traceUnmapBuffer(GLenum target)
+{
+    // What was written goes in before the unmap, while it can still be read.
+    const GLuint buffer = boundBuffer(target);
+    for (size_t m = mappings.size(); m-- > 0;)
+    {
+        const Mapping &mapping = mappings[m];
+        if (mapping.buffer != buffer)
+            continue;
+        if ((mapping.access & GL_MAP_WRITE_BIT) && !(mapping.access & GL_MAP_PERSISTENT_BIT))
+            putMappedWrite(mapping, mapping.offset, mapping.length);
+        mappings.erase(mappings.begin() + m);
+    }
+    begin(TRACE_UnmapBuffer);
+    put32(target);
+    return realUnmapBuffer(target);
+}
+
+void GLAPIENTRY traceUseProgram(GLuint program)
+{
+    realUseProgram(program);
+    begin(TRACE_UseProgram);
+    put32(program);
+}
+
+void GLAPIENTRY traceVertexAttribDivisor(GLuint index, GLuint divisor)
+{
+    realVertexAttribDivisor(index, divisor);
+    begin(TRACE_VertexAttribDivisor);
+    put32(index);
+    put32(divisor);
+}
+
+void GLAPIENTRY traceVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride,
+                                         const void *pointer)
+{
+    realVertexAttribPointer(index, size, type, normalized, stride, pointer);
+    begin(TRACE_VertexAttribPointer);
+    put32(index);
+    put32(size);
+    put32(type);
+    put32(normalized);
+    put32(stride);
+    put64((size_t)pointer);
+}
+
+} // namespace
+
+const char *glTraceCallName(GLTraceCall call)
+{
+    static const char *const names[TRACE_CALLS] =
+    {
+        "(end)", "(frame)", "(mapped write)",
+#define GL_TRACE_NAME(name) "gl" #name,
+        GL_TRACE_CORE_CALLS(GL_TRACE_NAME)
+        GL_TRACE_GLEW_CALLS(GL_TRACE_NAME)
+#undef GL_TRACE_NAME
+    };
+    return call < TRACE_CALLS ? names[call] : "(unknown)";
+}
+
+bool startGLTrace(const char *path)
+{
+    if (file)
+    {
+        printf("A GL trace is already being written\n");
+        return false;
+    }
+    file = openFile(path, "wb");
+    if (!file)
+    {
+        printf("%s could not be written\n", path);
+        return false;
+    }
+
+    records.reserve(BUFFER_BYTES);
+    stats = GLTraceStats();
+    bindings.clear();
+    mappings.clear();
+    unpack_alignment = 4;
+    unpack_row_length = 0;
+    unpack_image_height = 0;
+
+    putBytes(GL_TRACE_MAGIC, sizeof(GL_TRACE_MAGIC));
+    put32(GL_TRACE_VERSION);
+    put32(framebufferWidth());
+    put32(framebufferHeight());
+
+    // Entry points the context lacks stay NULL, so the scenes' checks for
+    // them still work.
+#define GL_TRACE_HOOK_CORE(name) real##name = __glTrace##name; __glTrace##name = trace##name;
+#define GL_TRACE_HOOK_GLEW(name) real##name = __glew##name; if (__glew##name) __glew##name = trace##name;
+    GL_TRACE_CORE_CALLS(GL_TRACE_HOOK_CORE)
+    GL_TRACE_GLEW_CALLS(GL_TRACE_HOOK_GLEW)
+#undef GL_TRACE_HOOK_CORE
+#undef GL_TRACE_HOOK_GLEW
+    return true;
+}
+
+void markGLTraceFrame()
+{
+    if (!file)
+        return;
+    put8(TRACE_FRAME);
+    put32(framebufferWidth());
+    put32(framebufferHeight());
+    stats.frames++;
+}
+
+GLTraceStats stopGLTrace()
+{
+    if (!file)
+        return stats;
+
+#define GL_TRACE_UNHOOK_CORE(name) __glTrace##name = real##name;
+#define GL_TRACE_UNHOOK_GLEW(name) __glew##name = real##name;
+    GL_TRACE_CORE_CALLS(GL_TRACE_UNHOOK_CORE)
+    GL_TRACE_GLEW_CALLS(GL_TRACE_UNHOOK_GLEW)
+#undef GL_TRACE_UNHOOK_CORE
+#undef GL_TRACE_UNHOOK_GLEW
+
+    put8(TRACE_END);
+    flush();
+    if (ferror(file))
+        printf("The GL trace could not be written completely\n");
+    fclose(file);
+    file = NULL;
+    std::vector<unsigned char>().swap(records);
+    return stats;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstddef>
+
+// Records the GL calls of a run into a compact binary trace that the
+// gl_replay tool (gl_replay.cpp) plays back on its own, so the cost of the
+// driver and of submission can be measured without the scenes' own work.
+//
+//     startGLTrace("run.gltrace");   // right after the context is created
+//     ...                            // markGLTraceFrame at the start of each frame
+//     stopGLTrace();                 // before it is destroyed
+//
+// Calls are caught by swapping GLEW's function pointers for recording ones
+// while a trace runs. The GL 1.1 entry points (draws, clears, texture
+// uploads) are not loaded by GLEW, so this header sends the ones below
+// through pointers of its own; every GL header of the project includes it
+// instead of <GL/glew.h>. Off, a call costs the same indirection as any
+// GLEW call.
+//
+// Each call is recorded with the data it reads: buffer contents, pixels,
+// shader sources, uniform values. Names the GL hands out are recorded as
+// they came, and the replay maps them to its own. Data written through a
+// mapping is recorded when the buffer is unmapped, or for persistent
+// mappings when a texture upload reads from it or a range of it is bound,
+// so it must be written before that. Queries, framebuffer calls
+// and other calls not listed here are left out: the trace is the scenes'
+// stream, not the host's or the backend's. Start on a fresh context, since
+// objects made before the start are unknown to the replay.
+
+// GL 1.1 calls sent through the pointers below.
+#define GL_TRACE_CORE_CALLS(X) \
+    X(BindTexture) X(Clear) X(ClearColor) X(DeleteTextures) X(DepthFunc) X(Disable) \
+    X(DrawArrays) X(DrawElements) X(Enable) X(FrontFace) X(GenTextures) X(PixelStorei) \
+    X(TexImage2D) X(TexParameterf) X(TexParameteri) X(TexSubImage2D) X(Viewport)
+
+// Calls loaded by GLEW. The position in the lists is the call's number in
+// the trace: add calls at the end of this one, or bump GL_TRACE_VERSION.
+#define GL_TRACE_GLEW_CALLS(X) \
+    X(ActiveTexture) X(AttachShader) X(BindBuffer) X(BindBufferBase) X(BindSampler) \
+    X(BindVertexArray) X(BufferData) X(BufferStorage) X(BufferSubData) X(ClearBufferData) \
+    X(ClearBufferSubData) X(ClearBufferfv) X(ClientWaitSync) X(CompileShader) \
+    X(CompressedTexImage2D) X(CompressedTexSubImage2D) X(CreateProgram) X(CreateShader) \
+    X(DeleteBuffers) X(DeleteProgram) X(DeleteShader) X(DeleteSync) X(DeleteVertexArrays) \
+    X(DisableVertexAttribArray) X(DrawElementsInstanced) X(DrawElementsInstancedBaseInstance) \
+    X(EnableVertexAttribArray) X(FenceSync) X(GenBuffers) X(GenVertexArrays) X(GenerateMipmap) \
+    X(GetBufferSubData) X(GetUniformLocation) X(LinkProgram) X(MapBufferRange) X(ShaderSource) \
+    X(TexBuffer) X(TexImage3D) X(TexStorage2D) X(TexStorage3D) X(TexSubImage3D) X(Uniform1i) \
+    X(Uniform3fv) X(UniformMatrix4fv) X(UnmapBuffer) X(UseProgram) X(VertexAttribDivisor) \
+    X(VertexAttribPointer) X(BindBufferRange)
+
+#define GL_TRACE_FUN(name) (__glTrace##name)
+
+#define GL_TRACE_DECLARE(name) extern decltype(&gl##name) __glTrace##name;
+GL_TRACE_CORE_CALLS(GL_TRACE_DECLARE)
+#undef GL_TRACE_DECLARE
+
+// gl_trace.cpp defines GL_TRACE_NO_REDIRECT to reach the real ones.
+#ifndef GL_TRACE_NO_REDIRECT
+#define glBindTexture GL_TRACE_FUN(BindTexture)
+#define glClear GL_TRACE_FUN(Clear)
+#define glClearColor GL_TRACE_FUN(ClearColor)
+#define glDeleteTextures GL_TRACE_FUN(DeleteTextures)
+#define glDepthFunc GL_TRACE_FUN(DepthFunc)
+#define glDisable GL_TRACE_FUN(Disable)
+#define glDrawArrays GL_TRACE_FUN(DrawArrays)
+#define glDrawElements GL_TRACE_FUN(DrawElements)
+#define glEnable GL_TRACE_FUN(Enable)
+#define glFrontFace GL_TRACE_FUN(FrontFace)
+#define glGenTextures GL_TRACE_FUN(GenTextures)
+#define glPixelStorei GL_TRACE_FUN(PixelStorei)
+#define glTexImage2D GL_TRACE_FUN(TexImage2D)
+#define glTexParameterf GL_TRACE_FUN(TexParameterf)
+#define glTexParameteri GL_TRACE_FUN(TexParameteri)
+#define glTexSubImage2D GL_TRACE_FUN(TexSubImage2D)
+#define glViewport GL_TRACE_FUN(Viewport)
+#endif
+
+// A trace is a header (GL_TRACE_MAGIC, GL_TRACE_VERSION, framebuffer width
+// and height as 32-bit words) and a record per call: its GLTraceCall as
+// one byte, then the arguments in order, unaligned and in the byte order of
+// the machine that wrote it. Enums, names and 32-bit values take 4 bytes,
+// offsets, sizes and sync objects 8. Data follows as an 8-byte count and
+// the bytes; pixel arguments start with a GLTracePixels byte.
+const char GL_TRACE_MAGIC[4] = { 'G', 'L', 'T', 'R' };
+const unsigned int GL_TRACE_VERSION = 1;
+
+enum GLTraceCall
+{
+    TRACE_END,                  // Last record
+    TRACE_FRAME,                // Start of a frame: framebuffer width, height
+    TRACE_MAPPED_WRITE,         // buffer, offset, data: bytes written through its mapping
+#define GL_TRACE_ENUM(name) TRACE_##name,
+    GL_TRACE_CORE_CALLS(GL_TRACE_ENUM)
+    GL_TRACE_GLEW_CALLS(GL_TRACE_ENUM)
+#undef GL_TRACE_ENUM
+    TRACE_CALLS
+};
+
+enum GLTracePixels
+{
+    TRACE_PIXELS_NONE,          // NULL, no unpack buffer
+    TRACE_PIXELS_DATA,          // Byte count and bytes
+    TRACE_PIXELS_OFFSET         // 8-byte offset into the bound unpack buffer
+};
+
+// "glDrawArrays", or for the records that are not calls a description.
+const char *glTraceCallName(GLTraceCall call);
+
+struct GLTraceStats
+{
+    unsigned long long calls;
+    unsigned long long frames;
+    unsigned long long bytes;       // Written to the file
+
+    GLTraceStats() : calls(0), frames(0), bytes(0) {}
+};
+
+// Needs the context current and GLEW initialised. Prints why on failure.
+bool startGLTrace(const char *path);
+
+// On the thread with the context, before the frame's first call.
+void markGLTraceFrame();
+
+// Puts the GL entry points back and closes the file.
+GLTraceStats stopGLTrace();
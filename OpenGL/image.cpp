@@ -0,0 +1,603 @@
+#include "image.h"
+#include "fileio.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGE_SSE2
+#include <emmintrin.h>
+#endif
+
+// The BMP row converters pick SSSE3 or AVX2 at run time, so they are built
+// for those targets whatever the rest of the file is compiled for.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define IMAGE_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define IMAGE_TARGET(isa)
+#else
+#define IMAGE_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace
+{
+
+// Average of 2 x 2 source pixels; the last row/column is repeated when the
+// source size is odd. Rows are summed into 16 bits with SSE2, then pairs of
+// columns are added (four channels at a time for RGBA).
+void downsampleBox(const unsigned char *src, unsigned int src_width, unsigned int src_height,
+                   unsigned char *dst, unsigned int dst_width, unsigned int dst_height,
+                   unsigned int channels)
+{
+    const size_t src_stride = imageRowBytes(src_width, channels);
+    const size_t dst_stride = imageRowBytes(dst_width, channels);
+    const size_t row_size = (size_t)src_width * channels;
+    std::vector<unsigned short> sums(row_size + 8);
+
+    for (unsigned int y = 0; y < dst_height; y++)
+    {
+        const unsigned char *row0 = src + std::min(2 * y, src_height - 1) * src_stride;
+        const unsigned char *row1 = src + std::min(2 * y + 1, src_height - 1) * src_stride;
+        unsigned char *out = dst + y * dst_stride;
+
+        size_t i = 0;
+#ifdef IMAGE_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= row_size; i += 16)
+        {
+            const __m128i a = _mm_loadu_si128((const __m128i *)(row0 + i));
+            const __m128i b = _mm_loadu_si128((const __m128i *)(row1 + i));
+            _mm_storeu_si128((__m128i *)&sums[i], _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+            _mm_storeu_si128((__m128i *)&sums[i + 8], _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+        }
+#endif
+        for (; i < row_size; i++)
+            sums[i] = (unsigned short)(row0[i] + row1[i]);
+
+        unsigned int x = 0;
+#ifdef IMAGE_SSE2
+        if (channels == 4)
+        {
+            // Two output pixels from four source pixels per iteration.
+            const __m128i round = _mm_set1_epi16(2);
+            for (; x + 1 < dst_width; x += 2)
+            {
+                const __m128i a = _mm_loadu_si128((const __m128i *)&sums[x * 8]);
+                const __m128i b = _mm_loadu_si128((const __m128i *)&sums[x * 8 + 8]);
+                const __m128i pair = _mm_unpacklo_epi64(_mm_add_epi16(a, _mm_srli_si128(a, 8)),
+                                                        _mm_add_epi16(b, _mm_srli_si128(b, 8)));
+                const __m128i average = _mm_srli_epi16(_mm_add_epi16(pair, round), 2);
+                _mm_storel_epi64((__m128i *)(out + x * 4), _mm_packus_epi16(average, zero));
+            }
+        }
+#endif
+        for (; x < dst_width; x++)
+        {
+            const unsigned short *s0 = &sums[(size_t)std::min(2 * x, src_width - 1) * channels];
+            const unsigned short *s1 = &sums[(size_t)std::min(2 * x + 1, src_width - 1) * channels];
+            for (unsigned int c = 0; c < channels; c++)
+                out[x * channels + c] = (unsigned char)((s0[c] + s1[c] + 2) >> 2);
+        }
+    }
+}
+
+const int KAISER_TAPS = 6;
+
+float besselI0(float x)
+{
+    float sum = 1.0f;
+    float term = 1.0f;
+    for (int k = 1; k < 20; k++)
+    {
+        term *= (x * 0.5f / k) * (x * 0.5f / k);
+        sum += term;
+    }
+    return sum;
+}
+
+// Weights of a half-band sinc windowed by a Kaiser window (alpha = 4) for
+// source pixels 2x-2 .. 2x+3 around output pixel x.
+void kaiserWeights(float weights[KAISER_TAPS])
+{
+    const float alpha = 4.0f;
+    const float radius = 3.0f;
+    const float pi = 3.14159265f;
+
+    float total = 0.0f;
+    for (int t = 0; t < KAISER_TAPS; t++)
+    {
+        const float d = (float)t - 2.5f;
+        const float s = d / radius;
+        const float window = besselI0(alpha * std::sqrt(std::max(0.0f, 1.0f - s * s))) / besselI0(alpha);
+        const float sinc = std::sin(pi * d * 0.5f) / (pi * d * 0.5f);
+        weights[t] = window * sinc;
+        total += weights[t];
+    }
+    for (int t = 0; t < KAISER_TAPS; t++)
+        weights[t] /= total;
+}
+
+unsigned int wrapIndex(int i, unsigned int size)
+{
+    const int n = (int)size;
+    return (unsigned int)(((i % n) + n) % n);
+}
+
+// Separable Kaiser downsample. Edges wrap, matching GL_REPEAT sampling.
+// The horizontal pass is scalar; the vertical pass runs four floats at a
+// time with SSE2.
+void downsampleKaiser(const unsigned char *src, unsigned int src_width, unsigned int src_height,
+                      unsigned char *dst, unsigned int dst_width, unsigned int dst_height,
+                      unsigned int channels)
+{
+    float weights[KAISER_TAPS];
+    kaiserWeights(weights);
+
+    const size_t src_stride = imageRowBytes(src_width, channels);
+    const size_t dst_stride = imageRowBytes(dst_width, channels);
+    const size_t row_size = (size_t)dst_width * channels;
+
+    // Horizontally filtered source rows.
+    std::vector<float> rows(row_size * src_height);
+    for (unsigned int y = 0; y < src_height; y++)
+    {
+        const unsigned char *in = src + y * src_stride;
+        float *out = &rows[y * row_size];
+        for (unsigned int x = 0; x < dst_width; x++)
+        {
+            for (unsigned int c = 0; c < channels; c++)
+            {
+                float sum = 0.0f;
+                for (int t = 0; t < KAISER_TAPS; t++)
+                    sum += weights[t] * in[wrapIndex(2 * (int)x - 2 + t, src_width) * channels + c];
+                out[x * channels + c] = sum;
+            }
+        }
+    }
+
+    for (unsigned int y = 0; y < dst_height; y++)
+    {
+        const float *taps[KAISER_TAPS];
+        for (int t = 0; t < KAISER_TAPS; t++)
+            taps[t] = &rows[wrapIndex(2 * (int)y - 2 + t, src_height) * row_size];
+        unsigned char *out = dst + y * dst_stride;
+
+        size_t i = 0;
+#ifdef IMAGE_SSE2
+        for (; i + 4 <= row_size; i += 4)
+        {
+            __m128 sum = _mm_setzero_ps();
+            for (int t = 0; t < KAISER_TAPS; t++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[t]), _mm_loadu_ps(taps[t] + i)));
+            const __m128i words = _mm_packs_epi32(_mm_cvtps_epi32(sum), _mm_setzero_si128());
+            const int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+            memcpy(out + i, &bytes, 4);
+        }
+#endif
+        for (; i < row_size; i++)
+        {
+            float sum = 0.0f;
+            for (int t = 0; t < KAISER_TAPS; t++)
+                sum += weights[t] * taps[t][i];
+            out[i] = (unsigned char)std::min(255.0f, std::max(0.0f, sum + 0.5f));
+        }
+    }
+}
+
+// ---------------------------------------------------------------- BMP
+
+unsigned int readU16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+unsigned int readU32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// Row converters to tightly packed RGBA8. order[c] is the source byte of
+// output channel c, or 0x80 for an alpha of 255.
+typedef void (*ConvertRow)(const unsigned char *src, unsigned char *dst, unsigned int width, const unsigned char order[4]);
+
+void convert24Scalar(const unsigned char *src, unsigned char *dst, unsigned int width, const unsigned char order[4])
+{
+    for (unsigned int x = 0; x < width; x++, src += 3, dst += 4)
+    {
+        dst[0] = src[order[0]];
+        dst[1] = src[order[1]];
+        dst[2] = src[order[2]];
+        dst[3] = 255;
+    }
+}
+
+void convert32Scalar(const unsigned char *src, unsigned char *dst, unsigned int width, const unsigned char order[4])
+{
+    for (unsigned int x = 0; x < width; x++, src += 4, dst += 4)
+    {
+        dst[0] = src[order[0]];
+        dst[1] = src[order[1]];
+        dst[2] = src[order[2]];
+        dst[3] = order[3] & 0x80 ? 255 : src[order[3]];
+    }
+}
+
+#ifdef IMAGE_X86
+
+// pshufb control for four pixels of `stride` bytes each. Lanes that read
+// 0x80 come out as zero and get their alpha OR-ed in afterwards.
+void shuffleControl(unsigned int stride, const unsigned char order[4], unsigned char control[16], unsigned char alpha[16])
+{
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        for (unsigned int c = 0; c < 4; c++)
+        {
+            const bool opaque = c == 3 && (stride == 3 || (order[3] & 0x80));
+            control[i * 4 + c] = opaque ? 0x80 : (unsigned char)(i * stride + order[c]);
+            alpha[i * 4 + c] = opaque ? 0xff : 0x00;
+        }
+    }
+}
+
+IMAGE_TARGET("ssse3")
+void convert24SSSE3(const unsigned char *src, unsigned char *dst, unsigned int width, const unsigned char order[4])
+{
+    unsigned char control_bytes[16];
+    unsigned char alpha_bytes[16];
+    shuffleControl(3, order, control_bytes, alpha_bytes);
+    const __m128i control = _mm_loadu_si128((const __m128i *)control_bytes);
+    const __m128i alpha = _mm_loadu_si128((const __m128i *)alpha_bytes);
+
+    // Each load reads 16 bytes for four 3-byte pixels; stop while the last
+    // load still ends inside the row.
+    unsigned int x = 0;
+    for (; x + 6 <= width; x += 4)
+    {
+        const __m128i pixels = _mm_loadu_si128((const __m128i *)(src + x * 3));
+        _mm_storeu_si128((__m128i *)(dst + x * 4), _mm_or_si128(_mm_shuffle_epi8(pixels, control), alpha));
+    }
+    convert24Scalar(src + x * 3, dst + x * 4, width - x, order);
+}
+
+IMAGE_TARGET("ssse3")
+void convert32SSSE3(const unsigned char *src, unsigned char *dst, unsigned int width, const unsigned char order[4])
+{
+    unsigned char control_bytes[16];
+    unsigned char alpha_bytes[16];
+    shuffleControl(4, order, control_bytes, alpha_bytes);
+    const __m128i control = _mm_loadu_si128((const __m128i *)control_bytes);
+    const __m128i alpha = _mm_loadu_si128((const __m128i *)alpha_bytes);
+
+    unsigned int x = 0;
+    for (; x + 4 <= width; x += 4)
+    {
+        const __m128i pixels = _mm_loadu_si128((const __m128i *)(src + x * 4));
+        _mm_storeu_si128((__m128i *)(dst + x * 4), _mm_or_si128(_mm_shuffle_epi8(pixels, control), alpha));
+    }
+    convert32Scalar(src + x * 4, dst + x * 4, width - x, order);
+}
+
+// vpshufb shuffles within each 128-bit lane, so both lanes use the same
+// control and the 3-byte case loads its two halves separately.
+IMAGE_TARGET("avx2")
+void convert24AVX2(const unsigned char *src, unsigned char *dst, unsigned int width, const unsigned char order[4])
+{
+    unsigned char control_bytes[16];
+    unsigned char alpha_bytes[16];
+    shuffleControl(3, order, control_bytes, alpha_bytes);
+    const __m256i control = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)control_bytes));
+    const __m256i alpha = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)alpha_bytes));
+
+    unsigned int x = 0;
+    for (; x + 10 <= width; x += 8)
+    {
+        const __m128i lo = _mm_loadu_si128((const __m128i *)(src + x * 3));
+        const __m128i hi = _mm_loadu_si128((const __m128i *)(src + x * 3 + 12));
+        const __m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        _mm256_storeu_si256((__m256i *)(dst + x * 4), _mm256_or_si256(_mm256_shuffle_epi8(pixels, control), alpha));
+    }
+    convert24Scalar(src + x * 3, dst + x * 4, width - x, order);
+}
+
+IMAGE_TARGET("avx2")
+void convert32AVX2(const unsigned char *src, unsigned char *dst, unsigned int width, const unsigned char order[4])
+{
+    unsigned char control_bytes[16];
+    unsigned char alpha_bytes[16];
+    shuffleControl(4, order, control_bytes, alpha_bytes);
+    const __m256i control = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)control_bytes));
+    const __m256i alpha = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)alpha_bytes));
+
+    unsigned int x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        const __m256i pixels = _mm256_loadu_si256((const __m256i *)(src + x * 4));
+        _mm256_storeu_si256((__m256i *)(dst + x * 4), _mm256_or_si256(_mm256_shuffle_epi8(pixels, control), alpha));
+    }
+    convert32Scalar(src + x * 4, dst + x * 4, width - x, order);
+}
+
+enum CpuFeature
+{
+    CPU_SSSE3 = 1 << 0,
+    CPU_AVX2  = 1 << 1
+};
+
+unsigned int detectCpuFeatures()
+{
+    unsigned int features = 0;
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    const int max_leaf = info[0];
+    __cpuid(info, 1);
+    if (info[2] & (1 << 9))
+        features |= CPU_SSSE3;
+    // AVX2 also needs the OS to save the YMM registers.
+    const bool os_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    if (os_avx && max_leaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5))
+            features |= CPU_AVX2;
+    }
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3"))
+        features |= CPU_SSSE3;
+    if (__builtin_cpu_supports("avx2"))
+        features |= CPU_AVX2;
+#endif
+    return features;
+}
+
+#endif // IMAGE_X86
+
+ConvertRow pickConverter(unsigned int bits)
+{
+#ifdef IMAGE_X86
+    static const unsigned int features = detectCpuFeatures();
+    if (features & CPU_AVX2)
+        return bits == 24 ? convert24AVX2 : convert32AVX2;
+    if (features & CPU_SSSE3)
+        return bits == 24 ? convert24SSSE3 : convert32SSSE3;
+#endif
+    return bits == 24 ? convert24Scalar : convert32Scalar;
+}
+
+// Byte of a 32-bit pixel selected by a bitfield mask, or -1 if the mask is
+// not exactly one whole byte.
+int maskByte(unsigned int mask)
+{
+    for (int b = 0; b < 4; b++)
+        if (mask == 0xffu << (8 * b))
+            return b;
+    return -1;
+}
+
+} // namespace
+
+unsigned int imageChannels(GLenum format)
+{
+    switch (format)
+    {
+    case GL_RED:    return 1;
+    case GL_RG:     return 2;
+    case GL_RGB:
+    case GL_BGR:    return 3;
+    case GL_RGBA:
+    case GL_BGRA:   return 4;
+    default:        return 0;
+    }
+}
+
+size_t imageRowBytes(unsigned int width, unsigned int channels)
+{
+    return ((size_t)width * channels + 3) & ~(size_t)3;
+}
+
+bool decodeBMP(const char *imagepath, Image &out_image)
+{
+    // BITMAPINFOHEADER compression values
+    const unsigned int BI_RGB = 0;
+    const unsigned int BI_BITFIELDS = 3;
+
+    MappedFile file;
+    if (!file.open(imagepath))
+    {
+        printf("Image could not be opened\n");
+        return false;
+    }
+
+    const unsigned char *data = (const unsigned char *)file.data();
+    const size_t size = file.size();
+    if (size < 14 + 12 || data[0] != 'B' || data[1] != 'M')
+    {
+        printf("%s is not a correct BMP file\n", imagepath);
+        return false;
+    }
+
+    // The 14-byte file header is followed by a BITMAPCOREHEADER (12 bytes)
+    // or a BITMAPINFOHEADER (40) and its V4 (108) / V5 (124) extensions.
+    const size_t data_offset = readU32(data + 10);
+    const unsigned int header_size = readU32(data + 14);
+    const unsigned char *info = data + 14;
+    if ((header_size != 12 && header_size < 40) || 14 + (size_t)header_size > size)
+    {
+        printf("%s is not a correct BMP file\n", imagepath);
+        return false;
+    }
+
+    int width, height;
+    unsigned int bits;
+    unsigned int compression = BI_RGB;
+    unsigned int colors_used = 0;
+    if (header_size == 12)
+    {
+        width = (int)readU16(info + 4);
+        height = (short)readU16(info + 6);
+        bits = readU16(info + 10);
+    }
+    else
+    {
+        width = (int)readU32(info + 4);
+        height = (int)readU32(info + 8);
+        bits = readU16(info + 14);
+        compression = readU32(info + 16);
+        colors_used = readU32(info + 32);
+    }
+
+    // A negative height means the rows are stored top row first.
+    const bool top_down = height < 0;
+    const unsigned int rows = top_down ? 0u - (unsigned int)height : (unsigned int)height;
+    if (width <= 0 || rows == 0 || width > 65536 || rows > 65536)
+    {
+        printf("%s has an invalid size of %d x %d\n", imagepath, width, height);
+        return false;
+    }
+
+    // Source byte of R, G, B and A within a pixel, 0x80 for opaque.
+    unsigned char order[4] = { 2, 1, 0, 0x80 };
+    bool supported = (bits == 8 || bits == 24) && compression == BI_RGB;
+    if (bits == 32 && compression == BI_RGB)
+    {
+        order[3] = 3;
+        supported = true;
+    }
+    else if (bits == 32 && compression == BI_BITFIELDS)
+    {
+        // The masks are part of a V4/V5 header, or follow a plain one.
+        const unsigned char *masks = info + 40;
+        if (14 + 40 + 12 <= size)
+        {
+            const unsigned int alpha_mask = header_size >= 56 ? readU32(info + 52) : 0;
+            const int r = maskByte(readU32(masks));
+            const int g = maskByte(readU32(masks + 4));
+            const int b = maskByte(readU32(masks + 8));
+            const int a = alpha_mask ? maskByte(alpha_mask) : 0x80;
+            supported = r >= 0 && g >= 0 && b >= 0 && a >= 0;
+            order[0] = (unsigned char)r;
+            order[1] = (unsigned char)g;
+            order[2] = (unsigned char)b;
+            order[3] = (unsigned char)a;
+        }
+    }
+    if (!supported)
+    {
+        printf("%s: %u-bit BMP with compression %u is not supported\n", imagepath, bits, compression);
+        return false;
+    }
+
+    // Rows are padded to 4 bytes.
+    const size_t stride = ((size_t)width * bits + 31) / 32 * 4;
+    if (data_offset > size || stride * rows > size - data_offset)
+    {
+        printf("%s is truncated\n", imagepath);
+        return false;
+    }
+    const unsigned char *pixels = data + data_offset;
+
+    out_image.width = (unsigned int)width;
+    out_image.height = rows;
+    out_image.format = GL_RGBA;
+    out_image.internal_format = GL_RGBA8;
+    out_image.pixels.resize((size_t)width * rows * 4);
+    out_image.mips.clear();
+
+    // BI_RGB leaves the fourth byte unused; most writers zero it, so an image
+    // without a single non-zero alpha is taken as opaque.
+    if (bits == 32 && compression == BI_RGB)
+    {
+        bool any_alpha = false;
+        for (size_t y = 0; y < rows && !any_alpha; y++)
+            for (int x = 0; x < width && !any_alpha; x++)
+                any_alpha = pixels[y * stride + x * 4 + 3] != 0;
+        if (!any_alpha)
+            order[3] = 0x80;
+    }
+
+    // GL wants the bottom row first, which is how BMPs are normally stored.
+    unsigned char *out = &out_image.pixels[0];
+    const size_t out_stride = (size_t)width * 4;
+    if (bits == 8)
+    {
+        const size_t palette_offset = 14 + header_size;
+        const size_t entry_size = header_size == 12 ? 3 : 4;
+        size_t entries = colors_used && colors_used < 256 ? colors_used : 256;
+        entries = std::min(entries, (std::min(data_offset, size) - std::min(palette_offset, data_offset)) / entry_size);
+
+        // Entries are BGR(X); indices past the palette read as opaque black.
+        unsigned char palette[256][4] = {};
+        for (size_t i = 0; i < 256; i++)
+            palette[i][3] = 255;
+        for (size_t i = 0; i < entries; i++)
+        {
+            const unsigned char *entry = data + palette_offset + i * entry_size;
+            palette[i][0] = entry[2];
+            palette[i][1] = entry[1];
+            palette[i][2] = entry[0];
+        }
+
+        for (size_t y = 0; y < rows; y++)
+        {
+            const unsigned char *src = pixels + y * stride;
+            unsigned char *dst = out + (top_down ? rows - 1 - y : y) * out_stride;
+            for (int x = 0; x < width; x++)
+                memcpy(dst + x * 4, palette[src[x]], 4);
+        }
+        return true;
+    }
+
+    const ConvertRow convert = pickConverter(bits);
+    for (size_t y = 0; y < rows; y++)
+        convert(pixels + y * stride, out + (top_down ? rows - 1 - y : y) * out_stride, (unsigned int)width, order);
+    return true;
+}
+
+unsigned int mipLevelCount(unsigned int width, unsigned int height)
+{
+    unsigned int size = std::max(width, height);
+    unsigned int levels = 1;
+    while (size > 1)
+    {
+        size >>= 1;
+        levels++;
+    }
+    return levels;
+}
+
+void generateMipmaps(Image &image, MipFilter filter)
+{
+    image.mips.clear();
+
+    const unsigned int channels = imageChannels(image.format);
+    if (channels == 0 || image.pixels.empty())
+        return;
+
+    image.mips.resize(mipLevelCount(image.width, image.height) - 1);
+
+    const unsigned char *src = &image.pixels[0];
+    unsigned int width = image.width;
+    unsigned int height = image.height;
+    for (size_t i = 0; i < image.mips.size(); i++)
+    {
+        ImageLevel &level = image.mips[i];
+        level.width = std::max(1u, width >> 1);
+        level.height = std::max(1u, height >> 1);
+        level.pixels.resize(imageRowBytes(level.width, channels) * level.height);
+
+        if (filter == MIP_FILTER_KAISER)
+            downsampleKaiser(src, width, height, &level.pixels[0], level.width, level.height, channels);
+        else
+            downsampleBox(src, width, height, &level.pixels[0], level.width, level.height, channels);
+
+        src = &level.pixels[0];
+        width = level.width;
+        height = level.height;
+    }
+}
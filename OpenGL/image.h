@@ -0,0 +1,59 @@
+#pragma once
+
+#include "gl_trace.h"
+#include <cstddef>
+#include <vector>
+
+// CPU side of textures: decoding and mip generation. Nothing here needs a
+// GL context, so tools can use it without creating a window.
+
+// One mip level below the base image. Rows are padded to 4 bytes like the
+// base level, so both upload with the default GL_UNPACK_ALIGNMENT.
+struct ImageLevel
+{
+    unsigned int width;
+    unsigned int height;
+    std::vector<unsigned char> pixels;
+
+    ImageLevel() : width(0), height(0) {}
+};
+
+// Decoded image in client memory, laid out the way glTexImage2D expects it.
+struct Image
+{
+    unsigned int width;
+    unsigned int height;
+    GLenum format;              // Client pixel format, e.g. GL_RGBA
+    GLenum internal_format;     // e.g. GL_RGBA8
+    std::vector<unsigned char> pixels;
+    std::vector<ImageLevel> mips;   // Levels 1..N-1; empty lets the GL build them
+
+    Image() : width(0), height(0), format(GL_RGBA), internal_format(GL_RGBA8) {}
+};
+
+enum MipFilter
+{
+    MIP_FILTER_BOX,     // 2 x 2 average. Fast, slightly blurry.
+    MIP_FILTER_KAISER   // 6-tap Kaiser-windowed sinc. Sharper, about 3x slower.
+};
+
+// Reads an 8-bit paletted, 24-bit or 32-bit (BI_RGB or byte-aligned
+// BI_BITFIELDS) BMP into tightly packed GL_RGBA8, bottom row first, whatever
+// the source's row order and padding. The swizzle uses SSSE3 or AVX2 when the
+// CPU has them. RLE and 1/4/16-bit files are rejected. Safe to call from any
+// thread.
+bool decodeBMP(const char *imagepath, Image &out_image);
+
+// Levels in a full mip chain down to 1 x 1.
+unsigned int mipLevelCount(unsigned int width, unsigned int height);
+
+// Fills image.mips with the full chain on the CPU. Safe to call from any
+// thread, so the asset loader runs it on its workers instead of paying for
+// glGenerateMipmap on the main thread.
+void generateMipmaps(Image &image, MipFilter filter = MIP_FILTER_BOX);
+
+// Bytes per pixel of an 8-bit client format, or 0 if unsupported.
+unsigned int imageChannels(GLenum format);
+
+// Row size including the padding to 4 bytes.
+size_t imageRowBytes(unsigned int width, unsigned int channels);
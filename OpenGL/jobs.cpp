@@ -0,0 +1,516 @@
+#include "jobs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+
+struct JobWork
+{
+    JobFunction fn;
+    void *data;
+    size_t begin;
+    size_t end;
+    size_t grain;               // Non-zero for parallelFor: split down to this before running
+    JobCounter *counter;
+};
+
+// A slot in the pool of the thread that queued it. Taken off a deque, the
+// work is copied out and the slot freed at once, so jobs running for long,
+// or starting many jobs of their own, hold no slot.
+struct Job
+{
+    JobWork work;
+    Job *next;                  // In a counter's waiting list
+    std::atomic<bool> in_use;
+};
+
+namespace
+{
+
+// Jobs a thread may have queued and not yet taken, and the size of its
+// deque. Beyond that, jobs run inline. parallelFor keeps about
+// log2(range / grain) per thread.
+const size_t THREAD_JOBS = 4096;
+
+// Failed attempts to find a job before a worker goes to sleep.
+const unsigned int IDLE_SPINS = 64;
+
+// Chase-Lev work-stealing deque of fixed capacity, after Lê, Pop, Cohen and
+// Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory
+// Models" (PPoPP 2013). The owner pushes and pops at the bottom; any thread
+// steals at the top. The two only race for the last job, which the
+// compare-exchange on top settles.
+class WorkDeque
+{
+public:
+    WorkDeque() : top_(0), bottom_(0)
+    {
+        for (size_t i = 0; i < THREAD_JOBS; i++)
+            jobs_[i].store(NULL, std::memory_order_relaxed);
+    }
+
+    // Owner. False when full.
+    bool push(Job *job)
+    {
+        const long long bottom = bottom_.load(std::memory_order_relaxed);
+        const long long top = top_.load(std::memory_order_acquire);
+        if (bottom - top >= (long long)THREAD_JOBS)
+            return false;
+        jobs_[bottom & (THREAD_JOBS - 1)].store(job, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Owner. Newest first.
+    Job *pop()
+    {
+        const long long bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long long top = top_.load(std::memory_order_relaxed);
+
+        Job *job = NULL;
+        if (top <= bottom)
+        {
+            job = jobs_[bottom & (THREAD_JOBS - 1)].load(std::memory_order_relaxed);
+            if (top == bottom)
+            {
+                // The last one: a thief may be taking it right now.
+                if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    job = NULL;
+                bottom_.store(bottom + 1, std::memory_order_relaxed);
+            }
+        }
+        else
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+        return job;
+    }
+
+    // Any thread. Oldest first.
+    Job *steal()
+    {
+        long long top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const long long bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom)
+            return NULL;
+        Job *job = jobs_[top & (THREAD_JOBS - 1)].load(std::memory_order_relaxed);
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return NULL;
+        return job;
+    }
+
+private:
+    // Padded apart, so the owner and the thieves do not keep stealing each
+    // other's cache line. Not alignas: the deques are heap allocated, and
+    // new only honours extended alignment from C++17.
+    std::atomic<long long> top_;
+    char top_padding_[64];
+    std::atomic<long long> bottom_;
+    char bottom_padding_[64];
+    std::atomic<Job *> jobs_[THREAD_JOBS];
+};
+
+struct JobThread
+{
+    WorkDeque deque;
+    Job pool[THREAD_JOBS];      // Searched round robin for a free slot
+    size_t next_job;
+    unsigned int random;        // Picks steal victims
+    std::atomic<unsigned long long> jobs;
+    std::atomic<unsigned long long> steals;
+
+    JobThread() : next_job(0), random(1), jobs(0), steals(0)
+    {
+        for (size_t i = 0; i < THREAD_JOBS; i++)
+            pool[i].in_use.store(false, std::memory_order_relaxed);
+    }
+};
+
+std::vector<JobThread *> job_threads;       // [0] is the thread that called initJobSystem
+std::vector<std::thread> workers;
+std::atomic<long long> queued(0);           // In some deque, not taken yet
+std::atomic<int> sleeping(0);
+std::atomic<bool> quit(false);
+std::mutex sleep_mutex;
+std::condition_variable wake;
+
+// Pieces of parallelFor calls made from threads outside the system, which
+// have no deque to queue them on. Counted in queued too.
+std::deque<JobWork> injected;
+std::atomic<int> injected_count(0);
+std::mutex injected_mutex;
+
+// Index into job_threads, or -1 for threads outside the system, which run
+// their jobs inline.
+thread_local int thread_index = -1;
+
+// NULL when every slot holds a job not taken yet.
+Job *allocateJob(const JobWork &work)
+{
+    JobThread &thread = *job_threads[thread_index];
+    for (size_t i = 0; i < THREAD_JOBS; i++)
+    {
+        Job *job = &thread.pool[thread.next_job];
+        thread.next_job = (thread.next_job + 1) % THREAD_JOBS;
+        if (!job->in_use.load(std::memory_order_acquire))
+        {
+            job->work = work;
+            job->next = NULL;
+            job->in_use.store(true, std::memory_order_relaxed);
+            return job;
+        }
+    }
+    return NULL;
+}
+
+// Frees the slot. The release pairs with allocateJob's acquire, so the
+// owner does not overwrite the work before it was copied out.
+JobWork takeWork(Job *job)
+{
+    const JobWork work = job->work;
+    job->in_use.store(false, std::memory_order_release);
+    return work;
+}
+
+void execute(JobWork work);
+
+// Queues the job on the calling thread's deque and wakes a sleeping worker
+// for it. Runs it on the spot if the deque is full.
+void queue(Job *job)
+{
+    if (!job_threads[thread_index]->deque.push(job))
+    {
+        execute(takeWork(job));
+        return;
+    }
+    queued.fetch_add(1);
+    if (sleeping.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        wake.notify_one();
+    }
+}
+
+// The jobs that were held back for counter.
+Job *takeWaiting(JobCounter &counter)
+{
+    std::lock_guard<std::mutex> lock(counter.waiting_mutex);
+    Job *jobs = counter.waiting;
+    counter.waiting = NULL;
+    return jobs;
+}
+
+void queueAll(Job *job)
+{
+    while (job)
+    {
+        Job *next = job->next;
+        queue(job);
+        job = next;
+    }
+}
+
+void execute(JobWork work)
+{
+    // Keep the first half, hand out the second, until the piece is small.
+    // Threads outside the system have nowhere to hand it to.
+    if (work.grain && thread_index >= 0)
+    {
+        while (work.end - work.begin > work.grain)
+        {
+            JobWork second = work;
+            second.begin = work.begin + (work.end - work.begin) / 2;
+            Job *half = allocateJob(second);
+            if (!half)
+                break;
+            work.end = second.begin;
+            work.counter->pending.fetch_add(1);
+            queue(half);
+        }
+    }
+
+    work.fn(work.data, work.begin, work.end);
+    if (thread_index >= 0)
+        job_threads[thread_index]->jobs.fetch_add(1, std::memory_order_relaxed);
+
+    JobCounter *counter = work.counter;
+    if (counter)
+    {
+        // finishing keeps waitForCounter from returning, and the owner from
+        // freeing the counter, until this thread is done with it.
+        counter->finishing.fetch_add(1);
+        Job *released = NULL;
+        if (counter->pending.fetch_sub(1) == 1)
+            released = takeWaiting(*counter);
+        counter->finishing.fetch_sub(1);
+        queueAll(released);
+    }
+}
+
+bool takeInjected(JobWork &out_work)
+{
+    if (injected_count.load() == 0)
+        return false;
+    std::lock_guard<std::mutex> lock(injected_mutex);
+    if (injected.empty())
+        return false;
+    out_work = injected.front();
+    injected.pop_front();
+    injected_count.fetch_sub(1);
+    queued.fetch_sub(1);
+    return true;
+}
+
+Job *findJob(JobThread &thread)
+{
+    Job *job = thread.deque.pop();
+    if (!job)
+    {
+        const size_t count = job_threads.size();
+        // xorshift, good enough to spread the thieves.
+        thread.random ^= thread.random << 13;
+        thread.random ^= thread.random >> 17;
+        thread.random ^= thread.random << 5;
+        const size_t first = thread.random % count;
+        for (size_t i = 0; i < count && !job; i++)
+        {
+            JobThread *victim = job_threads[(first + i) % count];
+            if (victim != &thread)
+                job = victim->deque.steal();
+        }
+        if (job)
+            thread.steals.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (job)
+        queued.fetch_sub(1);
+    return job;
+}
+
+// A job of the thread's own, a stolen one, or a piece handed in from
+// outside, in that order.
+bool findWork(JobThread &thread, JobWork &out_work)
+{
+    if (Job *job = findJob(thread))
+    {
+        out_work = takeWork(job);
+        return true;
+    }
+    return takeInjected(out_work);
+}
+
+// parallelFor from a thread outside the system: one piece per job thread
+// is handed in whole, and the job threads split them further as usual.
+// The caller runs the first piece, then whole pieces still not taken.
+void parallelForOutside(size_t begin, size_t end, size_t grain, JobFunction fn, void *data)
+{
+    const size_t pieces = std::min(job_threads.size(), (end - begin + grain - 1) / grain);
+    const size_t step = (end - begin + pieces - 1) / pieces;
+
+    JobCounter done;
+    int handed = 0;
+    {
+        std::lock_guard<std::mutex> lock(injected_mutex);
+        for (size_t piece = begin + step; piece < end; piece += step)
+        {
+            const JobWork work = { fn, data, piece, std::min(piece + step, end), grain, &done };
+            injected.push_back(work);
+            handed++;
+        }
+        done.pending.fetch_add(handed);
+        injected_count.fetch_add(handed);
+        queued.fetch_add(handed);
+    }
+    if (sleeping.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        wake.notify_all();
+    }
+
+    fn(data, begin, std::min(begin + step, end));
+    while (done.pending.load() > 0)
+    {
+        JobWork work;
+        if (takeInjected(work))
+            execute(work);
+        else
+            std::this_thread::yield();
+    }
+    while (done.finishing.load() > 0)
+        std::this_thread::yield();
+}
+
+void workerMain(int index)
+{
+    thread_index = index;
+    JobThread &thread = *job_threads[index];
+    unsigned int idle = 0;
+    while (!quit.load(std::memory_order_relaxed))
+    {
+        JobWork work;
+        if (findWork(thread, work))
+        {
+            execute(work);
+            idle = 0;
+        }
+        else if (++idle < IDLE_SPINS)
+            std::this_thread::yield();
+        else
+        {
+            // sleeping goes up before queued is checked, and queue() bumps
+            // queued before it checks sleeping, so one of the two sees the
+            // other. The timeout only covers a steal lost to another thief.
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleeping.fetch_add(1);
+            wake.wait_for(lock, std::chrono::milliseconds(1), []() { return queued.load() > 0 || quit.load(); });
+            sleeping.fetch_sub(1);
+            idle = 0;
+        }
+    }
+}
+
+} // namespace
+
+void initJobSystem(unsigned int thread_count)
+{
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    quit = false;
+    queued = 0;
+    for (unsigned int i = 0; i < thread_count; i++)
+    {
+        job_threads.push_back(new JobThread);
+        job_threads[i]->random = 2654435761u * (i + 1);
+    }
+    thread_index = 0;
+    for (unsigned int i = 1; i < thread_count; i++)
+        workers.push_back(std::thread(workerMain, (int)i));
+}
+
+void shutdownJobSystem()
+{
+    if (job_threads.empty())
+        return;
+
+    while (queued.load() > 0)
+    {
+        JobWork work;
+        if (findWork(*job_threads[0], work))
+            execute(work);
+        else
+            std::this_thread::yield();
+    }
+
+    quit = true;
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        wake.notify_all();
+    }
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+    workers.clear();
+
+    for (size_t i = 0; i < job_threads.size(); i++)
+        delete job_threads[i];
+    job_threads.clear();
+    thread_index = -1;
+}
+
+unsigned int jobThreadCount()
+{
+    return job_threads.empty() ? 1 : (unsigned int)job_threads.size();
+}
+
+void runJob(JobFunction fn, void *data, size_t begin, size_t end, JobCounter *counter)
+{
+    const JobWork work = { fn, data, begin, end, 0, counter };
+    Job *job = thread_index >= 0 && job_threads.size() > 1 ? allocateJob(work) : NULL;
+    if (!job)
+    {
+        fn(data, begin, end);
+        return;
+    }
+
+    if (counter)
+        counter->pending.fetch_add(1);
+    queue(job);
+}
+
+void runJobAfter(JobCounter &dependency, JobFunction fn, void *data, size_t begin, size_t end, JobCounter *counter)
+{
+    const JobWork work = { fn, data, begin, end, 0, counter };
+    Job *job = thread_index >= 0 && job_threads.size() > 1 ? allocateJob(work) : NULL;
+    if (!job)
+    {
+        waitForCounter(dependency);
+        fn(data, begin, end);
+        return;
+    }
+
+    if (counter)
+        counter->pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(dependency.waiting_mutex);
+        if (dependency.pending.load() > 0)
+        {
+            job->next = dependency.waiting;
+            dependency.waiting = job;
+            return;
+        }
+    }
+    queue(job);
+}
+
+void waitForCounter(JobCounter &counter)
+{
+    while (counter.pending.load() > 0)
+    {
+        JobWork work;
+        if (thread_index >= 0 && findWork(*job_threads[thread_index], work))
+            execute(work);
+        else
+            std::this_thread::yield();
+    }
+    while (counter.finishing.load() > 0)
+        std::this_thread::yield();
+}
+
+void parallelFor(size_t begin, size_t end, size_t grain, JobFunction fn, void *data)
+{
+    if (begin >= end)
+        return;
+    grain = std::max<size_t>(grain, 1);
+    if (job_threads.size() < 2 || end - begin <= grain)
+    {
+        fn(data, begin, end);
+        return;
+    }
+    if (thread_index < 0)
+    {
+        parallelForOutside(begin, end, grain, fn, data);
+        return;
+    }
+
+    JobCounter done;
+    const JobWork work = { fn, data, begin, end, grain, &done };
+    done.pending = 1;
+    execute(work);
+    waitForCounter(done);
+}
+
+JobStats jobStats()
+{
+    JobStats stats;
+    stats.threads = jobThreadCount();
+    for (size_t i = 0; i < job_threads.size(); i++)
+    {
+        stats.jobs += job_threads[i]->jobs.load(std::memory_order_relaxed);
+        stats.steals += job_threads[i]->steals.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
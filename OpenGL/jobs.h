@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+
+// Work-stealing job system for per-frame CPU work. Every worker thread, and
+// the thread that called initJobSystem, owns a Chase-Lev deque: it pushes and
+// pops its own jobs at the bottom (newest first, still warm in its cache)
+// while idle threads steal from the top of a random victim (oldest first,
+// usually the biggest piece of work left). Threads that wait for a counter
+// run jobs meanwhile instead of blocking, so jobs may start and wait for
+// other jobs.
+//
+//     JobCounter done;
+//     runJob(animate, &scene, &done);
+//     parallelFor(0, count, 256, computeMatrix, &scene);   // returns when all ran
+//     waitForCounter(done);
+//
+// Without initJobSystem, or with one thread, everything runs inline on the
+// caller. Other threads (the asset loader's workers) may call parallelFor
+// between initJobSystem and shutdownJobSystem; the job threads take its
+// pieces, while runJob and runJobAfter still run inline there.
+
+struct Job;
+
+// Counts the jobs started against it that have not finished. Jobs may also
+// be held back until a counter drops to zero (runJobAfter). Reuse a counter
+// only once it was waited for.
+struct JobCounter
+{
+    std::atomic<int> pending;
+    std::atomic<int> finishing;     // Threads between finishing a job and letting go of the counter
+    std::mutex waiting_mutex;
+    Job *waiting;                   // Held back by runJobAfter
+
+    JobCounter() : pending(0), finishing(0), waiting(NULL) {}
+
+private:
+    JobCounter(const JobCounter &);
+    JobCounter &operator=(const JobCounter &);
+};
+
+typedef void (*JobFunction)(void *data, size_t begin, size_t end);
+
+struct JobStats
+{
+    unsigned int threads;               // Workers plus the main thread
+    unsigned long long jobs;            // Run to completion
+    unsigned long long steals;          // Taken from another thread's deque
+
+    JobStats() : threads(1), jobs(0), steals(0) {}
+};
+
+// Starts thread_count - 1 workers; 0 = one thread per hardware thread. The
+// calling thread becomes thread 0 and is the one that may call waitForCounter
+// and parallelFor outside of jobs.
+void initJobSystem(unsigned int thread_count = 0);
+
+// Waits for the queued jobs, then joins the workers.
+void shutdownJobSystem();
+
+unsigned int jobThreadCount();
+
+// Queues fn(data, begin, end) on the calling thread's deque. counter, if
+// any, counts it until it finishes.
+void runJob(JobFunction fn, void *data, size_t begin, size_t end, JobCounter *counter);
+
+// Like runJob, but the job is only queued once dependency has no pending
+// jobs left.
+void runJobAfter(JobCounter &dependency, JobFunction fn, void *data, size_t begin, size_t end, JobCounter *counter);
+
+// Runs jobs until counter has no pending jobs left.
+void waitForCounter(JobCounter &counter);
+
+// fn(data, begin, end) over [begin, end) in pieces of at least grain
+// indices, and returns once all ran. The range is split in halves lazily:
+// a job keeps one half and queues the other, so idle threads steal big
+// pieces and a busy machine does not pay for many small ones.
+void parallelFor(size_t begin, size_t end, size_t grain, JobFunction fn, void *data);
+
+// Since initJobSystem.
+JobStats jobStats();
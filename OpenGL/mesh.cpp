@@ -0,0 +1,1255 @@
+#include "mesh.h"
+#include "fileio.h"
+#include "jobs.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESH_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+struct ObjCorner
+{
+    int p, t, n;    // 0-based indices into the OBJ arrays, -1 when absent
+
+    bool operator==(const ObjCorner &that) const
+    {
+        return p == that.p && t == that.t && n == that.n;
+    }
+};
+
+struct ObjCornerHash
+{
+    size_t operator()(const ObjCorner &c) const
+    {
+        size_t h = (size_t)(unsigned int)c.p * 2654435761u;
+        h ^= (size_t)(unsigned int)c.t * 2246822519u + (h << 6) + (h >> 2);
+        h ^= (size_t)(unsigned int)c.n * 3266489917u + (h << 6) + (h >> 2);
+        return h;
+    }
+};
+
+struct PositionKey
+{
+    unsigned int x, y, z;
+
+    bool operator==(const PositionKey &that) const
+    {
+        return x == that.x && y == that.y && z == that.z;
+    }
+};
+
+struct PositionKeyHash
+{
+    size_t operator()(const PositionKey &k) const
+    {
+        return (size_t)k.x * 73856093u ^ (size_t)k.y * 19349663u ^ (size_t)k.z * 83492791u;
+    }
+};
+
+struct ObjData
+{
+    std::vector<vmath::vec3> positions;
+    std::vector<vmath::vec2> uvs;
+    std::vector<vmath::vec3> normals;
+    std::vector<ObjCorner> corners;     // three per triangle
+};
+
+// Runs fn(begin, end) over [0, count) on the job system (jobs.h), in
+// ranges of at least min_range.
+template <typename F>
+void forRanges(size_t count, size_t min_range, const F &fn)
+{
+    struct Call
+    {
+        static void run(void *data, size_t begin, size_t end)
+        {
+            (*(const F *)data)(begin, end);
+        }
+    };
+    parallelFor(0, count, min_range, Call::run, (void *)&fn);
+}
+
+int scanToken(FILE *file, char (&token)[128])
+{
+#ifdef _MSC_VER
+    return fscanf_s(file, "%127s", token, 128);
+#else
+    return fscanf(file, "%127s", token);
+#endif
+}
+
+// Reads whatever is left of the current line, however long it is.
+void readRestOfLine(FILE *file, std::string &line)
+{
+    char chunk[256];
+    line.clear();
+    while (fgets(chunk, sizeof(chunk), file))
+    {
+        line += chunk;
+        if (line[line.size() - 1] == '\n')
+            break;
+    }
+}
+
+int parseFloats(const char *s, float *out, int count)
+{
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        char *end;
+        out[i] = strtof(s, &end);
+        if (end == s)
+            break;
+        s = end;
+    }
+    return i;
+}
+
+// OBJ indices are 1-based, negative values count back from the last element.
+int resolveIndex(long index, size_t count)
+{
+    if (index > 0 && (size_t)index <= count)
+        return (int)(index - 1);
+    if (index < 0 && (size_t)-index <= count)
+        return (int)((long)count + index);
+    return -1;
+}
+
+// Parses one face corner in any of the v, v/vt, v//vn or v/vt/vn forms.
+// Indices of streams that are not being loaded are left at -1.
+bool parseCorner(const char *&s, const ObjData &obj, bool want_uvs, bool want_normals, ObjCorner &corner)
+{
+    char *end;
+    long v = strtol(s, &end, 10);
+    long vt = 0;
+    long vn = 0;
+    if (end == s)
+        return false;
+    s = end;
+
+    if (*s == '/')
+    {
+        s++;
+        if (*s != '/')
+        {
+            vt = strtol(s, &end, 10);
+            if (end == s)
+                return false;
+            s = end;
+        }
+        if (*s == '/')
+        {
+            s++;
+            vn = strtol(s, &end, 10);
+            if (end == s)
+                return false;
+            s = end;
+        }
+    }
+
+    if (!want_uvs)
+        vt = 0;
+    if (!want_normals)
+        vn = 0;
+
+    corner.p = resolveIndex(v, obj.positions.size());
+    corner.t = vt ? resolveIndex(vt, obj.uvs.size()) : -1;
+    corner.n = vn ? resolveIndex(vn, obj.normals.size()) : -1;
+    return corner.p >= 0 && (vt == 0 || corner.t >= 0) && (vn == 0 || corner.n >= 0);
+}
+
+// MESH_LOAD_STDIO: the original buffered fscanf reader.
+bool readOBJStdio(const char *path, bool want_uvs, bool want_normals, ObjData &obj)
+{
+    FILE *file = openFile(path, "r");
+    if (!file)
+    {
+        printf("Impossible to open the file !\n");
+        return false;
+    }
+
+    char lineHeader[128];
+    std::string line;
+    std::vector<ObjCorner> polygon;
+
+    while (scanToken(file, lineHeader) != EOF)
+    {
+        readRestOfLine(file, line);
+        float f[3] = { 0.0f, 0.0f, 0.0f };
+
+        if (strcmp(lineHeader, "v") == 0)
+        {
+            parseFloats(line.c_str(), f, 3);
+            obj.positions.push_back(vmath::vec3(f[0], f[1], f[2]));
+        }
+        else if (strcmp(lineHeader, "vt") == 0 && want_uvs)
+        {
+            parseFloats(line.c_str(), f, 2);
+            obj.uvs.push_back(vmath::vec2(f[0], f[1]));
+        }
+        else if (strcmp(lineHeader, "vn") == 0 && want_normals)
+        {
+            parseFloats(line.c_str(), f, 3);
+            obj.normals.push_back(vmath::vec3(f[0], f[1], f[2]));
+        }
+        else if (strcmp(lineHeader, "f") == 0)
+        {
+            const char *s = line.c_str();
+            polygon.clear();
+            for (;;)
+            {
+                while (*s && isspace((unsigned char)*s))
+                    s++;
+                if (!*s)
+                    break;
+
+                ObjCorner corner;
+                if (!parseCorner(s, obj, want_uvs, want_normals, corner))
+                {
+                    printf("Bad face in %s: %s", path, line.c_str());
+                    fclose(file);
+                    return false;
+                }
+                polygon.push_back(corner);
+            }
+
+            if (polygon.size() < 3)
+            {
+                printf("Face with less than 3 corners in %s\n", path);
+                fclose(file);
+                return false;
+            }
+
+            // Triangulate polygons as a fan around the first corner.
+            for (size_t i = 2; i < polygon.size(); i++)
+            {
+                obj.corners.push_back(polygon[0]);
+                obj.corners.push_back(polygon[i - 1]);
+                obj.corners.push_back(polygon[i]);
+            }
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char *skipBlanks(const char *s, const char *end)
+{
+    while (s < end && isBlank(*s))
+        s++;
+    return s;
+}
+
+// Decimal float parser for the memory-mapped readers. Unlike strtof it needs
+// no terminator and ignores the locale. Returns NULL when there is no number.
+const char *parseFloat(const char *s, const char *end, float &out)
+{
+    static const double powers[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+
+    double mantissa = 0.0;
+    int exponent = 0;
+    int digits = 0;
+    for (; s < end && *s >= '0' && *s <= '9'; s++, digits++)
+        mantissa = mantissa * 10.0 + (*s - '0');
+    if (s < end && *s == '.')
+    {
+        for (s++; s < end && *s >= '0' && *s <= '9'; s++, digits++, exponent--)
+            mantissa = mantissa * 10.0 + (*s - '0');
+    }
+    if (digits == 0)
+        return NULL;
+
+    if (s < end && (*s == 'e' || *s == 'E'))
+    {
+        const char *e = s + 1;
+        bool negative_exponent = false;
+        if (e < end && (*e == '-' || *e == '+'))
+            negative_exponent = *e++ == '-';
+        int value = 0;
+        const char *first = e;
+        for (; e < end && *e >= '0' && *e <= '9'; e++)
+            value = value < 10000 ? value * 10 + (*e - '0') : value;
+        if (e != first)
+        {
+            exponent += negative_exponent ? -value : value;
+            s = e;
+        }
+    }
+
+    if (exponent < 0)
+        mantissa = exponent >= -22 ? mantissa / powers[-exponent] : mantissa * pow(10.0, exponent);
+    else if (exponent > 0)
+        mantissa = exponent <= 22 ? mantissa * powers[exponent] : mantissa * pow(10.0, exponent);
+
+    out = (float)(negative ? -mantissa : mantissa);
+    return s;
+}
+
+const char *parseInteger(const char *s, const char *end, long &out)
+{
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+'))
+        negative = *s++ == '-';
+
+    const char *first = s;
+    long value = 0;
+    for (; s < end && *s >= '0' && *s <= '9'; s++)
+        value = value * 10 + (*s - '0');
+    if (s == first)
+        return NULL;
+
+    out = negative ? -value : value;
+    return s;
+}
+
+int parseFloats(const char *s, const char *end, float *out, int count)
+{
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        const char *next = parseFloat(skipBlanks(s, end), end, out[i]);
+        if (!next)
+            break;
+        s = next;
+    }
+    return i;
+}
+
+// Part of an OBJ file parsed on its own. Negative face indices can only be
+// resolved against the elements read so far in this chunk; those corners are
+// flagged and offset once the counts of all earlier chunks are known.
+struct ObjChunk
+{
+    ObjData data;
+    std::vector<unsigned char> relative;    // per corner: bit 0 = p, 1 = t, 2 = n
+    bool ok;
+
+    ObjChunk() : ok(true) {}
+};
+
+enum
+{
+    RELATIVE_P = 1 << 0,
+    RELATIVE_T = 1 << 1,
+    RELATIVE_N = 1 << 2
+};
+
+inline int chunkIndex(long index, size_t count, unsigned char flag, unsigned char &relative)
+{
+    if (index > 0)
+        return (int)(index - 1);
+    if (index < 0)
+    {
+        relative |= flag;
+        return (int)((long)count + index);
+    }
+    return -1;
+}
+
+const char *parseCornerRange(const char *s, const char *end, bool want_uvs, bool want_normals,
+                             const ObjData &data, ObjCorner &corner, unsigned char &relative)
+{
+    long v = 0;
+    long vt = 0;
+    long vn = 0;
+
+    s = parseInteger(s, end, v);
+    if (!s || v == 0)
+        return NULL;
+    if (s < end && *s == '/')
+    {
+        s++;
+        if (s < end && *s != '/')
+        {
+            s = parseInteger(s, end, vt);
+            if (!s)
+                return NULL;
+        }
+        if (s < end && *s == '/')
+        {
+            s = parseInteger(s + 1, end, vn);
+            if (!s)
+                return NULL;
+        }
+    }
+    if (s < end && !isBlank(*s))
+        return NULL;
+
+    relative = 0;
+    corner.p = chunkIndex(v, data.positions.size(), RELATIVE_P, relative);
+    corner.t = want_uvs ? chunkIndex(vt, data.uvs.size(), RELATIVE_T, relative) : -1;
+    corner.n = want_normals ? chunkIndex(vn, data.normals.size(), RELATIVE_N, relative) : -1;
+    return s;
+}
+
+void parseOBJRange(const char *s, const char *end, bool want_uvs, bool want_normals, ObjChunk &chunk)
+{
+    ObjData &data = chunk.data;
+    std::vector<ObjCorner> polygon;
+    std::vector<unsigned char> polygon_relative;
+    float f[3];
+
+    while (s < end)
+    {
+        const char *line_end = (const char *)memchr(s, '\n', end - s);
+        if (!line_end)
+            line_end = end;
+        s = skipBlanks(s, line_end);
+        const ptrdiff_t length = line_end - s;
+
+        if (length >= 2 && s[0] == 'v' && isBlank(s[1]))
+        {
+            f[0] = f[1] = f[2] = 0.0f;
+            parseFloats(s + 2, line_end, f, 3);
+            data.positions.push_back(vmath::vec3(f[0], f[1], f[2]));
+        }
+        else if (length >= 3 && s[0] == 'v' && s[1] == 't' && isBlank(s[2]))
+        {
+            if (want_uvs)
+            {
+                f[0] = f[1] = 0.0f;
+                parseFloats(s + 3, line_end, f, 2);
+                data.uvs.push_back(vmath::vec2(f[0], f[1]));
+            }
+        }
+        else if (length >= 3 && s[0] == 'v' && s[1] == 'n' && isBlank(s[2]))
+        {
+            if (want_normals)
+            {
+                f[0] = f[1] = f[2] = 0.0f;
+                parseFloats(s + 3, line_end, f, 3);
+                data.normals.push_back(vmath::vec3(f[0], f[1], f[2]));
+            }
+        }
+        else if (length >= 2 && s[0] == 'f' && isBlank(s[1]))
+        {
+            polygon.clear();
+            polygon_relative.clear();
+            const char *c = skipBlanks(s + 2, line_end);
+            while (c < line_end)
+            {
+                ObjCorner corner;
+                unsigned char relative;
+                c = parseCornerRange(c, line_end, want_uvs, want_normals, data, corner, relative);
+                if (!c)
+                    break;
+                polygon.push_back(corner);
+                polygon_relative.push_back(relative);
+                c = skipBlanks(c, line_end);
+            }
+
+            if (!c || polygon.size() < 3)
+            {
+                printf("Bad face: %.*s\n", (int)(line_end - s), s);
+                chunk.ok = false;
+                return;
+            }
+
+            // Triangulate polygons as a fan around the first corner.
+            for (size_t i = 2; i < polygon.size(); i++)
+            {
+                data.corners.push_back(polygon[0]);
+                data.corners.push_back(polygon[i - 1]);
+                data.corners.push_back(polygon[i]);
+                chunk.relative.push_back(polygon_relative[0]);
+                chunk.relative.push_back(polygon_relative[i - 1]);
+                chunk.relative.push_back(polygon_relative[i]);
+            }
+        }
+
+        s = line_end + 1;
+    }
+}
+
+template <typename T>
+void appendRange(std::vector<T> &dst, size_t offset, const std::vector<T> &src)
+{
+    if (!src.empty())
+        memcpy((void *)&dst[offset], &src[0], src.size() * sizeof(T));
+}
+
+// Stitches parsed chunks back into one ObjData, fixing up relative indices and
+// checking every index against the final element counts.
+bool mergeChunks(std::vector<ObjChunk> &chunks, ObjData &obj)
+{
+    const size_t count = chunks.size();
+    std::vector<size_t> p_base(count + 1, 0), t_base(count + 1, 0), n_base(count + 1, 0), c_base(count + 1, 0);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!chunks[i].ok)
+            return false;
+        p_base[i + 1] = p_base[i] + chunks[i].data.positions.size();
+        t_base[i + 1] = t_base[i] + chunks[i].data.uvs.size();
+        n_base[i + 1] = n_base[i] + chunks[i].data.normals.size();
+        c_base[i + 1] = c_base[i] + chunks[i].data.corners.size();
+    }
+
+    // A single chunk is taken over as is and only needs its indices checked.
+    const bool single = count == 1;
+    if (single)
+    {
+        obj.positions.swap(chunks[0].data.positions);
+        obj.uvs.swap(chunks[0].data.uvs);
+        obj.normals.swap(chunks[0].data.normals);
+        obj.corners.swap(chunks[0].data.corners);
+    }
+    else
+    {
+        obj.positions.resize(p_base[count]);
+        obj.uvs.resize(t_base[count]);
+        obj.normals.resize(n_base[count]);
+        obj.corners.resize(c_base[count]);
+    }
+
+    const long p_total = (long)p_base[count];
+    const long t_total = (long)t_base[count];
+    const long n_total = (long)n_base[count];
+    std::vector<unsigned char> valid(count, 1);
+
+    forRanges(count, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            ObjChunk &chunk = chunks[i];
+            const std::vector<ObjCorner> &corners = single ? obj.corners : chunk.data.corners;
+            if (!single)
+            {
+                appendRange(obj.positions, p_base[i], chunk.data.positions);
+                appendRange(obj.uvs, t_base[i], chunk.data.uvs);
+                appendRange(obj.normals, n_base[i], chunk.data.normals);
+            }
+
+            for (size_t c = 0; c < corners.size(); c++)
+            {
+                ObjCorner corner = corners[c];
+                const unsigned char relative = chunk.relative[c];
+                if (relative & RELATIVE_P)
+                    corner.p += (int)p_base[i];
+                if (relative & RELATIVE_T)
+                    corner.t += (int)t_base[i];
+                if (relative & RELATIVE_N)
+                    corner.n += (int)n_base[i];
+
+                if (corner.p < 0 || corner.p >= p_total ||
+                    (corner.t >= t_total) || (corner.t < 0 && (relative & RELATIVE_T)) ||
+                    (corner.n >= n_total) || (corner.n < 0 && (relative & RELATIVE_N)))
+                {
+                    valid[i] = 0;
+                    break;
+                }
+                obj.corners[c_base[i] + c] = corner;
+            }
+
+            // Release the chunk as soon as it has been copied.
+            std::vector<vmath::vec3>().swap(chunk.data.positions);
+            std::vector<vmath::vec2>().swap(chunk.data.uvs);
+            std::vector<vmath::vec3>().swap(chunk.data.normals);
+            std::vector<ObjCorner>().swap(chunk.data.corners);
+            std::vector<unsigned char>().swap(chunk.relative);
+        }
+    });
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!valid[i])
+        {
+            printf("Face index out of range\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+// MESH_LOAD_MMAP / MESH_LOAD_PARALLEL: parse the text in place, in one chunk
+// or in one chunk per job thread split at line boundaries.
+bool readOBJText(const char *begin, size_t size, bool want_uvs, bool want_normals, bool parallel, ObjData &obj)
+{
+    const char *end = begin + size;
+
+    size_t chunk_count = 1;
+    if (parallel)
+    {
+        const size_t min_chunk = 1 << 20;
+        chunk_count = jobThreadCount();
+        if (size / min_chunk < chunk_count)
+            chunk_count = size / min_chunk > 0 ? size / min_chunk : 1;
+    }
+
+    std::vector<const char *> splits(chunk_count + 1, end);
+    splits[0] = begin;
+    for (size_t i = 1; i < chunk_count; i++)
+    {
+        const char *s = begin + size / chunk_count * i;
+        if (s < splits[i - 1])
+            s = splits[i - 1];
+        const char *newline = (const char *)memchr(s, '\n', end - s);
+        splits[i] = newline ? newline + 1 : end;
+    }
+
+    std::vector<ObjChunk> chunks(chunk_count);
+    forRanges(chunk_count, 1, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++)
+            parseOBJRange(splits[i], splits[i + 1], want_uvs, want_normals, chunks[i]);
+    });
+
+    return mergeChunks(chunks, obj);
+}
+
+bool readOBJMapped(const char *path, bool want_uvs, bool want_normals, bool parallel, ObjData &obj)
+{
+    MappedFile file;
+    if (!file.open(path))
+    {
+        printf("Impossible to open the file !\n");
+        return false;
+    }
+    return readOBJText(file.data(), file.size(), want_uvs, want_normals, parallel, obj);
+}
+
+// MESH_LOAD_CACHE: the finished mesh is stored next to the OBJ file and reused
+// for as long as the source size and time stamp match.
+struct MeshCacheHeader
+{
+    char magic[4];
+    unsigned int version;
+    unsigned long long source_size;
+    long long source_mtime;
+    unsigned int attribs;
+    float crease_angle;
+    unsigned int vertex_count;
+    unsigned int index_count;
+    unsigned int streams;       // MeshAttrib bits stored in the file
+    unsigned int reserved;
+};
+
+static const char mesh_cache_magic[4] = { 'O', 'M', 'S', 'H' };
+static const unsigned int mesh_cache_version = 1;
+
+std::string meshCachePath(const char *path)
+{
+    return std::string(path) + ".meshcache";
+}
+
+size_t meshCacheDataSize(const MeshCacheHeader &header)
+{
+    size_t size = header.vertex_count * sizeof(vmath::vec3) + header.index_count * sizeof(unsigned int);
+    if (header.streams & MESH_UV)
+        size += header.vertex_count * sizeof(vmath::vec2);
+    if (header.streams & MESH_NORMAL)
+        size += header.vertex_count * sizeof(vmath::vec3);
+    if (header.streams & MESH_TANGENT)
+        size += header.vertex_count * sizeof(vmath::vec4);
+    return size;
+}
+
+template <typename T>
+const char *readCacheArray(const char *s, size_t count, std::vector<T> &out)
+{
+    out.resize(count);
+    if (count)
+        memcpy((void *)&out[0], s, count * sizeof(T));
+    return s + count * sizeof(T);
+}
+
+bool readMeshCache(const char *path, const MeshLoadOptions &options, Mesh &out_mesh)
+{
+    unsigned long long source_size;
+    long long source_mtime;
+    if (!getFileStamp(path, source_size, source_mtime))
+        return false;
+
+    MappedFile file;
+    if (!file.open(meshCachePath(path).c_str()) || file.size() < sizeof(MeshCacheHeader))
+        return false;
+
+    MeshCacheHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, mesh_cache_magic, 4) != 0 ||
+        header.version != mesh_cache_version ||
+        header.source_size != source_size ||
+        header.source_mtime != source_mtime ||
+        header.attribs != options.attribs ||
+        header.crease_angle != options.crease_angle ||
+        file.size() != sizeof(header) + meshCacheDataSize(header))
+    {
+        return false;
+    }
+
+    out_mesh = Mesh();
+    const char *s = file.data() + sizeof(header);
+    s = readCacheArray(s, header.vertex_count, out_mesh.positions);
+    if (header.streams & MESH_UV)
+        s = readCacheArray(s, header.vertex_count, out_mesh.uvs);
+    if (header.streams & MESH_NORMAL)
+        s = readCacheArray(s, header.vertex_count, out_mesh.normals);
+    if (header.streams & MESH_TANGENT)
+        s = readCacheArray(s, header.vertex_count, out_mesh.tangents);
+    readCacheArray(s, header.index_count, out_mesh.indices);
+    return true;
+}
+
+template <typename T>
+bool writeCacheArray(FILE *file, const std::vector<T> &data)
+{
+    return data.empty() || fwrite(&data[0], sizeof(T), data.size(), file) == data.size();
+}
+
+void writeMeshCache(const char *path, const MeshLoadOptions &options, const Mesh &mesh)
+{
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, mesh_cache_magic, 4);
+    header.version = mesh_cache_version;
+    if (!getFileStamp(path, header.source_size, header.source_mtime))
+        return;
+    header.attribs = options.attribs;
+    header.crease_angle = options.crease_angle;
+    header.vertex_count = (unsigned int)mesh.positions.size();
+    header.index_count = (unsigned int)mesh.indices.size();
+    header.streams = MESH_POSITION;
+    if (!mesh.uvs.empty())
+        header.streams |= MESH_UV;
+    if (!mesh.normals.empty())
+        header.streams |= MESH_NORMAL;
+    if (!mesh.tangents.empty())
+        header.streams |= MESH_TANGENT;
+
+    const std::string cache_path = meshCachePath(path);
+    FILE *file = openFile(cache_path.c_str(), "wb");
+    if (!file)
+        return;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && writeCacheArray(file, mesh.positions);
+    ok = ok && writeCacheArray(file, mesh.uvs);
+    ok = ok && writeCacheArray(file, mesh.normals);
+    ok = ok && writeCacheArray(file, mesh.tangents);
+    ok = ok && writeCacheArray(file, mesh.indices);
+    fclose(file);
+
+    if (!ok)
+        remove(cache_path.c_str());
+}
+
+// acos(x) for x in [-1, 1]; Abramowitz & Stegun 4.4.45, error below 7e-5 rad.
+// Only used for angle weights, where that is plenty.
+inline float approxAcos(float x)
+{
+    const float ax = fabsf(x);
+    const float r = sqrtf(1.0f - ax) * (1.5707288f + ax * (-0.2121144f + ax * (0.0742610f - 0.0187293f * ax)));
+    return x < 0.0f ? 3.14159265f - r : r;
+}
+
+inline float cornerAngle(float d, float length_product)
+{
+    if (length_product <= 0.0f)
+        return 0.0f;
+    float c = d / length_product;
+    c = c < -1.0f ? -1.0f : (c > 1.0f ? 1.0f : c);
+    return approxAcos(c);
+}
+
+void faceFrame(const vmath::vec3 *positions, const unsigned int *tri, vmath::vec3 &normal, float *angles)
+{
+    const vmath::vec3 &p0 = positions[tri[0]];
+    const vmath::vec3 &p1 = positions[tri[1]];
+    const vmath::vec3 &p2 = positions[tri[2]];
+    const vmath::vec3 e01 = p1 - p0;
+    const vmath::vec3 e02 = p2 - p0;
+    const vmath::vec3 e12 = p2 - p1;
+
+    const vmath::vec3 n = vmath::cross(e01, e02);
+    const float len = vmath::length(n);
+    normal = len > 0.0f ? vmath::vec3(n / len) : vmath::vec3(0.0f, 0.0f, 0.0f);
+
+    const float l01 = vmath::length(e01);
+    const float l02 = vmath::length(e02);
+    const float l12 = vmath::length(e12);
+    angles[0] = cornerAngle(vmath::dot(e01, e02), l01 * l02);
+    angles[1] = cornerAngle(-vmath::dot(e01, e12), l01 * l12);
+    angles[2] = cornerAngle(vmath::dot(e02, e12), l02 * l12);
+}
+
+#ifdef MESH_SSE2
+inline __m128 dot3(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
+
+// Four lanes of cornerAngle.
+inline __m128 cornerAngle4(__m128 d, __m128 length_product)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 valid = _mm_cmpgt_ps(length_product, _mm_setzero_ps());
+    __m128 c = _mm_div_ps(d, _mm_or_ps(_mm_and_ps(valid, length_product), _mm_andnot_ps(valid, one)));
+    c = _mm_max_ps(_mm_set1_ps(-1.0f), _mm_min_ps(one, c));
+
+    const __m128 negative = _mm_cmplt_ps(c, _mm_setzero_ps());
+    const __m128 ax = _mm_andnot_ps(_mm_set1_ps(-0.0f), c);
+    __m128 poly = _mm_add_ps(_mm_mul_ps(ax, _mm_set1_ps(-0.0187293f)), _mm_set1_ps(0.0742610f));
+    poly = _mm_add_ps(_mm_mul_ps(ax, poly), _mm_set1_ps(-0.2121144f));
+    poly = _mm_add_ps(_mm_mul_ps(ax, poly), _mm_set1_ps(1.5707288f));
+    __m128 r = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(one, ax)), poly);
+    r = _mm_or_ps(_mm_and_ps(negative, _mm_sub_ps(_mm_set1_ps(3.14159265f), r)), _mm_andnot_ps(negative, r));
+    return _mm_and_ps(valid, r);
+}
+
+// faceFrame for four triangles at once, in structure-of-arrays form.
+void faceFrame4(const vmath::vec3 *positions, const unsigned int *tri, vmath::vec3 *normals, float *angles)
+{
+    float gather[9][4];
+    for (int i = 0; i < 4; i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            const vmath::vec3 &p = positions[tri[i * 3 + k]];
+            gather[k * 3 + 0][i] = p[0];
+            gather[k * 3 + 1][i] = p[1];
+            gather[k * 3 + 2][i] = p[2];
+        }
+    }
+
+    const __m128 p0x = _mm_loadu_ps(gather[0]), p0y = _mm_loadu_ps(gather[1]), p0z = _mm_loadu_ps(gather[2]);
+    const __m128 p1x = _mm_loadu_ps(gather[3]), p1y = _mm_loadu_ps(gather[4]), p1z = _mm_loadu_ps(gather[5]);
+    const __m128 p2x = _mm_loadu_ps(gather[6]), p2y = _mm_loadu_ps(gather[7]), p2z = _mm_loadu_ps(gather[8]);
+
+    const __m128 e01x = _mm_sub_ps(p1x, p0x), e01y = _mm_sub_ps(p1y, p0y), e01z = _mm_sub_ps(p1z, p0z);
+    const __m128 e02x = _mm_sub_ps(p2x, p0x), e02y = _mm_sub_ps(p2y, p0y), e02z = _mm_sub_ps(p2z, p0z);
+    const __m128 e12x = _mm_sub_ps(p2x, p1x), e12y = _mm_sub_ps(p2y, p1y), e12z = _mm_sub_ps(p2z, p1z);
+
+    __m128 nx = _mm_sub_ps(_mm_mul_ps(e01y, e02z), _mm_mul_ps(e01z, e02y));
+    __m128 ny = _mm_sub_ps(_mm_mul_ps(e01z, e02x), _mm_mul_ps(e01x, e02z));
+    __m128 nz = _mm_sub_ps(_mm_mul_ps(e01x, e02y), _mm_mul_ps(e01y, e02x));
+    const __m128 len2 = dot3(nx, ny, nz, nx, ny, nz);
+    const __m128 nonzero = _mm_cmpgt_ps(len2, _mm_setzero_ps());
+    const __m128 inv = _mm_and_ps(nonzero, _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_or_ps(len2, _mm_andnot_ps(nonzero, _mm_set1_ps(1.0f))))));
+    nx = _mm_mul_ps(nx, inv);
+    ny = _mm_mul_ps(ny, inv);
+    nz = _mm_mul_ps(nz, inv);
+
+    const __m128 l01 = _mm_sqrt_ps(dot3(e01x, e01y, e01z, e01x, e01y, e01z));
+    const __m128 l02 = _mm_sqrt_ps(dot3(e02x, e02y, e02z, e02x, e02y, e02z));
+    const __m128 l12 = _mm_sqrt_ps(dot3(e12x, e12y, e12z, e12x, e12y, e12z));
+    const __m128 a0 = cornerAngle4(dot3(e01x, e01y, e01z, e02x, e02y, e02z), _mm_mul_ps(l01, l02));
+    const __m128 a1 = cornerAngle4(_mm_sub_ps(_mm_setzero_ps(), dot3(e01x, e01y, e01z, e12x, e12y, e12z)), _mm_mul_ps(l01, l12));
+    const __m128 a2 = cornerAngle4(dot3(e02x, e02y, e02z, e12x, e12y, e12z), _mm_mul_ps(l02, l12));
+
+    float out[6][4];
+    _mm_storeu_ps(out[0], nx);
+    _mm_storeu_ps(out[1], ny);
+    _mm_storeu_ps(out[2], nz);
+    _mm_storeu_ps(out[3], a0);
+    _mm_storeu_ps(out[4], a1);
+    _mm_storeu_ps(out[5], a2);
+    for (int i = 0; i < 4; i++)
+    {
+        normals[i] = vmath::vec3(out[0][i], out[1][i], out[2][i]);
+        angles[i * 3 + 0] = out[3][i];
+        angles[i * 3 + 1] = out[4][i];
+        angles[i * 3 + 2] = out[5][i];
+    }
+}
+#endif
+
+// Unit face normals and the interior angle at every triangle corner.
+void computeFaceFrames(const Mesh &mesh, std::vector<vmath::vec3> &face_normals, std::vector<float> &corner_angles)
+{
+    const size_t tri_count = mesh.indices.size() / 3;
+    face_normals.resize(tri_count);
+    corner_angles.resize(tri_count * 3);
+    if (tri_count == 0)
+        return;
+
+    // Split the work in groups of four triangles so every triangle takes the
+    // same path, and gives the same result, however many threads there are.
+    forRanges((tri_count + 3) / 4, 4096, [&](size_t begin, size_t end) {
+        size_t t = begin * 4;
+        const size_t last = end * 4 < tri_count ? end * 4 : tri_count;
+#ifdef MESH_SSE2
+        for (; t + 4 <= last; t += 4)
+            faceFrame4(&mesh.positions[0], &mesh.indices[t * 3], &face_normals[t], &corner_angles[t * 3]);
+#endif
+        for (; t < last; t++)
+            faceFrame(&mesh.positions[0], &mesh.indices[t * 3], face_normals[t], &corner_angles[t * 3]);
+    });
+}
+
+template <typename T>
+void gatherAttribute(std::vector<T> &attribute, const std::vector<unsigned int> &source)
+{
+    if (attribute.empty())
+        return;
+    std::vector<T> gathered(source.size());
+    for (size_t i = 0; i < source.size(); i++)
+        gathered[i] = attribute[source[i]];
+    attribute.swap(gathered);
+}
+
+// Gives every distinct (vertex, tag) pair referenced by the index buffer a
+// vertex of its own, copying the attributes of the original vertex.
+void splitVertices(Mesh &mesh, const std::vector<unsigned int> &corner_tag)
+{
+    std::unordered_map<unsigned long long, unsigned int> remap;
+    std::vector<unsigned int> source;
+    remap.reserve(mesh.positions.size());
+    source.reserve(mesh.positions.size());
+
+    for (size_t c = 0; c < mesh.indices.size(); c++)
+    {
+        const unsigned long long key = ((unsigned long long)mesh.indices[c] << 32) | corner_tag[c];
+        std::pair<std::unordered_map<unsigned long long, unsigned int>::iterator, bool> r =
+            remap.insert(std::make_pair(key, (unsigned int)source.size()));
+        if (r.second)
+            source.push_back(mesh.indices[c]);
+        mesh.indices[c] = r.first->second;
+    }
+
+    gatherAttribute(mesh.positions, source);
+    gatherAttribute(mesh.uvs, source);
+    gatherAttribute(mesh.normals, source);
+    gatherAttribute(mesh.tangents, source);
+}
+
+// Corners grouped by key (CSR layout): corners[first[k] .. first[k + 1]) use key k.
+void groupCorners(const std::vector<unsigned int> &corner_key, size_t key_count,
+                  std::vector<unsigned int> &first, std::vector<unsigned int> &corners)
+{
+    first.assign(key_count + 1, 0);
+    for (size_t c = 0; c < corner_key.size(); c++)
+        first[corner_key[c] + 1]++;
+    for (size_t k = 0; k < key_count; k++)
+        first[k + 1] += first[k];
+
+    std::vector<unsigned int> fill(first.begin(), first.end() - 1);
+    corners.resize(corner_key.size());
+    for (size_t c = 0; c < corner_key.size(); c++)
+        corners[fill[corner_key[c]]++] = (unsigned int)c;
+}
+
+vmath::vec3 anyPerpendicular(const vmath::vec3 &n)
+{
+    const vmath::vec3 axis = fabsf(n[0]) < 0.9f ? vmath::vec3(1.0f, 0.0f, 0.0f) : vmath::vec3(0.0f, 1.0f, 0.0f);
+    return vmath::normalize(vmath::cross(n, axis));
+}
+
+// Welds the parsed corners into an indexed mesh and fills in what the file
+// lacked.
+void buildMesh(ObjData &obj, const MeshLoadOptions &options, Mesh &out_mesh)
+{
+    const bool want_normals = (options.attribs & (MESH_NORMAL | MESH_TANGENT)) != 0;
+
+    bool has_uvs = true;
+    bool has_normals = true;
+    for (size_t c = 0; c < obj.corners.size(); c++)
+    {
+        has_uvs = has_uvs && obj.corners[c].t >= 0;
+        has_normals = has_normals && obj.corners[c].n >= 0;
+    }
+
+    out_mesh = Mesh();
+    out_mesh.indices.reserve(obj.corners.size());
+
+    if (!has_uvs && !has_normals)
+    {
+        // Position-only corners already index the position array.
+        out_mesh.positions.swap(obj.positions);
+        for (size_t c = 0; c < obj.corners.size(); c++)
+            out_mesh.indices.push_back((unsigned int)obj.corners[c].p);
+    }
+
+    // Weld identical corners into shared vertices.
+    std::unordered_map<ObjCorner, unsigned int, ObjCornerHash> remap;
+    if (has_uvs || has_normals)
+        remap.reserve(obj.positions.size());
+
+    for (size_t c = 0; (has_uvs || has_normals) && c < obj.corners.size(); c++)
+    {
+        ObjCorner key = obj.corners[c];
+        if (!has_uvs)
+            key.t = -1;
+        if (!has_normals)
+            key.n = -1;
+
+        std::pair<std::unordered_map<ObjCorner, unsigned int, ObjCornerHash>::iterator, bool> r =
+            remap.insert(std::make_pair(key, (unsigned int)out_mesh.positions.size()));
+        if (r.second)
+        {
+            out_mesh.positions.push_back(obj.positions[key.p]);
+            if (has_uvs)
+                out_mesh.uvs.push_back(obj.uvs[key.t]);
+            if (has_normals)
+                out_mesh.normals.push_back(obj.normals[key.n]);
+        }
+        out_mesh.indices.push_back(r.first->second);
+    }
+
+    if (want_normals && !has_normals)
+        generateNormals(out_mesh, options.crease_angle);
+    if ((options.attribs & MESH_TANGENT) && has_uvs)
+        generateTangents(out_mesh);
+
+    if (!(options.attribs & MESH_UV))
+        std::vector<vmath::vec2>().swap(out_mesh.uvs);
+    if (!(options.attribs & MESH_NORMAL))
+        std::vector<vmath::vec3>().swap(out_mesh.normals);
+}
+
+} // namespace
+
+void generateNormals(Mesh &mesh, float crease_angle)
+{
+    const size_t corner_count = mesh.indices.size();
+    if (corner_count == 0)
+    {
+        mesh.normals.assign(mesh.positions.size(), vmath::vec3(0.0f, 0.0f, 1.0f));
+        return;
+    }
+
+    std::vector<vmath::vec3> face_normals;
+    std::vector<float> corner_angles;
+    computeFaceFrames(mesh, face_normals, corner_angles);
+
+    // Vertices may already be split along uv seams; weld them by position so
+    // smoothing carries across the seam.
+    std::unordered_map<PositionKey, unsigned int, PositionKeyHash> welded;
+    std::vector<unsigned int> vertex_position(mesh.positions.size());
+    welded.reserve(mesh.positions.size());
+    for (size_t v = 0; v < mesh.positions.size(); v++)
+    {
+        PositionKey key;
+        const float x = mesh.positions[v][0] + 0.0f, y = mesh.positions[v][1] + 0.0f, z = mesh.positions[v][2] + 0.0f;
+        memcpy(&key.x, &x, 4);
+        memcpy(&key.y, &y, 4);
+        memcpy(&key.z, &z, 4);
+        vertex_position[v] = welded.insert(std::make_pair(key, (unsigned int)welded.size())).first->second;
+    }
+
+    std::vector<unsigned int> corner_position(corner_count);
+    for (size_t c = 0; c < corner_count; c++)
+        corner_position[c] = vertex_position[mesh.indices[c]];
+
+    std::vector<unsigned int> first, corners;
+    groupCorners(corner_position, welded.size(), first, corners);
+
+    // Cluster the corners around each position by face normal: a corner joins
+    // the first cluster whose seed face lies within the crease angle. Cluster k
+    // of position p lives in slot first[p] + k, so slots never collide.
+    const float cos_crease = cosf(vmath::radians(crease_angle));
+    std::vector<unsigned int> corner_slot(corner_count);
+    std::vector<unsigned int> slot_seed(corner_count);
+    std::vector<vmath::vec3> slot_normal(corner_count);
+
+    forRanges(welded.size(), 4096, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; p++)
+        {
+            const unsigned int base = first[p];
+            const unsigned int count = first[p + 1] - base;
+            unsigned int clusters = 0;
+
+            for (unsigned int i = 0; i < count; i++)
+            {
+                const unsigned int c = corners[base + i];
+                const vmath::vec3 &fn = face_normals[c / 3];
+                const bool degenerate = vmath::dot(fn, fn) == 0.0f;
+
+                unsigned int k = 0;
+                while (k < clusters && !degenerate && vmath::dot(fn, face_normals[slot_seed[base + k]]) < cos_crease)
+                    k++;
+                if (k == clusters)
+                {
+                    slot_seed[base + k] = c / 3;
+                    slot_normal[base + k] = vmath::vec3(0.0f, 0.0f, 0.0f);
+                    clusters++;
+                }
+                slot_normal[base + k] += fn * corner_angles[c];
+                corner_slot[c] = base + k;
+            }
+
+            for (unsigned int k = 0; k < clusters; k++)
+            {
+                const float len = vmath::length(slot_normal[base + k]);
+                slot_normal[base + k] = len > 0.0f ? vmath::vec3(slot_normal[base + k] / len) : vmath::vec3(0.0f, 0.0f, 1.0f);
+            }
+        }
+    });
+
+    mesh.tangents.clear();
+    mesh.normals.clear();
+    splitVertices(mesh, corner_slot);
+
+    mesh.normals.resize(mesh.positions.size());
+    for (size_t c = 0; c < corner_count; c++)
+        mesh.normals[mesh.indices[c]] = slot_normal[corner_slot[c]];
+}
+
+void generateTangents(Mesh &mesh)
+{
+    const size_t corner_count = mesh.indices.size();
+    mesh.tangents.clear();
+    if (corner_count == 0 || mesh.uvs.size() != mesh.positions.size() || mesh.normals.size() != mesh.positions.size())
+        return;
+
+    std::vector<vmath::vec3> face_normals;
+    std::vector<float> corner_angles;
+    computeFaceFrames(mesh, face_normals, corner_angles);
+
+    // Per-face tangent from the uv gradients, and the bitangent sign each
+    // corner sees relative to its own vertex normal.
+    const size_t tri_count = corner_count / 3;
+    std::vector<vmath::vec3> face_tangents(tri_count);
+    std::vector<unsigned int> corner_flip(corner_count);
+
+    forRanges(tri_count, 16384, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++)
+        {
+            const unsigned int *tri = &mesh.indices[t * 3];
+            const vmath::vec3 e1 = mesh.positions[tri[1]] - mesh.positions[tri[0]];
+            const vmath::vec3 e2 = mesh.positions[tri[2]] - mesh.positions[tri[0]];
+            const vmath::vec2 d1 = mesh.uvs[tri[1]] - mesh.uvs[tri[0]];
+            const vmath::vec2 d2 = mesh.uvs[tri[2]] - mesh.uvs[tri[0]];
+            const float det = d1[0] * d2[1] - d2[0] * d1[1];
+
+            vmath::vec3 tangent(0.0f, 0.0f, 0.0f);
+            vmath::vec3 bitangent(0.0f, 0.0f, 0.0f);
+            if (fabsf(det) > 1e-20f)
+            {
+                const float r = 1.0f / det;
+                tangent = (e1 * d2[1] - e2 * d1[1]) * r;
+                bitangent = (e2 * d1[0] - e1 * d2[0]) * r;
+            }
+            face_tangents[t] = tangent;
+
+            for (int k = 0; k < 3; k++)
+            {
+                const vmath::vec3 &n = mesh.normals[tri[k]];
+                corner_flip[t * 3 + k] = vmath::dot(vmath::cross(n, tangent), bitangent) < 0.0f ? 1 : 0;
+            }
+        }
+    });
+
+    // Mirrored uv islands need their own vertices.
+    splitVertices(mesh, corner_flip);
+
+    std::vector<unsigned int> first, corners;
+    groupCorners(mesh.indices, mesh.positions.size(), first, corners);
+
+    mesh.tangents.resize(mesh.positions.size());
+    forRanges(mesh.positions.size(), 4096, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++)
+        {
+            const vmath::vec3 &n = mesh.normals[v];
+            vmath::vec3 sum(0.0f, 0.0f, 0.0f);
+            float sign = 1.0f;
+
+            // Project each face tangent into the vertex tangent plane before
+            // the angle-weighted sum, as MikkTSpace does.
+            for (unsigned int i = first[v]; i < first[v + 1]; i++)
+            {
+                const unsigned int c = corners[i];
+                vmath::vec3 t = face_tangents[c / 3];
+                t -= n * vmath::dot(n, t);
+                const float len = vmath::length(t);
+                if (len > 0.0f)
+                    sum += t * (corner_angles[c] / len);
+                sign = corner_flip[c] ? -1.0f : 1.0f;
+            }
+
+            const float len = vmath::length(sum);
+            const vmath::vec3 tangent = len > 0.0f ? vmath::vec3(sum / len) : anyPerpendicular(n);
+            mesh.tangents[v] = vmath::vec4(tangent, sign);
+        }
+    });
+}
+
+bool loadOBJ(const char *path, Mesh &out_mesh, const MeshLoadOptions &options)
+{
+    // Tangents are built from uvs and normals, so those are read either way.
+    const bool want_uvs = (options.attribs & (MESH_UV | MESH_TANGENT)) != 0;
+    const bool want_normals = (options.attribs & (MESH_NORMAL | MESH_TANGENT)) != 0;
+
+    if (options.mode == MESH_LOAD_CACHE && readMeshCache(path, options, out_mesh))
+        return true;
+
+    ObjData obj;
+    const bool read = options.mode == MESH_LOAD_STDIO
+        ? readOBJStdio(path, want_uvs, want_normals, obj)
+        : readOBJMapped(path, want_uvs, want_normals, options.mode != MESH_LOAD_MMAP, obj);
+    if (!read)
+        return false;
+    buildMesh(obj, options, out_mesh);
+
+    if (options.mode == MESH_LOAD_CACHE)
+        writeMeshCache(path, options, out_mesh);
+
+    return true;
+}
+
+bool parseOBJ(const char *data, size_t size, Mesh &out_mesh, const MeshLoadOptions &options)
+{
+    const bool want_uvs = (options.attribs & (MESH_UV | MESH_TANGENT)) != 0;
+    const bool want_normals = (options.attribs & (MESH_NORMAL | MESH_TANGENT)) != 0;
+
+    ObjData obj;
+    if (!readOBJText(data, size, want_uvs, want_normals, options.mode != MESH_LOAD_MMAP, obj))
+        return false;
+    buildMesh(obj, options, out_mesh);
+    return true;
+}
+
+bool loadOBJ(
+    const char * path,
+    std::vector <vmath::vec3> & out_vertices,
+    std::vector <vmath::vec2> & out_uvs,
+    std::vector <vmath::vec3> & out_normals,
+    unsigned int attribs
+)
+{
+    Mesh mesh;
+    MeshLoadOptions options;
+    options.attribs = attribs & ~MESH_TANGENT;
+    if (!loadOBJ(path, mesh, options))
+        return false;
+
+    out_vertices.reserve(out_vertices.size() + mesh.indices.size());
+    if (!mesh.uvs.empty())
+        out_uvs.reserve(out_uvs.size() + mesh.indices.size());
+    if (!mesh.normals.empty())
+        out_normals.reserve(out_normals.size() + mesh.indices.size());
+
+    // For each vertex of each triangle
+    for (size_t i = 0; i < mesh.indices.size(); i++)
+    {
+        const unsigned int index = mesh.indices[i];
+        out_vertices.push_back(mesh.positions[index]);
+        if (!mesh.uvs.empty())
+            out_uvs.push_back(mesh.uvs[index]);
+        if (!mesh.normals.empty())
+            out_normals.push_back(mesh.normals[index]);
+    }
+
+    return true;
+}
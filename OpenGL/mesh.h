@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+#include <vmath.h>
+
+// Indexed triangle mesh. Every attribute array is either empty or has one
+// entry per vertex; indices holds three entries per triangle.
+struct Mesh
+{
+    std::vector<vmath::vec3> positions;
+    std::vector<vmath::vec2> uvs;
+    std::vector<vmath::vec3> normals;
+    std::vector<vmath::vec4> tangents;    // xyz = tangent, w = bitangent sign (+1 / -1)
+    std::vector<unsigned int> indices;
+};
+
+// Vertex streams, one bit per shader input location (layout(location = N)),
+// so a mask from GetProgramInputMask can be passed straight to the loader.
+enum MeshAttrib
+{
+    MESH_POSITION   = 1 << 0,
+    MESH_UV         = 1 << 1,
+    MESH_NORMAL     = 1 << 2,
+    MESH_TANGENT    = 1 << 3,
+    MESH_ALL        = MESH_POSITION | MESH_UV | MESH_NORMAL | MESH_TANGENT
+};
+
+enum MeshLoadMode
+{
+    MESH_LOAD_STDIO,        // Buffered fscanf/fgets reader, one line at a time.
+    MESH_LOAD_MMAP,         // Parse the memory-mapped file on the calling thread.
+    MESH_LOAD_PARALLEL,     // Parse the memory-mapped file on all job threads (jobs.h).
+    MESH_LOAD_CACHE         // Reuse <path>.meshcache if it is current, else parse in parallel and write it.
+};
+
+struct MeshLoadOptions
+{
+    unsigned int attribs;       // MeshAttrib bits. Streams not asked for are skipped while parsing.
+    float crease_angle;         // Degrees. Faces meeting at a sharper angle get split normals.
+    MeshLoadMode mode;
+
+    MeshLoadOptions()
+        : attribs(MESH_ALL),
+          crease_angle(60.0f),
+          mode(MESH_LOAD_PARALLEL)
+    {
+    }
+};
+
+// Loads a Wavefront OBJ file into an indexed mesh. Faces may use any of the
+// v, v/vt, v//vn or v/vt/vn forms and may have more than three corners.
+// Normals missing from the file are generated with generateNormals.
+// Positions are always loaded; other streams only when options.attribs
+// asks for them (tangents also need uvs and normals while loading, but
+// those are dropped again unless requested).
+bool loadOBJ(const char *path, Mesh &out_mesh, const MeshLoadOptions &options = MeshLoadOptions());
+
+// Same as above, for OBJ text the caller already has in memory (a mapping it
+// also hashes, say). Parses on all job threads unless options.mode is
+// MESH_LOAD_MMAP; the stdio reader and the mesh cache need a path.
+bool parseOBJ(const char *data, size_t size, Mesh &out_mesh, const MeshLoadOptions &options = MeshLoadOptions());
+
+// Same as above, but expanded to one vertex per triangle corner for glDrawArrays.
+// Arrays for streams missing from attribs are left empty.
+bool loadOBJ(
+    const char * path,
+    std::vector <vmath::vec3> & out_vertices,
+    std::vector <vmath::vec2> & out_uvs,
+    std::vector <vmath::vec3> & out_normals,
+    unsigned int attribs = MESH_POSITION | MESH_UV | MESH_NORMAL
+);
+
+// Smooth, angle-weighted vertex normals. Vertices that share a position are
+// smoothed together unless their faces differ by more than crease_angle
+// degrees, in which case the vertex is split.
+void generateNormals(Mesh &mesh, float crease_angle);
+
+// MikkTSpace style per-vertex tangents (needs uvs and normals). Vertices whose
+// triangles disagree on the bitangent sign (mirrored uvs) are split.
+void generateTangents(Mesh &mesh);
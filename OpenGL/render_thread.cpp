@@ -0,0 +1,322 @@
+#include "render_thread.h"
+
+#include <chrono>
+#include <cstring>
+
+#include "assets.h"
+#include "backend.h"
+#include "frame_timer.h"
+#include "gl_state.h"
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+// Enough for a few frames of the heaviest scene; a full ring only makes the
+// main thread wait.
+const size_t RING_COMMANDS = 1 << 16;
+
+// Yields a waiting thread spins through before it goes to sleep. Enough to
+// cover a packet arriving within a few microseconds without a wake-up.
+const int SPIN_YIELDS = 64;
+
+double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+RenderCommand hostCommand(RenderOp op)
+{
+    RenderCommand command;
+    command.op = op;
+    return command;
+}
+
+} // namespace
+
+void executeRenderCommand(const RenderCommand &command)
+{
+    switch (command.op)
+    {
+    case RENDER_VIEWPORT:
+        glViewport(command.args[0], command.args[1], command.args[2], command.args[3]);
+        break;
+    case RENDER_CLEAR_COLOR:
+        glClearBufferfv(GL_COLOR, 0, command.values);
+        break;
+    case RENDER_CLEAR_DEPTH:
+        glClearBufferfv(GL_DEPTH, 0, command.values);
+        break;
+    case RENDER_USE_PROGRAM:
+        cachedUseProgram((GLuint)command.args[0]);
+        break;
+    case RENDER_BIND_VERTEX_ARRAY:
+        cachedBindVertexArray((GLuint)command.args[0]);
+        break;
+    case RENDER_UNIFORM_MATRIX4:
+        cachedUniformMatrix4(command.args[0], command.values);
+        break;
+    case RENDER_DRAW_ELEMENTS:
+        glDrawElements((GLenum)command.args[0], command.args[1], (GLenum)command.args[2],
+                       (const void *)(size_t)command.args[3]);
+        break;
+    default:
+        break;
+    }
+}
+
+void CommandRecorder::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    RenderCommand command;
+    command.op = RENDER_VIEWPORT;
+    command.args[0] = x;
+    command.args[1] = y;
+    command.args[2] = width;
+    command.args[3] = height;
+    record(command);
+}
+
+void CommandRecorder::clearColor(const GLfloat color[4])
+{
+    RenderCommand command;
+    command.op = RENDER_CLEAR_COLOR;
+    memcpy(command.values, color, 4 * sizeof(GLfloat));
+    record(command);
+}
+
+void CommandRecorder::clearDepth(GLfloat depth)
+{
+    RenderCommand command;
+    command.op = RENDER_CLEAR_DEPTH;
+    command.values[0] = depth;
+    record(command);
+}
+
+void CommandRecorder::useProgram(GLuint program)
+{
+    RenderCommand command;
+    command.op = RENDER_USE_PROGRAM;
+    command.args[0] = (GLint)program;
+    record(command);
+}
+
+void CommandRecorder::bindVertexArray(GLuint vao)
+{
+    RenderCommand command;
+    command.op = RENDER_BIND_VERTEX_ARRAY;
+    command.args[0] = (GLint)vao;
+    record(command);
+}
+
+void CommandRecorder::uniformMatrix4(GLint location, const GLfloat *matrix)
+{
+    RenderCommand command;
+    command.op = RENDER_UNIFORM_MATRIX4;
+    command.args[0] = location;
+    memcpy(command.values, matrix, 16 * sizeof(GLfloat));
+    record(command);
+}
+
+void CommandRecorder::drawElements(GLenum mode, GLsizei count, GLenum type, size_t offset)
+{
+    RenderCommand command;
+    command.op = RENDER_DRAW_ELEMENTS;
+    command.args[0] = (GLint)mode;
+    command.args[1] = count;
+    command.args[2] = (GLint)type;
+    command.args[3] = (GLint)offset;
+    record(command);
+}
+
+void CommandRecorder::record(const RenderCommand &command)
+{
+    if (thread_)
+        thread_->push(command);
+    else
+        executeRenderCommand(command);
+}
+
+RenderThread::RenderThread()
+    : ring_(RING_COMMANDS),
+      backend_(NULL),
+      begin_frame_(NULL),
+      end_frame_(NULL),
+      frames_recorded_(0),
+      frames_submitted_(0),
+      pending_assets_(0),
+      render_sleeping_(false),
+      main_sleeping_(false),
+      measured_seconds_(0.0),
+      render_wait_seconds_(0.0),
+      commands_(0)
+{
+}
+
+RenderThread::~RenderThread()
+{
+    if (thread_.joinable())
+        stop();
+}
+
+bool RenderThread::start(Backend *backend, FrameHook begin_frame, FrameHook end_frame)
+{
+    backend_ = backend;
+    begin_frame_ = begin_frame;
+    end_frame_ = end_frame;
+    frames_recorded_ = 0;
+    frames_submitted_ = 0;
+    pending_assets_ = pendingAssetCount();
+    measured_seconds_ = 0.0;
+    render_wait_seconds_ = 0.0;
+    commands_ = 0;
+    stats_ = RenderThreadStats();
+
+    if (!backend_->makeCurrent(false))
+        return false;
+    thread_ = std::thread(&RenderThread::run, this);
+    return true;
+}
+
+void RenderThread::beginFrame()
+{
+    push(hostCommand(RENDER_FRAME_BEGIN));
+}
+
+void RenderThread::endFrame()
+{
+    push(hostCommand(RENDER_FRAME_END));
+    frames_recorded_++;
+    // Recording the next frame may overlap this one's submission, no more.
+    waitForRender(1);
+}
+
+void RenderThread::push(const RenderCommand &command)
+{
+    if (!ring_.push(command))
+    {
+        const Clock::time_point start = Clock::now();
+        waitUntil(main_wake_, main_sleeping_, [&]() { return ring_.push(command); });
+        stats_.main_wait_seconds += secondsSince(start);
+    }
+    notify(render_wake_, render_sleeping_);
+}
+
+void RenderThread::beginMeasure()
+{
+    push(hostCommand(RENDER_MEASURE));
+}
+
+unsigned int RenderThread::pendingAssets() const
+{
+    return pending_assets_.load(std::memory_order_relaxed);
+}
+
+double RenderThread::stop()
+{
+    push(hostCommand(RENDER_QUIT));
+    thread_.join();
+    backend_->makeCurrent(true);
+    setAssetLoaderThread();
+    return measured_seconds_;
+}
+
+RenderThreadStats RenderThread::stats() const
+{
+    RenderThreadStats stats = stats_;
+    stats.frames = frames_submitted_;
+    stats.commands = commands_;
+    stats.render_wait_seconds = render_wait_seconds_;
+    return stats;
+}
+
+void RenderThread::waitForRender(size_t frames_ahead)
+{
+    if (frames_recorded_ - frames_submitted_.load(std::memory_order_acquire) <= frames_ahead)
+        return;
+    const Clock::time_point start = Clock::now();
+    waitUntil(main_wake_, main_sleeping_, [&]() {
+        return frames_recorded_ - frames_submitted_.load(std::memory_order_acquire) <= frames_ahead;
+    });
+    stats_.main_wait_seconds += secondsSince(start);
+}
+
+template <typename Ready>
+void RenderThread::waitUntil(std::condition_variable &wake, std::atomic<bool> &sleeping, Ready ready)
+{
+    for (int i = 0; i < SPIN_YIELDS; i++)
+    {
+        if (ready())
+            return;
+        std::this_thread::yield();
+    }
+
+    // The flag goes up before ready() is checked again under the lock, and
+    // notify checks it after its change, so one of the two sees the other.
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    wake.wait(lock, ready);
+    sleeping.store(false, std::memory_order_relaxed);
+}
+
+void RenderThread::notify(std::condition_variable &wake, std::atomic<bool> &sleeping)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!sleeping.load(std::memory_order_relaxed))
+        return;
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    wake.notify_one();
+}
+
+void RenderThread::run()
+{
+    backend_->makeCurrent(true);
+    setAssetLoaderThread();
+
+    bool measuring = false;
+    Clock::time_point measure_start;
+    for (;;)
+    {
+        RenderCommand command;
+        if (!ring_.pop(command))
+        {
+            const Clock::time_point start = Clock::now();
+            waitUntil(render_wake_, render_sleeping_, [&]() { return ring_.pop(command); });
+            render_wait_seconds_ += secondsSince(start);
+        }
+        // The main thread may be waiting for the slot.
+        notify(main_wake_, main_sleeping_);
+
+        switch (command.op)
+        {
+        case RENDER_FRAME_BEGIN:
+            begin_frame_(backend_);
+            pending_assets_.store(pendingAssetCount(), std::memory_order_relaxed);
+            break;
+        case RENDER_FRAME_END:
+            end_frame_(backend_);
+            frames_submitted_.fetch_add(1, std::memory_order_release);
+            notify(main_wake_, main_sleeping_);
+            break;
+        case RENDER_MEASURE:
+            glFinish();
+            resetFrameTiming();
+            measure_start = Clock::now();
+            measuring = true;
+            break;
+        case RENDER_QUIT:
+            if (measuring)
+            {
+                glFinish();
+                measured_seconds_ = secondsSince(measure_start);
+            }
+            backend_->makeCurrent(false);
+            return;
+        default:
+            executeRenderCommand(command);
+            commands_++;
+            break;
+        }
+    }
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "gl_trace.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+#include "spsc_ring.h"
+
+class Backend;
+
+// A thread that owns the GL context and submits frames the main thread
+// recorded as command packets. The main thread records frame N+1 (and runs
+// the simulation for it) while the render thread submits frame N; it never
+// gets further ahead than that, so input latency grows by one frame at most.
+// Packets travel through an SpscRing; a full ring makes the main thread wait.
+// A thread that has to wait spins for a moment, then sleeps until the other
+// side pushes, pops or finishes a frame.
+//
+//     CommandRecorder commands(&render_thread);   // or CommandRecorder() to issue directly
+//     render_thread.beginFrame();
+//     scene.onRecord(alpha, commands);
+//     render_thread.endFrame();
+
+enum RenderOp
+{
+    RENDER_VIEWPORT,            // args: x, y, width, height
+    RENDER_CLEAR_COLOR,         // values[0..3]
+    RENDER_CLEAR_DEPTH,         // values[0]
+    RENDER_USE_PROGRAM,         // args[0]
+    RENDER_BIND_VERTEX_ARRAY,   // args[0]
+    RENDER_UNIFORM_MATRIX4,     // args[0] = location, values[0..15]
+    RENDER_DRAW_ELEMENTS,       // args: mode, count, type, byte offset
+    // Host packets, not recorded by scenes
+    RENDER_FRAME_BEGIN,
+    RENDER_FRAME_END,
+    RENDER_MEASURE,             // glFinish, then restarts the frame timing and the throughput clock
+    RENDER_QUIT
+};
+
+struct RenderCommand
+{
+    RenderOp op;
+    GLint args[4];
+    GLfloat values[16];
+};
+
+// Issues one scene command on the calling thread's context.
+void executeRenderCommand(const RenderCommand &command);
+
+class RenderThread;
+
+// What scenes draw through when they support the render thread. Without a
+// thread the commands are issued straight away.
+class CommandRecorder
+{
+public:
+    explicit CommandRecorder(RenderThread *thread = NULL) : thread_(thread) {}
+
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    void clearColor(const GLfloat color[4]);
+    void clearDepth(GLfloat depth);
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vao);
+    void uniformMatrix4(GLint location, const GLfloat *matrix);
+    void drawElements(GLenum mode, GLsizei count, GLenum type, size_t offset);
+
+private:
+    void record(const RenderCommand &command);
+
+    RenderThread *thread_;
+};
+
+struct RenderThreadStats
+{
+    unsigned long long frames;
+    unsigned long long commands;
+    double main_wait_seconds;       // Main thread waiting for ring space or for the frame before
+    double render_wait_seconds;     // Render thread waiting for packets
+
+    RenderThreadStats() : frames(0), commands(0), main_wait_seconds(0.0), render_wait_seconds(0.0) {}
+};
+
+class RenderThread
+{
+public:
+    // Called on the render thread at the start and end of every frame, for
+    // the host's per-frame GL work; end_frame presents.
+    typedef void (*FrameHook)(Backend *backend);
+
+    RenderThread();
+    ~RenderThread();
+
+    // The context must be current on the calling thread; it is released here
+    // and made current on the render thread.
+    bool start(Backend *backend, FrameHook begin_frame, FrameHook end_frame);
+
+    // Main thread, between start and stop.
+    void beginFrame();
+    void endFrame();
+    void push(const RenderCommand &command);
+
+    // The next frame starts the throughput clock (see stop).
+    void beginMeasure();
+
+    // Asset loads still pending on the render thread as of its last frame.
+    unsigned int pendingAssets() const;
+
+    // Waits for the queued frames, joins the thread and makes the context
+    // current on the calling thread again. Returns the seconds from the
+    // frame after beginMeasure to the end of the last one, 0 without.
+    double stop();
+
+    RenderThreadStats stats() const;
+
+private:
+    void run();
+    void waitForRender(size_t frames_ahead);
+
+    // Returns once ready() holds, sleeping on wake after a short spin.
+    template <typename Ready>
+    void waitUntil(std::condition_variable &wake, std::atomic<bool> &sleeping, Ready ready);
+    // Wakes the thread waiting on wake, if it sleeps.
+    void notify(std::condition_variable &wake, std::atomic<bool> &sleeping);
+
+    SpscRing<RenderCommand> ring_;
+    std::thread thread_;
+    Backend *backend_;
+    FrameHook begin_frame_;
+    FrameHook end_frame_;
+    unsigned long long frames_recorded_;
+    std::atomic<unsigned long long> frames_submitted_;
+    std::atomic<unsigned int> pending_assets_;
+    std::mutex wake_mutex_;
+    std::condition_variable render_wake_;   // Packets pushed
+    std::condition_variable main_wake_;     // Packets popped, frames submitted
+    std::atomic<bool> render_sleeping_;
+    std::atomic<bool> main_sleeping_;
+    double measured_seconds_;       // Written by the render thread, read after the join
+    RenderThreadStats stats_;       // Main thread's share
+    double render_wait_seconds_;    // Render thread's, read after the join
+    unsigned long long commands_;
+};
@@ -0,0 +1,65 @@
+#include "scene.h"
+
+#include <cctype>
+#include <cstddef>
+#include <string>
+
+namespace
+{
+
+// A function-local static, so scenes registered from other files' static
+// initializers find it constructed.
+std::vector<Scene> &registry()
+{
+    static std::vector<Scene> scenes;
+    return scenes;
+}
+
+int scene_count = 0;
+
+std::string upper(const char *name)
+{
+    std::string result(name);
+    for (size_t i = 0; i < result.size(); i++)
+        result[i] = (char)toupper((unsigned char)result[i]);
+    return result;
+}
+
+} // namespace
+
+bool registerScene(const Scene &scene)
+{
+    std::vector<Scene> &scenes = registry();
+    std::vector<Scene>::iterator position = scenes.begin();
+    while (position != scenes.end() && upper(position->name) < upper(scene.name))
+        ++position;
+    scenes.insert(position, scene);
+    return true;
+}
+
+const std::vector<Scene> &registeredScenes()
+{
+    return registry();
+}
+
+const Scene *findScene(const char *name)
+{
+    const std::string wanted = upper(name);
+    const std::vector<Scene> &scenes = registry();
+    for (size_t i = 0; i < scenes.size(); i++)
+    {
+        if (upper(scenes[i].name) == wanted)
+            return &scenes[i];
+    }
+    return NULL;
+}
+
+void setSceneCount(int count)
+{
+    scene_count = count;
+}
+
+int sceneCount(int default_count)
+{
+    return scene_count > 0 ? scene_count : default_count;
+}
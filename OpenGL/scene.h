@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+
+class CommandRecorder;
+
+// The examples register themselves here during static initialization, each
+// from its own .cpp, and the host picks one or several by name at run time
+// (--scene). All of them run in the same process and GL context, one after
+// the other.
+struct Scene
+{
+    const char *name;               // As given to --scene
+    const char *description;
+    int width;                      // Framebuffer size the scene draws at
+    int height;
+    void (*onAwake)();              // Creates the scene's GL objects
+    void (*onUpdate)(double current_time);  // Animates and draws one frame
+    void (*onShutdown)();           // Frees what onAwake created
+
+    // Scenes that simulate at a fixed rate set these instead of onUpdate.
+    // The host calls onStep as often as the clock says (--sim-rate, 120 Hz by
+    // default), then onRender once per frame with how far the clock is past
+    // the last step, as a fraction of a step; the scene draws that far from
+    // its previous simulated state towards the last. Simulation cost then
+    // follows the clock, not the frame rate.
+    void (*onStep)(double step);
+    void (*onRender)(double alpha);
+
+    // Optional, next to onRender: records the same frame as commands instead
+    // of issuing GL calls, so that --render-thread can submit it from the
+    // thread that owns the context while the next frame is being stepped
+    // and recorded. Must not touch GL, nor load or release assets: the
+    // loader belongs to the thread with the context (assets.h).
+    void (*onRecord)(double alpha, CommandRecorder &commands);
+};
+
+// Returns true, so it can initialize a namespace-scope constant.
+bool registerScene(const Scene &scene);
+
+// Sorted by name; registration order across files is unspecified.
+const std::vector<Scene> &registeredScenes();
+
+// Case-insensitive. NULL if no scene has that name.
+const Scene *findScene(const char *name);
+
+// How many objects to draw, for scenes that draw any number of them (--count).
+// The host sets it before each onAwake, 0 when not given; the scene then
+// takes sceneCount(its own default).
+void setSceneCount(int count);
+int sceneCount(int default_count);
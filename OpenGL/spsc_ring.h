@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue between exactly one producer thread and one
+// consumer thread. Each index is written by one side only and read by the
+// other with acquire / release ordering, so a slot's contents are visible
+// before the index that publishes it. The capacity is rounded up to a power
+// of two; one slot stays empty to tell a full ring from an empty one.
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(size_t capacity)
+        : head_(0),
+          tail_(0)
+    {
+        size_t size = 2;
+        while (size < capacity + 1)
+            size *= 2;
+        slots_.resize(size);
+        mask_ = size - 1;
+    }
+
+    // Producer. False if the ring is full.
+    bool push(const T &value)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t next = (tail + 1) & mask_;
+        if (next == head_.load(std::memory_order_acquire))
+            return false;
+        slots_[tail] = value;
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer. False if the ring is empty.
+    bool pop(T &value)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return false;
+        value = slots_[head];
+        head_.store((head + 1) & mask_, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const
+    {
+        return mask_;
+    }
+
+private:
+    std::vector<T> slots_;
+    size_t mask_;
+    // Padded apart, so the two threads do not keep stealing each other's
+    // cache line on every push and pop, nor that of the members around the
+    // ring. Not alignas: rings live in heap allocated objects, and new only
+    // honours extended alignment from C++17.
+    char mask_padding_[64];
+    std::atomic<size_t> head_;  // Next slot to pop, written by the consumer
+    char head_padding_[64];
+    std::atomic<size_t> tail_;  // Next slot to push, written by the producer
+    char tail_padding_[64];
+};
@@ -0,0 +1,585 @@
+#include "streaming.h"
+#include "assets.h"
+#include "fileio.h"
+#include "frame_arena.h"
+#include "texture.h"
+#include "upload.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Must match STREAMING_FEEDBACK_BINDING.
+const char *const STREAMING_FEEDBACK_GLSL =
+    "layout(std430, binding = 7) buffer StreamingFeedback               \n"
+    "{                                                                  \n"
+    "    uint streaming_levels[];                                       \n"
+    "};                                                                 \n"
+    "                                                                   \n"
+    "void streamingFeedback(uint slot, vec2 uv, vec2 size)              \n"
+    "{                                                                  \n"
+    "    vec2 dx = dFdx(uv * size);                                     \n"
+    "    vec2 dy = dFdy(uv * size);                                     \n"
+    "    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));         \n"
+    "    atomicMin(streaming_levels[slot], uint(max(lod, 0.0)));        \n"
+    "}                                                                  \n";
+
+namespace
+{
+
+const unsigned int NO_LEVEL = ~0u;
+const unsigned int MAX_PENDING = 16;    // Level reads in flight on the workers
+const int FEEDBACK_FRAMES = 3;          // Readback lags this many frames behind
+
+// Where the levels of one file come from: a mapped container or a decoded
+// image. Read-only once opened, so workers can copy from it.
+struct Source
+{
+    std::string path;           // Canonical
+    TextureFile *file;
+    Image image;
+    std::vector<TextureFileLevel> levels;
+    GLenum internal_format;
+    GLenum format;
+    GLenum type;
+    bool compressed;
+    GLint unpack_alignment;
+    unsigned int users;
+
+    Source() : file(NULL), internal_format(0), format(0), type(0), compressed(false), unpack_alignment(1), users(0) {}
+    ~Source() { delete file; }
+};
+
+struct LevelRead
+{
+    StreamedTexture *texture;
+    unsigned int level;
+    UploadSpan span;            // Holds the level when staged
+    bool staged;
+    std::vector<unsigned char> data;    // Otherwise here
+};
+
+bool initialised = false;
+StreamingOptions options;
+unsigned int frame = 0;
+
+std::vector<std::shared_ptr<Source> > sources;
+std::vector<StreamedTexture *> textures;
+std::vector<StreamedTexture *> feedback_textures;   // By slot, NULL if free
+unsigned int feedback_users = 0;                    // Slots not NULL
+
+size_t resident_bytes = 0;
+size_t pending_bytes = 0;
+unsigned long long loaded_levels = 0;
+unsigned long long evictions = 0;
+unsigned long long budget_refusals = 0;
+
+std::atomic<unsigned int> pending_reads(0);
+std::vector<LevelRead *> finished_reads;
+std::mutex finished_mutex;
+
+GLuint feedback_buffers[FEEDBACK_FRAMES] = { 0, 0, 0 };
+GLsync feedback_fences[FEEDBACK_FRAMES] = { 0, 0, 0 };
+int feedback_index = 0;
+bool feedback_recording = false;    // feedback_buffers[feedback_index] was cleared and bound for this frame
+
+size_t levelBytes(const StreamedTexture *texture, unsigned int level)
+{
+    return sources[texture->source]->levels[level].size;
+}
+
+// Coarsest levels up to STREAMING_TAIL_SIZE; never evicted.
+unsigned int tailLevel(const StreamedTexture *texture)
+{
+    unsigned int level = 0;
+    while (level + 1 < texture->levels &&
+           std::max(texture->width >> level, texture->height >> level) > STREAMING_TAIL_SIZE)
+        level++;
+    return level;
+}
+
+// Defines or (with data NULL and a zero size) frees one level of the bound
+// texture. The source's pixel store settings must be set.
+void specifyLevel(const Source &source, unsigned int level, const void *data, bool empty)
+{
+    const TextureFileLevel &info = source.levels[level];
+    const GLsizei width = empty ? 0 : (GLsizei)info.width;
+    const GLsizei height = empty ? 0 : (GLsizei)info.height;
+    if (source.compressed)
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, source.internal_format, width, height, 0, empty ? 0 : (GLsizei)info.size, data);
+    else
+        glTexImage2D(GL_TEXTURE_2D, level, source.internal_format, width, height, 0, source.format, source.type, data);
+}
+
+std::shared_ptr<Source> openSource(const char *path)
+{
+    // By canonical path, so that different spellings of a file share it.
+    const std::string key = canonicalPath(path);
+    for (size_t i = 0; i < sources.size(); i++)
+        if (sources[i] && sources[i]->path == key)
+            return sources[i];
+
+    std::shared_ptr<Source> source(new Source);
+    source->path = key;
+    source->file = openTextureContainer(path);
+    if (source->file)
+    {
+        if (!textureFormatSupported(source->file->internal_format))
+            return std::shared_ptr<Source>();
+        source->levels = source->file->levels;
+        source->internal_format = source->file->internal_format;
+        source->format = source->file->format;
+        source->type = source->file->type;
+        source->compressed = source->file->compressed;
+        source->unpack_alignment = 1;
+    }
+    else if (!isTextureContainerPath(path) && decodeBMP(path, source->image))
+    {
+        // No cache to map: the whole chain stays in client memory.
+        generateMipmaps(source->image);
+        const Image &image = source->image;
+        const unsigned int channels = imageChannels(image.format);
+        TextureFileLevel level = { image.width, image.height, &image.pixels[0], image.pixels.size() };
+        source->levels.push_back(level);
+        for (size_t i = 0; i < image.mips.size(); i++)
+        {
+            TextureFileLevel mip = { image.mips[i].width, image.mips[i].height, &image.mips[i].pixels[0],
+                                     imageRowBytes(image.mips[i].width, channels) * image.mips[i].height };
+            source->levels.push_back(mip);
+        }
+        source->internal_format = image.internal_format;
+        source->format = image.format;
+        source->type = GL_UNSIGNED_BYTE;
+        source->unpack_alignment = 4;
+    }
+    else
+        return std::shared_ptr<Source>();
+
+    sources.push_back(source);
+    return source;
+}
+
+void destroyTexture(StreamedTexture *texture)
+{
+    for (unsigned int level = texture->resident_level; level < texture->levels; level++)
+        resident_bytes -= levelBytes(texture, level);
+    glDeleteTextures(1, &texture->texture);
+
+    if (texture->feedback_slot != NO_LEVEL)
+    {
+        feedback_textures[texture->feedback_slot] = NULL;
+        feedback_users--;
+    }
+
+    std::shared_ptr<Source> &source = sources[texture->source];
+    if (--source->users == 0)
+        source.reset();
+
+    textures.erase(std::remove(textures.begin(), textures.end(), texture), textures.end());
+    delete texture;
+}
+
+// Frees the finest resident level. The texture must be bound.
+void evictLevel(StreamedTexture *texture)
+{
+    const Source &source = *sources[texture->source];
+    const unsigned int level = texture->resident_level;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+    specifyLevel(source, level, NULL, true);
+    texture->resident_level = level + 1;
+    resident_bytes -= levelBytes(texture, level);
+    evictions++;
+}
+
+// Evicts the least recently needed non-tail levels that were not needed
+// this frame until bytes more fit under the budget.
+bool makeRoom(size_t bytes)
+{
+    while (resident_bytes + pending_bytes + bytes > options.budget_bytes)
+    {
+        StreamedTexture *victim = NULL;
+        unsigned int oldest = frame;
+        for (size_t i = 0; i < textures.size(); i++)
+        {
+            // A texture with a read in flight keeps its levels, or the read
+            // would leave a hole below them.
+            StreamedTexture *texture = textures[i];
+            if (texture->released || texture->loading_level != NO_LEVEL || texture->resident_level >= tailLevel(texture))
+                continue;
+            const unsigned int used = texture->level_used[texture->resident_level];
+            if (used < oldest)
+            {
+                oldest = used;
+                victim = texture;
+            }
+        }
+        if (!victim)
+            return false;
+        glBindTexture(GL_TEXTURE_2D, victim->texture);
+        evictLevel(victim);
+    }
+    return true;
+}
+
+void startRead(StreamedTexture *texture, unsigned int level)
+{
+    const std::shared_ptr<Source> source = sources[texture->source];
+    texture->loading_level = level;
+    pending_bytes += levelBytes(texture, level);
+    pending_reads++;
+
+    queueAssetJob([texture, level, source]() {
+        // Copying out of the mapping is what pages the level in, so it
+        // happens here rather than on the main thread.
+        const TextureFileLevel &info = source->levels[level];
+        LevelRead *read = new LevelRead;
+        read->texture = texture;
+        read->level = level;
+        read->staged = reserveUpload(info.size, read->span);
+        if (read->staged)
+            memcpy(read->span.data, info.data, info.size);
+        else
+            read->data.assign(info.data, info.data + info.size);
+
+        std::lock_guard<std::mutex> lock(finished_mutex);
+        finished_reads.push_back(read);
+        pending_reads--;
+    });
+}
+
+// Uploads finished reads. Levels only ever extend the resident range by
+// one, so BASE_LEVEL can move down right after.
+void applyFinishedReads()
+{
+    ArenaScope scope(scratchArena());
+    ArenaVector<LevelRead *> reads((ArenaAllocator<LevelRead *>(scratchArena())));
+    {
+        std::lock_guard<std::mutex> lock(finished_mutex);
+        reads.assign(finished_reads.begin(), finished_reads.end());
+        finished_reads.clear();
+    }
+
+    for (size_t i = 0; i < reads.size(); i++)
+    {
+        LevelRead *read = reads[i];
+        StreamedTexture *texture = read->texture;
+        pending_bytes -= levelBytes(texture, read->level);
+        texture->loading_level = NO_LEVEL;
+
+        if (texture->released)
+        {
+            if (read->staged)
+                retireUpload(read->span);
+            destroyTexture(texture);
+            delete read;
+            continue;
+        }
+
+        const Source &source = *sources[texture->source];
+        glBindTexture(GL_TEXTURE_2D, texture->texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, source.unpack_alignment);
+        if (read->staged)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadRingBuffer());
+            specifyLevel(source, read->level, (const void *)read->span.offset, false);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            retireUpload(read->span);
+        }
+        else
+            specifyLevel(source, read->level, &read->data[0], false);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, read->level);
+
+        texture->resident_level = read->level;
+        resident_bytes += levelBytes(texture, read->level);
+        loaded_levels++;
+        delete read;
+    }
+}
+
+void readFeedback()
+{
+    // The buffer the frame just drawn into is fenced; the oldest one is read
+    // back once its fence has passed, reset and bound for the next frame.
+    // With no texture in a slot there is nothing to record, so nothing is
+    // fenced, read or reset until one is opened.
+    if (feedback_recording)
+    {
+        feedback_fences[feedback_index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        feedback_index = (feedback_index + 1) % FEEDBACK_FRAMES;
+        feedback_recording = false;
+    }
+    if (!feedback_buffers[0] || feedback_users == 0)
+        return;
+
+    GLsync &fence = feedback_fences[feedback_index];
+    const GLuint buffer = feedback_buffers[feedback_index];
+    if (fence)
+    {
+        // Only waits if the GPU is more than FEEDBACK_FRAMES - 1 frames
+        // behind, where the swap would normally have throttled us already.
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence);
+        fence = 0;
+
+        ArenaScope scope(scratchArena());
+        ArenaVector<GLuint> levels(feedback_textures.size(), 0, ArenaAllocator<GLuint>(scratchArena()));
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, levels.size() * sizeof(GLuint), &levels[0]);
+        for (size_t slot = 0; slot < levels.size(); slot++)
+            if (levels[slot] != NO_LEVEL && feedback_textures[slot])
+                requestTextureLevel(feedback_textures[slot], levels[slot]);
+    }
+
+    const GLuint unseen = NO_LEVEL;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &unseen);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STREAMING_FEEDBACK_BINDING, buffer);
+    feedback_recording = true;
+}
+
+} // namespace
+
+void initTextureStreaming(const StreamingOptions &streaming_options)
+{
+    options = streaming_options;
+    frame = 0;
+    resident_bytes = pending_bytes = 0;
+    loaded_levels = evictions = budget_refusals = 0;
+    initialised = true;
+
+    if (options.feedback_slots && GLEW_VERSION_4_3)
+    {
+        feedback_textures.assign(options.feedback_slots, NULL);
+        const std::vector<GLuint> unseen(options.feedback_slots, NO_LEVEL);
+        glGenBuffers(FEEDBACK_FRAMES, feedback_buffers);
+        for (int i = 0; i < FEEDBACK_FRAMES; i++)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, feedback_buffers[i]);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, unseen.size() * sizeof(GLuint), &unseen[0], GL_DYNAMIC_READ);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STREAMING_FEEDBACK_BINDING, feedback_buffers[0]);
+        feedback_index = 0;
+        feedback_recording = false;
+        feedback_users = 0;
+    }
+}
+
+void shutdownTextureStreaming()
+{
+    if (!initialised)
+        return;
+
+    // Reads still on the workers may be waiting for upload ring space, which
+    // only comes back through recycleUploads.
+    while (pending_reads > 0)
+    {
+        recycleUploads();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    for (size_t i = 0; i < finished_reads.size(); i++)
+    {
+        if (finished_reads[i]->staged)
+            retireUpload(finished_reads[i]->span);
+        delete finished_reads[i];
+    }
+    finished_reads.clear();
+
+    while (!textures.empty())
+        destroyTexture(textures.back());
+    sources.clear();
+
+    for (int i = 0; i < FEEDBACK_FRAMES; i++)
+    {
+        if (feedback_fences[i])
+            glDeleteSync(feedback_fences[i]);
+        feedback_fences[i] = 0;
+    }
+    if (feedback_buffers[0])
+        glDeleteBuffers(FEEDBACK_FRAMES, feedback_buffers);
+    std::fill(feedback_buffers, feedback_buffers + FEEDBACK_FRAMES, 0);
+    feedback_textures.clear();
+    feedback_users = 0;
+    feedback_recording = false;
+    initialised = false;
+}
+
+void setTextureStreamingBudget(size_t budget_bytes)
+{
+    options.budget_bytes = budget_bytes;
+}
+
+StreamedTexture *openStreamedTexture(const char *path)
+{
+    const std::shared_ptr<Source> source = openSource(path);
+    if (!source || source->levels.empty())
+    {
+        printf("%s could not be opened for streaming\n", path);
+        return NULL;
+    }
+
+    StreamedTexture *texture = new StreamedTexture;
+    texture->width = source->levels[0].width;
+    texture->height = source->levels[0].height;
+    texture->levels = (unsigned int)source->levels.size();
+    texture->source = (unsigned int)(std::find(sources.begin(), sources.end(), source) - sources.begin());
+    texture->loading_level = NO_LEVEL;
+    texture->level_used.assign(texture->levels, 0);
+    texture->released = false;
+    source->users++;
+
+    texture->feedback_slot = NO_LEVEL;
+    for (size_t slot = 0; slot < feedback_textures.size(); slot++)
+    {
+        if (!feedback_textures[slot])
+        {
+            feedback_textures[slot] = texture;
+            texture->feedback_slot = (unsigned int)slot;
+            feedback_users++;
+            break;
+        }
+    }
+
+    // Mutable storage, so single levels can be defined and freed again.
+    GLint bound = 0;
+    GLint alignment = 4;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glGenTextures(1, &texture->texture);
+    glBindTexture(GL_TEXTURE_2D, texture->texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, source->unpack_alignment);
+
+    const unsigned int tail = tailLevel(texture);
+    for (unsigned int level = tail; level < texture->levels; level++)
+    {
+        specifyLevel(*source, level, source->levels[level].data, false);
+        resident_bytes += source->levels[level].size;
+    }
+    texture->resident_level = tail;
+    texture->wanted_level = tail;
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, tail);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture->levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture->levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    glBindTexture(GL_TEXTURE_2D, bound);
+
+    textures.push_back(texture);
+    return texture;
+}
+
+void closeStreamedTexture(StreamedTexture *texture)
+{
+    if (!texture)
+        return;
+    if (texture->loading_level != NO_LEVEL)
+        texture->released = true;
+    else
+        destroyTexture(texture);
+}
+
+void requestTextureLevel(StreamedTexture *texture, unsigned int level)
+{
+    texture->wanted_level = std::min(texture->wanted_level, std::min(level, texture->levels - 1));
+}
+
+unsigned int levelForScreenSize(const StreamedTexture *texture, float screen_pixels)
+{
+    const float texels = (float)std::max(texture->width, texture->height);
+    if (screen_pixels <= 0.0f)
+        return texture->levels - 1;
+    if (screen_pixels >= texels)
+        return 0;
+    // Round down: a level too sharp costs memory, one too blurry shows.
+    const unsigned int level = (unsigned int)floorf(log2f(texels / screen_pixels));
+    return std::min(level, texture->levels - 1);
+}
+
+float projectedSize(float radius, float distance, float fov_y_degrees, int viewport_height)
+{
+    const float tan_half_fov = tanf(fov_y_degrees * 0.5f * 3.14159265f / 180.0f);
+    return radius * viewport_height / (std::max(distance, radius) * tan_half_fov);
+}
+
+void updateTextureStreaming()
+{
+    // Scenes that stream nothing pay for nothing.
+    if (!initialised || (textures.empty() && !feedback_recording))
+        return;
+
+    GLint bound = 0;
+    GLint alignment = 4;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+
+    frame++;
+    readFeedback();
+
+    // Levels from the wanted one down are in use this frame.
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        StreamedTexture *texture = textures[i];
+        for (unsigned int level = texture->wanted_level; level < texture->levels; level++)
+            texture->level_used[level] = frame;
+    }
+
+    applyFinishedReads();
+
+    // Settle any budget cut before loading more.
+    makeRoom(0);
+
+    // One level per texture at a time, sharpest deficit first.
+    ArenaScope scope(scratchArena());
+    ArenaVector<StreamedTexture *> wanting((ArenaAllocator<StreamedTexture *>(scratchArena())));
+    wanting.reserve(textures.size());
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        StreamedTexture *texture = textures[i];
+        if (!texture->released && texture->wanted_level < texture->resident_level && texture->loading_level == NO_LEVEL)
+            wanting.push_back(texture);
+    }
+    std::sort(wanting.begin(), wanting.end(), [](const StreamedTexture *a, const StreamedTexture *b) {
+        return a->resident_level - a->wanted_level > b->resident_level - b->wanted_level;
+    });
+    for (size_t i = 0; i < wanting.size() && pending_reads < MAX_PENDING; i++)
+    {
+        StreamedTexture *texture = wanting[i];
+        const unsigned int level = texture->resident_level - 1;
+        if (!makeRoom(levelBytes(texture, level)))
+        {
+            budget_refusals++;
+            break;
+        }
+        startRead(texture, level);
+    }
+
+    for (size_t i = 0; i < textures.size(); i++)
+        textures[i]->wanted_level = textures[i]->levels - 1;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    glBindTexture(GL_TEXTURE_2D, bound);
+}
+
+StreamingStats textureStreamingStats()
+{
+    StreamingStats stats;
+    stats.budget_bytes = options.budget_bytes;
+    stats.resident_bytes = resident_bytes;
+    stats.textures = (unsigned int)textures.size();
+    stats.pending_requests = pending_reads;
+    stats.loaded_levels = loaded_levels;
+    stats.evictions = evictions;
+    stats.budget_refusals = budget_refusals;
+    return stats;
+}
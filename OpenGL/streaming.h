@@ -0,0 +1,114 @@
+#pragma once
+
+#include "gl_trace.h"
+#include <cstddef>
+#include <vector>
+
+// Texture streaming with per-mip residency. Each streamed texture keeps only
+// the levels it currently needs in GL memory: the coarse tail (levels up to
+// STREAMING_TAIL_SIZE texels) is always resident, finer levels are loaded on
+// the asset workers one at a time as they are requested, and the least
+// recently needed ones are evicted again to stay under the memory budget.
+// GL_TEXTURE_BASE_LEVEL always points at the finest resident level, so
+// sampling never touches a missing one.
+//
+// The needed level comes from the scene, estimated from the object's size on
+// screen (levelForScreenSize), or from the GPU: fragment shaders that include
+// STREAMING_FEEDBACK_GLSL write the finest level they sample per texture into
+// a buffer that is read back a few frames later.
+//
+// initAssetLoader must run first; the host loop calls updateTextureStreaming
+// once per frame after the scene has drawn.
+
+// Levels this size and smaller are loaded when the texture is opened and
+// never evicted.
+const unsigned int STREAMING_TAIL_SIZE = 64;
+
+// Shader storage binding point of the feedback buffer.
+const GLuint STREAMING_FEEDBACK_BINDING = 7;
+
+// Declares streamingFeedback(slot, uv, size): records the finest level that a
+// texture of the given full size is sampled at this fragment. Needs GL 4.3;
+// paste after the #version line of a fragment shader.
+extern const char *const STREAMING_FEEDBACK_GLSL;
+
+struct StreamingOptions
+{
+    size_t budget_bytes;        // GL memory for all streamed levels, the tails included
+    unsigned int feedback_slots;    // Textures the feedback buffer can track, 0 = no feedback
+
+    StreamingOptions()
+        : budget_bytes(256 << 20),
+          feedback_slots(4096)
+    {
+    }
+};
+
+struct StreamingStats
+{
+    size_t budget_bytes;
+    size_t resident_bytes;
+    unsigned int textures;
+    unsigned int pending_requests;      // Levels being read on the workers
+    unsigned long long loaded_levels;
+    unsigned long long evictions;
+    unsigned long long budget_refusals; // Loads skipped because everything resident was still needed
+
+    StreamingStats()
+        : budget_bytes(0), resident_bytes(0), textures(0), pending_requests(0),
+          loaded_levels(0), evictions(0), budget_refusals(0)
+    {
+    }
+};
+
+struct StreamedTexture
+{
+    GLuint texture;             // GL_TEXTURE_2D, complete from resident_level down
+    unsigned int width;         // Of level 0
+    unsigned int height;
+    unsigned int levels;        // In the source
+    unsigned int resident_level;    // Finest level in GL memory
+    unsigned int feedback_slot;     // For streamingFeedback, ~0u without feedback
+
+    // Owned by the manager.
+    unsigned int source;
+    unsigned int wanted_level;      // Finest level requested this frame
+    unsigned int loading_level;     // Level on a worker, ~0u if none
+    std::vector<unsigned int> level_used;  // Frame each level was last needed
+    bool released;
+};
+
+// Needs the GL context.
+void initTextureStreaming(const StreamingOptions &options = StreamingOptions());
+
+// Waits for the workers to finish their reads and frees every texture.
+void shutdownTextureStreaming();
+
+void setTextureStreamingBudget(size_t budget_bytes);
+
+// Opens a .ktx2 / .dds file or an image's current texenc cache (memory-
+// mapped, levels read on demand), or decodes a BMP and keeps its mip chain
+// in client memory. Files opened more than once share the source. Uploads
+// the tail right away; returns NULL if the file cannot be read.
+StreamedTexture *openStreamedTexture(const char *path);
+
+// Frees the texture once no read of it is in flight.
+void closeStreamedTexture(StreamedTexture *texture);
+
+// Asks for the given level (0 = full size) to be resident for this frame.
+// Several requests in a frame keep the finest.
+void requestTextureLevel(StreamedTexture *texture, unsigned int level);
+
+// Level whose size matches an on-screen extent of screen_pixels along the
+// texture's larger axis.
+unsigned int levelForScreenSize(const StreamedTexture *texture, float screen_pixels);
+
+// On-screen diameter in pixels of a sphere of the given radius at the given
+// view distance, for levelForScreenSize.
+float projectedSize(float radius, float distance, float fov_y_degrees, int viewport_height);
+
+// Once per frame: reads back the feedback, uploads finished levels, evicts
+// least recently needed levels over the budget and starts the next reads.
+void updateTextureStreaming();
+
+StreamingStats textureStreamingStats();
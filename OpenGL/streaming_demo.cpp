@@ -0,0 +1,232 @@
+// Texture streaming demo. A 16 x 16 field of ground tiles, each with its own
+// streamed copy of uvtemplate.bmp, is flown over low. At full resolution the
+// tiles would need about 340 MB; the streaming budget is 32 MB, so each
+// tile asks for the level its on-screen size calls for and the manager
+// evicts what went out of view. Prints the streaming counters every two
+// seconds.
+
+#include "OpenGL.h"
+
+#include <cstdio>
+#include <vmath.h>
+
+#include "camera.h"
+#include "gl_state.h"
+#include "scene.h"
+#include "streaming.h"
+
+namespace
+{
+
+const int GRID_SIZE = 16;
+const int TILE_COUNT = GRID_SIZE * GRID_SIZE;
+const float TILE_SIZE = 4.0f;
+const float SPACING = 5.0f;
+const float FOV = 60.0f;
+const size_t BUDGET_BYTES = 32 << 20;
+
+GLuint program;
+GLuint vao;
+GLuint position_buffer;
+GLuint uv_buffer;
+GLint view_location;
+GLint offset_location;
+GLint tex_location;
+StreamedTexture *tiles[TILE_COUNT];
+double next_report;
+
+int getWindowWidth()
+{
+    return 1280;
+}
+
+int getWindowHeight()
+{
+    return 720;
+}
+
+void onAwake()
+{
+    next_report = 0.0;
+
+    CameraLens lens;
+    lens.fov = FOV;
+    lens.far_plane = 500.0f;
+    setCameraLens(lens);
+
+    static const char *vs_source[] =
+    {
+        "#version 420 core                                                  \n",
+        CAMERA_GLSL,
+        "                                                                   \n"
+        "layout(location = 0) in vec3 position;                             \n"
+        "layout(location = 1) in vec2 uv;                                   \n"
+        "                                                                   \n"
+        "out vec2 fragmentUV;                                               \n"
+        "                                                                   \n"
+        "uniform mat4 view_matrix;                                          \n"
+        "uniform vec3 offset;                                               \n"
+        "                                                                   \n"
+        "void main(void)                                                    \n"
+        "{                                                                  \n"
+        "    gl_Position = proj_matrix * view_matrix * vec4(position + offset, 1); \n"
+        "    fragmentUV = uv;                                               \n"
+        "}                                                                  \n"
+    };
+
+    static const char *fs_source[] =
+    {
+        "#version 420 core                                                  \n"
+        "                                                                   \n"
+        "out vec3 color;                                                    \n"
+        "                                                                   \n"
+        "in vec2 fragmentUV;                                                \n"
+        "                                                                   \n"
+        "uniform sampler2D texSampler;                                      \n"
+        "                                                                   \n"
+        "void main(void)                                                    \n"
+        "{                                                                  \n"
+        "    color = texture(texSampler, fragmentUV).rgb;                   \n"
+        "}                                                                  \n"
+    };
+
+    program = glCreateProgram();
+    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fs, 1, fs_source, NULL);
+    glCompileShader(fs);
+    CheckShaderCompileError(fs);
+
+    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vs, 3, vs_source, NULL);
+    glCompileShader(vs);
+    CheckShaderCompileError(vs);
+
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+
+    glLinkProgram(program);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    glUseProgram(program);
+
+    view_location = glGetUniformLocation(program, "view_matrix");
+    offset_location = glGetUniformLocation(program, "offset");
+    tex_location = glGetUniformLocation(program, "texSampler");
+
+    const float h = TILE_SIZE * 0.5f;
+    const GLfloat tile_positions[] =
+    {
+        -h, 0.0f, -h,
+         h, 0.0f, -h,
+         h, 0.0f,  h,
+        -h, 0.0f, -h,
+         h, 0.0f,  h,
+        -h, 0.0f,  h
+    };
+
+    static const GLfloat tile_uvs[] =
+    {
+        0.0f, 0.0f,
+        1.0f, 0.0f,
+        1.0f, 1.0f,
+        0.0f, 0.0f,
+        1.0f, 1.0f,
+        0.0f, 1.0f
+    };
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    glGenBuffers(1, &position_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, position_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(tile_positions), tile_positions, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(0);
+
+    glGenBuffers(1, &uv_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, uv_buffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(tile_uvs), tile_uvs, GL_STATIC_DRAW);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+    glEnableVertexAttribArray(1);
+
+    // Every tile streams on its own, as if each had a different image.
+    setTextureStreamingBudget(BUDGET_BYTES);
+    for (int i = 0; i < TILE_COUNT; i++)
+        tiles[i] = openStreamedTexture("./uvtemplate.bmp");
+
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(tex_location, 0);
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+}
+
+void onUpdate(double current_time)
+{
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Circling low over the field, looking ahead along the path.
+    const float angle = (float)current_time * 10.0f;
+    const float radius = GRID_SIZE * SPACING * 0.3f;
+    const float radians = angle * 3.14159265f / 180.0f;
+    const vmath::vec3 eye(sinf(radians) * radius, 3.0f, cosf(radians) * radius);
+    const vmath::vec3 forward(cosf(radians), 0.0f, -sinf(radians));
+
+    const vmath::mat4 view_matrix = vmath::lookat(eye, eye + forward - vmath::vec3(0.0f, 0.3f, 0.0f), vmath::vec3(0.0f, 1.0f, 0.0f));
+    cachedUseProgram(program);
+    cachedUniformMatrix4(view_location, view_matrix);
+
+    cachedBindVertexArray(vao);
+    for (int i = 0; i < TILE_COUNT; i++)
+    {
+        if (!tiles[i])
+            continue;
+
+        const vmath::vec3 offset(((i % GRID_SIZE) - GRID_SIZE * 0.5f) * SPACING, 0.0f,
+                                 ((i / GRID_SIZE) - GRID_SIZE * 0.5f) * SPACING);
+        const vmath::vec3 to_tile = offset - eye;
+        const float distance = vmath::length(to_tile);
+
+        // Tiles behind the camera are not drawn and ask for nothing, so
+        // their fine levels become the first to go.
+        if (vmath::dot(to_tile, forward) < -TILE_SIZE)
+            continue;
+
+        const float pixels = projectedSize(TILE_SIZE * 0.7071f, distance, FOV, framebufferHeight());
+        requestTextureLevel(tiles[i], levelForScreenSize(tiles[i], pixels));
+
+        cachedUniform3fv(offset_location, offset);
+        cachedBindTexture(0, GL_TEXTURE_2D, tiles[i]->texture);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+
+    if (current_time >= next_report)
+    {
+        const StreamingStats stats = textureStreamingStats();
+        printf("streaming: %.1f / %.1f MB resident, %u pending, %llu loaded, %llu evicted, %llu refused\n",
+               stats.resident_bytes / 1048576.0, stats.budget_bytes / 1048576.0, stats.pending_requests,
+               stats.loaded_levels, stats.evictions, stats.budget_refusals);
+        next_report = current_time + 2.0;
+    }
+}
+
+void onShutdown()
+{
+    for (int i = 0; i < TILE_COUNT; i++)
+        closeStreamedTexture(tiles[i]);
+    // Scenes run after this one get the default budget back.
+    setTextureStreamingBudget(StreamingOptions().budget_bytes);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &position_buffer);
+    glDeleteBuffers(1, &uv_buffer);
+    glDeleteProgram(program);
+}
+
+const Scene streaming_scene =
+{
+    "STREAMING", "Per-mip texture streaming under a memory budget",
+    getWindowWidth(), getWindowHeight(), onAwake, onUpdate, onShutdown, NULL, NULL, NULL
+};
+const bool streaming_registered = registerScene(streaming_scene);
+
+} // namespace
@@ -0,0 +1,943 @@
+#include "texcompress.h"
+#include "fileio.h"
+#include "dds.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXCOMPRESS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+// One 4 x 4 block with a float array per channel (r, g, b, a), so four
+// pixels fill an SSE register.
+struct Block
+{
+    float c[4][16];
+};
+
+void fetchBlock(const unsigned char *pixels, unsigned int width, unsigned int height, GLenum format,
+                unsigned int bx, unsigned int by, Block &block)
+{
+    const unsigned int channels = imageChannels(format);
+    const bool bgr = format == GL_BGR || format == GL_BGRA;
+    const size_t stride = imageRowBytes(width, channels);
+
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        // Blocks hanging over the edge repeat the last row / column.
+        const unsigned int x = std::min(bx * 4 + (i & 3), width - 1);
+        const unsigned int y = std::min(by * 4 + (i >> 2), height - 1);
+        const unsigned char *p = pixels + y * stride + x * channels;
+
+        if (channels < 3)
+        {
+            block.c[0][i] = block.c[1][i] = block.c[2][i] = p[0];
+            block.c[3][i] = channels == 2 ? p[1] : 255.0f;
+        }
+        else
+        {
+            block.c[0][i] = p[bgr ? 2 : 0];
+            block.c[1][i] = p[1];
+            block.c[2][i] = p[bgr ? 0 : 2];
+            block.c[3][i] = channels == 4 ? p[3] : 255.0f;
+        }
+    }
+}
+
+// Picks the closest palette entry for every pixel and returns the summed
+// squared error. weights scales each channel's error, 0 ignores it.
+float nearestIndices(const Block &block, const float palette[][4], int palette_size,
+                     const float weights[4], unsigned char indices[16])
+{
+    float total = 0.0f;
+#ifdef TEXCOMPRESS_SSE2
+    for (int i = 0; i < 16; i += 4)
+    {
+        __m128 best = _mm_set1_ps(FLT_MAX);
+        __m128i best_index = _mm_setzero_si128();
+        for (int p = 0; p < palette_size; p++)
+        {
+            __m128 error = _mm_setzero_ps();
+            for (int c = 0; c < 4; c++)
+            {
+                const __m128 diff = _mm_sub_ps(_mm_loadu_ps(&block.c[c][i]), _mm_set1_ps(palette[p][c]));
+                error = _mm_add_ps(error, _mm_mul_ps(_mm_set1_ps(weights[c]), _mm_mul_ps(diff, diff)));
+            }
+            const __m128i closer = _mm_castps_si128(_mm_cmplt_ps(error, best));
+            best = _mm_min_ps(error, best);
+            best_index = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(p)), _mm_andnot_si128(closer, best_index));
+        }
+
+        float errors[4];
+        int best_indices[4];
+        _mm_storeu_ps(errors, best);
+        _mm_storeu_si128((__m128i *)best_indices, best_index);
+        for (int k = 0; k < 4; k++)
+        {
+            indices[i + k] = (unsigned char)best_indices[k];
+            total += errors[k];
+        }
+    }
+#else
+    for (int i = 0; i < 16; i++)
+    {
+        float best = FLT_MAX;
+        for (int p = 0; p < palette_size; p++)
+        {
+            float error = 0.0f;
+            for (int c = 0; c < 4; c++)
+            {
+                const float diff = block.c[c][i] - palette[p][c];
+                error += weights[c] * diff * diff;
+            }
+            if (error < best)
+            {
+                best = error;
+                indices[i] = (unsigned char)p;
+            }
+        }
+        total += best;
+    }
+#endif
+    return total;
+}
+
+// Mean and main direction of the block's colours (the first `channels`
+// channels). The axis is zero for a flat block.
+void principalAxis(const Block &block, int channels, float mean[4], float axis[4])
+{
+    for (int c = 0; c < 4; c++)
+    {
+        float sum = 0.0f;
+        for (int i = 0; i < 16; i++)
+            sum += block.c[c][i];
+        mean[c] = sum / 16.0f;
+        axis[c] = 0.0f;
+    }
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; i++)
+        for (int a = 0; a < channels; a++)
+            for (int b = a; b < channels; b++)
+                covariance[a][b] += (block.c[a][i] - mean[a]) * (block.c[b][i] - mean[b]);
+    for (int a = 0; a < channels; a++)
+        for (int b = 0; b < a; b++)
+            covariance[a][b] = covariance[b][a];
+
+    // Power iteration, starting from the row of the largest variance.
+    int start = 0;
+    for (int c = 1; c < channels; c++)
+        if (covariance[c][c] > covariance[start][start])
+            start = c;
+    float v[4] = { 0, 0, 0, 0 };
+    for (int c = 0; c < channels; c++)
+        v[c] = covariance[start][c];
+
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[4] = { 0, 0, 0, 0 };
+        float length = 0.0f;
+        for (int a = 0; a < channels; a++)
+        {
+            for (int b = 0; b < channels; b++)
+                next[a] += covariance[a][b] * v[b];
+            length += next[a] * next[a];
+        }
+        if (length < 1e-12f)
+            return;
+        length = 1.0f / std::sqrt(length);
+        for (int c = 0; c < channels; c++)
+            v[c] = next[c] * length;
+    }
+    for (int c = 0; c < channels; c++)
+        axis[c] = v[c];
+}
+
+// Endpoints at the extremes of the block projected onto its axis.
+void axisEndpoints(const Block &block, int channels, float e0[4], float e1[4])
+{
+    float mean[4];
+    float axis[4];
+    principalAxis(block, channels, mean, axis);
+
+    float lo = 0.0f;
+    float hi = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < channels; c++)
+            t += (block.c[c][i] - mean[c]) * axis[c];
+        lo = std::min(lo, t);
+        hi = std::max(hi, t);
+    }
+    for (int c = 0; c < 4; c++)
+    {
+        e0[c] = mean[c] + axis[c] * hi;
+        e1[c] = mean[c] + axis[c] * lo;
+    }
+}
+
+// Least squares endpoints for fixed indices, where pixel i is
+// (1 - w_i) * e0 + w_i * e1. Returns false if the weights are degenerate.
+bool fitEndpoints(const Block &block, int channels, const float w[16], float e0[4], float e1[4])
+{
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ap[4] = { 0, 0, 0, 0 };
+    float bp[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+    {
+        const float a = 1.0f - w[i];
+        const float b = w[i];
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < channels; c++)
+        {
+            ap[c] += a * block.c[c][i];
+            bp[c] += b * block.c[c][i];
+        }
+    }
+
+    const float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f)
+        return false;
+    for (int c = 0; c < channels; c++)
+    {
+        e0[c] = std::min(255.0f, std::max(0.0f, (ap[c] * bb - bp[c] * ab) / det));
+        e1[c] = std::min(255.0f, std::max(0.0f, (bp[c] * aa - ap[c] * ab) / det));
+    }
+    return true;
+}
+
+class BitWriter
+{
+public:
+    explicit BitWriter(unsigned char *out) : out_(out), position_(0) {}
+
+    void write(unsigned int value, int bits)
+    {
+        for (int b = 0; b < bits; b++, position_++)
+            if ((value >> b) & 1)
+                out_[position_ >> 3] |= (unsigned char)(1 << (position_ & 7));
+    }
+
+private:
+    unsigned char *out_;
+    int position_;
+};
+
+class BitReader
+{
+public:
+    explicit BitReader(const unsigned char *in) : in_(in), position_(0) {}
+
+    unsigned int read(int bits)
+    {
+        unsigned int value = 0;
+        for (int b = 0; b < bits; b++, position_++)
+            value |= (unsigned int)((in_[position_ >> 3] >> (position_ & 7)) & 1) << b;
+        return value;
+    }
+
+private:
+    const unsigned char *in_;
+    int position_;
+};
+
+// ---------------------------------------------------------------- BC1 / BC3
+
+unsigned short packColor565(const float color[4])
+{
+    const int r = (int)(std::min(255.0f, std::max(0.0f, color[0])) * 31.0f / 255.0f + 0.5f);
+    const int g = (int)(std::min(255.0f, std::max(0.0f, color[1])) * 63.0f / 255.0f + 0.5f);
+    const int b = (int)(std::min(255.0f, std::max(0.0f, color[2])) * 31.0f / 255.0f + 0.5f);
+    return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+void unpackColor565(unsigned short value, int color[3])
+{
+    const int r = (value >> 11) & 31;
+    const int g = (value >> 5) & 63;
+    const int b = value & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// Palette order of a four-colour block: c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1.
+const float bc1_weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+float evaluateColor(const Block &block, unsigned short c0, unsigned short c1, unsigned char indices[16])
+{
+    static const float weights[4] = { 1.0f, 1.0f, 1.0f, 0.0f };
+
+    int a[3];
+    int b[3];
+    unpackColor565(c0, a);
+    unpackColor565(c1, b);
+
+    float palette[4][4];
+    for (int c = 0; c < 3; c++)
+    {
+        palette[0][c] = (float)a[c];
+        palette[1][c] = (float)b[c];
+        palette[2][c] = (float)((2 * a[c] + b[c]) / 3);
+        palette[3][c] = (float)((a[c] + 2 * b[c]) / 3);
+    }
+    for (int p = 0; p < 4; p++)
+        palette[p][3] = 0.0f;
+
+    return nearestIndices(block, palette, 4, weights, indices);
+}
+
+// Four-colour BC1 block: principal axis endpoints, then two least squares
+// refinements of the endpoints for the chosen indices.
+void encodeColorBlock(const Block &block, unsigned char out[8])
+{
+    float e0[4];
+    float e1[4];
+    axisEndpoints(block, 3, e0, e1);
+
+    unsigned short c0 = packColor565(e0);
+    unsigned short c1 = packColor565(e1);
+    unsigned char indices[16];
+    float best = evaluateColor(block, c0, c1, indices);
+
+    for (int iteration = 0; iteration < 2 && best > 0.0f; iteration++)
+    {
+        float w[16];
+        for (int i = 0; i < 16; i++)
+            w[i] = bc1_weights[indices[i]];
+        if (!fitEndpoints(block, 3, w, e0, e1))
+            break;
+
+        const unsigned short n0 = packColor565(e0);
+        const unsigned short n1 = packColor565(e1);
+        unsigned char n_indices[16];
+        const float error = evaluateColor(block, n0, n1, n_indices);
+        if (error >= best)
+            break;
+        best = error;
+        c0 = n0;
+        c1 = n1;
+        memcpy(indices, n_indices, 16);
+    }
+
+    // c0 > c1 selects four-colour mode; equal endpoints would select the
+    // three-colour mode, where index 3 is black, so use index 0 throughout.
+    if (c0 < c1)
+    {
+        std::swap(c0, c1);
+        for (int i = 0; i < 16; i++)
+            indices[i] ^= 1;
+    }
+    else if (c0 == c1)
+        memset(indices, 0, 16);
+
+    unsigned int bits = 0;
+    for (int i = 0; i < 16; i++)
+        bits |= (unsigned int)indices[i] << (2 * i);
+
+    out[0] = (unsigned char)(c0 & 0xff);
+    out[1] = (unsigned char)(c0 >> 8);
+    out[2] = (unsigned char)(c1 & 0xff);
+    out[3] = (unsigned char)(c1 >> 8);
+    out[4] = (unsigned char)(bits & 0xff);
+    out[5] = (unsigned char)((bits >> 8) & 0xff);
+    out[6] = (unsigned char)((bits >> 16) & 0xff);
+    out[7] = (unsigned char)(bits >> 24);
+}
+
+// Eight-value alpha block (a0 > a1) spanning the block's alpha range.
+void encodeAlphaBlock(const Block &block, unsigned char out[8])
+{
+    static const float weights[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+    float lo = 255.0f;
+    float hi = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        lo = std::min(lo, block.c[3][i]);
+        hi = std::max(hi, block.c[3][i]);
+    }
+    const int a0 = (int)(hi + 0.5f);
+    const int a1 = (int)(lo + 0.5f);
+
+    unsigned char indices[16] = {};
+    if (a0 != a1)
+    {
+        float palette[8][4] = {};
+        palette[0][3] = (float)a0;
+        palette[1][3] = (float)a1;
+        for (int p = 2; p < 8; p++)
+            palette[p][3] = (float)(((8 - p) * a0 + (p - 1) * a1) / 7);
+        nearestIndices(block, palette, 8, weights, indices);
+    }
+
+    memset(out, 0, 8);
+    out[0] = (unsigned char)a0;
+    out[1] = (unsigned char)a1;
+    BitWriter writer(out + 2);
+    for (int i = 0; i < 16; i++)
+        writer.write(indices[i], 3);
+}
+
+void decodeColorBlock(const unsigned char *in, bool four_color_only, unsigned char out[16][4])
+{
+    const unsigned short c0 = (unsigned short)(in[0] | (in[1] << 8));
+    const unsigned short c1 = (unsigned short)(in[2] | (in[3] << 8));
+    const unsigned int bits = in[4] | (in[5] << 8) | (in[6] << 16) | ((unsigned int)in[7] << 24);
+
+    int a[3];
+    int b[3];
+    unpackColor565(c0, a);
+    unpackColor565(c1, b);
+
+    int palette[4][4];
+    for (int c = 0; c < 3; c++)
+    {
+        palette[0][c] = a[c];
+        palette[1][c] = b[c];
+        if (c0 > c1 || four_color_only)
+        {
+            palette[2][c] = (2 * a[c] + b[c]) / 3;
+            palette[3][c] = (a[c] + 2 * b[c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (a[c] + b[c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    palette[0][3] = palette[1][3] = palette[2][3] = 255;
+    palette[3][3] = (c0 > c1 || four_color_only) ? 255 : 0;
+
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 4; c++)
+            out[i][c] = (unsigned char)palette[(bits >> (2 * i)) & 3][c];
+}
+
+void decodeAlphaBlock(const unsigned char *in, unsigned char out[16][4])
+{
+    const int a0 = in[0];
+    const int a1 = in[1];
+    int palette[8] = { a0, a1 };
+    for (int p = 2; p < 8; p++)
+    {
+        if (a0 > a1)
+            palette[p] = ((8 - p) * a0 + (p - 1) * a1) / 7;
+        else if (p < 6)
+            palette[p] = ((6 - p) * a0 + (p - 1) * a1) / 5;
+        else
+            palette[p] = p == 6 ? 0 : 255;
+    }
+
+    BitReader reader(in + 2);
+    for (int i = 0; i < 16; i++)
+        out[i][3] = (unsigned char)palette[reader.read(3)];
+}
+
+// ---------------------------------------------------------------- BC7
+
+// Mode 6 only: one subset, 7-bit RGBA endpoints with a shared bit each, and
+// 4-bit indices. It handles smooth gradients and alpha well and keeps the
+// encoder small; a full search over all eight modes would gain a little on
+// blocks with several distinct colours.
+
+const int bc7_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+void quantizeMode6(const float e[4], int pbit, int q[4])
+{
+    for (int c = 0; c < 4; c++)
+    {
+        const int v = (int)std::floor((e[c] - pbit) * 0.5f + 0.5f);
+        q[c] = std::min(127, std::max(0, v)) * 2 + pbit;
+    }
+}
+
+float evaluateMode6(const Block &block, const int q0[4], const int q1[4], unsigned char indices[16])
+{
+    static const float weights[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+    float palette[16][4];
+    for (int p = 0; p < 16; p++)
+        for (int c = 0; c < 4; c++)
+            palette[p][c] = (float)(((64 - bc7_weights4[p]) * q0[c] + bc7_weights4[p] * q1[c] + 32) >> 6);
+    return nearestIndices(block, palette, 16, weights, indices);
+}
+
+// Tries the four shared-bit combinations for a pair of float endpoints.
+float bestMode6(const Block &block, const float e0[4], const float e1[4], int q0[4], int q1[4], int pbits[2], unsigned char indices[16])
+{
+    float best = FLT_MAX;
+    for (int p = 0; p < 4; p++)
+    {
+        int t0[4];
+        int t1[4];
+        unsigned char t_indices[16];
+        quantizeMode6(e0, p & 1, t0);
+        quantizeMode6(e1, p >> 1, t1);
+        const float error = evaluateMode6(block, t0, t1, t_indices);
+        if (error < best)
+        {
+            best = error;
+            memcpy(q0, t0, sizeof(t0));
+            memcpy(q1, t1, sizeof(t1));
+            pbits[0] = p & 1;
+            pbits[1] = p >> 1;
+            memcpy(indices, t_indices, 16);
+        }
+    }
+    return best;
+}
+
+void encodeBC7Block(const Block &block, unsigned char out[16])
+{
+    float e0[4];
+    float e1[4];
+    axisEndpoints(block, 4, e0, e1);
+
+    int q0[4];
+    int q1[4];
+    int pbits[2];
+    unsigned char indices[16];
+    float best = bestMode6(block, e0, e1, q0, q1, pbits, indices);
+
+    for (int iteration = 0; iteration < 2 && best > 0.0f; iteration++)
+    {
+        float w[16];
+        for (int i = 0; i < 16; i++)
+            w[i] = bc7_weights4[indices[i]] / 64.0f;
+        if (!fitEndpoints(block, 4, w, e0, e1))
+            break;
+
+        int n0[4];
+        int n1[4];
+        int n_pbits[2];
+        unsigned char n_indices[16];
+        const float error = bestMode6(block, e0, e1, n0, n1, n_pbits, n_indices);
+        if (error >= best)
+            break;
+        best = error;
+        memcpy(q0, n0, sizeof(n0));
+        memcpy(q1, n1, sizeof(n1));
+        memcpy(pbits, n_pbits, sizeof(n_pbits));
+        memcpy(indices, n_indices, 16);
+    }
+
+    // The first index is stored with its top bit implied zero.
+    if (indices[0] >= 8)
+    {
+        for (int c = 0; c < 4; c++)
+            std::swap(q0[c], q1[c]);
+        std::swap(pbits[0], pbits[1]);
+        for (int i = 0; i < 16; i++)
+            indices[i] = (unsigned char)(15 - indices[i]);
+    }
+
+    memset(out, 0, 16);
+    BitWriter writer(out);
+    writer.write(1 << 6, 7);
+    for (int c = 0; c < 4; c++)
+    {
+        writer.write((unsigned int)q0[c] >> 1, 7);
+        writer.write((unsigned int)q1[c] >> 1, 7);
+    }
+    writer.write((unsigned int)pbits[0], 1);
+    writer.write((unsigned int)pbits[1], 1);
+    writer.write(indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        writer.write(indices[i], 4);
+}
+
+void decodeBC7Block(const unsigned char *in, unsigned char out[16][4])
+{
+    if ((in[0] & 0x7f) != 0x40)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            out[i][0] = out[i][2] = out[i][3] = 255;
+            out[i][1] = 0;
+        }
+        return;
+    }
+
+    BitReader reader(in);
+    reader.read(7);
+    int q0[4];
+    int q1[4];
+    for (int c = 0; c < 4; c++)
+    {
+        q0[c] = (int)reader.read(7) << 1;
+        q1[c] = (int)reader.read(7) << 1;
+    }
+    const int p0 = (int)reader.read(1);
+    const int p1 = (int)reader.read(1);
+    for (int c = 0; c < 4; c++)
+    {
+        q0[c] |= p0;
+        q1[c] |= p1;
+    }
+
+    for (int i = 0; i < 16; i++)
+    {
+        const int w = bc7_weights4[reader.read(i == 0 ? 3 : 4)];
+        for (int c = 0; c < 4; c++)
+            out[i][c] = (unsigned char)(((64 - w) * q0[c] + w * q1[c] + 32) >> 6);
+    }
+}
+
+void encodeBlock(BlockFormat format, const Block &block, unsigned char *out)
+{
+    switch (format)
+    {
+    case BLOCK_BC1:
+        encodeColorBlock(block, out);
+        break;
+    case BLOCK_BC3:
+        encodeAlphaBlock(block, out);
+        encodeColorBlock(block, out + 8);
+        break;
+    case BLOCK_BC7:
+        encodeBC7Block(block, out);
+        break;
+    }
+}
+
+unsigned int blocksAcross(unsigned int size)
+{
+    return (size + 3) / 4;
+}
+
+// reserved1[0] tags the stamp of the source file kept in reserved1[1..4].
+const unsigned int DDS_STAMP_TAG = DDS_FOURCC('S', 'R', 'C', 'S');
+
+size_t levelBytes(BlockFormat format, unsigned int width, unsigned int height)
+{
+    return (size_t)blocksAcross(width) * blocksAcross(height) * blockBytes(format);
+}
+
+// Opens the cache and checks its header against the source file's stamp.
+// Returns the file positioned at the first level, or NULL.
+FILE *openCurrentCache(const char *imagepath, BlockFormat format, DDSHeader &header)
+{
+    unsigned long long source_size;
+    long long source_mtime;
+    if (!getFileStamp(imagepath, source_size, source_mtime))
+        return NULL;
+
+    FILE *file = openFile(compressedCachePath(imagepath, format).c_str(), "rb");
+    if (!file)
+        return NULL;
+
+    unsigned int magic = 0;
+    bool ok = fread(&magic, sizeof(magic), 1, file) == 1 &&
+              fread(&header, sizeof(header), 1, file) == 1 &&
+              magic == DDS_FOURCC('D', 'D', 'S', ' ') &&
+              header.size == sizeof(DDSHeader) &&
+              header.reserved1[0] == DDS_STAMP_TAG &&
+              header.reserved1[1] == (unsigned int)(source_size & 0xffffffffu) &&
+              header.reserved1[2] == (unsigned int)(source_size >> 32) &&
+              header.reserved1[3] == (unsigned int)((unsigned long long)source_mtime & 0xffffffffu) &&
+              header.reserved1[4] == (unsigned int)((unsigned long long)source_mtime >> 32) &&
+              header.width > 0 && header.height > 0 &&
+              header.mip_count > 0 && header.mip_count <= mipLevelCount(header.width, header.height);
+
+    if (ok && format == BLOCK_BC7)
+    {
+        DDSHeaderDX10 dx10;
+        ok = header.format.fourcc == DDS_FOURCC('D', 'X', '1', '0') &&
+             fread(&dx10, sizeof(dx10), 1, file) == 1 &&
+             dx10.dxgi_format == DXGI_FORMAT_BC7_UNORM;
+    }
+    else if (ok)
+        ok = header.format.fourcc == (format == BLOCK_BC1 ? DDS_FOURCC('D', 'X', 'T', '1') : DDS_FOURCC('D', 'X', 'T', '5'));
+
+    if (!ok)
+    {
+        fclose(file);
+        return NULL;
+    }
+    return file;
+}
+
+} // namespace
+
+unsigned int blockBytes(BlockFormat format)
+{
+    return format == BLOCK_BC1 ? 8 : 16;
+}
+
+GLenum blockInternalFormat(BlockFormat format)
+{
+    switch (format)
+    {
+    case BLOCK_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BLOCK_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    default:        return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    }
+}
+
+const char *blockFormatName(BlockFormat format)
+{
+    switch (format)
+    {
+    case BLOCK_BC1: return "bc1";
+    case BLOCK_BC3: return "bc3";
+    default:        return "bc7";
+    }
+}
+
+bool compressImage(const Image &image, BlockFormat format, CompressedImage &out_image, unsigned int thread_count)
+{
+    if (image.pixels.empty() || imageChannels(image.format) == 0)
+        return false;
+
+    out_image.format = format;
+    out_image.width = image.width;
+    out_image.height = image.height;
+    out_image.levels.resize(1 + image.mips.size());
+
+    // One task per row of blocks, over every level, handed out through an
+    // atomic counter so the small levels do not leave threads idle.
+    struct Row
+    {
+        const unsigned char *pixels;
+        unsigned int width;
+        unsigned int height;
+        unsigned int by;
+        unsigned char *out;
+    };
+    std::vector<Row> rows;
+
+    for (size_t l = 0; l < out_image.levels.size(); l++)
+    {
+        CompressedLevel &level = out_image.levels[l];
+        level.width = l == 0 ? image.width : image.mips[l - 1].width;
+        level.height = l == 0 ? image.height : image.mips[l - 1].height;
+        level.blocks.resize(levelBytes(format, level.width, level.height));
+
+        const unsigned char *pixels = l == 0 ? &image.pixels[0] : &image.mips[l - 1].pixels[0];
+        const size_t row_bytes = (size_t)blocksAcross(level.width) * blockBytes(format);
+        for (unsigned int by = 0; by < blocksAcross(level.height); by++)
+        {
+            Row row = { pixels, level.width, level.height, by, &level.blocks[by * row_bytes] };
+            rows.push_back(row);
+        }
+    }
+
+    std::atomic<size_t> next(0);
+    const GLenum pixel_format = image.format;
+    const unsigned int bytes = blockBytes(format);
+    auto work = [&]() {
+        Block block;
+        for (size_t r = next++; r < rows.size(); r = next++)
+        {
+            const Row &row = rows[r];
+            for (unsigned int bx = 0; bx < blocksAcross(row.width); bx++)
+            {
+                fetchBlock(row.pixels, row.width, row.height, pixel_format, bx, row.by, block);
+                encodeBlock(format, block, row.out + bx * bytes);
+            }
+        }
+    };
+
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    thread_count = (unsigned int)std::min<size_t>(thread_count, rows.size());
+
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < thread_count; t++)
+        threads.push_back(std::thread(work));
+    work();
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+    return true;
+}
+
+void decompressLevel(BlockFormat format, const CompressedLevel &level, std::vector<unsigned char> &out_rgba)
+{
+    out_rgba.resize((size_t)level.width * level.height * 4);
+
+    const unsigned int across = blocksAcross(level.width);
+    for (unsigned int by = 0; by < blocksAcross(level.height); by++)
+    {
+        for (unsigned int bx = 0; bx < across; bx++)
+        {
+            const unsigned char *in = &level.blocks[((size_t)by * across + bx) * blockBytes(format)];
+            unsigned char texels[16][4];
+            switch (format)
+            {
+            case BLOCK_BC1:
+                decodeColorBlock(in, false, texels);
+                break;
+            case BLOCK_BC3:
+                decodeColorBlock(in + 8, true, texels);
+                decodeAlphaBlock(in, texels);
+                break;
+            case BLOCK_BC7:
+                decodeBC7Block(in, texels);
+                break;
+            }
+
+            for (unsigned int i = 0; i < 16; i++)
+            {
+                const unsigned int x = bx * 4 + (i & 3);
+                const unsigned int y = by * 4 + (i >> 2);
+                if (x < level.width && y < level.height)
+                    memcpy(&out_rgba[((size_t)y * level.width + x) * 4], texels[i], 4);
+            }
+        }
+    }
+}
+
+double compressionPSNR(const Image &image, const CompressedImage &compressed)
+{
+    if (compressed.levels.empty() || image.pixels.empty())
+        return 0.0;
+
+    std::vector<unsigned char> decoded;
+    decompressLevel(compressed.format, compressed.levels[0], decoded);
+
+    const unsigned int channels = imageChannels(image.format);
+    const int compared = (compressed.format != BLOCK_BC1 && (channels == 2 || channels == 4)) ? 4 : 3;
+
+    double squared = 0.0;
+    Block block;
+    for (unsigned int by = 0; by < blocksAcross(image.height); by++)
+    {
+        for (unsigned int bx = 0; bx < blocksAcross(image.width); bx++)
+        {
+            fetchBlock(&image.pixels[0], image.width, image.height, image.format, bx, by, block);
+            for (unsigned int i = 0; i < 16; i++)
+            {
+                const unsigned int x = bx * 4 + (i & 3);
+                const unsigned int y = by * 4 + (i >> 2);
+                if (x >= image.width || y >= image.height)
+                    continue;
+                const unsigned char *texel = &decoded[((size_t)y * image.width + x) * 4];
+                for (int c = 0; c < compared; c++)
+                {
+                    const double diff = block.c[c][i] - texel[c];
+                    squared += diff * diff;
+                }
+            }
+        }
+    }
+
+    const double mse = squared / ((double)image.width * image.height * compared);
+    if (mse <= 0.0)
+        return 99.0;
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+std::string compressedCachePath(const char *imagepath, BlockFormat format)
+{
+    return std::string(imagepath) + "." + blockFormatName(format) + ".dds";
+}
+
+bool writeCompressedCache(const char *imagepath, const CompressedImage &compressed)
+{
+    unsigned long long source_size;
+    long long source_mtime;
+    if (compressed.levels.empty() || !getFileStamp(imagepath, source_size, source_mtime))
+        return false;
+
+    // Levels are written in GL row order (bottom-up), so other DDS viewers
+    // show the image upside down; the file is only meant as our cache.
+    DDSHeader header;
+    memset(&header, 0, sizeof(header));
+    header.size = sizeof(DDSHeader);
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header.height = compressed.height;
+    header.width = compressed.width;
+    header.linear_size = (unsigned int)compressed.levels[0].blocks.size();
+    header.mip_count = (unsigned int)compressed.levels.size();
+    header.reserved1[0] = DDS_STAMP_TAG;
+    header.reserved1[1] = (unsigned int)(source_size & 0xffffffffu);
+    header.reserved1[2] = (unsigned int)(source_size >> 32);
+    header.reserved1[3] = (unsigned int)((unsigned long long)source_mtime & 0xffffffffu);
+    header.reserved1[4] = (unsigned int)((unsigned long long)source_mtime >> 32);
+    header.format.size = sizeof(DDSPixelFormat);
+    header.format.flags = DDPF_FOURCC;
+    header.format.fourcc = compressed.format == BLOCK_BC1 ? DDS_FOURCC('D', 'X', 'T', '1') :
+                           compressed.format == BLOCK_BC3 ? DDS_FOURCC('D', 'X', 'T', '5') :
+                                                            DDS_FOURCC('D', 'X', '1', '0');
+    header.caps[0] = DDSCAPS_TEXTURE | (compressed.levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+    const std::string path = compressedCachePath(imagepath, compressed.format);
+    FILE *file = openFile(path.c_str(), "wb");
+    if (!file)
+        return false;
+
+    const unsigned int magic = DDS_FOURCC('D', 'D', 'S', ' ');
+    bool ok = fwrite(&magic, sizeof(magic), 1, file) == 1 &&
+              fwrite(&header, sizeof(header), 1, file) == 1;
+    if (ok && compressed.format == BLOCK_BC7)
+    {
+        const DDSHeaderDX10 dx10 = { DXGI_FORMAT_BC7_UNORM, D3D10_RESOURCE_DIMENSION_TEXTURE2D, 0, 1, 0 };
+        ok = fwrite(&dx10, sizeof(dx10), 1, file) == 1;
+    }
+    for (size_t l = 0; ok && l < compressed.levels.size(); l++)
+    {
+        const std::vector<unsigned char> &blocks = compressed.levels[l].blocks;
+        ok = fwrite(&blocks[0], 1, blocks.size(), file) == blocks.size();
+    }
+
+    fclose(file);
+    if (!ok)
+        remove(path.c_str());
+    return ok;
+}
+
+bool compressedCacheCurrent(const char *imagepath, BlockFormat format)
+{
+    DDSHeader header;
+    FILE *file = openCurrentCache(imagepath, format, header);
+    if (!file)
+        return false;
+    fclose(file);
+    return true;
+}
+
+bool readCompressedCache(const char *imagepath, BlockFormat format, CompressedImage &out_image)
+{
+    DDSHeader header;
+    FILE *file = openCurrentCache(imagepath, format, header);
+    if (!file)
+        return false;
+
+    bool ok = true;
+    out_image.format = format;
+    out_image.width = header.width;
+    out_image.height = header.height;
+    out_image.levels.resize(header.mip_count);
+
+    unsigned int width = header.width;
+    unsigned int height = header.height;
+    for (size_t l = 0; ok && l < out_image.levels.size(); l++)
+    {
+        CompressedLevel &level = out_image.levels[l];
+        level.width = width;
+        level.height = height;
+        level.blocks.resize(levelBytes(format, width, height));
+        ok = fread(&level.blocks[0], 1, level.blocks.size(), file) == level.blocks.size();
+        width = std::max(1u, width >> 1);
+        height = std::max(1u, height >> 1);
+    }
+
+    fclose(file);
+    if (!ok)
+        out_image.levels.clear();
+    return ok;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "gl_trace.h"
+#include <string>
+#include <vector>
+
+#include "image.h"
+
+// Block-compressed (BCn) textures: the encoder, the .dds cache written next
+// to the source image, and a PSNR check. Nothing here needs a GL context;
+// openTextureContainer in texture.h maps the cache and createTextureFromFile
+// uploads it.
+
+enum BlockFormat
+{
+    BLOCK_BC1,      // RGB, 4 bits per pixel. Alpha is dropped.
+    BLOCK_BC3,      // RGBA, 8 bits per pixel. BC1 colour plus interpolated alpha.
+    BLOCK_BC7       // RGBA, 8 bits per pixel. Best quality, slowest to encode.
+};
+
+struct CompressedLevel
+{
+    unsigned int width;
+    unsigned int height;
+    std::vector<unsigned char> blocks;  // Rows of 4 x 4 blocks, bottom row first like glCompressedTexImage2D
+
+    CompressedLevel() : width(0), height(0) {}
+};
+
+struct CompressedImage
+{
+    BlockFormat format;
+    unsigned int width;
+    unsigned int height;
+    std::vector<CompressedLevel> levels;    // Level 0 first
+
+    CompressedImage() : format(BLOCK_BC1), width(0), height(0) {}
+};
+
+// 8 for BC1, 16 for BC3 and BC7.
+unsigned int blockBytes(BlockFormat format);
+
+// Internal format to hand to glCompressedTexImage2D.
+GLenum blockInternalFormat(BlockFormat format);
+
+const char *blockFormatName(BlockFormat format);
+
+// Compresses level 0 and every level in image.mips. The blocks of all levels
+// are shared out between thread_count threads (0 = one per hardware thread).
+bool compressImage(const Image &image, BlockFormat format, CompressedImage &out_image, unsigned int thread_count = 0);
+
+// Decodes one level to tightly packed RGBA8. BC7 blocks using a mode other
+// than 6 (the only one compressImage writes) decode as magenta.
+void decompressLevel(BlockFormat format, const CompressedLevel &level, std::vector<unsigned char> &out_rgba);
+
+// Peak signal-to-noise ratio in dB of level 0 against the source image, over
+// RGB, plus alpha when both the format and the image have it.
+double compressionPSNR(const Image &image, const CompressedImage &compressed);
+
+// <imagepath>.bc1.dds, .bc3.dds or .bc7.dds
+std::string compressedCachePath(const char *imagepath, BlockFormat format);
+
+// Writes the compressed image as a DDS file next to the source, stamped with
+// the source's size and modification time.
+bool writeCompressedCache(const char *imagepath, const CompressedImage &compressed);
+
+// True if the cache exists and matches the source's current stamp.
+bool compressedCacheCurrent(const char *imagepath, BlockFormat format);
+
+// Reads the cache written by writeCompressedCache. Fails if it is missing or
+// older than the source. Safe to call from any thread.
+bool readCompressedCache(const char *imagepath, BlockFormat format, CompressedImage &out_image);
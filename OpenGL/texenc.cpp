@@ -0,0 +1,143 @@
+// Offline block-compressed texture encoder. Select it with #define TEXENC in
+// OpenGL.h, or build it on its own; it needs no window or GL context:
+//
+//   g++ -O2 -std=c++14 -DTEXENC -Iinclude texenc.cpp texcompress.cpp image.cpp fileio.cpp -pthread -o texenc
+//
+// Builds the mip chain of every image, compresses it to each requested
+// format and writes <image>.bc1.dds / .bc3.dds / .bc7.dds next to it, which
+// loadTextureAsync then uploads instead of the BMP. Prints encode throughput
+// and PSNR as JSON on stdout.
+//
+//   texenc [--format bc1|bc3|bc7|all] [--threads N] [--repeat N] [--kaiser] [image.bmp ...]
+
+#include "OpenGL.h"
+
+#ifdef TEXENC
+
+#include "texcompress.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+const BlockFormat formats[] = { BLOCK_BC1, BLOCK_BC3, BLOCK_BC7 };
+
+bool parseFormat(const char *name, std::vector<BlockFormat> &out_formats)
+{
+    out_formats.clear();
+    for (int f = 0; f < 3; f++)
+    {
+        if (strcmp(name, "all") == 0 || strcmp(name, blockFormatName(formats[f])) == 0)
+            out_formats.push_back(formats[f]);
+    }
+    return !out_formats.empty();
+}
+
+// Pixels in the whole chain, which is what the encoder touches.
+unsigned long long chainPixels(const Image &image)
+{
+    unsigned long long pixels = (unsigned long long)image.width * image.height;
+    for (size_t i = 0; i < image.mips.size(); i++)
+        pixels += (unsigned long long)image.mips[i].width * image.mips[i].height;
+    return pixels;
+}
+
+unsigned long long compressedBytes(const CompressedImage &compressed)
+{
+    unsigned long long bytes = 0;
+    for (size_t i = 0; i < compressed.levels.size(); i++)
+        bytes += compressed.levels[i].blocks.size();
+    return bytes;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::vector<BlockFormat> selected(formats, formats + 3);
+    std::vector<const char *> paths;
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    int repeat = 1;
+    MipFilter filter = MIP_FILTER_BOX;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--format") == 0 && i + 1 < argc && parseFormat(argv[i + 1], selected))
+            i++;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = (unsigned int)std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+            repeat = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--kaiser") == 0)
+            filter = MIP_FILTER_KAISER;
+        else if (argv[i][0] != '-')
+            paths.push_back(argv[i]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--format bc1|bc3|bc7|all] [--threads N] [--repeat N] [--kaiser] [image.bmp ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (paths.empty())
+        paths.push_back("./uvtemplate.bmp");
+
+    bool first = true;
+    int failures = 0;
+    printf("{\n  \"threads\": %u,\n  \"repeat\": %d,\n  \"results\": [\n", threads, repeat);
+
+    for (size_t p = 0; p < paths.size(); p++)
+    {
+        Image image;
+        if (!decodeBMP(paths[p], image))
+        {
+            fprintf(stderr, "could not read %s\n", paths[p]);
+            failures++;
+            continue;
+        }
+        generateMipmaps(image, filter);
+        const unsigned long long pixels = chainPixels(image);
+        const unsigned long long source_bytes = image.pixels.size();
+
+        for (size_t f = 0; f < selected.size(); f++)
+        {
+            CompressedImage compressed;
+            double seconds = 1e30;
+            for (int r = 0; r < repeat; r++)
+            {
+                const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                compressImage(image, selected[f], compressed, threads);
+                seconds = std::min(seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            }
+
+            const bool written = writeCompressedCache(paths[p], compressed);
+            if (!written)
+            {
+                fprintf(stderr, "could not write %s\n", compressedCachePath(paths[p], selected[f]).c_str());
+                failures++;
+            }
+
+            printf("%s    { \"image\": \"%s\", \"format\": \"%s\", \"width\": %u, \"height\": %u, \"levels\": %u, "
+                   "\"seconds\": %.6f, \"mpixels_per_s\": %.2f, \"psnr_db\": %.2f, \"bytes\": %llu, "
+                   "\"level0_ratio\": %.2f, \"written\": %s }",
+                   first ? "" : ",\n", paths[p], blockFormatName(selected[f]), image.width, image.height,
+                   (unsigned int)compressed.levels.size(), seconds, pixels / 1e6 / seconds,
+                   compressionPSNR(image, compressed), compressedBytes(compressed),
+                   (double)source_bytes / compressed.levels[0].blocks.size(), written ? "true" : "false");
+            first = false;
+            fflush(stdout);
+        }
+    }
+
+    printf("\n  ]\n}\n");
+    return failures ? 1 : 0;
+}
+
+#endif
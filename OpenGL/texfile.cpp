@@ -0,0 +1,340 @@
+#include "texfile.h"
+#include "dds.h"
+#include "image.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace
+{
+
+struct FormatInfo
+{
+    unsigned int vk_format;     // 0 if KTX2 files cannot name it
+    unsigned int dxgi_format;   // 0 if DDS files cannot name it
+    GLenum internal_format;
+    GLenum format;              // 0 for block-compressed formats
+    unsigned int block_bytes;   // Bytes per 4 x 4 block, 0 if uncompressed
+    unsigned int pixel_bytes;   // Bytes per pixel, 0 if compressed
+};
+
+const FormatInfo format_table[] =
+{
+    { 9,   0,                                GL_R8,            GL_RED,  0, 1 },
+    { 16,  0,                                GL_RG8,           GL_RG,   0, 2 },
+    { 23,  0,                                GL_RGB8,          GL_RGB,  0, 3 },
+    { 29,  0,                                GL_SRGB8,         GL_RGB,  0, 3 },
+    { 30,  0,                                GL_RGB8,          GL_BGR,  0, 3 },
+    { 37,  DXGI_FORMAT_R8G8B8A8_UNORM,       GL_RGBA8,         GL_RGBA, 0, 4 },
+    { 43,  DXGI_FORMAT_R8G8B8A8_UNORM_SRGB,  GL_SRGB8_ALPHA8,  GL_RGBA, 0, 4 },
+    { 44,  DXGI_FORMAT_B8G8R8A8_UNORM,       GL_RGBA8,         GL_BGRA, 0, 4 },
+    { 50,  DXGI_FORMAT_B8G8R8A8_UNORM_SRGB,  GL_SRGB8_ALPHA8,  GL_BGRA, 0, 4 },
+    { 131, 0,                                GL_COMPRESSED_RGB_S3TC_DXT1_EXT,        0, 8,  0 },
+    { 132, 0,                                GL_COMPRESSED_SRGB_S3TC_DXT1_EXT,       0, 8,  0 },
+    { 133, DXGI_FORMAT_BC1_UNORM,            GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,       0, 8,  0 },
+    { 134, DXGI_FORMAT_BC1_UNORM_SRGB,       GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, 0, 8,  0 },
+    { 135, DXGI_FORMAT_BC2_UNORM,            GL_COMPRESSED_RGBA_S3TC_DXT3_EXT,       0, 16, 0 },
+    { 136, DXGI_FORMAT_BC2_UNORM_SRGB,       GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT, 0, 16, 0 },
+    { 137, DXGI_FORMAT_BC3_UNORM,            GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,       0, 16, 0 },
+    { 138, DXGI_FORMAT_BC3_UNORM_SRGB,       GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 0, 16, 0 },
+    { 139, DXGI_FORMAT_BC4_UNORM,            GL_COMPRESSED_RED_RGTC1,                0, 8,  0 },
+    { 141, DXGI_FORMAT_BC5_UNORM,            GL_COMPRESSED_RG_RGTC2,                 0, 16, 0 },
+    { 145, DXGI_FORMAT_BC7_UNORM,            GL_COMPRESSED_RGBA_BPTC_UNORM,          0, 16, 0 },
+    { 146, DXGI_FORMAT_BC7_UNORM_SRGB,       GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM,    0, 16, 0 }
+};
+
+const FormatInfo *findVkFormat(unsigned int vk_format)
+{
+    for (size_t i = 0; i < sizeof(format_table) / sizeof(format_table[0]); i++)
+        if (format_table[i].vk_format == vk_format)
+            return &format_table[i];
+    return NULL;
+}
+
+const FormatInfo *findDxgiFormat(unsigned int dxgi_format)
+{
+    for (size_t i = 0; i < sizeof(format_table) / sizeof(format_table[0]); i++)
+        if (dxgi_format && format_table[i].dxgi_format == dxgi_format)
+            return &format_table[i];
+    return NULL;
+}
+
+size_t levelSize(const FormatInfo &info, unsigned int width, unsigned int height)
+{
+    if (info.block_bytes)
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * info.block_bytes;
+    return (size_t)width * height * info.pixel_bytes;
+}
+
+void setFormat(const FormatInfo &info, TextureFile &file)
+{
+    file.internal_format = info.internal_format;
+    file.format = info.format;
+    file.type = info.block_bytes ? 0 : GL_UNSIGNED_BYTE;
+    file.compressed = info.block_bytes != 0;
+}
+
+// ---------------------------------------------------------------- KTX2
+
+const unsigned char ktx2_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct KTX2Header
+{
+    unsigned char identifier[12];
+    unsigned int vk_format;
+    unsigned int type_size;
+    unsigned int width;
+    unsigned int height;
+    unsigned int depth;
+    unsigned int layer_count;
+    unsigned int face_count;
+    unsigned int level_count;
+    unsigned int supercompression;
+    unsigned int dfd_offset;
+    unsigned int dfd_length;
+    unsigned int kvd_offset;
+    unsigned int kvd_length;
+    unsigned long long sgd_offset;
+    unsigned long long sgd_length;
+};
+
+struct KTX2Level
+{
+    unsigned long long offset;
+    unsigned long long length;
+    unsigned long long uncompressed_length;
+};
+
+static_assert(sizeof(KTX2Header) == 80, "KTX2 header must be 80 bytes");
+
+const unsigned int KTX2_SUPERCOMPRESSION_NONE = 0;
+const unsigned int KTX2_SUPERCOMPRESSION_ZSTD = 2;
+
+bool inflateZstd(const char *path, const unsigned char *data, size_t size, size_t uncompressed_size,
+                 std::vector<unsigned char> &out)
+{
+#ifdef HAVE_ZSTD
+    out.resize(uncompressed_size);
+    const size_t result = ZSTD_decompress(out.empty() ? NULL : &out[0], out.size(), data, size);
+    if (ZSTD_isError(result) || result != uncompressed_size)
+    {
+        printf("%s: corrupt zstd level (%s)\n", path, ZSTD_isError(result) ? ZSTD_getErrorName(result) : "short");
+        return false;
+    }
+    return true;
+#else
+    (void)data;
+    (void)size;
+    (void)uncompressed_size;
+    (void)out;
+    printf("%s: zstd supercompression needs a build with HAVE_ZSTD\n", path);
+    return false;
+#endif
+}
+
+bool parseKTX2(const char *path, TextureFile &file)
+{
+    const unsigned char *data = (const unsigned char *)file.mapping.data();
+    const size_t size = file.mapping.size();
+
+    KTX2Header header;
+    if (size < sizeof(header))
+        return false;
+    memcpy(&header, data, sizeof(header));
+
+    const FormatInfo *info = findVkFormat(header.vk_format);
+    if (!info)
+    {
+        printf("%s: unsupported vkFormat %u\n", path, header.vk_format);
+        return false;
+    }
+    if (header.width == 0 || header.height == 0 || header.depth > 1 ||
+        header.layer_count > 1 || header.face_count != 1)
+    {
+        printf("%s: only single 2D images are supported\n", path);
+        return false;
+    }
+    if (header.supercompression != KTX2_SUPERCOMPRESSION_NONE && header.supercompression != KTX2_SUPERCOMPRESSION_ZSTD)
+    {
+        printf("%s: unsupported supercompression scheme %u\n", path, header.supercompression);
+        return false;
+    }
+
+    // Level count 0 asks the loader to generate the chain.
+    const unsigned int level_count = std::max(1u, header.level_count);
+    if (level_count > mipLevelCount(header.width, header.height) ||
+        sizeof(header) + level_count * sizeof(KTX2Level) > size)
+        return false;
+
+    setFormat(*info, file);
+    file.width = header.width;
+    file.height = header.height;
+    file.levels.resize(level_count);
+    if (header.supercompression == KTX2_SUPERCOMPRESSION_ZSTD)
+        file.inflated.reserve(level_count);
+
+    for (unsigned int i = 0; i < level_count; i++)
+    {
+        KTX2Level index;
+        memcpy(&index, data + sizeof(header) + i * sizeof(KTX2Level), sizeof(index));
+
+        TextureFileLevel &level = file.levels[i];
+        level.width = std::max(1u, header.width >> i);
+        level.height = std::max(1u, header.height >> i);
+        level.size = levelSize(*info, level.width, level.height);
+
+        if (index.offset > size || index.length > size - index.offset)
+            return false;
+
+        if (header.supercompression == KTX2_SUPERCOMPRESSION_ZSTD)
+        {
+            if (index.uncompressed_length != level.size)
+                return false;
+            file.inflated.push_back(std::vector<unsigned char>());
+            if (!inflateZstd(path, data + index.offset, (size_t)index.length, level.size, file.inflated.back()))
+                return false;
+            level.data = &file.inflated.back()[0];
+        }
+        else
+        {
+            if (index.length != level.size)
+                return false;
+            level.data = data + index.offset;
+        }
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------- DDS
+
+const FormatInfo *legacyDDSFormat(const DDSPixelFormat &pf)
+{
+    if (pf.flags & DDPF_FOURCC)
+    {
+        switch (pf.fourcc)
+        {
+        case DDS_FOURCC('D', 'X', 'T', '1'): return findDxgiFormat(DXGI_FORMAT_BC1_UNORM);
+        case DDS_FOURCC('D', 'X', 'T', '3'): return findDxgiFormat(DXGI_FORMAT_BC2_UNORM);
+        case DDS_FOURCC('D', 'X', 'T', '5'): return findDxgiFormat(DXGI_FORMAT_BC3_UNORM);
+        case DDS_FOURCC('A', 'T', 'I', '1'):
+        case DDS_FOURCC('B', 'C', '4', 'U'): return findDxgiFormat(DXGI_FORMAT_BC4_UNORM);
+        case DDS_FOURCC('A', 'T', 'I', '2'):
+        case DDS_FOURCC('B', 'C', '5', 'U'): return findDxgiFormat(DXGI_FORMAT_BC5_UNORM);
+        default: return NULL;
+        }
+    }
+    if ((pf.flags & DDPF_RGB) && pf.rgb_bit_count == 32)
+        return pf.masks[0] == 0x00ff0000 ? findDxgiFormat(DXGI_FORMAT_B8G8R8A8_UNORM) :
+               pf.masks[0] == 0x000000ff ? findDxgiFormat(DXGI_FORMAT_R8G8B8A8_UNORM) : NULL;
+    if ((pf.flags & DDPF_RGB) && pf.rgb_bit_count == 24 && pf.masks[0] == 0x00ff0000)
+        return findVkFormat(30);
+    if ((pf.flags & DDPF_LUMINANCE) && pf.rgb_bit_count == 8)
+        return findVkFormat(9);
+    return NULL;
+}
+
+bool parseDDS(const char *path, TextureFile &file)
+{
+    const unsigned char *data = (const unsigned char *)file.mapping.data();
+    const size_t size = file.mapping.size();
+
+    DDSHeader header;
+    size_t offset = 4 + sizeof(header);
+    if (size < offset)
+        return false;
+    memcpy(&header, data + 4, sizeof(header));
+    if (header.size != sizeof(DDSHeader) || header.width == 0 || header.height == 0)
+        return false;
+
+    const unsigned int DDSCAPS2_CUBEMAP = 0x200, DDSCAPS2_VOLUME = 0x200000;
+    if (header.caps[1] & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME))
+    {
+        printf("%s: only single 2D images are supported\n", path);
+        return false;
+    }
+
+    const FormatInfo *info;
+    if ((header.format.flags & DDPF_FOURCC) && header.format.fourcc == DDS_FOURCC('D', 'X', '1', '0'))
+    {
+        DDSHeaderDX10 dx10;
+        if (size < offset + sizeof(dx10))
+            return false;
+        memcpy(&dx10, data + offset, sizeof(dx10));
+        offset += sizeof(dx10);
+
+        const unsigned int D3D10_RESOURCE_MISC_TEXTURECUBE = 0x4;
+        if (dx10.dimension != D3D10_RESOURCE_DIMENSION_TEXTURE2D || dx10.array_size > 1 ||
+            (dx10.misc_flags & D3D10_RESOURCE_MISC_TEXTURECUBE))
+        {
+            printf("%s: only single 2D images are supported\n", path);
+            return false;
+        }
+        info = findDxgiFormat(dx10.dxgi_format);
+    }
+    else
+        info = legacyDDSFormat(header.format);
+
+    if (!info)
+    {
+        printf("%s: unsupported DDS pixel format\n", path);
+        return false;
+    }
+
+    const unsigned int level_count = (header.flags & DDSD_MIPMAPCOUNT) ? std::max(1u, header.mip_count) : 1;
+    if (level_count > mipLevelCount(header.width, header.height))
+        return false;
+
+    setFormat(*info, file);
+    file.width = header.width;
+    file.height = header.height;
+    file.levels.resize(level_count);
+
+    for (unsigned int i = 0; i < level_count; i++)
+    {
+        TextureFileLevel &level = file.levels[i];
+        level.width = std::max(1u, header.width >> i);
+        level.height = std::max(1u, header.height >> i);
+        level.size = levelSize(*info, level.width, level.height);
+        if (level.size > size - offset)
+            return false;
+        level.data = data + offset;
+        offset += level.size;
+    }
+    return true;
+}
+
+} // namespace
+
+bool openTextureFile(const char *path, TextureFile &out_file)
+{
+    out_file.levels.clear();
+    out_file.inflated.clear();
+    if (!out_file.mapping.open(path))
+    {
+        printf("%s could not be opened\n", path);
+        return false;
+    }
+
+    const unsigned char *data = (const unsigned char *)out_file.mapping.data();
+    const size_t size = out_file.mapping.size();
+
+    bool ok = false;
+    if (size >= sizeof(ktx2_identifier) && memcmp(data, ktx2_identifier, sizeof(ktx2_identifier)) == 0)
+        ok = parseKTX2(path, out_file);
+    else if (size >= 4 && memcmp(data, "DDS ", 4) == 0)
+        ok = parseDDS(path, out_file);
+
+    if (!ok)
+    {
+        printf("%s is not a valid KTX2 or DDS file\n", path);
+        out_file.levels.clear();
+        out_file.inflated.clear();
+        out_file.mapping.close();
+    }
+    return ok;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "gl_trace.h"
+#include <vector>
+
+#include "fileio.h"
+
+// KTX2 and DDS texture containers, read through a memory mapping. Level
+// pointers point straight into the mapping, so the upload reads the file's
+// pages without an intermediate copy; only supercompressed (zstd) levels are
+// inflated into memory first, which needs a build with HAVE_ZSTD.
+//
+// Both containers normally store the top row first, while GL takes the first
+// row as the bottom one, so such images are sampled upside down unless they
+// were authored for GL. The .dds caches written by texenc are.
+
+struct TextureFileLevel
+{
+    unsigned int width;
+    unsigned int height;
+    const unsigned char *data;
+    size_t size;
+};
+
+struct TextureFile
+{
+    unsigned int width;
+    unsigned int height;
+    GLenum internal_format;     // Sized or compressed internal format
+    GLenum format;              // Client format and type of uncompressed levels, 0 when compressed
+    GLenum type;
+    bool compressed;
+    std::vector<TextureFileLevel> levels;   // Level 0 first. Rows are tightly packed.
+
+    // Owned storage behind the level pointers.
+    MappedFile mapping;
+    std::vector<std::vector<unsigned char> > inflated;
+
+    TextureFile() : width(0), height(0), internal_format(0), format(0), type(0), compressed(false) {}
+};
+
+// Maps a .ktx2 or .dds file (told apart by their magic) and validates the
+// header and level sizes. Only single 2D images are accepted: no arrays,
+// cube maps or 3D textures. Safe to call from any thread.
+bool openTextureFile(const char *path, TextureFile &out_file);
@@ -0,0 +1,317 @@
+#include "texture.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+GLenum sizedFormat(GLenum internal_format)
+{
+    switch (internal_format)
+    {
+    case GL_RED:    return GL_R8;
+    case GL_RG:     return GL_RG8;
+    case GL_RGB:    return GL_RGB8;
+    case GL_RGBA:   return GL_RGBA8;
+    default:        return internal_format;
+    }
+}
+
+bool internalFormatSupported(GLenum internal_format)
+{
+    switch (internal_format)
+    {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        return GLEW_EXT_texture_compression_s3tc != 0;
+    case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+        return GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB;
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+    case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+        return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+    default:
+        // Uncompressed and RGTC formats are core in GL 3.x.
+        return true;
+    }
+}
+
+// Filtering and wrapping for the texture bound to target.
+void setSampling(GLenum target, GLsizei levels, const TextureOptions &options, GLenum wrap = GL_REPEAT)
+{
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, wrap);
+
+    if (options.anisotropy > 1.0f &&
+        (GLEW_VERSION_4_6 || GLEW_ARB_texture_filter_anisotropic || GLEW_EXT_texture_filter_anisotropic))
+    {
+        GLfloat max_anisotropy = 1.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_anisotropy);
+        glTexParameterf(target, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::min(options.anisotropy, max_anisotropy));
+    }
+}
+
+// Creates the texture and uploads level_data[i] as level i; the pointers are
+// client memory or offsets into the bound GL_PIXEL_UNPACK_BUFFER. Levels
+// without data are made with glGenerateMipmap.
+GLuint uploadLevels(const Image &image, const std::vector<const unsigned char *> &level_data, const TextureOptions &options)
+{
+    const GLsizei levels = options.mipmaps ? (GLsizei)mipLevelCount(image.width, image.height) : 1;
+    const bool cpu_mips = levels > 1 && level_data.size() >= (size_t)levels;
+
+    // Create one OpenGL texture
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+
+    // "Bind" the newly created texture : all future texture functions will modify this texture
+    glBindTexture(GL_TEXTURE_2D, textureID);
+
+    // Give the image to OpenGL
+    if (GLEW_VERSION_4_2 || GLEW_ARB_texture_storage)
+    {
+        // Immutable storage for the whole chain, so the driver allocates and
+        // validates it once.
+        glTexStorage2D(GL_TEXTURE_2D, levels, sizedFormat(image.internal_format), image.width, image.height);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, image.format, GL_UNSIGNED_BYTE, level_data[0]);
+        for (GLsizei i = 1; cpu_mips && i < levels; i++)
+        {
+            const ImageLevel &level = image.mips[i - 1];
+            glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width, level.height, image.format, GL_UNSIGNED_BYTE, level_data[i]);
+        }
+    }
+    else
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, sizedFormat(image.internal_format), image.width, image.height, 0, image.format, GL_UNSIGNED_BYTE, level_data[0]);
+        for (GLsizei i = 1; cpu_mips && i < levels; i++)
+        {
+            const ImageLevel &level = image.mips[i - 1];
+            glTexImage2D(GL_TEXTURE_2D, i, sizedFormat(image.internal_format), level.width, level.height, 0, image.format, GL_UNSIGNED_BYTE, level_data[i]);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    }
+
+    if (levels > 1 && !cpu_mips)
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+    setSampling(GL_TEXTURE_2D, levels, options);
+
+    return textureID;
+}
+
+bool hasExtension(const std::string &path, const char *extension)
+{
+    const size_t length = strlen(extension);
+    if (path.size() < length)
+        return false;
+    for (size_t i = 0; i < length; i++)
+        if (tolower((unsigned char)path[path.size() - length + i]) != extension[i])
+            return false;
+    return true;
+}
+
+} // namespace
+
+GLuint createTexture(const Image &image, const TextureOptions &options)
+{
+    std::vector<const unsigned char *> level_data(1, &image.pixels[0]);
+    for (size_t i = 0; i < image.mips.size(); i++)
+        level_data.push_back(&image.mips[i].pixels[0]);
+    return uploadLevels(image, level_data, options);
+}
+
+GLuint loadBMP(const char *imagepath, const TextureOptions &options)
+{
+    Image image;
+    if (!decodeBMP(imagepath, image))
+        return 0;
+    return createTexture(image, options);
+}
+
+bool textureFormatSupported(GLenum internal_format)
+{
+    return internalFormatSupported(internal_format);
+}
+
+bool compressedFormatSupported(BlockFormat format)
+{
+    return internalFormatSupported(blockInternalFormat(format));
+}
+
+bool isTextureContainerPath(const char *path)
+{
+    return hasExtension(path, ".ktx2") || hasExtension(path, ".dds");
+}
+
+// Maps the file itself for .ktx2 / .dds, otherwise the current block-
+// compressed cache of the image in the best format the GL can sample.
+TextureFile *openTextureContainer(const char *path)
+{
+    std::string container;
+    if (isTextureContainerPath(path))
+        container = path;
+    else
+    {
+        static const BlockFormat preference[] = { BLOCK_BC7, BLOCK_BC3, BLOCK_BC1 };
+        for (int i = 0; i < 3 && container.empty(); i++)
+        {
+            if (compressedFormatSupported(preference[i]) && compressedCacheCurrent(path, preference[i]))
+                container = compressedCachePath(path, preference[i]);
+        }
+        if (container.empty())
+            return NULL;
+    }
+
+    TextureFile *file = new TextureFile;
+    if (!openTextureFile(container.c_str(), *file))
+    {
+        delete file;
+        return NULL;
+    }
+    return file;
+}
+
+GLuint createTextureFromFile(const TextureFile &file, const TextureOptions &options)
+{
+    if (file.levels.empty() || !internalFormatSupported(file.internal_format))
+        return 0;
+
+    // Uncompressed files without a chain get one from glGenerateMipmap;
+    // compressed ones sample whatever levels they carry.
+    const GLsizei file_levels = (GLsizei)file.levels.size();
+    const bool generate = options.mipmaps && !file.compressed && file_levels == 1;
+    const GLsizei levels = !options.mipmaps ? 1 :
+                           generate ? (GLsizei)mipLevelCount(file.width, file.height) : file_levels;
+    const GLsizei uploaded = std::min(levels, file_levels);
+
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+
+    // Container rows are tightly packed.
+    GLint alignment = 4;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // The level pointers are into the file mapping, so the driver reads the
+    // data straight from the page cache.
+    const bool storage = GLEW_VERSION_4_2 || GLEW_ARB_texture_storage;
+    if (storage)
+        glTexStorage2D(GL_TEXTURE_2D, levels, file.internal_format, file.width, file.height);
+    for (GLsizei i = 0; i < uploaded; i++)
+    {
+        const TextureFileLevel &level = file.levels[i];
+        if (file.compressed && storage)
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width, level.height, file.internal_format, (GLsizei)level.size, level.data);
+        else if (file.compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, file.internal_format, level.width, level.height, 0, (GLsizei)level.size, level.data);
+        else if (storage)
+            glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width, level.height, file.format, file.type, level.data);
+        else
+            glTexImage2D(GL_TEXTURE_2D, i, file.internal_format, level.width, level.height, 0, file.format, file.type, level.data);
+    }
+    if (!storage)
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+    if (generate)
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+    setSampling(GL_TEXTURE_2D, levels, options);
+
+    return textureID;
+}
+
+GLuint createAtlasTexture(const TextureAtlas &atlas, const TextureOptions &options)
+{
+    if (atlas.pages.empty())
+        return 0;
+
+    const GLsizei size = (GLsizei)atlas.page_size;
+    const GLsizei layers = (GLsizei)atlas.pages.size();
+    const GLsizei levels = options.mipmaps ? (GLsizei)atlas.levels : 1;
+
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+
+    const bool storage = GLEW_VERSION_4_2 || GLEW_ARB_texture_storage;
+    if (storage)
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, size, size, layers);
+    for (GLsizei i = 0; i < levels; i++)
+    {
+        const GLsizei level_size = std::max(1, size >> i);
+        if (!storage)
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, i, GL_RGBA8, level_size, level_size, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        for (GLsizei layer = 0; layer < layers; layer++)
+        {
+            const Image &page = atlas.pages[layer];
+            const unsigned char *pixels = i == 0 ? &page.pixels[0] : &page.mips[i - 1].pixels[0];
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, level_size, level_size, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        }
+    }
+    if (!storage)
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    // Images never wrap inside an atlas; the padding takes the filter taps.
+    setSampling(GL_TEXTURE_2D_ARRAY, levels, options, GL_CLAMP_TO_EDGE);
+
+    return textureID;
+}
+
+bool stageImage(Image &image, UploadSpan &out_span)
+{
+    if (image.pixels.empty())
+        return false;
+
+    size_t bytes = image.pixels.size();
+    for (size_t i = 0; i < image.mips.size(); i++)
+        bytes += image.mips[i].pixels.size();
+    if (!reserveUpload(bytes, out_span))
+        return false;
+
+    // Level after level, in the order createStagedTexture reads them. Every
+    // level is a whole number of padded rows, so each starts 4-byte aligned.
+    size_t offset = 0;
+    memcpy(out_span.data, &image.pixels[0], image.pixels.size());
+    offset += image.pixels.size();
+    std::vector<unsigned char>().swap(image.pixels);
+    for (size_t i = 0; i < image.mips.size(); i++)
+    {
+        std::vector<unsigned char> &pixels = image.mips[i].pixels;
+        memcpy(out_span.data + offset, &pixels[0], pixels.size());
+        offset += pixels.size();
+        std::vector<unsigned char>().swap(pixels);
+    }
+    return true;
+}
+
+GLuint createStagedTexture(const Image &image, const UploadSpan &span, const TextureOptions &options)
+{
+    std::vector<const unsigned char *> level_data;
+    size_t offset = span.offset;
+    level_data.push_back((const unsigned char *)offset);
+    offset += imageRowBytes(image.width, imageChannels(image.format)) * image.height;
+    for (size_t i = 0; i < image.mips.size(); i++)
+    {
+        const ImageLevel &level = image.mips[i];
+        level_data.push_back((const unsigned char *)offset);
+        offset += imageRowBytes(level.width, imageChannels(image.format)) * level.height;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadRingBuffer());
+    const GLuint texture = uploadLevels(image, level_data, options);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    retireUpload(span);
+    return texture;
+}
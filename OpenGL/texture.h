@@ -0,0 +1,63 @@
+#pragma once
+
+#include "gl_trace.h"
+
+#include "atlas.h"
+#include "image.h"
+#include "texcompress.h"
+#include "texfile.h"
+#include "upload.h"
+
+struct TextureOptions
+{
+    bool mipmaps;           // Full chain with trilinear filtering, else level 0 only
+    float anisotropy;       // Max anisotropic samples, 1 = off. Clamped to what the GL supports.
+
+    TextureOptions()
+        : mipmaps(true),
+          anisotropy(1.0f)
+    {
+    }
+};
+
+// Creates a GL texture from a decoded image. Needs the GL context.
+// Uses immutable storage when available; levels missing from image.mips
+// are made with glGenerateMipmap.
+GLuint createTexture(const Image &image, const TextureOptions &options = TextureOptions());
+
+// Copies the image's levels into a reserved span of the upload ring and
+// frees its client pixels, keeping the level sizes. Any thread; fails (with
+// the image untouched) if the ring is off, closed or too small.
+bool stageImage(Image &image, UploadSpan &out_span);
+
+// createTexture for an image staged with stageImage: the levels are read
+// from the ring through GL_PIXEL_UNPACK_BUFFER offsets, then the span is
+// retired. Needs the GL context.
+GLuint createStagedTexture(const Image &image, const UploadSpan &span, const TextureOptions &options = TextureOptions());
+
+// decodeBMP + createTexture.
+GLuint loadBMP(const char *imagepath, const TextureOptions &options = TextureOptions());
+
+// True if the GL can sample textures of the internal format.
+bool textureFormatSupported(GLenum internal_format);
+
+// True if the GL can sample the block format: EXT_texture_compression_s3tc
+// for BC1 / BC3, GL 4.2 or ARB_texture_compression_bptc for BC7.
+bool compressedFormatSupported(BlockFormat format);
+
+// True for .ktx2 and .dds paths.
+bool isTextureContainerPath(const char *path);
+
+// Maps path itself if it is a .ktx2 / .dds file, otherwise the current
+// block-compressed cache written by texenc (<path>.bc7.dds, then .bc3.dds,
+// then .bc1.dds) in the best format the GL can sample. NULL if there is
+// none. Any thread.
+TextureFile *openTextureContainer(const char *path);
+
+// Creates a GL texture from a mapped KTX2 / DDS file, or returns 0 if the GL
+// cannot sample its format. Needs the GL context.
+GLuint createTextureFromFile(const TextureFile &file, const TextureOptions &options = TextureOptions());
+
+// Creates a GL_TEXTURE_2D_ARRAY with one layer per atlas page and the
+// atlas's bleed-free mip levels. Needs the GL context.
+GLuint createAtlasTexture(const TextureAtlas &atlas, const TextureOptions &options = TextureOptions());
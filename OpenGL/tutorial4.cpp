@@ -2,16 +2,20 @@
 
 #include "OpenGL.h"
 
-#ifdef TUT4
-
 #include <vmath.h>
 
+#include "camera.h"
+#include "gl_state.h"
+#include "scene.h"
+
+namespace
+{
+
 GLuint program;
 GLuint vao;
 GLuint position_buffer;
 GLuint color_buffer;
 GLint mv_location;
-GLint proj_location;
 
 int getWindowWidth()
 {
@@ -27,7 +31,8 @@ void onAwake()
 {
     static const char * vs_source[] =
     {
-        "#version 420 core                                                  \n"
+        "#version 420 core                                                  \n",
+        CAMERA_GLSL,
         "                                                                   \n"
         "layout(location = 0) in vec3 position;                             \n"
         "layout(location = 1) in vec3 color;                                \n"
@@ -35,7 +40,6 @@ void onAwake()
         "out vec3 fragmentColor;                                            \n"
         "                                                                   \n"
         "uniform mat4 mv_matrix;                                            \n"
-        "uniform mat4 proj_matrix;                                          \n"
         "                                                                   \n"
         "void main(void)                                                    \n"
         "{                                                                  \n"
@@ -65,7 +69,7 @@ void onAwake()
     CheckShaderCompileError(fs);
 
     GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs, 1, vs_source, NULL);
+    glShaderSource(vs, 3, vs_source, NULL);
     glCompileShader(vs);
     CheckShaderCompileError(vs);
 
@@ -75,7 +79,6 @@ void onAwake()
     glLinkProgram(program);
 
     mv_location = glGetUniformLocation(program, "mv_matrix");
-    proj_location = glGetUniformLocation(program, "proj_matrix");
 
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
@@ -163,7 +166,6 @@ void onAwake()
     glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertex_buffer_data), g_vertex_buffer_data, GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, position_buffer);
     glVertexAttribPointer(
         0,                                // attribute. No particular reason for 1, but must match the layout in the shader.
         3,                                // size
@@ -178,7 +180,6 @@ void onAwake()
     glBufferData(GL_ARRAY_BUFFER, sizeof(g_color_buffer_data), g_color_buffer_data, GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, color_buffer);
     glVertexAttribPointer(
         1,                                // attribute. No particular reason for 1, but must match the layout in the shader.
         3,                                // size
@@ -194,16 +195,10 @@ void onAwake()
 
 void onUpdate(double current_time)
 {
-    glViewport(0, 0, getWindowWidth(), getWindowHeight());
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glUseProgram(program);
-
-    vmath::mat4 proj_matrix = vmath::perspective(50.0f,
-        (float)getWindowWidth() / (float)getWindowHeight(),
-        0.1f,
-        1000.0f);
-    glUniformMatrix4fv(proj_location, 1, GL_FALSE, proj_matrix);
+    cachedUseProgram(program);
+    cachedBindVertexArray(vao);
 
     float f = (float)current_time * 0.3f;
     vmath::mat4 mv_matrix = vmath::translate(0.0f, 0.0f, -4.0f) *
@@ -212,7 +207,7 @@ void onUpdate(double current_time)
             sinf(1.3f * f) * cosf(1.5f * f) * 2.0f) *
         vmath::rotate((float)current_time * 45.0f, 0.0f, 1.0f, 0.0f) *
         vmath::rotate((float)current_time * 81.0f, 1.0f, 0.0f, 0.0f);
-    glUniformMatrix4fv(mv_location, 1, GL_FALSE, mv_matrix);
+    cachedUniformMatrix4(mv_location, mv_matrix);
 
     glDrawArrays(GL_TRIANGLES, 0, 12 * 3);
 }
@@ -225,4 +220,12 @@ void onShutdown()
     glDeleteProgram(program);
     glDeleteBuffers(1, &position_buffer);
 }
-#endif
+
+const Scene tut4_scene =
+{
+    "TUT4", "Colored cube (opengl-tutorial.org tutorial 4)",
+    getWindowWidth(), getWindowHeight(), onAwake, onUpdate, onShutdown, NULL, NULL, NULL
+};
+const bool tut4_registered = registerScene(tut4_scene);
+
+} // namespace
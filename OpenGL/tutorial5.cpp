@@ -2,19 +2,23 @@
 
 #include "OpenGL.h"
 
-#ifdef TUT5
-
 #include <vmath.h>
 
+#include "assets.h"
+#include "camera.h"
+#include "gl_state.h"
+#include "scene.h"
+
+namespace
+{
+
 GLuint program;
 GLuint vao;
 GLuint position_buffer;
 GLuint uv_buffer;
 GLuint mv_location;
-GLuint proj_location;
 GLuint tex_location;
-
-GLuint loadBMP(const char *imagepath);
+TextureAsset *texture;
 
 int getWindowWidth()
 {
@@ -30,7 +34,8 @@ void onAwake()
 {
     static const char *vs_source[] =
     {
-        "#version 420 core                                                  \n"
+        "#version 420 core                                                  \n",
+        CAMERA_GLSL,
         "                                                                   \n"
         "layout(location = 0) in vec3 position;                             \n"
         "layout(location = 1) in vec2 uv;                                   \n"
@@ -38,7 +43,6 @@ void onAwake()
         "out vec2 fragmentUV;                                               \n"
         "                                                                   \n"
         "uniform mat4 mv_matrix;                                            \n"
-        "uniform mat4 proj_matrix;                                          \n"
         "                                                                   \n"
         "void main(void)                                                    \n"
         "{                                                                  \n"
@@ -70,7 +74,7 @@ void onAwake()
     CheckShaderCompileError(fs);
 
     GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs, 1, vs_source, NULL);
+    glShaderSource(vs, 3, vs_source, NULL);
     glCompileShader(vs);
     CheckShaderCompileError(vs);
 
@@ -81,7 +85,6 @@ void onAwake()
     glUseProgram(program);
 
     mv_location = glGetUniformLocation(program, "mv_matrix");
-    proj_location = glGetUniformLocation(program, "proj_matrix");
     tex_location = glGetUniformLocation(program, "texSampler");
 
     glGenVertexArrays(1, &vao);
@@ -170,7 +173,6 @@ void onAwake()
     glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertex_buffer_data), g_vertex_buffer_data, GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, position_buffer);
     glVertexAttribPointer(
         0,                                // attribute. No particular reason for 1, but must match the layout in the shader.
         3,                                // size
@@ -185,7 +187,6 @@ void onAwake()
     glBufferData(GL_ARRAY_BUFFER, sizeof(g_uv_buffer_data), g_uv_buffer_data, GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(1);
-    glBindBuffer(GL_ARRAY_BUFFER, uv_buffer);
     glVertexAttribPointer(
         1,                                // attribute. No particular reason for 1, but must match the layout in the shader.
         2,                                // size : U+V => 2
@@ -195,9 +196,8 @@ void onAwake()
         (void*)0                          // array buffer offset
     );
 
-    GLuint image = loadBMP("./uvtemplate.bmp");
+    texture = loadTextureAsync("./uvtemplate.bmp");
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, image);
     glUniform1i(tex_location, 0);
 
     glEnable(GL_DEPTH_TEST);
@@ -206,14 +206,10 @@ void onAwake()
 
 void onUpdate(double current_time)
 {
-    glViewport(0, 0, getWindowWidth(), getWindowHeight());
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    vmath::mat4 proj_matrix = vmath::perspective(50.0f,
-        (float)getWindowWidth() / (float)getWindowHeight(),
-        0.1f,
-        1000.0f);
-    glUniformMatrix4fv(proj_location, 1, GL_FALSE, proj_matrix);
+    cachedUseProgram(program);
+    cachedBindVertexArray(vao);
 
     float f = (float)current_time * 0.3f;
     vmath::mat4 mv_matrix = vmath::translate(0.0f, 0.0f, -4.0f) *
@@ -222,8 +218,10 @@ void onUpdate(double current_time)
             sinf(1.3f * f) * cosf(1.5f * f) * 2.0f) *
         vmath::rotate((float)current_time * 45.0f, 0.0f, 1.0f, 0.0f) *
         vmath::rotate((float)current_time * 81.0f, 1.0f, 0.0f, 0.0f);
-    glUniformMatrix4fv(mv_location, 1, GL_FALSE, mv_matrix);
+    cachedUniformMatrix4(mv_location, mv_matrix);
 
+    // Placeholder checkers until the image has been decoded and uploaded.
+    cachedBindTexture(0, GL_TEXTURE_2D, texture->texture);
     glDrawArrays(GL_TRIANGLES, 0, 12 * 3);
 }
 
@@ -234,71 +232,14 @@ void onShutdown()
     glDeleteVertexArrays(1, &vao);
     glDeleteProgram(program);
     glDeleteBuffers(1, &position_buffer);
+    releaseTexture(texture);
 }
 
-GLuint loadBMP(const char *imagepath)
+const Scene tut5_scene =
 {
-    // Data read from the header of the BMP file
-    unsigned char header[54]; // Each BMP file begins by a 54-bytes header
-    unsigned int dataPos;     // Position in the file where the actual data begins
-    unsigned int width, height;
-    unsigned int imageSize;   // = width * height * 3
-                              // Actual RGB data
-    unsigned char *data;
-
-    FILE *file = new FILE;
-    if (fopen_s(&file, imagepath, "rb"))
-    {
-        printf("Image could not be opened\n");
-        return 0;
-    }
-
-    if (fread(header, 1, 54, file) != 54)
-    {
-        // If not 54 bytes read : problem
-        printf("Not a correct BMP file\n");
-        return false;
-    }
+    "TUT5", "Textured cube (opengl-tutorial.org tutorial 5)",
+    getWindowWidth(), getWindowHeight(), onAwake, onUpdate, onShutdown, NULL, NULL, NULL
+};
+const bool tut5_registered = registerScene(tut5_scene);
 
-    if (header[0] != 'B' || header[1] != 'M')
-    {
-        printf("Not a correct BMP file\n");
-        return 0;
-    }
-
-    // Read ints from the byte array
-    dataPos = *(int*)&(header[0x0A]);
-    imageSize = *(int*)&(header[0x22]);
-    width = *(int*)&(header[0x12]);
-    height = *(int*)&(header[0x16]);
-
-    // Some BMP files are misformatted, guess missing information
-    if (imageSize == 0)    imageSize = width * height * 3; // 3 : one byte for each Red, Green and Blue component
-    if (dataPos == 0)      dataPos = 54; // The BMP header is done that way
-
-    data = new unsigned char[imageSize]; // Create a buffer
-
-    // Read the actual data from the file into the buffer
-    fread(data, 1, imageSize, file);
-
-    //Everything is in memory now, the file can be closed
-    fclose(file);
-
-    // Create one OpenGL texture
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-
-    // "Bind" the newly created texture : all future texture functions will modify this texture
-    glBindTexture(GL_TEXTURE_2D, textureID);
-
-    // Give the image to OpenGL
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-    return textureID;
-}
-#endif
+} // namespace
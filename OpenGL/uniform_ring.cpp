@@ -0,0 +1,114 @@
+#include "uniform_ring.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace
+{
+
+// The larger of the offset alignments the GL asks of uniform and shader
+// storage buffer ranges, so a region can be bound as either.
+size_t regionAlignment()
+{
+    GLint uniform_alignment = 1;
+    GLint storage_alignment = 1;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_alignment);
+    if (GLEW_VERSION_4_3 || GLEW_ARB_shader_storage_buffer_object)
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storage_alignment);
+    return (size_t)std::max(std::max(uniform_alignment, storage_alignment), 1);
+}
+
+bool signalled(GLsync fence)
+{
+    const GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+} // namespace
+
+UniformRing::UniformRing()
+    : buffer_(0), data_(NULL), frame_bytes_(0), frame_(0)
+{
+    for (unsigned int i = 0; i < FRAMES; i++)
+        fences_[i] = NULL;
+}
+
+bool UniformRing::create(size_t frame_bytes)
+{
+    destroy();
+    if (!(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) || frame_bytes == 0)
+        return false;
+
+    const size_t alignment = regionAlignment();
+    frame_bytes_ = (frame_bytes + alignment - 1) / alignment * alignment;
+    const size_t size = frame_bytes_ * FRAMES;
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &buffer_);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+    glBufferStorage(GL_UNIFORM_BUFFER, size, NULL, flags);
+    data_ = (unsigned char *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    if (!data_)
+    {
+        printf("Uniform ring of %u bytes could not be mapped\n", (unsigned int)size);
+        glDeleteBuffers(1, &buffer_);
+        buffer_ = 0;
+        frame_bytes_ = 0;
+        return false;
+    }
+
+    frame_ = 0;
+    stats_ = UniformRingStats();
+    return true;
+}
+
+void UniformRing::destroy()
+{
+    if (!buffer_)
+        return;
+
+    for (unsigned int i = 0; i < FRAMES; i++)
+    {
+        if (!fences_[i])
+            continue;
+        glClientWaitSync(fences_[i], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fences_[i]);
+        fences_[i] = NULL;
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glDeleteBuffers(1, &buffer_);
+    buffer_ = 0;
+    data_ = NULL;
+    frame_bytes_ = 0;
+}
+
+void *UniformRing::beginFrame()
+{
+    GLsync &fence = fences_[frame_];
+    if (fence)
+    {
+        if (!signalled(fence))
+        {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            stats_.waits++;
+            stats_.wait_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        glDeleteSync(fence);
+        fence = NULL;
+    }
+    return data_ + frameOffset();
+}
+
+void UniformRing::endFrame()
+{
+    fences_[frame_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame_ = (frame_ + 1) % FRAMES;
+    stats_.frames++;
+}
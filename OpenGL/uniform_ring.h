@@ -0,0 +1,74 @@
+#pragma once
+
+#include "gl_trace.h"
+#include <cstddef>
+
+// Per-object shader data rewritten every frame, kept in one persistently
+// mapped buffer split into FRAMES regions. Each frame the CPU fills the next
+// region in place and binds ranges of it, so setting the data of a thousand
+// objects takes no GL call at all; the frame's fence marks when the GPU is
+// done reading, and the region is only written again FRAMES frames later,
+// after waiting for that fence if the GPU is still behind.
+//
+//     void *objects = ring.beginFrame();
+//     ...                                 // write, then bind ranges at ring.frameOffset() + n
+//     ring.endFrame();                    // after the frame's draws
+//
+// Needs GL 4.4 or ARB_buffer_storage. Use from the thread that has the
+// context only.
+
+struct UniformRingStats
+{
+    unsigned long long frames;
+    unsigned long long waits;           // Frames whose region the GPU was still reading
+    double wait_seconds;
+
+    UniformRingStats() : frames(0), waits(0), wait_seconds(0.0) {}
+};
+
+class UniformRing
+{
+public:
+    static const unsigned int FRAMES = 3;
+
+    UniformRing();
+
+    // Creates and maps the buffer, with FRAMES regions of at least
+    // frame_bytes each. Returns false (and stays off) if the GL lacks
+    // persistent mapping.
+    bool create(size_t frame_bytes);
+
+    // Waits for the GPU to finish with every region and deletes the buffer.
+    // Needs the context, so it is not left to a destructor.
+    void destroy();
+
+    bool active() const { return buffer_ != 0; }
+    GLuint buffer() const { return buffer_; }
+
+    // Region offsets are aligned for glBindBufferRange of uniform and
+    // shader storage buffers.
+    size_t frameBytes() const { return frame_bytes_; }
+
+    // The mapped start of the frame's region, once the GPU has read what it
+    // held FRAMES frames ago.
+    void *beginFrame();
+
+    // Byte offset of the frame's region in buffer().
+    size_t frameOffset() const { return frame_ * frame_bytes_; }
+
+    // Fences the region after the draws reading it have been issued.
+    void endFrame();
+
+    UniformRingStats stats() const { return stats_; }
+
+private:
+    UniformRing(const UniformRing &);
+    UniformRing &operator=(const UniformRing &);
+
+    GLuint buffer_;
+    unsigned char *data_;
+    size_t frame_bytes_;
+    unsigned int frame_;
+    GLsync fences_[FRAMES];
+    UniformRingStats stats_;
+};
@@ -0,0 +1,239 @@
+#include "upload.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+
+namespace
+{
+
+// Span starts are aligned so every row and block format lands on a boundary
+// the driver can DMA from directly.
+const size_t SPAN_ALIGNMENT = 256;
+
+struct Block
+{
+    size_t offset;
+    size_t size;
+    GLsync fence;
+    bool retired;
+};
+
+GLuint ring_buffer = 0;
+unsigned char *ring_data = NULL;
+size_t ring_size = 0;
+
+// Blocks in allocation order; the front one is the oldest still in use.
+// blocks[i] has id front_id + i.
+std::deque<Block> blocks;
+unsigned long long front_id = 0;
+bool closed = true;
+UploadStats stats;
+std::mutex ring_mutex;
+std::condition_variable space_freed;
+
+// Offset where a span of the given size fits, or false. Caller holds the lock.
+bool findSpace(size_t size, size_t &out_offset)
+{
+    if (blocks.empty())
+    {
+        out_offset = 0;
+        return size <= ring_size;
+    }
+
+    const size_t tail = blocks.front().offset;
+    const size_t head = blocks.back().offset + blocks.back().size;
+    if (blocks.back().offset >= tail)
+    {
+        // Not wrapped: room after the head, else at the start before the tail.
+        if (size <= ring_size - head)
+        {
+            out_offset = head;
+            return true;
+        }
+        out_offset = 0;
+        return size <= tail;
+    }
+
+    // Wrapped: room between the head and the tail.
+    out_offset = head;
+    return size <= tail - head;
+}
+
+// Drops retired blocks off the front. Caller holds the lock.
+bool popSignalled()
+{
+    bool freed = false;
+    while (!blocks.empty() && blocks.front().retired)
+    {
+        Block &block = blocks.front();
+        if (block.fence)
+        {
+            const GLenum status = glClientWaitSync(block.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                break;
+            glDeleteSync(block.fence);
+        }
+        blocks.pop_front();
+        front_id++;
+        freed = true;
+    }
+    return freed;
+}
+
+size_t alignUp(size_t value)
+{
+    return (value + SPAN_ALIGNMENT - 1) / SPAN_ALIGNMENT * SPAN_ALIGNMENT;
+}
+
+} // namespace
+
+bool initUploadRing(size_t ring_bytes)
+{
+    if (!(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) || ring_bytes == 0)
+        return false;
+
+    ring_size = alignUp(ring_bytes);
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &ring_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring_buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ring_size, NULL, flags);
+    ring_data = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ring_size, flags);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (!ring_data)
+    {
+        printf("Upload ring of %u bytes could not be mapped\n", (unsigned int)ring_size);
+        glDeleteBuffers(1, &ring_buffer);
+        ring_buffer = 0;
+        ring_size = 0;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(ring_mutex);
+    blocks.clear();
+    front_id = 0;
+    stats = UploadStats();
+    closed = false;
+    return true;
+}
+
+void closeUploadRing()
+{
+    {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        closed = true;
+    }
+    space_freed.notify_all();
+}
+
+void shutdownUploadRing()
+{
+    closeUploadRing();
+    if (!ring_buffer)
+        return;
+
+    // Spans never retired are not read by anything; the rest are waited for.
+    std::lock_guard<std::mutex> lock(ring_mutex);
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        if (!blocks[i].fence)
+            continue;
+        glClientWaitSync(blocks[i].fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(blocks[i].fence);
+    }
+    blocks.clear();
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring_buffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &ring_buffer);
+    ring_buffer = 0;
+    ring_data = NULL;
+    ring_size = 0;
+}
+
+bool uploadRingActive()
+{
+    return ring_buffer != 0;
+}
+
+GLuint uploadRingBuffer()
+{
+    return ring_buffer;
+}
+
+bool reserveUpload(size_t bytes, UploadSpan &out_span)
+{
+    const size_t size = alignUp(bytes);
+
+    std::unique_lock<std::mutex> lock(ring_mutex);
+    if (closed || size > ring_size)
+    {
+        stats.fallbacks++;
+        return false;
+    }
+
+    size_t offset;
+    if (!findSpace(size, offset))
+    {
+        // Only the main thread can check fences, so wait for recycleUploads.
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        space_freed.wait(lock, [&]() { return closed || findSpace(size, offset); });
+        stats.stalls++;
+        stats.stall_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (closed)
+        {
+            stats.fallbacks++;
+            return false;
+        }
+    }
+
+    Block block = { offset, size, NULL, false };
+    blocks.push_back(block);
+
+    out_span.offset = offset;
+    out_span.size = bytes;
+    out_span.data = ring_data + offset;
+    out_span.id = front_id + blocks.size() - 1;
+    return true;
+}
+
+void retireUpload(const UploadSpan &span)
+{
+    std::lock_guard<std::mutex> lock(ring_mutex);
+    if (span.id < front_id || span.id - front_id >= blocks.size())
+        return;
+
+    Block &block = blocks[(size_t)(span.id - front_id)];
+    block.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    block.retired = true;
+    stats.uploads++;
+    stats.bytes += span.size;
+}
+
+void recycleUploads()
+{
+    bool freed;
+    {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        freed = popSignalled();
+    }
+    if (freed)
+        space_freed.notify_all();
+}
+
+void countDeferredUploadFrame()
+{
+    std::lock_guard<std::mutex> lock(ring_mutex);
+    stats.deferred_frames++;
+}
+
+UploadStats uploadStats()
+{
+    std::lock_guard<std::mutex> lock(ring_mutex);
+    return stats;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "gl_trace.h"
+#include <cstddef>
+
+// Streaming texture uploads through one persistently mapped
+// GL_PIXEL_UNPACK_BUFFER used as a ring. Worker threads reserve a span and
+// copy decoded pixels straight into the mapping; the main thread then points
+// glTexSubImage2D at the span's offset, so the driver copies from GPU-visible
+// memory without blocking on client memory, and fences the span. Space comes
+// back once its fence has signalled. Needs GL 4.4 or ARB_buffer_storage;
+// without them the ring stays off and callers upload from client memory.
+
+struct UploadSpan
+{
+    size_t offset;              // Byte offset in the ring buffer, for the *SubImage calls
+    size_t size;
+    unsigned char *data;        // Mapped pointer, writable from any thread
+    unsigned long long id;
+
+    UploadSpan() : offset(0), size(0), data(NULL), id(0) {}
+};
+
+struct UploadStats
+{
+    unsigned long long uploads;         // Spans retired by the main thread
+    unsigned long long bytes;
+    unsigned long long stalls;          // Reservations that waited for the GPU to free space
+    double stall_seconds;               // Summed over all worker threads
+    unsigned long long fallbacks;       // Reservations refused: larger than the ring, or the ring closed
+    unsigned long long deferred_frames; // Frames that hit the byte budget with uploads left over
+
+    UploadStats() : uploads(0), bytes(0), stalls(0), stall_seconds(0.0), fallbacks(0), deferred_frames(0) {}
+};
+
+// Creates and maps the ring. Main thread, needs the GL context. Returns false
+// (and leaves the ring off) if the GL lacks persistent mapping.
+bool initUploadRing(size_t ring_bytes);
+
+// Makes every pending and future reservation fail, so workers blocked in
+// reserveUpload return. Call before joining them.
+void closeUploadRing();
+
+// Waits for the GPU to finish with the ring and deletes it. Main thread.
+void shutdownUploadRing();
+
+bool uploadRingActive();
+
+// The buffer to bind to GL_PIXEL_UNPACK_BUFFER while issuing uploads.
+GLuint uploadRingBuffer();
+
+// Any thread. Blocks while the ring has no room, counting a stall. Fails
+// when the ring is off or closed or bytes exceeds its size.
+bool reserveUpload(size_t bytes, UploadSpan &out_span);
+
+// Main thread, after the GL commands reading the span have been issued
+// (or when it will not be used after all). Fences the span.
+void retireUpload(const UploadSpan &span);
+
+// Main thread, once per frame. Frees the spans whose fences have signalled.
+void recycleUploads();
+
+// Called by the frame's upload pump when its byte budget left work over.
+void countDeferredUploadFrame();
+
+UploadStats uploadStats();